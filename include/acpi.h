@@ -7,6 +7,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 /*
@@ -38,7 +39,37 @@ struct acpi_rsdt {
  */
 
 enum acpi_madt_type {
-	ACPI_MADT_TYPE_IOAPIC = 1,
+	ACPI_MADT_TYPE_LAPIC        = 0,
+	ACPI_MADT_TYPE_IOAPIC       = 1,
+	ACPI_MADT_TYPE_INT_OVERRIDE = 2,
+	ACPI_MADT_TYPE_NMI_SOURCE   = 3,
+	ACPI_MADT_TYPE_LAPIC_NMI    = 4,
+	ACPI_MADT_TYPE_LAPIC_ADDR   = 5,
+	ACPI_MADT_TYPE_X2APIC       = 9,
+	ACPI_MADT_TYPE_X2APIC_NMI   = 10,
+};
+
+enum acpi_madt_lapic_flags {
+	ACPI_MADT_LAPIC_ENABLED        = 0x01,
+	ACPI_MADT_LAPIC_ONLINE_CAPABLE = 0x02,
+};
+
+/*
+ * MPS INTI flags, used by interrupt source overrides and NMI sources.
+ */
+#define ACPI_MADT_POLARITY(flags)       ((flags) & 0x3)
+#define ACPI_MADT_TRIGGER(flags)        (((flags) >> 2) & 0x3)
+
+enum acpi_madt_polarity {
+	ACPI_MADT_POLARITY_CONFORMS    = 0,
+	ACPI_MADT_POLARITY_ACTIVE_HIGH = 1,
+	ACPI_MADT_POLARITY_ACTIVE_LOW  = 3,
+};
+
+enum acpi_madt_trigger {
+	ACPI_MADT_TRIGGER_CONFORMS = 0,
+	ACPI_MADT_TRIGGER_EDGE     = 1,
+	ACPI_MADT_TRIGGER_LEVEL    = 3,
 };
 
 struct acpi_madt {
@@ -52,6 +83,27 @@ struct acpi_madt_header {
 	uint8_t length;
 } __attribute__((packed));
 
+struct acpi_madt_lapic {
+	struct acpi_madt_header header;
+	uint8_t  uid;
+	uint8_t  apic_id;
+	uint32_t flags;
+} __attribute__((packed));
+
+struct acpi_madt_lapic_addr {
+	struct acpi_madt_header header;
+	uint16_t reserved;
+	uint64_t address;
+} __attribute__((packed));
+
+struct acpi_madt_x2apic {
+	struct acpi_madt_header header;
+	uint16_t reserved;
+	uint32_t apic_id;
+	uint32_t flags;
+	uint32_t uid;
+} __attribute__((packed));
+
 struct acpi_madt_ioapic {
 	struct acpi_madt_header header;
 	uint8_t apic_id;
@@ -60,6 +112,35 @@ struct acpi_madt_ioapic {
 	uint32_t gsib;
 } __attribute__((packed));
 
+struct acpi_madt_int_override {
+	struct acpi_madt_header header;
+	uint8_t  bus;
+	uint8_t  source;
+	uint32_t gsi;
+	uint16_t flags;
+} __attribute__((packed));
+
+struct acpi_madt_nmi_source {
+	struct acpi_madt_header header;
+	uint16_t flags;
+	uint32_t gsi;
+} __attribute__((packed));
+
+struct acpi_madt_lapic_nmi {
+	struct acpi_madt_header header;
+	uint8_t  uid;
+	uint16_t flags;
+	uint8_t  lint;
+} __attribute__((packed));
+
+struct acpi_madt_x2apic_nmi {
+	struct acpi_madt_header header;
+	uint16_t flags;
+	uint32_t uid;
+	uint8_t  lint;
+	uint8_t  reserved[3];
+} __attribute__((packed));
+
 /*
  * DMA Remapping table (DMAR).
  */
@@ -81,6 +162,10 @@ struct acpi_dmar_header {
 	uint16_t length;
 } __attribute__((packed));
 
+/*
+ * DMAR DRHD entry. This structure is followed by a variable number of device
+ * scopes.
+ */
 struct acpi_dmar_drhd {
 	struct acpi_dmar_header header;
 	uint8_t flags;
@@ -89,7 +174,11 @@ struct acpi_dmar_drhd {
 	uint32_t reg_base[2];
 } __attribute__((packed));
 
-enum acpi_dmar_rmrr_devscope_type {
+enum acpi_dmar_drhd_flags {
+	ACPI_DMAR_DRHD_FLAG_INCLUDE_PCI_ALL = 0x01,
+};
+
+enum acpi_dmar_devscope_type {
 	ACPI_DMAR_SCOPE_TYPE_NOT_USED  = 0,
 	ACPI_DMAR_SCOPE_TYPE_ENDPOINT  = 1,
 	ACPI_DMAR_SCOPE_TYPE_BRIDGE    = 2,
@@ -99,7 +188,12 @@ enum acpi_dmar_rmrr_devscope_type {
 	ACPI_DMAR_SCOPE_TYPE_RESERVED  = 6,
 };
 
-struct acpi_dmar_rmrr_devscope {
+/*
+ * DMAR device scope. The path has a variable number of hops, the first one
+ * being located on the start bus and each following one on the secondary bus
+ * of the bridge designated by the previous hop.
+ */
+struct acpi_dmar_devscope {
 	uint8_t  type;
 	uint8_t  length;
 	uint16_t reserved;
@@ -108,16 +202,423 @@ struct acpi_dmar_rmrr_devscope {
 	struct {
 		uint8_t dev;
 		uint8_t fun;
-	} path[1];
+	} path[];
 } __attribute__((packed));
 
+/*
+ * DMAR RMRR entry. This structure is followed by a variable number of device
+ * scopes.
+ */
 struct acpi_dmar_rmrr {
 	struct acpi_dmar_header header;
 	uint16_t reserved;
 	uint16_t segment;
-	uint32_t reg_base[2];
-	uint32_t reg_limit[2];
-	struct acpi_dmar_rmrr_devscope devscope[1];
+	uint64_t reg_base;
+	uint64_t reg_limit;
+} __attribute__((packed));
+
+/*
+ * AMD I/O Virtualization Reporting Structure (IVRS).
+ */
+
+enum acpi_ivrs_type {
+	ACPI_IVRS_TYPE_IVHD_LEGACY = 0x10,
+	ACPI_IVRS_TYPE_IVHD_EFR    = 0x11,
+	ACPI_IVRS_TYPE_IVHD_ACPI   = 0x40,
+	ACPI_IVRS_TYPE_IVMD_ALL    = 0x20,
+	ACPI_IVRS_TYPE_IVMD_SELECT = 0x21,
+	ACPI_IVRS_TYPE_IVMD_RANGE  = 0x22,
+};
+
+struct acpi_ivrs {
+	struct acpi_header header;
+	uint32_t ivinfo;
+	uint8_t  reserved[8];
+} __attribute__((packed));
+
+struct acpi_ivrs_header {
+	uint8_t  type;
+	uint8_t  flags;
+	uint16_t length;
+	uint16_t devid;
+} __attribute__((packed));
+
+/*
+ * IVRS I/O Virtualization Hardware Definition (IVHD) block. This structure is
+ * followed by a variable number of device entries. IVHD types 11h and 40h
+ * carry an image of the extended feature register before the device entries.
+ */
+struct acpi_ivrs_ivhd {
+	struct acpi_ivrs_header header;
+	uint16_t cap_offset;
+	uint64_t base;
+	uint16_t segment;
+	uint16_t info;
+	uint32_t attributes;
+} __attribute__((packed));
+
+struct acpi_ivrs_ivhd_efr {
+	struct acpi_ivrs_ivhd ivhd;
+	uint64_t efr;
+	uint64_t efr2;
+} __attribute__((packed));
+
+enum acpi_ivhd_dev_type {
+	ACPI_IVHD_DEV_PAD          = 0x00,
+	ACPI_IVHD_DEV_ALL          = 0x01,
+	ACPI_IVHD_DEV_SELECT       = 0x02,
+	ACPI_IVHD_DEV_RANGE_START  = 0x03,
+	ACPI_IVHD_DEV_RANGE_END    = 0x04,
+	ACPI_IVHD_DEV_ALIAS_SELECT = 0x42,
+	ACPI_IVHD_DEV_ALIAS_RANGE  = 0x43,
+	ACPI_IVHD_DEV_EXT_SELECT   = 0x46,
+	ACPI_IVHD_DEV_EXT_RANGE    = 0x47,
+	ACPI_IVHD_DEV_SPECIAL      = 0x48,
+	ACPI_IVHD_DEV_ACPI_HID     = 0xf0,
+};
+
+enum acpi_ivhd_special_variety {
+	ACPI_IVHD_SPECIAL_IOAPIC = 1,
+	ACPI_IVHD_SPECIAL_HPET   = 2,
+};
+
+/*
+ * IVHD device entries. Types below 40h are 4 bytes long, types below 80h are 8
+ * bytes long, and the ACPI HID entry is followed by a variable length UID.
+ */
+struct acpi_ivhd_dev {
+	uint8_t  type;
+	uint16_t devid;
+	uint8_t  dte;
+} __attribute__((packed));
+
+struct acpi_ivhd_dev_alias {
+	struct acpi_ivhd_dev dev;
+	uint8_t  reserved;
+	uint16_t alias;
+	uint8_t  reserved2;
+} __attribute__((packed));
+
+struct acpi_ivhd_dev_special {
+	struct acpi_ivhd_dev dev;
+	uint8_t  handle;
+	uint16_t devid;
+	uint8_t  variety;
+} __attribute__((packed));
+
+struct acpi_ivhd_dev_hid {
+	struct acpi_ivhd_dev dev;
+	char     hid[8];
+	char     cid[8];
+	uint8_t  uid_format;
+	uint8_t  uid_length;
+} __attribute__((packed));
+
+/*
+ * IVRS I/O Virtualization Memory Definition (IVMD) block.
+ */
+enum acpi_ivmd_flags {
+	ACPI_IVMD_FLAG_UNITY     = 0x01,
+	ACPI_IVMD_FLAG_READ      = 0x02,
+	ACPI_IVMD_FLAG_WRITE     = 0x04,
+	ACPI_IVMD_FLAG_EXCLUSION = 0x08,
+};
+
+struct acpi_ivrs_ivmd {
+	struct acpi_ivrs_header header;
+	uint16_t aux;
+	uint8_t  reserved[8];
+	uint64_t start;
+	uint64_t length;
+} __attribute__((packed));
+
+/*
+ * PCI Express memory mapped configuration space table (MCFG).
+ */
+struct acpi_mcfg {
+	struct acpi_header header;
+	uint8_t reserved[8];
 } __attribute__((packed));
 
+struct acpi_mcfg_entry {
+	uint64_t base;
+	uint16_t segment;
+	uint8_t  start_bus;
+	uint8_t  end_bus;
+	uint32_t reserved;
+} __attribute__((packed));
+
+/*
+ * System Resource Affinity Table (SRAT), assigning the processors and memory
+ * ranges to proximity domains.
+ */
+
+enum acpi_srat_type {
+	ACPI_SRAT_TYPE_LAPIC  = 0,
+	ACPI_SRAT_TYPE_MEMORY = 1,
+	ACPI_SRAT_TYPE_X2APIC = 2,
+};
+
+enum acpi_srat_flags {
+	ACPI_SRAT_ENABLED       = 0x01,
+	ACPI_SRAT_HOTPLUGGABLE  = 0x02,  /* memory affinity only */
+	ACPI_SRAT_NON_VOLATILE  = 0x04,  /* memory affinity only */
+};
+
+struct acpi_srat {
+	struct acpi_header header;
+	uint8_t reserved[12];
+} __attribute__((packed));
+
+struct acpi_srat_header {
+	uint8_t type;
+	uint8_t length;
+} __attribute__((packed));
+
+/*
+ * SRAT processor local APIC affinity entry. The proximity domain is split in
+ * a low byte and three high bytes.
+ */
+struct acpi_srat_lapic {
+	struct acpi_srat_header header;
+	uint8_t  domain_lo;
+	uint8_t  apic_id;
+	uint32_t flags;
+	uint8_t  sapic_eid;
+	uint8_t  domain_hi[3];
+	uint32_t clock_domain;
+} __attribute__((packed));
+
+struct acpi_srat_memory {
+	struct acpi_srat_header header;
+	uint32_t domain;
+	uint16_t reserved1;
+	uint64_t base;
+	uint64_t length;
+	uint32_t reserved2;
+	uint32_t flags;
+	uint64_t reserved3;
+} __attribute__((packed));
+
+struct acpi_srat_x2apic {
+	struct acpi_srat_header header;
+	uint16_t reserved1;
+	uint32_t domain;
+	uint32_t apic_id;
+	uint32_t flags;
+	uint32_t clock_domain;
+	uint32_t reserved2;
+} __attribute__((packed));
+
+/*
+ * Generic address structure, describing a register in some address space.
+ */
+enum acpi_gas_space {
+	ACPI_GAS_SPACE_MEMORY = 0,
+	ACPI_GAS_SPACE_IO     = 1,
+	ACPI_GAS_SPACE_PCI    = 2,
+	ACPI_GAS_SPACE_FFH    = 0x7f,
+};
+
+struct acpi_gas {
+	uint8_t  space_id;
+	uint8_t  bit_width;
+	uint8_t  bit_offset;
+	uint8_t  access_size;
+	uint64_t address;
+} __attribute__((packed));
+
+/*
+ * Fixed ACPI Description Table (FADT). Older revisions are shorter, fields
+ * past the table length must be ignored.
+ */
+enum acpi_fadt_flags {
+	ACPI_FADT_RESET_REG_SUP = 1 << 10,
+	ACPI_FADT_HW_REDUCED    = 1 << 20,
+};
+
+struct acpi_fadt {
+	struct acpi_header header;
+	uint32_t firmware_ctrl;
+	uint32_t dsdt;
+	uint8_t  reserved0;
+	uint8_t  preferred_pm_profile;
+	uint16_t sci_int;
+	uint32_t smi_cmd;
+	uint8_t  acpi_enable;
+	uint8_t  acpi_disable;
+	uint8_t  s4bios_req;
+	uint8_t  pstate_cnt;
+	uint32_t pm1a_evt_blk;
+	uint32_t pm1b_evt_blk;
+	uint32_t pm1a_cnt_blk;
+	uint32_t pm1b_cnt_blk;
+	uint32_t pm2_cnt_blk;
+	uint32_t pm_tmr_blk;
+	uint32_t gpe0_blk;
+	uint32_t gpe1_blk;
+	uint8_t  pm1_evt_len;
+	uint8_t  pm1_cnt_len;
+	uint8_t  pm2_cnt_len;
+	uint8_t  pm_tmr_len;
+	uint8_t  gpe0_blk_len;
+	uint8_t  gpe1_blk_len;
+	uint8_t  gpe1_base;
+	uint8_t  cst_cnt;
+	uint16_t p_lvl2_lat;
+	uint16_t p_lvl3_lat;
+	uint16_t flush_size;
+	uint16_t flush_stride;
+	uint8_t  duty_offset;
+	uint8_t  duty_width;
+	uint8_t  day_alrm;
+	uint8_t  mon_alrm;
+	uint8_t  century;
+	uint16_t iapc_boot_arch;
+	uint8_t  reserved1;
+	uint32_t flags;
+	struct acpi_gas reset_reg;
+	uint8_t  reset_value;
+	uint16_t arm_boot_arch;
+	uint8_t  minor_version;
+	uint64_t x_firmware_ctrl;
+	uint64_t x_dsdt;
+	struct acpi_gas x_pm1a_evt_blk;
+	struct acpi_gas x_pm1b_evt_blk;
+	struct acpi_gas x_pm1a_cnt_blk;
+	struct acpi_gas x_pm1b_cnt_blk;
+	struct acpi_gas x_pm2_cnt_blk;
+	struct acpi_gas x_pm_tmr_blk;
+	struct acpi_gas x_gpe0_blk;
+	struct acpi_gas x_gpe1_blk;
+	struct acpi_gas sleep_control_reg;
+	struct acpi_gas sleep_status_reg;
+	uint64_t hypervisor_vendor_id;
+} __attribute__((packed));
+
+/*
+ * Low Power Idle Table (LPIT), describing the low power idle states that the
+ * platform can enter, with their entry trigger and wake latency.
+ */
+enum acpi_lpit_type {
+	ACPI_LPIT_TYPE_NATIVE = 0,
+};
+
+#define ACPI_LPIT_FLAG_DISABLED (1 << 0)
+
+struct acpi_lpit {
+	struct acpi_header header;
+} __attribute__((packed));
+
+struct acpi_lpit_header {
+	uint32_t type;
+	uint32_t length;
+	uint16_t uid;
+	uint16_t reserved;
+	uint32_t flags;
+} __attribute__((packed));
+
+struct acpi_lpit_native {
+	struct acpi_lpit_header header;
+	struct acpi_gas entry_trigger;
+	uint32_t residency;              /* microseconds */
+	uint32_t latency;                /* microseconds */
+	struct acpi_gas residency_counter;
+	uint64_t counter_frequency;
+} __attribute__((packed));
+
+/*
+ * Serial port subtypes of the Debug Port Table 2, also used as interface
+ * types by the SPCR.
+ */
+enum acpi_dbg2_serial_subtype {
+	ACPI_DBG2_16550            = 0x00,
+	ACPI_DBG2_16550_SUBSET     = 0x01,
+	ACPI_DBG2_16550_GAS        = 0x12,
+};
+
+#define ACPI_DBG2_TYPE_SERIAL   0x8000
+
+/*
+ * Serial Port Console Redirection table (SPCR). The UART clock appeared with
+ * revision 3, the precise baud rate and the namespace string with revision 4.
+ */
+enum acpi_spcr_baud_rate {
+	ACPI_SPCR_BAUD_AS_IS  = 0,
+	ACPI_SPCR_BAUD_9600   = 3,
+	ACPI_SPCR_BAUD_19200  = 4,
+	ACPI_SPCR_BAUD_57600  = 6,
+	ACPI_SPCR_BAUD_115200 = 7,
+};
+
+#define ACPI_SPCR_NO_PCI        0xffff
+
+struct acpi_spcr {
+	struct acpi_header header;
+	uint8_t  interface_type;
+	uint8_t  reserved0[3];
+	struct acpi_gas base_address;
+	uint8_t  interrupt_type;
+	uint8_t  irq;
+	uint32_t gsi;
+	uint8_t  baud_rate;
+	uint8_t  parity;
+	uint8_t  stop_bits;
+	uint8_t  flow_control;
+	uint8_t  terminal_type;
+	uint8_t  language;
+	uint16_t pci_device_id;
+	uint16_t pci_vendor_id;
+	uint8_t  pci_bus;
+	uint8_t  pci_device;
+	uint8_t  pci_function;
+	uint32_t pci_flags;
+	uint8_t  pci_segment;
+	uint32_t uart_clock;             /* Hz, revision 3 */
+	uint32_t precise_baud_rate;      /* revision 4 */
+} __attribute__((packed));
+
+/*
+ * Debug Port Table 2 (DBG2). Each device information structure refers to its
+ * base address registers by offset.
+ */
+struct acpi_dbg2 {
+	struct acpi_header header;
+	uint32_t info_offset;
+	uint32_t info_count;
+} __attribute__((packed));
+
+struct acpi_dbg2_device {
+	uint8_t  revision;
+	uint16_t length;
+	uint8_t  num_registers;
+	uint16_t namespace_length;
+	uint16_t namespace_offset;
+	uint16_t oem_data_length;
+	uint16_t oem_data_offset;
+	uint16_t port_type;
+	uint16_t port_subtype;
+	uint16_t reserved;
+	uint16_t base_address_offset;
+	uint16_t address_size_offset;
+} __attribute__((packed));
+
+/*
+ * Check whether a FADT field is present in the table.
+ */
+#define ACPI_FADT_HAS(fadt, field) \
+	((fadt)->header.length >= offsetof(struct acpi_fadt, field) + sizeof ((fadt)->field))
+
+/*
+ * Check whether a SPCR field is present in the table, for its revision.
+ */
+#define ACPI_SPCR_HAS(spcr, field, rev) ((spcr)->header.revision >= (rev) && \
+	(spcr)->header.length >= offsetof(struct acpi_spcr, field) + sizeof ((spcr)->field))
+
 extern bool acpi_parse_tables(void);
+extern void acpi_evaluate_s5(void);
+extern struct acpi_header *acpi_find_table(char *signature, uint32_t index);
+extern const char *dmar_devscope_type_name(uint8_t type);
+extern const char *ivhd_dev_type_name(uint8_t type, uint8_t variety);
+extern const char *madt_polarity_name(uint16_t flags);
+extern const char *madt_trigger_name(uint16_t flags);
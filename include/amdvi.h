@@ -0,0 +1,44 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Size of the AMD IOMMU MMIO register window.
+ */
+#define AMDVI_MMIO_SIZE         0x4000
+
+/*
+ * IVHD flags.
+ */
+#define AMDVI_IVHD_IOTLB        0x10
+#define AMDVI_IVHD_COHERENT     0x20
+
+/*
+ * Extended feature register fields.
+ */
+#define AMDVI_EFR_PREF(efr)     ((uint32_t) (efr) & 0x1)
+#define AMDVI_EFR_PPR(efr)      ((uint32_t) ((efr) >> 1) & 0x1)
+#define AMDVI_EFR_XT(efr)       ((uint32_t) ((efr) >> 2) & 0x1)
+#define AMDVI_EFR_NX(efr)       ((uint32_t) ((efr) >> 3) & 0x1)
+#define AMDVI_EFR_GT(efr)       ((uint32_t) ((efr) >> 4) & 0x1)
+#define AMDVI_EFR_IA(efr)       ((uint32_t) ((efr) >> 6) & 0x1)
+#define AMDVI_EFR_GA(efr)       ((uint32_t) ((efr) >> 7) & 0x1)
+#define AMDVI_EFR_HE(efr)       ((uint32_t) ((efr) >> 8) & 0x1)
+#define AMDVI_EFR_PC(efr)       ((uint32_t) ((efr) >> 9) & 0x1)
+#define AMDVI_EFR_HATS(efr)     ((uint32_t) ((efr) >> 10) & 0x3)
+#define AMDVI_EFR_GATS(efr)     ((uint32_t) ((efr) >> 12) & 0x3)
+
+/*
+ * Number of host page table levels supported by an AMD IOMMU.
+ */
+#define AMDVI_HOST_LEVELS(efr) \
+	(AMDVI_EFR_HATS(efr) == 3 ? 4 : 4 + AMDVI_EFR_HATS(efr))
+
+extern bool amdvi_scan(void);
@@ -0,0 +1,110 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "acpi.h"
+
+/*
+ * Build a namespace segment identifier from its four characters.
+ */
+#define AML_SEG(s) \
+	((uint32_t) (s)[0] | ((uint32_t) (s)[1] << 8) | \
+	 ((uint32_t) (s)[2] << 16) | ((uint32_t) (s)[3] << 24))
+
+/*
+ * Compressed EISA identifiers, as found in _HID and _CID.
+ */
+#define AML_EISAID_PNP0A03      0x030ad041      /* PCI host bridge         */
+#define AML_EISAID_PNP0A08      0x080ad041      /* PCI Express host bridge */
+
+/*
+ * Types of evaluated objects.
+ */
+enum aml_object_type {
+	AML_UNINITIALISED = 0,
+	AML_INTEGER,
+	AML_STRING,
+	AML_BUFFER,
+	AML_PACKAGE,
+	AML_REFERENCE,          /* namespace node                  */
+	AML_ELEMENT,            /* package element, from Index()   */
+	AML_BYTE,               /* buffer byte, from Index()       */
+};
+
+/*
+ * Types of namespace nodes.
+ */
+enum aml_node_type {
+	AML_NODE_SCOPE = 0,
+	AML_NODE_DEVICE,
+	AML_NODE_PROCESSOR,
+	AML_NODE_POWER,
+	AML_NODE_THERMAL,
+	AML_NODE_NAME,
+	AML_NODE_METHOD,
+	AML_NODE_REGION,
+	AML_NODE_FIELD,
+	AML_NODE_BUFFER_FIELD,
+	AML_NODE_MUTEX,
+	AML_NODE_EVENT,
+	AML_NODE_ALIAS,
+};
+
+struct aml_node;
+
+struct aml_object {
+	uint8_t  type;
+	uint32_t size;                  /* string, buffer or package length */
+	union {
+		uint64_t           integer;
+		uint8_t           *buffer;
+		struct aml_object *package;
+		struct aml_node   *node;
+		struct aml_object *element;
+	};
+};
+
+struct aml_node {
+	uint32_t         name;
+	uint8_t          type;
+	uint8_t          argc;          /* method argument count      */
+	uint8_t          access;        /* field access width (bytes) */
+	uint8_t          space;         /* region address space       */
+	struct aml_node *parent;
+	struct aml_node *child;
+	struct aml_node *sibling;
+	const uint8_t   *aml;           /* name data or method body   */
+	const uint8_t   *end;           /* end of the method body     */
+	struct aml_object *value;       /* evaluated name data        */
+	union {
+		struct {
+			uint64_t base;
+			uint64_t length;
+		} region;
+		struct {
+			struct aml_node   *region;
+			struct aml_object *buffer;
+			uint32_t           offset;  /* in bits */
+			uint32_t           width;   /* in bits */
+		} field;
+		struct aml_node *alias;
+	};
+};
+
+extern bool aml_load_table(struct acpi_header *table);
+extern struct aml_node *aml_root(void);
+extern struct aml_node *aml_lookup(struct aml_node *scope, const char *path);
+extern bool aml_evaluate(struct aml_node *node, uint32_t argc,
+                         struct aml_object *args, struct aml_object *result);
+extern bool aml_evaluate_integer(struct aml_node *scope, const char *path,
+                                 uint64_t *value);
+extern bool aml_to_integer(struct aml_object *object, uint64_t *value);
+extern bool aml_is_pci_root(struct aml_node *device);
+extern bool aml_pci_bus(struct aml_node *device, uint16_t *segment, uint8_t *bus);
@@ -0,0 +1,24 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Make room for one more element at the end of a growable vector, that is any
+ * structure with "count", "capacity" and "list" members. The list is moved to
+ * a larger arena allocation when full. Returns false when the arena is
+ * exhausted.
+ */
+#define vector_reserve(vec)                                     \
+	arena_vector_reserve((void **) &(vec)->list, (vec)->count, \
+	                     &(vec)->capacity, sizeof (*(vec)->list))
+
+extern void *arena_alloc(uint32_t size);
+extern bool arena_vector_reserve(void **list, uint32_t count, uint32_t *capacity,
+                                 uint32_t elemsize);
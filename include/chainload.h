@@ -0,0 +1,35 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Maximum number of segments of the chainloaded image. */
+#define CHAINLOAD_MAX_SEGMENTS  16
+
+/* Maximum number of multiboot2 modules passed on to the next stage. */
+#define CHAINLOAD_MAX_MODULES   32
+
+/*
+ * Hand-off block read by the trampoline, see entry.S. The segments are copied
+ * from the module to their load address, the rest of their memory size is
+ * zeroed, and the entry point is called with the new multiboot2 info.
+ */
+struct chainload_block {
+	uint32_t entry;
+	uint32_t mbi;
+	uint32_t num_segments;
+	struct chainload_segment {
+		uint32_t dst;
+		uint32_t src;
+		uint32_t filesz;
+		uint32_t memsz;
+	} segment[];
+} __attribute__((packed));
+
+extern bool chainload(uint32_t info_addr, void (*dump)(void));
@@ -7,31 +7,37 @@
 #pragma once
 
 /*
- * Maximum number of memory regions to accept from the multiboot information
- * structure. This is an arbitrary limit and exceeding it will throw an error.
+ * Size of the scratch memory arena backing the variable length lists of the
+ * sysinfo structure. This is part of the image .bss and exceeding it will
+ * throw an error.
  */
-#define MAX_MEMORY_REGIONS      16
+#define CONFIG_ARENA_SIZE       0x100000
 
 /*
- * Maximum number of I/O APICs to register. This is set to 1 to match what seL4
- * does. All additional I/O APICs will be ignored (with a warning).
+ * Fixed memory budget of the AML interpreter, the number of namespace nodes,
+ * the size of the heap holding the objects created while evaluating and the
+ * number of memory region bytes the firmware code can store to. Running out
+ * aborts the evaluation of the PCI interrupt routing with a warning.
  */
-#define MAX_NUM_IOAPICS         1
+#define CONFIG_AML_MAX_NODES    8192
+#define CONFIG_AML_HEAP_SIZE    0x40000
+#define CONFIG_AML_MAX_STORES   256
 
 /*
- * Maximum number of DMA Remapping Hardware units. This is an arbitrary limit
- * and exceeding it will throw an error.
+ * Size of the multiboot2 info structure built from the PVH start info when
+ * booted through the PVH entry point.
  */
-#define MAX_NUM_DRHUS           16
-
-/*
- * Maximum number of Reserved memory Region Reporting structures. This is an
- * arbitrary limit and exceeding it will throw an error.
- */
-#define MAX_NUM_RMRRS           16
+#define CONFIG_PVH_INFO_SIZE    0x2000
 
 /*
  * Default serial port to use. The first port is traditionally located at
  * 0x3f8, and the second one at 0x2f8.
  */
 #define CONFIG_SERIAL_PORT	0x3f8
+
+/*
+ * Baud rate of the serial port, and input clock of the UART when the firmware
+ * doesn't tell. Legacy PC serial ports run from a 1.8432MHz clock.
+ */
+#define CONFIG_SERIAL_BAUD      115200
+#define CONFIG_SERIAL_CLOCK     1843200
@@ -0,0 +1,12 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+extern void console_discover(void);
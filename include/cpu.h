@@ -0,0 +1,74 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * CPUID leaf 1 feature bits.
+ */
+#define CPUID_1_ECX_X2APIC      (1 << 21)
+#define CPUID_1_EDX_MSR         (1 << 5)
+
+/*
+ * Model specific registers.
+ */
+#define MSR_IA32_APIC_BASE      0x1b
+#define MSR_APIC_BASE_EXTD      (1 << 10)
+#define MSR_PLATFORM_INFO       0xce
+#define MSR_TURBO_RATIO_LIMIT   0x1ad
+#define MSR_IA32_HWP_CAPABILITIES 0x771
+
+/*
+ * Processor features reported in the machine file. The names follow the Linux
+ * /proc/cpuinfo flags.
+ */
+enum cpu_feature {
+	CPU_FEATURE_PGE,
+	CPU_FEATURE_PAT,
+	CPU_FEATURE_PCID,
+	CPU_FEATURE_SSE4_2,
+	CPU_FEATURE_X2APIC,
+	CPU_FEATURE_TSC_DEADLINE,
+	CPU_FEATURE_XSAVE,
+	CPU_FEATURE_AVX,
+	CPU_FEATURE_RDRAND,
+	CPU_FEATURE_HYPERVISOR,
+	CPU_FEATURE_IDA,
+	CPU_FEATURE_HWP,
+	CPU_FEATURE_FSGSBASE,
+	CPU_FEATURE_AVX2,
+	CPU_FEATURE_SMEP,
+	CPU_FEATURE_INVPCID,
+	CPU_FEATURE_AVX512F,
+	CPU_FEATURE_AVX512DQ,
+	CPU_FEATURE_RDSEED,
+	CPU_FEATURE_SMAP,
+	CPU_FEATURE_AVX512BW,
+	CPU_FEATURE_AVX512VL,
+	CPU_FEATURE_UMIP,
+	CPU_FEATURE_PKU,
+	CPU_FEATURE_LA57,
+	CPU_FEATURE_AMX_BF16,
+	CPU_FEATURE_AMX_TILE,
+	CPU_FEATURE_AMX_INT8,
+	CPU_FEATURE_XSAVEOPT,
+	CPU_FEATURE_XSAVEC,
+	CPU_FEATURE_XSAVES,
+	CPU_FEATURE_NX,
+	CPU_FEATURE_PDPE1GB,
+	CPU_FEATURE_RDTSCP,
+	CPU_FEATURE_NONSTOP_TSC,
+	CPU_NUM_FEATURES,
+};
+
+#define cpu_has(feature) ((sysinfo.cpu_info.features >> (feature)) & 1)
+
+extern const char *cpu_feature_name(uint32_t feature);
+
+extern bool cpu_scan(void);
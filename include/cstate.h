@@ -0,0 +1,54 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * CPUID MONITOR/MWAIT enumeration.
+ */
+#define CPUID_1_ECX_MONITOR     (1 << 3)
+#define CPUID_5_ECX_EMX         (1 << 0)
+#define CPUID_5_ECX_IBE         (1 << 1)
+
+/* Number of sub-states of C-state n (C0 to C7) in CPUID leaf 5 EDX. */
+#define CPUID_5_EDX_SUBSTATES(edx, n) (((edx) >> ((n) * 4)) & 0xf)
+
+/* MWAIT hint of a sub-state of C-state n, from C1. */
+#define MWAIT_HINT(n, sub)      ((((n) - 1) << 4) | (sub))
+
+/* Idle state without MWAIT hint, such as an LPIT state entered otherwise. */
+#define CSTATE_NO_HINT          0xffffffff
+
+/*
+ * Local APIC registers, as MMIO offsets. In x2APIC mode the MSR number is
+ * 0x800 plus the offset divided by 16.
+ */
+#define LAPIC_REG_TPR           0x80
+#define LAPIC_REG_EOI           0xb0
+#define LAPIC_REG_SVR           0xf0
+#define LAPIC_REG_LVT_TIMER     0x320
+#define LAPIC_REG_TIMER_ICR     0x380
+#define LAPIC_REG_TIMER_DCR     0x3e0
+#define MSR_X2APIC_BASE         0x800
+
+#define LAPIC_SVR_ENABLE        (1 << 8)
+#define LAPIC_LVT_MASKED        (1 << 16)
+#define LAPIC_TIMER_DIV_1       0xb
+#define MSR_APIC_BASE_ENABLE    (1 << 11)
+
+/*
+ * Wake latency measurement: rounds per state, LAPIC timer count of a round,
+ * and TSC cycles after which a round is given up.
+ */
+#define CSTATE_MEASURE_ROUNDS   8
+#define CSTATE_TIMER_COUNT      0x20000
+#define CSTATE_TIMEOUT          (1ULL << 32)
+
+extern bool cstate_scan(void);
+extern void cstate_timer_interrupt(void);
@@ -0,0 +1,29 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+/*
+ * Discovery phases, in the order main() runs them.
+ */
+enum phase {
+	PHASE_ACPI,
+	PHASE_MEMORY,
+	PHASE_CPU,
+	PHASE_PRT,
+	PHASE_SMBIOS,
+	PHASE_MTRR,
+	PHASE_IOAPIC,
+	PHASE_VTD,
+	PHASE_AMDVI,
+	PHASE_CSTATE,
+	PHASE_DONE,
+};
+
+extern void phase_done(enum phase phase);
+extern void machine_file_object(void);
+extern void dump_machine_file(void);
+extern void serve(void);
@@ -0,0 +1,124 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * EFI memory types, as found in the EFI memory map.
+ */
+enum efi_memory_type {
+	EFI_RESERVED_MEMORY_TYPE        = 0,
+	EFI_LOADER_CODE                 = 1,
+	EFI_LOADER_DATA                 = 2,
+	EFI_BOOT_SERVICES_CODE          = 3,
+	EFI_BOOT_SERVICES_DATA          = 4,
+	EFI_RUNTIME_SERVICES_CODE       = 5,
+	EFI_RUNTIME_SERVICES_DATA       = 6,
+	EFI_CONVENTIONAL_MEMORY         = 7,
+	EFI_UNUSABLE_MEMORY             = 8,
+	EFI_ACPI_RECLAIM_MEMORY         = 9,
+	EFI_ACPI_MEMORY_NVS             = 10,
+	EFI_MEMORY_MAPPED_IO            = 11,
+	EFI_MEMORY_MAPPED_IO_PORT_SPACE = 12,
+	EFI_PAL_CODE                    = 13,
+	EFI_PERSISTENT_MEMORY           = 14,
+	EFI_UNACCEPTED_MEMORY           = 15,
+};
+
+/*
+ * EFI memory attributes.
+ */
+#define EFI_MEMORY_UC                   (1ULL << 0)
+#define EFI_MEMORY_WC                   (1ULL << 1)
+#define EFI_MEMORY_WT                   (1ULL << 2)
+#define EFI_MEMORY_WB                   (1ULL << 3)
+#define EFI_MEMORY_NV                   (1ULL << 15)
+#define EFI_MEMORY_MORE_RELIABLE        (1ULL << 16)
+#define EFI_MEMORY_SP                   (1ULL << 18)
+#define EFI_MEMORY_RUNTIME              (1ULL << 63)
+
+/* EFI pages are always 4KiB. */
+#define EFI_PAGE_SHIFT                  12
+
+/*
+ * EFI memory descriptor. The descriptors of a memory map may be larger, the
+ * stride is given by the descriptor size.
+ */
+struct efi_memory_descriptor {
+	uint32_t type;
+	uint32_t pad;
+	uint64_t phys_start;
+	uint64_t virt_start;
+	uint64_t num_pages;
+	uint64_t attribute;
+} __attribute__((packed));
+
+struct efi_guid {
+	uint32_t data1;
+	uint16_t data2;
+	uint16_t data3;
+	uint8_t  data4[8];
+} __attribute__((packed));
+
+struct efi_table_header {
+	uint64_t signature;
+	uint32_t revision;
+	uint32_t header_size;
+	uint32_t crc32;
+	uint32_t reserved;
+} __attribute__((packed));
+
+/*
+ * EFI system tables of 32-bit and 64-bit firmwares, only the configuration
+ * table is used.
+ */
+struct efi_system_table32 {
+	struct efi_table_header header;
+	uint32_t firmware_vendor;
+	uint32_t firmware_revision;
+	uint32_t console_handles[6];
+	uint32_t runtime_services;
+	uint32_t boot_services;
+	uint32_t num_config_entries;
+	uint32_t config_table;
+} __attribute__((packed));
+
+struct efi_system_table64 {
+	struct efi_table_header header;
+	uint64_t firmware_vendor;
+	uint32_t firmware_revision;
+	uint32_t pad;
+	uint64_t console_handles[6];
+	uint64_t runtime_services;
+	uint64_t boot_services;
+	uint64_t num_config_entries;
+	uint64_t config_table;
+} __attribute__((packed));
+
+struct efi_config_entry32 {
+	struct efi_guid guid;
+	uint32_t table;
+} __attribute__((packed));
+
+struct efi_config_entry64 {
+	struct efi_guid guid;
+	uint64_t table;
+} __attribute__((packed));
+
+/*
+ * Configuration tables of interest.
+ */
+extern const struct efi_guid efi_guid_acpi10;
+extern const struct efi_guid efi_guid_acpi20;
+extern const struct efi_guid efi_guid_smbios;
+extern const struct efi_guid efi_guid_smbios3;
+
+extern const char *efi_memory_type_name(uint32_t type);
+extern void *efi_config_table(const struct efi_guid *guid);
+extern bool efi_system_table(uint64_t *addr, uint32_t *size, uint64_t *config, uint32_t *config_size);
@@ -0,0 +1,85 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * ELF identification and the few header fields needed to load an executable.
+ */
+#define ELF_MAGIC               "\177ELF"
+#define ELF_CLASS_32            1
+#define ELF_CLASS_64            2
+#define ELF_DATA_LSB            1
+#define ELF_TYPE_EXEC           2
+#define ELF_MACHINE_386         3
+#define ELF_MACHINE_X86_64      62
+#define ELF_PT_LOAD             1
+
+struct elf_ident {
+	char     magic[4];
+	uint8_t  class;
+	uint8_t  data;
+	uint8_t  version;
+	uint8_t  pad[9];
+} __attribute__((packed));
+
+struct elf32_header {
+	struct elf_ident ident;
+	uint16_t type;
+	uint16_t machine;
+	uint32_t version;
+	uint32_t entry;
+	uint32_t phoff;
+	uint32_t shoff;
+	uint32_t flags;
+	uint16_t ehsize;
+	uint16_t phentsize;
+	uint16_t phnum;
+	uint16_t shentsize;
+	uint16_t shnum;
+	uint16_t shstrndx;
+} __attribute__((packed));
+
+struct elf64_header {
+	struct elf_ident ident;
+	uint16_t type;
+	uint16_t machine;
+	uint32_t version;
+	uint64_t entry;
+	uint64_t phoff;
+	uint64_t shoff;
+	uint32_t flags;
+	uint16_t ehsize;
+	uint16_t phentsize;
+	uint16_t phnum;
+	uint16_t shentsize;
+	uint16_t shnum;
+	uint16_t shstrndx;
+} __attribute__((packed));
+
+struct elf32_phdr {
+	uint32_t type;
+	uint32_t offset;
+	uint32_t vaddr;
+	uint32_t paddr;
+	uint32_t filesz;
+	uint32_t memsz;
+	uint32_t flags;
+	uint32_t align;
+} __attribute__((packed));
+
+struct elf64_phdr {
+	uint32_t type;
+	uint32_t flags;
+	uint64_t offset;
+	uint64_t vaddr;
+	uint64_t paddr;
+	uint64_t filesz;
+	uint64_t memsz;
+	uint64_t align;
+} __attribute__((packed));
@@ -0,0 +1,12 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+extern uint32_t crc32c(uint32_t crc, const void *buf, uint32_t len);
+extern uint32_t fingerprint(void);
@@ -0,0 +1,99 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Hypervisor CPUID leaves. Each interface takes a block of 0x100 leaves from
+ * 0x40000000, a hypervisor may expose several of them such as KVM with its
+ * Hyper-V emulation.
+ */
+#define CPUID_HYPERVISOR_BASE   0x40000000
+#define CPUID_HYPERVISOR_STRIDE 0x100
+#define CPUID_HYPERVISOR_BLOCKS 16
+
+/* Generic timing leaf, frequencies in kHz. */
+#define CPUID_HYPERVISOR_TIMING 0x10
+
+enum hypervisor_vendor {
+	HYPERVISOR_UNKNOWN,
+	HYPERVISOR_KVM,
+	HYPERVISOR_HYPERV,
+	HYPERVISOR_XEN,
+	HYPERVISOR_VMWARE,
+};
+
+/*
+ * Paravirtual features reported in the machine file. The names follow the
+ * Linux kernel definitions.
+ */
+enum hypervisor_feature {
+	/* KVM, leaf 1. */
+	HV_FEATURE_KVM_CLOCKSOURCE,
+	HV_FEATURE_KVM_NOP_IO_DELAY,
+	HV_FEATURE_KVM_CLOCKSOURCE2,
+	HV_FEATURE_KVM_ASYNC_PF,
+	HV_FEATURE_KVM_STEAL_TIME,
+	HV_FEATURE_KVM_PV_EOI,
+	HV_FEATURE_KVM_PV_UNHALT,
+	HV_FEATURE_KVM_PV_TLB_FLUSH,
+	HV_FEATURE_KVM_ASYNC_PF_VMEXIT,
+	HV_FEATURE_KVM_PV_SEND_IPI,
+	HV_FEATURE_KVM_POLL_CONTROL,
+	HV_FEATURE_KVM_PV_SCHED_YIELD,
+	HV_FEATURE_KVM_ASYNC_PF_INT,
+	HV_FEATURE_KVM_MSI_EXT_DEST_ID,
+	HV_FEATURE_KVM_HC_MAP_GPA_RANGE,
+	HV_FEATURE_KVM_MIGRATION_CONTROL,
+	HV_FEATURE_KVM_CLOCKSOURCE_STABLE,
+	HV_FEATURE_KVM_HINTS_REALTIME,
+
+	/* Hyper-V, leaves 3, 4 and 6. */
+	HV_FEATURE_HYPERV_TIME_REF_COUNT,
+	HV_FEATURE_HYPERV_SYNIC,
+	HV_FEATURE_HYPERV_STIMER,
+	HV_FEATURE_HYPERV_APIC_ACCESS,
+	HV_FEATURE_HYPERV_HYPERCALL,
+	HV_FEATURE_HYPERV_VP_INDEX,
+	HV_FEATURE_HYPERV_REFERENCE_TSC,
+	HV_FEATURE_HYPERV_FREQUENCY_MSRS,
+	HV_FEATURE_HYPERV_REENLIGHTENMENT,
+	HV_FEATURE_HYPERV_TSC_INVARIANT,
+	HV_FEATURE_HYPERV_LOCAL_TLB_FLUSH,
+	HV_FEATURE_HYPERV_REMOTE_TLB_FLUSH,
+	HV_FEATURE_HYPERV_APIC_ACCESS_RECOMMENDED,
+	HV_FEATURE_HYPERV_RELAXED_TIMING,
+	HV_FEATURE_HYPERV_CLUSTER_IPI,
+	HV_FEATURE_HYPERV_EX_PROCESSOR_MASKS,
+	HV_FEATURE_HYPERV_ENLIGHTENED_VMCS,
+	HV_FEATURE_HYPERV_APIC_OVERLAY_ASSIST,
+	HV_FEATURE_HYPERV_MSR_BITMAPS,
+	HV_FEATURE_HYPERV_SLAT,
+	HV_FEATURE_HYPERV_DMA_REMAPPING,
+	HV_FEATURE_HYPERV_INTERRUPT_REMAPPING,
+
+	/* Xen, leaves 3 and 4. */
+	HV_FEATURE_XEN_TSC_EMULATED,
+	HV_FEATURE_XEN_HOST_TSC_RELIABLE,
+	HV_FEATURE_XEN_RDTSCP,
+	HV_FEATURE_XEN_APIC_ACCESS_VIRT,
+	HV_FEATURE_XEN_X2APIC_VIRT,
+	HV_FEATURE_XEN_IOMMU_MAPPINGS,
+	HV_FEATURE_XEN_VCPU_ID,
+	HV_FEATURE_XEN_DOMID,
+	HV_FEATURE_XEN_EXT_DEST_ID,
+	HV_FEATURE_XEN_UPCALL_VECTOR,
+
+	HV_NUM_FEATURES,
+};
+
+extern const char *hypervisor_vendor_name(uint32_t vendor);
+extern const char *hypervisor_feature_name(uint32_t feature);
+
+extern bool hypervisor_scan(void);
@@ -0,0 +1,39 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+/*
+ * Exception vectors.
+ */
+#define IDT_VECTOR_GP           13
+
+/*
+ * Interrupt vectors, for the wake latency measurement of the idle states.
+ */
+#define IDT_VECTOR_LAPIC_TIMER  48
+#define IDT_VECTOR_SPURIOUS     63
+
+/*
+ * Number of IDT entries, enough for the exceptions and a few interrupts.
+ */
+#define IDT_NUM_VECTORS         64
+
+#ifndef __ASM__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+extern void idt_init(void);
+extern void idt_set_gate(uint32_t vector, void (*handler)(void));
+
+/*
+ * Read a model specific register, returns false instead of faulting if the
+ * processor doesn't implement it. Defined in entry.S.
+ */
+extern bool rdmsr_safe(uint32_t msr, uint64_t *value);
+
+#endif /* __ASM__ */
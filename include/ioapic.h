@@ -0,0 +1,19 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Number of legacy ISA interrupts, identity mapped to GSIs unless overridden
+ * or their GSI is taken by an override.
+ */
+#define IOAPIC_NUM_ISA_IRQS     16
+
+extern bool ioapic_scan(void);
+extern bool ioapic_isa_irq_gsi(uint8_t irq, uint32_t *gsi, uint16_t *flags);
@@ -0,0 +1,20 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Large page sizes.
+ */
+#define MEMORY_PAGE_SIZE_2M     0x200000ULL
+#define MEMORY_PAGE_SIZE_1G     0x40000000ULL
+
+extern bool memory_add(uint64_t addr, uint64_t size);
+extern bool memory_finalise(void);
+extern uint64_t memory_aligned_extent(uint32_t region, uint64_t align, uint64_t *base);
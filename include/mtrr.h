@@ -0,0 +1,58 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * CPUID leaf 1 feature bits.
+ */
+#define CPUID_1_EDX_MTRR        (1 << 12)
+#define CPUID_1_EDX_PAT         (1 << 16)
+
+/*
+ * Memory type range registers.
+ */
+#define MSR_MTRRCAP             0xfe
+#define MSR_MTRR_DEF_TYPE       0x2ff
+#define MSR_MTRR_PHYSBASE(n)    (0x200 + 2 * (n))
+#define MSR_MTRR_PHYSMASK(n)    (0x201 + 2 * (n))
+#define MSR_MTRR_FIX_64K        0x250
+#define MSR_MTRR_FIX_16K        0x258
+#define MSR_MTRR_FIX_4K         0x268
+#define MSR_PAT                 0x277
+
+#define MTRRCAP_VCNT(cap)       ((uint32_t) (cap) & 0xff)
+#define MTRRCAP_FIX             (1 << 8)
+#define MTRR_DEF_TYPE_FE        (1 << 10)
+#define MTRR_DEF_TYPE_E         (1 << 11)
+#define MTRR_PHYSMASK_VALID     (1 << 11)
+
+/*
+ * Number of fixed range MTRR entries (8 x 64K, 16 x 16K and 64 x 4K).
+ */
+#define MTRR_NUM_FIXED          88
+
+/*
+ * Memory types, as encoded in the MTRRs and PAT entries. MTRR_TYPE_MIXED is
+ * not an architectural encoding and marks overlapping conflicting MTRRs.
+ */
+enum mtrr_type {
+	MTRR_TYPE_UC     = 0,
+	MTRR_TYPE_WC     = 1,
+	MTRR_TYPE_WT     = 4,
+	MTRR_TYPE_WP     = 5,
+	MTRR_TYPE_WB     = 6,
+	MTRR_TYPE_UC_    = 7,
+	MTRR_TYPE_MIXED  = 0xff,
+};
+
+extern bool mtrr_scan(void);
+extern uint64_t mtrr_range_type(uint64_t base, uint64_t size, uint8_t *type);
+extern uint8_t mtrr_effective_type(uint8_t type, uint32_t pat_index);
+extern const char *mtrr_type_name(uint8_t type);
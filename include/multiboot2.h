@@ -24,6 +24,60 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+/*
+ * Multiboot2 header, found in the first 32KiB of an image on an 8-byte
+ * boundary, followed by header tags.
+ */
+#define MULTIBOOT2_HEADER_SEARCH        32768
+
+struct multiboot2_header {
+	uint32_t magic;
+	uint32_t architecture;
+	uint32_t header_length;
+	uint32_t checksum;
+} __attribute__((packed));
+
+/*
+ * Multiboot2 header tags. Tags flagged optional may be ignored by the boot
+ * loader.
+ */
+enum multiboot2_header_tag_type {
+	MULTIBOOT2_HEADER_TAG_END                 = 0,
+	MULTIBOOT2_HEADER_TAG_INFORMATION_REQUEST = 1,
+	MULTIBOOT2_HEADER_TAG_ADDRESS             = 2,
+	MULTIBOOT2_HEADER_TAG_ENTRY_ADDRESS       = 3,
+	MULTIBOOT2_HEADER_TAG_CONSOLE_FLAGS       = 4,
+	MULTIBOOT2_HEADER_TAG_FRAMEBUFFER         = 5,
+	MULTIBOOT2_HEADER_TAG_MODULE_ALIGN        = 6,
+	MULTIBOOT2_HEADER_TAG_EFI_BS              = 7,
+	MULTIBOOT2_HEADER_TAG_ENTRY_ADDRESS_EFI32 = 8,
+	MULTIBOOT2_HEADER_TAG_ENTRY_ADDRESS_EFI64 = 9,
+	MULTIBOOT2_HEADER_TAG_RELOCATABLE         = 10,
+};
+
+#define MULTIBOOT2_HEADER_TAG_OPTIONAL  1
+
+struct multiboot2_header_tag {
+	uint16_t type;
+	uint16_t flags;
+	uint32_t size;
+} __attribute__((packed));
+
+/*
+ * Multiboot2 address header tag, the a.out kludge: where to load the image
+ * when it isn't loaded from its ELF program headers.
+ */
+struct multiboot2_header_tag_address {
+	uint32_t header_addr;
+	uint32_t load_addr;
+	uint32_t load_end_addr;
+	uint32_t bss_end_addr;
+} __attribute__((packed));
+
+struct multiboot2_header_tag_entry {
+	uint32_t entry_addr;
+} __attribute__((packed));
+
 /*
  * Boot info tags.
  */
@@ -50,6 +104,9 @@ enum multiboot2_info_tag {
 	MULTIBOOT2_INFO_TAG_EFI32_IMAGE_HANDLE  = 19,
 	MULTIBOOT2_INFO_TAG_EFI64_IMAGE_HANDLE  = 20,
 	MULTIBOOT2_INFO_TAG_LOAD_BASE_PADDR     = 21,
+
+	/* Machine file passed to a chainloaded image, see chainload.c. */
+	MULTIBOOT2_INFO_TAG_MACHINE_FILE        = 0x4d44,
 };
 
 /*
@@ -72,6 +129,9 @@ struct multiboot2_info_header {
 	uint32_t reserved;
 } __attribute__((packed));
 
+/* Info tags are recorded by type below this limit, see multiboot2_tag(). */
+#define MULTIBOOT2_NUM_TAGS             32
+
 /*
  * Multiboot2 boot information tag header. This header is followed by tag
  * specific data.
@@ -81,6 +141,15 @@ struct multiboot2_tag_header {
 	uint32_t size;
 } __attribute__((packed));
 
+/*
+ * Multiboot2 module boot tag. This structure is followed by the module
+ * command line as a NUL terminated string.
+ */
+struct multiboot2_tag_module {
+	uint32_t mod_start;
+	uint32_t mod_end;
+} __attribute__((packed));
+
 /*
  * Multiboot2 memory map boot tag. This structure is followed by an array of
  * entries.
@@ -128,6 +197,45 @@ struct multiboot2_tag_rsdp2 {
 	uint8_t  reserved[3];
 } __attribute__((packed));
 
+/*
+ * Multiboot2 SMBIOS tables boot tag. This structure is followed by a copy of
+ * the SMBIOS entry point structure.
+ */
+struct multiboot2_tag_smbios {
+	uint8_t  major;
+	uint8_t  minor;
+	uint8_t  reserved[6];
+} __attribute__((packed));
+
+/*
+ * Multiboot2 EFI system table boot tags, for 32-bit and 64-bit firmwares.
+ */
+struct multiboot2_tag_efi32 {
+	uint32_t pointer;
+} __attribute__((packed));
+
+struct multiboot2_tag_efi64 {
+	uint64_t pointer;
+} __attribute__((packed));
+
+/*
+ * Multiboot2 EFI memory map boot tag. This structure is followed by the EFI
+ * memory descriptors, see efi.h.
+ */
+struct multiboot2_tag_efi_mmap {
+	uint32_t descr_size;
+	uint32_t descr_vers;
+} __attribute__((packed));
+
+/*
+ * Round a number up to the next 64-bit boundary, the alignment of the tags.
+ */
+static inline uint32_t roundup64(uint32_t n)
+{
+	return (n + 7) & ~7;
+}
+
+extern struct multiboot2_tag_header *multiboot2_tag(uint32_t type);
 extern bool multiboot2_parse_info(uint32_t info_addr);
 
 #endif
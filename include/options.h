@@ -6,22 +6,55 @@
 
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 
+/*
+ * 16550 UART used as console, on an I/O port or memory mapped. Memory mapped
+ * registers are stride bytes apart and accessed width bytes at a time. A null
+ * baud rate keeps the divisor programmed by the firmware.
+ */
+struct serial_config {
+	bool     mmio;
+	uint32_t base;
+	uint8_t  stride;
+	uint8_t  width;
+	uint32_t clock;          /* Hz */
+	uint32_t baud;
+};
+
 /*
  * Program options.
  */
 struct options {
 
 	/* Serial port to use. */
-	uint16_t serial_port;
+	struct serial_config serial;
+
+	/* Whether to switch to the console advertised by the firmware. */
+	bool serial_firmware;
 
 	/* What to do on exit. */
 	enum {
-		OPTION_ON_EXIT_HANG     = 0,
-		OPTION_ON_EXIT_REBOOT   = 1,
-		OPTION_ON_EXIT_SHUTDOWN = 2,
+		OPTION_ON_EXIT_HANG      = 0,
+		OPTION_ON_EXIT_REBOOT    = 1,
+		OPTION_ON_EXIT_SHUTDOWN  = 2,
+		OPTION_ON_EXIT_CHAINLOAD = 3,
 	} on_exit;
+
+	/* Output format. */
+	enum {
+		OPTION_DUMP_JSON = 0,
+		OPTION_DUMP_RAW  = 1,
+		OPTION_DUMP_BOTH = 2,
+		OPTION_DUMP_SECTIONS = 3,
+	} dump;
+
+	/* Whether the machine fingerprint covers the raw ACPI tables. */
+	bool fingerprint_acpi;
+
+	/* Whether to measure the wake latency of the idle states. */
+	bool measure_cstates;
 };
 
 /* Global program option data. */
@@ -0,0 +1,51 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Structures made of type-tagged entries, walked once and dispatched to the
+ * parsers registered for each entry type.
+ */
+enum parser_table {
+	PARSER_MULTIBOOT2,      /* multiboot2 info tags */
+	PARSER_MADT,            /* MADT interrupt controller structures */
+	PARSER_DMAR,            /* DMAR remapping structures */
+	PARSER_SRAT,            /* SRAT affinity structures */
+	PARSER_NUM_TABLES,
+};
+
+/* Entry types above this limit are never dispatched. */
+#define PARSER_MAX_TYPES        64
+
+struct parser {
+	uint32_t table;
+	uint32_t type;
+	bool (*parse)(void *entry);
+};
+
+/*
+ * Register a parser for an entry type, which must be an identifier. The
+ * parser takes a pointer to the entry header, of any type, and returns false
+ * on fatal errors. The registrations are collected in the parsers section by
+ * the linker.
+ */
+#define PARSER(tbl, typ, fn)                                                   \
+	static bool parser_call_##typ(void *entry)                             \
+	{                                                                      \
+		return fn(entry);                                              \
+	}                                                                      \
+	static const struct parser parser_##typ                                \
+	__attribute__((used, section("parsers"), aligned(4))) = {              \
+		.table = tbl,                                                  \
+		.type  = typ,                                                  \
+		.parse = parser_call_##typ,                                    \
+	}
+
+extern bool parser_dispatch(enum parser_table table, uint32_t type, void *entry);
@@ -0,0 +1,98 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Build a 16-bit PCI requester ID from its bus, device and function numbers.
+ */
+#define PCI_DEVID(bus, dev, fun) \
+	((uint16_t) (((bus) << 8) | ((dev) << 3) | (fun)))
+
+/*
+ * Configuration space registers.
+ */
+#define PCI_VENDOR_ID           0x00
+#define PCI_COMMAND             0x04
+#define PCI_STATUS              0x06
+#define PCI_CLASS_REVISION      0x08
+#define PCI_HEADER_TYPE         0x0e
+#define PCI_BAR0                0x10
+#define PCI_SECONDARY_BUS       0x19
+#define PCI_SUBORDINATE_BUS     0x1a
+#define PCI_CAPABILITY_LIST     0x34
+
+#define PCI_HEADER_TYPE_MASK    0x7f
+#define PCI_HEADER_TYPE_BRIDGE  0x01
+#define PCI_HEADER_TYPE_MULTI   0x80
+
+#define PCI_COMMAND_IO          0x01
+#define PCI_COMMAND_MEMORY      0x02
+
+#define PCI_BAR_IO              0x01
+#define PCI_BAR_MEM_64          0x04
+#define PCI_BAR_IO_MASK         0xfffffffc
+#define PCI_BAR_MEM_MASK        0xfffffff0
+
+#define PCI_STATUS_CAP_LIST     0x10
+
+/*
+ * PCI Express capability, and its device/port types.
+ */
+#define PCI_CAP_ID_EXP          0x10
+#define PCI_EXP_FLAGS           0x02
+#define PCI_EXP_FLAGS_TYPE(flags) (((flags) >> 4) & 0xf)
+
+enum pci_exp_type {
+	PCI_EXP_TYPE_ENDPOINT    = 0x0,
+	PCI_EXP_TYPE_LEG_END     = 0x1,
+	PCI_EXP_TYPE_ROOT_PORT   = 0x4,
+	PCI_EXP_TYPE_UPSTREAM    = 0x5,
+	PCI_EXP_TYPE_DOWNSTREAM  = 0x6,
+	PCI_EXP_TYPE_PCI_BRIDGE  = 0x7,
+	PCI_EXP_TYPE_PCIE_BRIDGE = 0x8,
+	PCI_EXP_TYPE_RC_END      = 0x9,
+	PCI_EXP_TYPE_RC_EC       = 0xa,
+	PCI_EXP_TYPE_NONE        = 0xff, /* conventional PCI */
+};
+
+/*
+ * Extended capabilities, only reachable through the memory mapped
+ * configuration space.
+ */
+#define PCI_EXT_CAP_BASE        0x100
+#define PCI_EXT_CAP_ID(header)  ((header) & 0xffff)
+#define PCI_EXT_CAP_NEXT(header) (((header) >> 20) & 0xffc)
+
+/*
+ * Access Control Services capability.
+ */
+#define PCI_EXT_CAP_ID_ACS      0x0d
+#define PCI_ACS_CAP             0x04
+#define PCI_ACS_CTRL            0x06
+
+#define PCI_ACS_SV              0x01    /* source validation */
+#define PCI_ACS_TB              0x02    /* translation blocking */
+#define PCI_ACS_RR              0x04    /* P2P request redirect */
+#define PCI_ACS_CR              0x08    /* P2P completion redirect */
+#define PCI_ACS_UF              0x10    /* upstream forwarding */
+
+/* Index of the bridge above the functions of a root bus. */
+#define PCI_NO_PARENT           0xffffffff
+
+extern uint32_t pci_read32(uint16_t segment, uint8_t bus, uint8_t dev,
+                           uint8_t fun, uint16_t offset);
+extern uint16_t pci_read16(uint16_t segment, uint8_t bus, uint8_t dev,
+                           uint8_t fun, uint16_t offset);
+extern uint8_t pci_read8(uint16_t segment, uint8_t bus, uint8_t dev,
+                         uint8_t fun, uint16_t offset);
+extern void pci_write8(uint16_t segment, uint8_t bus, uint8_t dev, uint8_t fun,
+                       uint16_t offset, uint8_t value);
+extern bool pci_exists(uint16_t segment, uint8_t bus, uint8_t dev, uint8_t fun);
+extern bool pci_scan(uint16_t segment);
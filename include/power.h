@@ -0,0 +1,34 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+/*
+ * PM1 control register fields.
+ */
+#define ACPI_PM1_SCI_EN         (1 << 0)
+#define ACPI_PM1_SLP_TYP(typ)   ((typ) << 10)
+#define ACPI_PM1_SLP_TYP_MASK   (0x7 << 10)
+#define ACPI_PM1_SLP_EN         (1 << 13)
+
+/*
+ * Hardware-reduced ACPI sleep control register fields.
+ */
+#define ACPI_SLEEP_SLP_TYP(typ) (((typ) & 0x7) << 2)
+#define ACPI_SLEEP_SLP_EN       (1 << 5)
+
+/*
+ * Legacy reset mechanisms.
+ */
+#define KBC_COMMAND_PORT        0x64
+#define KBC_STATUS_INPUT_FULL   0x02
+#define KBC_COMMAND_RESET       0xfe
+#define RESET_CONTROL_PORT      0xcf9
+#define RESET_CONTROL_SYS_RST   0x02
+#define RESET_CONTROL_RST_CPU   0x04
+
+extern void power_reboot(void);
+extern void power_shutdown(void);
@@ -0,0 +1,13 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+extern bool prt_scan(void);
+extern const char *prt_pin_name(uint8_t pin);
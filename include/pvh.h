@@ -0,0 +1,66 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+/*
+ * Xen ELF note announcing the 32-bit PVH entry point, used by QEMU and Xen
+ * to boot the ELF file directly.
+ */
+#define PVH_ELFNOTE_PHYS32_ENTRY        18
+
+/*
+ * Magic value of the PVH start info structure, also passed in %eax by the
+ * PVH entry point to tell it apart from a multiboot2 boot.
+ */
+#define PVH_BOOT_MAGIC                  0x336ec578
+
+/* Further definitions only apply the C code. */
+#ifndef __ASM__
+
+#include <stdint.h>
+
+/*
+ * PVH start info structure, pointed to by %ebx on entry. The memory map is
+ * only present from version 1.
+ */
+struct pvh_start_info {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t flags;
+	uint32_t nr_modules;
+	uint64_t modlist_paddr;
+	uint64_t cmdline_paddr;
+	uint64_t rsdp_paddr;
+	uint64_t memmap_paddr;
+	uint32_t memmap_entries;
+	uint32_t reserved;
+} __attribute__((packed));
+
+/*
+ * PVH module list entry.
+ */
+struct pvh_module {
+	uint64_t paddr;
+	uint64_t size;
+	uint64_t cmdline_paddr;
+	uint64_t reserved;
+} __attribute__((packed));
+
+/*
+ * PVH memory map entry, with the same layout and E820 types as the multiboot2
+ * memory map entries.
+ */
+struct pvh_memmap_entry {
+	uint64_t addr;
+	uint64_t size;
+	uint32_t type;
+	uint32_t reserved;
+} __attribute__((packed));
+
+extern uint32_t pvh_to_multiboot2(uint32_t start_info_addr);
+
+#endif
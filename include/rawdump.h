@@ -0,0 +1,32 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Raw dump framing. The block holds one record per firmware blob, each one
+ * made of a header line followed by its base64 encoded data:
+ *
+ *     @<kind> <address> <size> <encoding> <crc32c>
+ *
+ * The size and the CRC32C are those of the original data. With the "rle"
+ * encoding, the data is run-length encoded before the base64 encoding: a
+ * control byte below 0x80 is followed by that many plus one literal bytes,
+ * otherwise the next byte is repeated the control byte minus 0x7d times.
+ */
+#define RAWDUMP_BEGIN           "-----BEGIN MACHINE RAW BLOCK-----"
+#define RAWDUMP_END             "-----END MACHINE RAW BLOCK-----"
+#define RAWDUMP_LINE_LENGTH     76
+
+#define RAWDUMP_RLE_MAX_LITERAL 128
+#define RAWDUMP_RLE_MIN_RUN     3
+#define RAWDUMP_RLE_MAX_RUN     130
+#define RAWDUMP_RLE_RUN         0x80
+
+extern bool rawdump(uint32_t info_addr);
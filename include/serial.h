@@ -6,21 +6,126 @@
 
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "fingerprint.h"
 #include "options.h"
 #include "utils.h"
 
+/*
+ * UART registers, as indices scaled by the register stride.
+ */
+#define UART_DATA               0
+#define UART_IER                1
+#define UART_FCR                2
+#define UART_LCR                3
+#define UART_MCR                4
+#define UART_LSR                5
+#define UART_MSR                6
+
+#define UART_LSR_DATA_READY     0x01
+#define UART_LSR_THR_EMPTY      0x20
+
+/*
+ * Serial configuration of a legacy PC serial port, at the default baud rate.
+ */
+#define SERIAL_CONFIG_PORT(port) {              \
+		.mmio   = false,                \
+		.base   = (port),               \
+		.stride = 1,                    \
+		.width  = 1,                    \
+		.clock  = CONFIG_SERIAL_CLOCK,  \
+		.baud   = CONFIG_SERIAL_BAUD,   \
+	}
+
+/*
+ * Window of the output, see serial_window_begin(). Only the characters in
+ * the window are sent, unless silent, and their CRC32C is computed. They are
+ * also stored in the capture buffer if there is one.
+ */
+struct serial_window {
+	bool     enabled;
+	bool     silent;
+	uint32_t pos;
+	uint32_t start;
+	uint32_t end;
+	uint32_t crc;
+	char     *capture;
+};
+
+#ifdef MACHINEDUMP_HOST
+/* The replay tool doesn't stream sections, every file gets a closed window. */
+static struct serial_window serial_window;
+#else
+extern struct serial_window serial_window;
+#endif
+
+/*
+ * Read and write a UART register, through the I/O ports or the memory mapped
+ * registers of the console.
+ */
+static inline uint8_t serial_in(uint32_t reg)
+{
+	if (!options.serial.mmio)
+		return in8(options.serial.base + reg);
+
+	uint32_t addr = options.serial.base + reg * options.serial.stride;
+	if (options.serial.width == 4)
+		return *(volatile uint32_t *) addr;
+	if (options.serial.width == 2)
+		return *(volatile uint16_t *) addr;
+	return *(volatile uint8_t *) addr;
+}
+
+static inline void serial_out(uint32_t reg, uint8_t value)
+{
+	if (!options.serial.mmio) {
+		out8(options.serial.base + reg, value);
+		return;
+	}
+
+	uint32_t addr = options.serial.base + reg * options.serial.stride;
+	if (options.serial.width == 4)
+		*(volatile uint32_t *) addr = value;
+	else if (options.serial.width == 2)
+		*(volatile uint16_t *) addr = value;
+	else
+		*(volatile uint8_t *) addr = value;
+}
+
+/*
+ * Output a single byte to the serial port, as is.
+ */
+static inline void serial_write(uint8_t ch)
+{
+	while ((serial_in(UART_LSR) & UART_LSR_THR_EMPTY) == 0)
+		;
+	serial_out(UART_DATA, ch);
+}
+
 /*
  * Output a single character to the serial port. Note that newlines "\n" are
- * transparently converted to "\r\n".
+ * transparently converted to "\r\n", the window only counts the "\n".
  */
 static inline void serial_putc(uint8_t ch)
 {
-	if (ch == '\n')
-		serial_putc('\r');
+	if (serial_window.enabled) {
+		uint32_t pos = serial_window.pos++;
+		if (pos < serial_window.start || pos >= serial_window.end)
+			return;
+		serial_window.crc = crc32c(serial_window.crc, &ch, 1);
+		if (serial_window.capture)
+			serial_window.capture[pos - serial_window.start] = ch;
+		if (serial_window.silent)
+			return;
+	}
 
-	while ((in8(options.serial_port + 5) & 0x20) == 0)
-		;
-	out8(options.serial_port, ch);
+	if (ch == '\n')
+		serial_write('\r');
+	serial_write(ch);
 }
 
 /*
@@ -32,5 +137,43 @@ static inline void serial_puts(const char *s)
 		serial_putc(*s++);
 }
 
+/*
+ * Only send the characters output from start to end, counting from here. A
+ * silent window sends nothing, to compute the length and CRC32C of output.
+ */
+static inline void serial_window_begin(uint32_t start, uint32_t end, bool silent)
+{
+	serial_window.pos = 0;
+	serial_window.start = start;
+	serial_window.end = end;
+	serial_window.crc = 0;
+	serial_window.silent = silent;
+	serial_window.capture = NULL;
+	serial_window.enabled = true;
+}
+
+/*
+ * Store the output in a buffer of the given size instead of sending it, the
+ * characters that don't fit are dropped.
+ */
+static inline void serial_capture_begin(char *buffer, uint32_t size)
+{
+	serial_window_begin(0, size, true);
+	serial_window.capture = buffer;
+}
+
+/*
+ * Close the window and return the CRC32C of the characters sent, and the
+ * number of characters output in total if requested.
+ */
+static inline uint32_t serial_window_end(uint32_t *length)
+{
+	serial_window.enabled = false;
+	if (length)
+		*length = serial_window.pos;
+	return serial_window.crc;
+}
+
 extern void serial_init(void);
+extern uint8_t serial_getc(void);
 extern void serial_printf(const char *fmt, ...);
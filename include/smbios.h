@@ -0,0 +1,154 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * SMBIOS 2.1 32-bit entry point structure, anchored by "_SM_".
+ */
+struct smbios_entry32 {
+	char     anchor[4];
+	uint8_t  checksum;
+	uint8_t  length;
+	uint8_t  major;
+	uint8_t  minor;
+	uint16_t max_struct_size;
+	uint8_t  revision;
+	uint8_t  formatted[5];
+	char     dmi_anchor[5];
+	uint8_t  dmi_checksum;
+	uint16_t table_length;
+	uint32_t table_address;
+	uint16_t num_structs;
+	uint8_t  bcd_revision;
+} __attribute__((packed));
+
+/*
+ * SMBIOS 3.0 64-bit entry point structure, anchored by "_SM3_".
+ */
+struct smbios_entry64 {
+	char     anchor[5];
+	uint8_t  checksum;
+	uint8_t  length;
+	uint8_t  major;
+	uint8_t  minor;
+	uint8_t  docrev;
+	uint8_t  revision;
+	uint8_t  reserved;
+	uint32_t table_max_size;
+	uint64_t table_address;
+} __attribute__((packed));
+
+/*
+ * Header of every SMBIOS structure. The formatted area is followed by the
+ * string set, terminated by two zero bytes.
+ */
+struct smbios_header {
+	uint8_t  type;
+	uint8_t  length;
+	uint16_t handle;
+} __attribute__((packed));
+
+enum smbios_type {
+	SMBIOS_TYPE_MEMORY_DEVICE        = 17,
+	SMBIOS_TYPE_MEMORY_ARRAY_MAPPED  = 19,
+	SMBIOS_TYPE_MEMORY_DEVICE_MAPPED = 20,
+	SMBIOS_TYPE_END                  = 127,
+};
+
+/*
+ * Memory Device (type 17), up to SMBIOS 3.3. Check the structure length
+ * before accessing the later fields.
+ */
+struct smbios_memory_device {
+	struct smbios_header header;
+	uint16_t array_handle;
+	uint16_t error_handle;
+	uint16_t total_width;
+	uint16_t data_width;
+	uint16_t size;
+	uint8_t  form_factor;
+	uint8_t  device_set;
+	uint8_t  device_locator;
+	uint8_t  bank_locator;
+	uint8_t  memory_type;
+	uint16_t type_detail;
+	uint16_t speed;
+	uint8_t  manufacturer;
+	uint8_t  serial_number;
+	uint8_t  asset_tag;
+	uint8_t  part_number;
+	uint8_t  attributes;
+	uint32_t extended_size;
+	uint16_t configured_speed;
+	uint16_t minimum_voltage;
+	uint16_t maximum_voltage;
+	uint16_t configured_voltage;
+	uint8_t  technology;
+	uint16_t operating_mode;
+	uint8_t  firmware_version;
+	uint16_t module_manufacturer;
+	uint16_t module_product;
+	uint16_t controller_manufacturer;
+	uint16_t controller_product;
+	uint64_t nonvolatile_size;
+	uint64_t volatile_size;
+	uint64_t cache_size;
+	uint64_t logical_size;
+	uint32_t extended_speed;
+	uint32_t extended_configured_speed;
+} __attribute__((packed));
+
+/* Special values of the memory device size and speed fields. */
+#define SMBIOS_SIZE_UNKNOWN     0xffff
+#define SMBIOS_SIZE_EXTENDED    0x7fff
+#define SMBIOS_SIZE_KB          0x8000
+#define SMBIOS_SPEED_EXTENDED   0xffff
+#define SMBIOS_ADDR_EXTENDED    0xffffffff
+
+/*
+ * Memory Array Mapped Address (type 19), in KiB unless extended.
+ */
+struct smbios_array_mapped {
+	struct smbios_header header;
+	uint32_t start;
+	uint32_t end;
+	uint16_t array_handle;
+	uint8_t  partition_width;
+	uint64_t extended_start;
+	uint64_t extended_end;
+} __attribute__((packed));
+
+/*
+ * Memory Device Mapped Address (type 20), in KiB unless extended.
+ */
+struct smbios_device_mapped {
+	struct smbios_header header;
+	uint32_t start;
+	uint32_t end;
+	uint16_t device_handle;
+	uint16_t array_mapped_handle;
+	uint8_t  partition_row;
+	uint8_t  interleave_position;
+	uint8_t  interleave_depth;
+	uint64_t extended_start;
+	uint64_t extended_end;
+} __attribute__((packed));
+
+/*
+ * Check whether a structure is long enough to hold a field.
+ */
+#define SMBIOS_HAS(s, field) \
+	((s)->header.length >= offsetof(typeof(*(s)), field) + sizeof ((s)->field))
+
+extern bool smbios_find_table(uint64_t *addr, uint32_t *size);
+extern bool smbios_scan(void);
+extern const char *smbios_memory_type_name(uint8_t type);
+extern const char *smbios_form_factor_name(uint8_t form_factor);
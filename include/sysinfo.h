@@ -6,59 +6,428 @@
 
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 #include "config.h"
+#include "mtrr.h"
 
 /**
- * System information structure.
+ * System information structure. The variable length lists are growable
+ * vectors backed by the arena, see vector_reserve().
  */
 struct sysinfo {
 
 	/* Memory regions. */
 	struct {
 		uint32_t count;
+		uint32_t capacity;
 		struct {
 			uint64_t addr;
 			uint64_t size;
-		} list[MAX_MEMORY_REGIONS];
+		} *list;
 	} memory;
 
+	/*
+	 * EFI memory map regions with notable attributes: runtime services,
+	 * specific-purpose or more reliable memory.
+	 */
+	struct {
+		uint32_t count;
+		uint32_t capacity;
+		struct {
+			uint64_t addr;
+			uint64_t size;
+			uint64_t attribute;
+			uint32_t type;
+		} *list;
+	} efi_memory;
+
 	/* ACPI Root System Description Table. */
 	struct {
 		uint32_t addr;
 	} rsdt;
 
+	/* ACPI Differentiated System Description Table, from the FADT. */
+	struct {
+		uint32_t addr;
+	} dsdt;
+
 	/* APIC. */
 	struct {
 		uint64_t addr;
+		bool     x2apic;
+		bool     x2apic_enabled;
 	} apic;
 
+	/* Processors, identified by their local APIC. */
+	struct {
+		uint32_t count;
+		uint32_t capacity;
+		struct {
+			uint32_t apic_id;
+			uint32_t uid;
+			uint32_t flags;
+		} *list;
+	} cpu;
+
+	/* Proximity domains of the processors, from the SRAT. */
+	struct {
+		uint32_t count;
+		uint32_t capacity;
+		struct {
+			uint32_t apic_id;
+			uint32_t domain;
+		} *list;
+	} cpu_affinity;
+
+	/* Proximity domains of the memory ranges, from the SRAT. */
+	struct {
+		uint32_t count;
+		uint32_t capacity;
+		struct {
+			uint64_t addr;
+			uint64_t size;
+			uint32_t domain;
+			uint32_t flags;
+		} *list;
+	} memory_affinity;
+
+	/* Features of the boot processor. */
+	struct {
+		char     vendor[13];
+		char     brand[49];
+		uint32_t family;
+		uint32_t model;
+		uint32_t stepping;
+		uint32_t phys_bits;
+		uint32_t virt_bits;
+		uint64_t features;       /* bitmap of enum cpu_feature */
+		uint64_t xsave_mask;
+		uint32_t xsave_size;
+		struct {
+			uint32_t size;
+			uint32_t offset;
+		} xsave_component[64];
+		uint32_t base_mhz;
+		uint32_t max_mhz;
+		uint32_t bus_mhz;
+		uint64_t tsc_hz;
+		uint32_t base_ratio;
+		uint64_t turbo_ratios;   /* one byte per number of active cores */
+		uint32_t hwp_caps;
+		uint32_t pmu_version;
+		uint32_t pmu_counters;
+		uint32_t pmu_counter_width;
+		uint32_t pmu_fixed_counters;
+		uint32_t pmu_fixed_counter_width;
+	} cpu_info;
+
+	/*
+	 * Processor idle states, from the MWAIT sub-states of CPUID leaf 5 and
+	 * the LPIT entries, with their wake latency in TSC cycles if measured.
+	 */
+	struct {
+		bool     mwait;
+		bool     break_on_interrupt;
+		uint16_t monitor_min;
+		uint16_t monitor_max;
+		uint32_t count;
+		uint32_t capacity;
+		struct {
+			uint32_t hint;           /* MWAIT hint, CSTATE_NO_HINT if none */
+			bool     lpit;
+			bool     disabled;
+			uint16_t uid;
+			uint32_t residency_us;
+			uint32_t latency_us;
+			bool     measured;
+			uint32_t wake_min;
+			uint32_t wake_max;
+		} *list;
+	} cstate;
+
+	/* Hypervisor interfaces, from the CPUID leaves at 0x40000000 and up. */
+	struct {
+		uint32_t count;
+		uint32_t capacity;
+		struct {
+			uint32_t base;
+			uint32_t max_leaf;
+			uint32_t vendor;         /* enum hypervisor_vendor */
+			char     signature[13];
+			uint32_t version;        /* major << 16 | minor, 0 if unknown */
+			uint32_t tsc_khz;
+			uint32_t apic_khz;
+			uint64_t features;       /* bitmap of enum hypervisor_feature */
+		} *list;
+	} hypervisor;
+
 	/* I/O APICs. */
 	struct {
 		uint32_t count;
-		uint32_t addr[MAX_NUM_IOAPICS];
+		uint32_t capacity;
+		struct {
+			uint32_t addr;
+			uint32_t gsi_base;
+			uint8_t  id;
+			uint8_t  version;
+			uint8_t  num_entries;
+		} *list;
 	} ioapic;
 
+	/* Interrupt source overrides. */
+	struct {
+		uint32_t count;
+		uint32_t capacity;
+		struct {
+			uint32_t gsi;
+			uint16_t flags;
+			uint8_t  bus;
+			uint8_t  source;
+		} *list;
+	} int_override;
+
+	/*
+	 * NMI sources, either wired to an I/O APIC input (GSI) or to a local APIC
+	 * LINT pin of the processor(s) designated by their ACPI UID.
+	 */
+	struct {
+		uint32_t count;
+		uint32_t capacity;
+		struct {
+			bool     lapic;
+			uint32_t gsi;
+			uint32_t uid;
+			uint16_t flags;
+			uint8_t  lint;
+		} *list;
+	} nmi;
+
+	/* PCI interrupt routing, from the _PRT objects of the ACPI namespace. */
+	struct {
+		uint32_t count;
+		uint32_t capacity;
+		struct {
+			uint32_t gsi;
+			uint16_t segment;
+			uint16_t flags;
+			uint8_t  bus;
+			uint8_t  device;
+			uint8_t  pin;
+			char     link[5];
+		} *list;
+	} prt;
+
+	/* PCI memory mapped configuration spaces. */
+	struct {
+		uint32_t count;
+		uint32_t capacity;
+		struct {
+			uint64_t addr;
+			uint16_t segment;
+			uint8_t  start_bus;
+			uint8_t  end_bus;
+		} *list;
+	} pci;
+
 	/* DMA Remapping Hardware Units. */
 	struct {
 		uint32_t count;
-		uint32_t addr[MAX_NUM_DRHUS];
+		uint32_t capacity;
+		struct {
+			uint64_t addr;
+			uint16_t segment;
+			bool     include_pci_all;
+			bool     cap_unknown;    /* registers above 4GiB, out of reach */
+			uint64_t cap;
+			uint64_t ecap;
+		} *list;
 	} drhu;
 
+	/* DRHD device scopes, resolved to their PCI requester IDs. */
+	struct {
+		uint32_t count;
+		uint32_t capacity;
+		struct {
+			uint32_t drhu;
+			uint8_t  type;
+			uint8_t  enum_id;
+			uint16_t devid;
+			uint8_t  secondary_bus;
+			uint8_t  subordinate_bus;
+		} *list;
+	} devscope;
+
+	/*
+	 * PCI functions of the segments behind the DRHUs, with the DRHU that
+	 * translates their DMA and their isolation group, identified by the
+	 * index of its first function.
+	 */
+	struct {
+		uint32_t count;
+		uint32_t capacity;
+		struct {
+			uint32_t parent;
+			uint32_t drhu;
+			uint32_t group;
+			uint16_t segment;
+			uint16_t devid;
+			uint16_t class;
+			uint16_t acs_cap;
+			uint16_t acs_ctrl;
+			uint8_t  pcie_type;
+			uint8_t  secondary_bus;
+			uint8_t  subordinate_bus;
+			bool     bridge;
+			bool     multifunction;
+			bool     acs;
+		} *list;
+	} pcidev;
+
 	/* Reserved memory Region Reporting structures. */
 	struct {
 		uint32_t count;
+		uint32_t capacity;
 		struct {
-			uint32_t addr;
-			uint32_t limit;
-			uint32_t devid;
-		} list[MAX_NUM_RMRRS];
+			uint64_t addr;
+			uint64_t limit;
+			uint16_t segment;
+			uint16_t devid;
+		} *list;
 	} rmrr;
 
+	/* AMD IOMMUs, from the IVRS IVHD blocks. */
+	struct {
+		uint32_t count;
+		uint32_t capacity;
+		struct {
+			uint64_t addr;
+			uint64_t efr;
+			uint16_t segment;
+			uint16_t devid;
+			uint16_t cap_offset;
+			uint8_t  type;
+			uint8_t  flags;
+		} *list;
+	} ivhd;
+
+	/* Devices behind the AMD IOMMUs, as ranges of requester IDs. */
+	struct {
+		uint32_t count;
+		uint32_t capacity;
+		struct {
+			uint32_t ivhd;
+			uint16_t first;
+			uint16_t last;
+			uint16_t alias;
+			uint8_t  type;
+			uint8_t  handle;
+			uint8_t  variety;
+		} *list;
+	} ivhd_dev;
+
+	/* IVRS memory definitions (unity mapped and exclusion ranges). */
+	struct {
+		uint32_t count;
+		uint32_t capacity;
+		struct {
+			uint64_t addr;
+			uint64_t size;
+			uint16_t first;
+			uint16_t last;
+			uint8_t  flags;
+		} *list;
+	} ivmd;
+
+	/* AMD-Vi. */
+	struct {
+		uint32_t num_iopt_levels;
+	} amdvi;
+
 	/* VT-d. */
 	struct {
 		uint32_t num_iopt_levels;
+		uint32_t superpages;
 	} vtd;
+
+	/* Reset and sleep controls, from the FADT. */
+	struct {
+		bool     fadt;
+		bool     hw_reduced;
+		bool     reset_reg;
+		uint8_t  reset_space;
+		uint8_t  reset_value;
+		uint64_t reset_addr;
+		uint16_t smi_cmd;
+		uint8_t  acpi_enable;
+		uint16_t pm1a_cnt;
+		uint16_t pm1b_cnt;
+		uint8_t  sleep_control_space;
+		uint64_t sleep_control;
+		bool     s5;
+		uint8_t  slp_typa;
+		uint8_t  slp_typb;
+	} power;
+
+	/* Memory devices, from the SMBIOS type 17 structures. */
+	struct {
+		uint32_t count;
+		uint32_t capacity;
+		struct {
+			uint64_t size;           /* bytes, 0 for an empty slot */
+			uint32_t speed;          /* MT/s */
+			uint32_t configured_speed;
+			uint16_t handle;
+			uint16_t array;
+			uint16_t total_width;
+			uint16_t data_width;
+			uint8_t  type;
+			uint8_t  form_factor;
+			uint8_t  ranks;
+			char     locator[32];
+			char     bank_locator[32];
+			char     manufacturer[32];
+			char     part_number[32];
+		} *list;
+	} dimm;
+
+	/*
+	 * Physical address ranges of the memory devices (type 20) or, when the
+	 * firmware doesn't describe them, of the memory arrays (type 19).
+	 */
+	struct {
+		uint32_t count;
+		uint32_t capacity;
+		struct {
+			uint64_t addr;
+			uint64_t size;
+			uint16_t handle;         /* device or array handle */
+			bool     device;
+			uint8_t  interleave_position;
+			uint8_t  interleave_depth;
+		} *list;
+	} dimm_range;
+
+	/* Memory type range registers and page attribute table. */
+	struct {
+		bool     supported;
+		bool     enabled;
+		bool     fixed_enabled;
+		bool     pat_supported;
+		uint8_t  default_type;
+		uint8_t  fixed[MTRR_NUM_FIXED];
+		uint64_t phys_mask;
+		uint64_t pat;
+		struct {
+			uint32_t count;
+			uint32_t capacity;
+			struct {
+				uint64_t base;
+				uint64_t size;
+				uint8_t  type;
+			} *list;
+		} var;
+	} mtrr;
 };
 
 /* Global system information data. */
@@ -16,7 +16,7 @@
 static inline char memcmp(char *m1, char *m2, uint32_t len)
 {
 	while (len--)
-		if (*m2 != *m1)
+		if (*m2++ != *m1++)
 			return 1;
 	return 0;
 }
@@ -75,6 +75,74 @@ static inline bool strtou64(char *str, uint64_t *val)
 	return true;
 }
 
+/*
+ * Split a string into space-separated tokens and return the first token. The
+ * input string is modified in place to insert string terminating 0 bytes, and
+ * the string pointer is moved to the end of the token on success to be called
+ * iteratively.
+ */
+static inline char *get_token(char **string)
+{
+	/* Strip any leading space. */
+	char *token = *string;
+	while (*token == ' ')
+		token++;
+
+	/* Jump past the token and zero-terminate it. */
+	char *end = token;
+	while (*end) {
+		if (*end == ' ') {
+			*end++ = 0;
+			break;
+		}
+		end++;
+	}
+
+	/* Return NULL when there aren't any more tokens. */
+	if (end == token)
+		return NULL;
+
+	/* Otherwise return the token and bump the string pointer. */
+	*string = end;
+	return token;
+}
+
+/*
+ * Unsigned 64-bit division, without relying on the compiler runtime.
+ */
+static inline uint64_t divide64(uint64_t dividend, uint64_t divisor, uint64_t *remainder)
+{
+	uint64_t quotient = 0, rem = 0;
+
+	for (int i = 63; i >= 0; i--) {
+		rem = (rem << 1) | ((dividend >> i) & 1);
+		if (rem >= divisor) {
+			rem -= divisor;
+			quotient |= 1ULL << i;
+		}
+	}
+	*remainder = rem;
+	return quotient;
+}
+
+/*
+ * Port, MSR and TSC accesses. The host build of the replay tool runs without
+ * hardware and provides its own versions of these.
+ */
+#ifdef MACHINEDUMP_HOST
+
+extern uint8_t in8(uint16_t port);
+extern void out8(uint16_t port, uint8_t value);
+extern uint16_t in16(uint16_t port);
+extern void out16(uint16_t port, uint16_t value);
+extern uint32_t in32(uint16_t port);
+extern void out32(uint16_t port, uint32_t value);
+extern uint64_t rdmsr(uint32_t msr);
+extern void wrmsr(uint32_t msr, uint64_t value);
+extern uint64_t rdtsc(void);
+
+#else
+
 static inline uint8_t in8 (uint16_t port)
 {
 	uint8_t value;
@@ -86,3 +154,57 @@ static inline void out8 (uint16_t port, uint8_t value)
 {
 	__asm__ __volatile__ ("outb %b0,%w1": :"a" (value), "Nd" (port));
 }
+
+static inline uint16_t in16 (uint16_t port)
+{
+	uint16_t value;
+	__asm__ __volatile__ ("inw %w1,%0":"=a" (value):"Nd" (port));
+	return value;
+}
+
+static inline void out16 (uint16_t port, uint16_t value)
+{
+	__asm__ __volatile__ ("outw %w0,%w1": :"a" (value), "Nd" (port));
+}
+
+static inline uint32_t in32 (uint16_t port)
+{
+	uint32_t value;
+	__asm__ __volatile__ ("inl %w1,%0":"=a" (value):"Nd" (port));
+	return value;
+}
+
+static inline void out32 (uint16_t port, uint32_t value)
+{
+	__asm__ __volatile__ ("outl %0,%w1": :"a" (value), "Nd" (port));
+}
+
+static inline uint64_t rdmsr(uint32_t msr)
+{
+	uint32_t lo, hi;
+	__asm__ __volatile__ ("rdmsr":"=a" (lo), "=d" (hi):"c" (msr));
+	return ((uint64_t) hi << 32) | lo;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t value)
+{
+	__asm__ __volatile__ ("wrmsr": :"c" (msr), "a" ((uint32_t) value),
+	                      "d" ((uint32_t) (value >> 32)));
+}
+
+static inline uint64_t rdtsc(void)
+{
+	uint32_t lo, hi;
+	__asm__ __volatile__ ("rdtsc":"=a" (lo), "=d" (hi));
+	return ((uint64_t) hi << 32) | lo;
+}
+
+#endif
+
+static inline void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t *eax,
+                         uint32_t *ebx, uint32_t *ecx, uint32_t *edx)
+{
+	__asm__ __volatile__ ("cpuid"
+	                      :"=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx)
+	                      :"a" (leaf), "c" (subleaf));
+}
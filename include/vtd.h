@@ -7,5 +7,32 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Capability register fields.
+ */
+#define VTD_CAP_ND(cap)         ((uint32_t) (cap) & 0x7)
+#define VTD_CAP_SAGAW(cap)      ((uint32_t) ((cap) >> 8) & 0x1f)
+#define VTD_CAP_MGAW(cap)       (((uint32_t) ((cap) >> 16) & 0x3f) + 1)
+#define VTD_CAP_SLLPS(cap)      ((uint32_t) ((cap) >> 34) & 0xf)
+#define VTD_CAP_PSI(cap)        ((uint32_t) ((cap) >> 39) & 0x1)
+#define VTD_CAP_NFR(cap)        (((uint32_t) ((cap) >> 40) & 0xff) + 1)
+
+#define VTD_SLLPS_2M            0x1
+#define VTD_SLLPS_1G            0x2
+
+/*
+ * Extended capability register fields.
+ */
+#define VTD_ECAP_C(ecap)        ((uint32_t) (ecap) & 0x1)
+#define VTD_ECAP_QI(ecap)       ((uint32_t) ((ecap) >> 1) & 0x1)
+#define VTD_ECAP_IR(ecap)       ((uint32_t) ((ecap) >> 3) & 0x1)
+#define VTD_ECAP_EIM(ecap)      ((uint32_t) ((ecap) >> 4) & 0x1)
+#define VTD_ECAP_PT(ecap)       ((uint32_t) ((ecap) >> 6) & 0x1)
+#define VTD_ECAP_SC(ecap)       ((uint32_t) ((ecap) >> 7) & 0x1)
+
+/* DRHU of the PCI functions that no DRHU translates. */
+#define VTD_NO_DRHU             0xffffffff
 
 extern bool vtd_scan(void);
@@ -8,8 +8,40 @@
 #include <stdint.h>
 
 #include "acpi.h"
+#include "aml.h"
+#include "arena.h"
+#include "parser.h"
+#include "pci.h"
 #include "serial.h"
 #include "sysinfo.h"
+#include "utils.h"
+
+/*
+ * Record a processor from a MADT local APIC or local x2APIC entry.
+ */
+static bool add_cpu(uint32_t apic_id, uint32_t uid, uint32_t flags)
+{
+	/* Some firmwares describe the same processor with both entry types. */
+	for (uint32_t i = 0; i < sysinfo.cpu.count; i++)
+		if (sysinfo.cpu.list[i].apic_id == apic_id)
+			return true;
+
+	/* Processors that can never be brought up are of no interest. */
+	if (!(flags & (ACPI_MADT_LAPIC_ENABLED | ACPI_MADT_LAPIC_ONLINE_CAPABLE)))
+		return true;
+
+	/* Populate the sysinfo structure. */
+	if (!vector_reserve(&sysinfo.cpu))
+		return false;
+	sysinfo.cpu.list[sysinfo.cpu.count].apic_id = apic_id;
+	sysinfo.cpu.list[sysinfo.cpu.count].uid     = uid;
+	sysinfo.cpu.list[sysinfo.cpu.count].flags   = flags;
+	sysinfo.cpu.count++;
+	serial_printf("[*] CPU #%d found with APIC ID %d%s\n",
+	              sysinfo.cpu.count, apic_id,
+	              flags & ACPI_MADT_LAPIC_ENABLED ? "" : " (disabled)");
+	return true;
+}
 
 /*
  * Parse MADT I/O APIC entries.
@@ -17,16 +49,139 @@
 static bool parse_madt_ioapic(struct acpi_madt_ioapic *ioapic)
 {
 	/* Populate the sysinfo structure. */
-	if (sysinfo.ioapic.count == MAX_NUM_IOAPICS) {
-		serial_puts("[!] Warning: too many IOAPICs, ignoring.\n");
-		return true;
-	}
-	sysinfo.ioapic.addr[sysinfo.ioapic.count++] = ioapic->address;
-	serial_printf("[*] I/O APIC #%d found at %X\n",
+	if (!vector_reserve(&sysinfo.ioapic))
+		return false;
+	sysinfo.ioapic.list[sysinfo.ioapic.count].addr     = ioapic->address;
+	sysinfo.ioapic.list[sysinfo.ioapic.count].gsi_base = ioapic->gsib;
+	sysinfo.ioapic.list[sysinfo.ioapic.count].id       = ioapic->apic_id;
+	sysinfo.ioapic.count++;
+	serial_printf("[*] I/O APIC #%d found at %x (GSI base %d)\n",
 	              sysinfo.ioapic.count,
-	              ioapic->address);
+	              ioapic->address,
+	              ioapic->gsib);
+	return true;
+}
+PARSER(PARSER_MADT, ACPI_MADT_TYPE_IOAPIC, parse_madt_ioapic);
+
+/*
+ * Parse MADT interrupt source override entries.
+ */
+static bool parse_madt_int_override(struct acpi_madt_int_override *iso)
+{
+	/* Populate the sysinfo structure. */
+	if (!vector_reserve(&sysinfo.int_override))
+		return false;
+	sysinfo.int_override.list[sysinfo.int_override.count].bus    = iso->bus;
+	sysinfo.int_override.list[sysinfo.int_override.count].source = iso->source;
+	sysinfo.int_override.list[sysinfo.int_override.count].gsi    = iso->gsi;
+	sysinfo.int_override.list[sysinfo.int_override.count].flags  = iso->flags;
+	sysinfo.int_override.count++;
+	serial_printf("[*] IRQ %d overridden to GSI %d\n", iso->source, iso->gsi);
+	return true;
+}
+PARSER(PARSER_MADT, ACPI_MADT_TYPE_INT_OVERRIDE, parse_madt_int_override);
+
+/*
+ * Record an NMI source.
+ */
+static bool add_nmi(bool lapic, uint32_t gsi, uint32_t uid, uint8_t lint, uint16_t flags)
+{
+	if (!vector_reserve(&sysinfo.nmi))
+		return false;
+	sysinfo.nmi.list[sysinfo.nmi.count].lapic = lapic;
+	sysinfo.nmi.list[sysinfo.nmi.count].gsi   = gsi;
+	sysinfo.nmi.list[sysinfo.nmi.count].uid   = uid;
+	sysinfo.nmi.list[sysinfo.nmi.count].lint  = lint;
+	sysinfo.nmi.list[sysinfo.nmi.count].flags = flags;
+	sysinfo.nmi.count++;
+	return true;
+}
+
+/*
+ * Parse MADT local APIC entries.
+ */
+static bool parse_madt_lapic(struct acpi_madt_lapic *lapic)
+{
+	return add_cpu(lapic->apic_id, lapic->uid, lapic->flags);
+}
+PARSER(PARSER_MADT, ACPI_MADT_TYPE_LAPIC, parse_madt_lapic);
+
+/*
+ * Parse MADT local x2APIC entries.
+ */
+static bool parse_madt_x2apic(struct acpi_madt_x2apic *x2apic)
+{
+	return add_cpu(x2apic->apic_id, x2apic->uid, x2apic->flags);
+}
+PARSER(PARSER_MADT, ACPI_MADT_TYPE_X2APIC, parse_madt_x2apic);
+
+/*
+ * Parse the MADT 64-bit APIC address override.
+ */
+static bool parse_madt_lapic_addr(struct acpi_madt_lapic_addr *lapic_addr)
+{
+	sysinfo.apic.addr = lapic_addr->address;
+	serial_printf("[*] APIC address overridden to %X\n", sysinfo.apic.addr);
 	return true;
 }
+PARSER(PARSER_MADT, ACPI_MADT_TYPE_LAPIC_ADDR, parse_madt_lapic_addr);
+
+/*
+ * Parse MADT NMI source entries.
+ */
+static bool parse_madt_nmi_source(struct acpi_madt_nmi_source *nmi)
+{
+	return add_nmi(false, nmi->gsi, 0, 0, nmi->flags);
+}
+PARSER(PARSER_MADT, ACPI_MADT_TYPE_NMI_SOURCE, parse_madt_nmi_source);
+
+/*
+ * Parse MADT local APIC NMI entries.
+ */
+static bool parse_madt_lapic_nmi(struct acpi_madt_lapic_nmi *nmi)
+{
+	return add_nmi(true, 0, nmi->uid == 0xff ? 0xffffffff : nmi->uid, nmi->lint, nmi->flags);
+}
+PARSER(PARSER_MADT, ACPI_MADT_TYPE_LAPIC_NMI, parse_madt_lapic_nmi);
+
+/*
+ * Parse MADT local x2APIC NMI entries.
+ */
+static bool parse_madt_x2apic_nmi(struct acpi_madt_x2apic_nmi *nmi)
+{
+	return add_nmi(true, 0, nmi->uid, nmi->lint, nmi->flags);
+}
+PARSER(PARSER_MADT, ACPI_MADT_TYPE_X2APIC_NMI, parse_madt_x2apic_nmi);
+
+/*
+ * Return a printable name for the polarity of MPS INTI flags.
+ */
+const char *madt_polarity_name(uint16_t flags)
+{
+	switch (ACPI_MADT_POLARITY(flags)) {
+	case ACPI_MADT_POLARITY_ACTIVE_HIGH:
+		return "high";
+	case ACPI_MADT_POLARITY_ACTIVE_LOW:
+		return "low";
+	default:
+		return "conforms";
+	}
+}
+
+/*
+ * Return a printable name for the trigger mode of MPS INTI flags.
+ */
+const char *madt_trigger_name(uint16_t flags)
+{
+	switch (ACPI_MADT_TRIGGER(flags)) {
+	case ACPI_MADT_TRIGGER_EDGE:
+		return "edge";
+	case ACPI_MADT_TRIGGER_LEVEL:
+		return "level";
+	default:
+		return "conforms";
+	}
+}
 
 /*
  * Parse the Multiple APIC Description Table (MADT).
@@ -49,9 +204,8 @@ static bool parse_madt(struct acpi_madt *madt)
 			break;
 		}
 
-		/* Catch I/O APICs. */
-		if (header->type == ACPI_MADT_TYPE_IOAPIC &&
-		    !parse_madt_ioapic((struct acpi_madt_ioapic *) header))
+		/* Pass the entry to its parser. */
+		if (!parser_dispatch(PARSER_MADT, header->type, header))
 			return false;
 
 		/* Jump to the next entry. */
@@ -61,80 +215,231 @@ static bool parse_madt(struct acpi_madt *madt)
 	return true;
 }
 
+/*
+ * Return a printable name for a DMAR device scope type.
+ */
+const char *dmar_devscope_type_name(uint8_t type)
+{
+	switch (type) {
+	case ACPI_DMAR_SCOPE_TYPE_ENDPOINT:
+		return "endpoint";
+	case ACPI_DMAR_SCOPE_TYPE_BRIDGE:
+		return "bridge";
+	case ACPI_DMAR_SCOPE_TYPE_IOAPIC:
+		return "ioapic";
+	case ACPI_DMAR_SCOPE_TYPE_HPET:
+		return "hpet";
+	case ACPI_DMAR_SCOPE_TYPE_NAMESPACE:
+		return "namespace";
+	default:
+		return "unknown";
+	}
+}
+
+/*
+ * Return the next device scope following a DMAR entry header, or NULL when the
+ * end of the entry has been reached.
+ */
+static struct acpi_dmar_devscope *next_devscope(struct acpi_dmar_header *header,
+                                                struct acpi_dmar_devscope *devscope,
+                                                uint32_t hdrsize)
+{
+	char *end = (char *) header + header->length;
+
+	if (devscope == NULL)
+		devscope = (void *) ((char *) header + hdrsize);
+	else if (devscope->length == 0)
+		return NULL;
+	else
+		devscope = (void *) ((char *) devscope + devscope->length);
+
+	if ((char *) devscope + sizeof (*devscope) > end ||
+	    (char *) devscope + devscope->length > end)
+		return NULL;
+	if (devscope->length < sizeof (*devscope)) {
+		serial_puts("[!] Warning: ACPI: DMAR device scope too short, ignoring the rest of the entry\n");
+		return NULL;
+	}
+	return devscope;
+}
+
+/*
+ * Resolve the bus, device and function numbers of a DMAR device scope. Every
+ * hop of the path but the last designates a bridge, whose secondary bus is
+ * where the next hop is located.
+ */
+static bool resolve_devscope(uint16_t segment, struct acpi_dmar_devscope *devscope,
+                             uint8_t *bus, uint8_t *dev, uint8_t *fun)
+{
+	if (devscope->length < sizeof (*devscope) + sizeof (devscope->path[0])) {
+		serial_puts("[!] Warning: ACPI: DMAR device scope without a path, ignoring\n");
+		return false;
+	}
+	int nhops = (devscope->length - sizeof (*devscope)) / sizeof (devscope->path[0]);
+
+	*bus = devscope->start_bus;
+	for (int i = 0; i < nhops; i++) {
+		*dev = devscope->path[i].dev;
+		*fun = devscope->path[i].fun;
+
+		if (i + 1 == nhops)
+			break;
+
+		if (!pci_exists(segment, *bus, *dev, *fun)) {
+			serial_printf("[!] Warning: ACPI: DMAR device scope: bridge %d:%d.%d not found, ignoring\n",
+			              *bus, *dev, *fun);
+			return false;
+		}
+		*bus = pci_read8(segment, *bus, *dev, *fun, PCI_SECONDARY_BUS);
+	}
+
+	return true;
+}
+
 /*
  * Parse DMAR DRHD entries.
  */
 static bool parse_dmar_drhd(struct acpi_dmar_drhd *drhd)
 {
 	/* Populate the sysinfo structure. */
-	if (sysinfo.drhu.count == MAX_NUM_DRHUS) {
-		serial_puts("[X] Error: too many DRHUs, please raise the limit\n");
+	if (!vector_reserve(&sysinfo.drhu))
 		return false;
-	}
-	sysinfo.drhu.addr[sysinfo.drhu.count++] = drhd->reg_base[0];
-	serial_printf("[*] DRHU #%d found at %x\n",
+	uint32_t id = sysinfo.drhu.count++;
+	sysinfo.drhu.list[id].addr            = (uint64_t) drhd->reg_base[1] << 32 | drhd->reg_base[0];
+	sysinfo.drhu.list[id].segment         = drhd->segment;
+	sysinfo.drhu.list[id].include_pci_all = drhd->flags & ACPI_DMAR_DRHD_FLAG_INCLUDE_PCI_ALL;
+	serial_printf("[*] DRHU #%d found at %X (segment %d%s)\n",
 	              sysinfo.drhu.count,
-	              drhd->reg_base[0]);
+	              sysinfo.drhu.list[id].addr,
+	              drhd->segment,
+	              sysinfo.drhu.list[id].include_pci_all ? ", all devices" : "");
+
+	/* Walk the list of device scopes. */
+	struct acpi_dmar_devscope *devscope = NULL;
+	while ((devscope = next_devscope(&drhd->header, devscope, sizeof (*drhd)))) {
+		uint8_t bus, dev, fun;
+
+		if (devscope->type == ACPI_DMAR_SCOPE_TYPE_NOT_USED ||
+		    devscope->type >= ACPI_DMAR_SCOPE_TYPE_RESERVED) {
+			serial_printf("[!] Warning: ACPI: DRHD device scope type %d not supported, ignoring\n",
+			              devscope->type);
+			continue;
+		}
+		if (!resolve_devscope(drhd->segment, devscope, &bus, &dev, &fun))
+			continue;
+
+		if (!vector_reserve(&sysinfo.devscope))
+			return false;
+		uint32_t n = sysinfo.devscope.count++;
+		sysinfo.devscope.list[n].drhu    = id;
+		sysinfo.devscope.list[n].type    = devscope->type;
+		sysinfo.devscope.list[n].enum_id = devscope->enum_id;
+		sysinfo.devscope.list[n].devid   = PCI_DEVID(bus, dev, fun);
+
+		/* Bridges cover their whole subordinate bus range. */
+		if (devscope->type == ACPI_DMAR_SCOPE_TYPE_BRIDGE) {
+			sysinfo.devscope.list[n].secondary_bus =
+				pci_read8(drhd->segment, bus, dev, fun, PCI_SECONDARY_BUS);
+			sysinfo.devscope.list[n].subordinate_bus =
+				pci_read8(drhd->segment, bus, dev, fun, PCI_SUBORDINATE_BUS);
+		}
+
+		serial_printf("[*] DRHU #%d scope: %s %d:%d.%d\n",
+		              id + 1, dmar_devscope_type_name(devscope->type),
+		              bus, dev, fun);
+	}
 
 	return true;
 }
+PARSER(PARSER_DMAR, ACPI_DMAR_TYPE_DRHD, parse_dmar_drhd);
 
 /*
- * Parse DMAR RMRR entries.
+ * Add an RMRR entry for a single PCI requester ID.
  */
-static bool parse_dmar_rmrr(struct acpi_dmar_rmrr *rmrr)
+static bool add_rmrr(struct acpi_dmar_rmrr *rmrr, uint16_t devid)
 {
-	serial_puts("[*] ACPI: DMAR: RMRR table found\n");
+	if (!vector_reserve(&sysinfo.rmrr))
+		return false;
+	sysinfo.rmrr.list[sysinfo.rmrr.count].addr    = rmrr->reg_base;
+	sysinfo.rmrr.list[sysinfo.rmrr.count].limit   = rmrr->reg_limit;
+	sysinfo.rmrr.list[sysinfo.rmrr.count].segment = rmrr->segment;
+	sysinfo.rmrr.list[sysinfo.rmrr.count].devid   = devid;
+	sysinfo.rmrr.count++;
+
+	serial_printf("[*] RMRR #%d found at %X for device %d:%d.%d\n",
+	              sysinfo.rmrr.count, rmrr->reg_base,
+	              devid >> 8, (devid >> 3) & 0x1f, devid & 7);
+	return true;
+}
 
-	/* Validate the entry. */
-	if (rmrr->reg_base[1] != 0 || rmrr->reg_limit[1] != 0) {
-		serial_puts("[!] Warning: ACPI: RMRR device above 4GiB, disabling IOMMU support\n");
-		sysinfo.drhu.count = 0;
-		sysinfo.rmrr.count = 0;
+/*
+ * Add RMRR entries for a bridge and for every function present below it. The
+ * RMRR consumers only deal with single requester IDs, so a bridge scope is
+ * expanded into the devices it covers.
+ */
+static bool add_rmrr_bridge(struct acpi_dmar_rmrr *rmrr, uint8_t bus, uint8_t dev, uint8_t fun)
+{
+	if (!add_rmrr(rmrr, PCI_DEVID(bus, dev, fun)))
+		return false;
+
+	uint8_t secondary   = pci_read8(rmrr->segment, bus, dev, fun, PCI_SECONDARY_BUS);
+	uint8_t subordinate = pci_read8(rmrr->segment, bus, dev, fun, PCI_SUBORDINATE_BUS);
+	if (secondary == 0 || secondary > subordinate)
 		return true;
+
+	for (uint32_t b = secondary; b <= subordinate; b++) {
+		for (uint8_t d = 0; d < 32; d++) {
+			for (uint8_t f = 0; f < 8; f++) {
+				if (!pci_exists(rmrr->segment, b, d, f)) {
+					if (f == 0)
+						break;
+					continue;
+				}
+				if (!add_rmrr(rmrr, PCI_DEVID(b, d, f)))
+					return false;
+				if (f == 0 && !(pci_read8(rmrr->segment, b, d, f, PCI_HEADER_TYPE)
+				                & PCI_HEADER_TYPE_MULTI))
+					break;
+			}
+		}
 	}
+	return true;
+}
+
+/*
+ * Parse DMAR RMRR entries.
+ */
+static bool parse_dmar_rmrr(struct acpi_dmar_rmrr *rmrr)
+{
+	serial_puts("[*] ACPI: DMAR: RMRR table found\n");
 
 	/* Walk the list of device scopes. */
-	int devmax = (rmrr->header.length - sizeof (*rmrr)) / sizeof (rmrr->devscope[0]);
-	for (int i = 0; i <= devmax; i++) {
-		struct acpi_dmar_rmrr_devscope *devscope = &rmrr->devscope[i];
-
-		/* Check the device scope type. */
-		if (devscope->type != ACPI_DMAR_SCOPE_TYPE_ENDPOINT) {
-			serial_puts("[!] Warning: ACPI: RMRR device scope: type not supported, disabling IOMMU support\n");
-			sysinfo.drhu.count = 0;
-			sysinfo.rmrr.count = 0;
-			return true;
-		}
+	struct acpi_dmar_devscope *devscope = NULL;
+	while ((devscope = next_devscope(&rmrr->header, devscope, sizeof (*rmrr)))) {
+		uint8_t bus, dev, fun;
 
-		/* Check the device scope size. */
-		if (devscope->length != sizeof (*devscope)) {
-			serial_puts("[!] Warning: ACPI: RMRR device scope: bridges not supported, disabling IOMMU support\n");
-			sysinfo.drhu.count = 0;
-			sysinfo.rmrr.count = 0;
-			return true;
+		/* Only PCI devices can be the target of an RMRR. */
+		if (devscope->type != ACPI_DMAR_SCOPE_TYPE_ENDPOINT &&
+		    devscope->type != ACPI_DMAR_SCOPE_TYPE_BRIDGE) {
+			serial_printf("[!] Warning: ACPI: RMRR device scope type %s not supported, ignoring\n",
+			              dmar_devscope_type_name(devscope->type));
+			continue;
 		}
+		if (!resolve_devscope(rmrr->segment, devscope, &bus, &dev, &fun))
+			continue;
 
 		/* Populate the sysinfo structure. */
-		if (sysinfo.rmrr.count == MAX_NUM_RMRRS) {
-			serial_puts("[X] Error: too many RMRRs, please raise the limit\n");
+		if (devscope->type == ACPI_DMAR_SCOPE_TYPE_BRIDGE) {
+			if (!add_rmrr_bridge(rmrr, bus, dev, fun))
+				return false;
+		} else if (!add_rmrr(rmrr, PCI_DEVID(bus, dev, fun))) {
 			return false;
 		}
-		sysinfo.rmrr.list[sysinfo.rmrr.count].addr  = rmrr->reg_base[0];
-		sysinfo.rmrr.list[sysinfo.rmrr.count].limit = rmrr->reg_limit[0];
-		sysinfo.rmrr.list[sysinfo.rmrr.count].devid = 0 \
-			| (devscope->start_bus   << 8)          \
-			| (devscope->path[0].dev << 3)          \
-			| (devscope->path[0].fun << 0);
-		sysinfo.rmrr.count++;
-
-		serial_printf("[*] RMRR #%d found at %x\n",
-		              sysinfo.rmrr.count,
-		              rmrr->reg_base[0]);
 	}
 
 	return true;
 }
+PARSER(PARSER_DMAR, ACPI_DMAR_TYPE_RMRR, parse_dmar_rmrr);
 
 /*
  * Parse the Intel DMA Remapping table (DMAR).
@@ -153,14 +458,365 @@ static bool parse_dmar(struct acpi_dmar *dmar)
 			break;
 		}
 
-		/* Catch DHRDs. */
-		if (header->type == ACPI_DMAR_TYPE_DRHD &&
-		    !parse_dmar_drhd((struct acpi_dmar_drhd *) header))
+		/* Pass the entry to its parser. */
+		if (!parser_dispatch(PARSER_DMAR, header->type, header))
+			return false;
+
+		/* Jump to the next entry. */
+		header = (void *) ((char *) header + header->length);
+	}
+	return true;
+}
+
+/*
+ * Return a printable name for an IVHD device entry type.
+ */
+const char *ivhd_dev_type_name(uint8_t type, uint8_t variety)
+{
+	switch (type) {
+	case ACPI_IVHD_DEV_ALL:
+		return "all";
+	case ACPI_IVHD_DEV_SELECT:
+		return "select";
+	case ACPI_IVHD_DEV_RANGE_START:
+		return "range";
+	case ACPI_IVHD_DEV_ALIAS_SELECT:
+	case ACPI_IVHD_DEV_ALIAS_RANGE:
+		return "alias";
+	case ACPI_IVHD_DEV_SPECIAL:
+		if (variety == ACPI_IVHD_SPECIAL_IOAPIC)
+			return "ioapic";
+		if (variety == ACPI_IVHD_SPECIAL_HPET)
+			return "hpet";
+		return "special";
+	case ACPI_IVHD_DEV_ACPI_HID:
+		return "acpi";
+	default:
+		return "unknown";
+	}
+}
+
+/*
+ * Record a range of devices behind an AMD IOMMU.
+ */
+static bool add_ivhd_dev(uint32_t ivhd, uint8_t type, uint16_t first, uint16_t last,
+                         uint16_t alias)
+{
+	if (!vector_reserve(&sysinfo.ivhd_dev))
+		return false;
+	uint32_t n = sysinfo.ivhd_dev.count++;
+	sysinfo.ivhd_dev.list[n].ivhd  = ivhd;
+	sysinfo.ivhd_dev.list[n].type  = type;
+	sysinfo.ivhd_dev.list[n].first = first;
+	sysinfo.ivhd_dev.list[n].last  = last;
+	sysinfo.ivhd_dev.list[n].alias = alias;
+	return true;
+}
+
+/*
+ * Parse IVRS IVHD blocks.
+ */
+static bool parse_ivrs_ivhd(struct acpi_ivrs_ivhd *ivhd)
+{
+	/* Populate the sysinfo structure. */
+	if (!vector_reserve(&sysinfo.ivhd))
+		return false;
+	uint32_t id = sysinfo.ivhd.count++;
+	uint32_t hdrsize = sizeof (*ivhd);
+	sysinfo.ivhd.list[id].addr       = ivhd->base;
+	sysinfo.ivhd.list[id].segment    = ivhd->segment;
+	sysinfo.ivhd.list[id].devid      = ivhd->header.devid;
+	sysinfo.ivhd.list[id].cap_offset = ivhd->cap_offset;
+	sysinfo.ivhd.list[id].type       = ivhd->header.type;
+	sysinfo.ivhd.list[id].flags      = ivhd->header.flags;
+	if (ivhd->header.type != ACPI_IVRS_TYPE_IVHD_LEGACY) {
+		sysinfo.ivhd.list[id].efr = ((struct acpi_ivrs_ivhd_efr *) ivhd)->efr;
+		hdrsize = sizeof (struct acpi_ivrs_ivhd_efr);
+	}
+	serial_printf("[*] AMD IOMMU #%d found at %X (segment %d, type %x)\n",
+	              sysinfo.ivhd.count, ivhd->base, ivhd->segment,
+	              ivhd->header.type);
+
+	/* Walk the list of device entries. */
+	char *end = (char *) ivhd + ivhd->header.length;
+	char *ptr = (char *) ivhd + hdrsize;
+	struct acpi_ivhd_dev *range = NULL;
+	uint16_t alias = 0;
+	while (ptr + sizeof (struct acpi_ivhd_dev) <= end) {
+		struct acpi_ivhd_dev *dev = (void *) ptr;
+		uint32_t length;
+
+		/* Work out the size of the entry from its type. */
+		if (dev->type < 0x40)
+			length = 4;
+		else if (dev->type < 0x80)
+			length = 8;
+		else if (dev->type == ACPI_IVHD_DEV_ACPI_HID)
+			length = sizeof (struct acpi_ivhd_dev_hid)
+				+ ((struct acpi_ivhd_dev_hid *) dev)->uid_length;
+		else {
+			serial_printf("[!] Warning: ACPI: IVHD device entry type %x not supported, ignoring the rest of the block\n",
+			              dev->type);
+			break;
+		}
+		if (ptr + length > end)
+			break;
+		ptr += length;
+
+		switch (dev->type) {
+		case ACPI_IVHD_DEV_ALL:
+			if (!add_ivhd_dev(id, dev->type, 0, 0xffff, 0))
+				return false;
+			break;
+
+		case ACPI_IVHD_DEV_SELECT:
+		case ACPI_IVHD_DEV_EXT_SELECT:
+			if (!add_ivhd_dev(id, ACPI_IVHD_DEV_SELECT, dev->devid, dev->devid, 0))
+				return false;
+			break;
+
+		case ACPI_IVHD_DEV_ALIAS_SELECT:
+			if (!add_ivhd_dev(id, dev->type, dev->devid, dev->devid,
+			                  ((struct acpi_ivhd_dev_alias *) dev)->alias))
+				return false;
+			break;
+
+		case ACPI_IVHD_DEV_RANGE_START:
+		case ACPI_IVHD_DEV_EXT_RANGE:
+			range = dev;
+			alias = 0;
+			break;
+
+		case ACPI_IVHD_DEV_ALIAS_RANGE:
+			range = dev;
+			alias = ((struct acpi_ivhd_dev_alias *) dev)->alias;
+			break;
+
+		case ACPI_IVHD_DEV_RANGE_END:
+			if (range == NULL) {
+				serial_puts("[!] Warning: ACPI: IVHD end of range without a start, ignoring\n");
+				break;
+			}
+			if (!add_ivhd_dev(id,
+			                  range->type == ACPI_IVHD_DEV_ALIAS_RANGE
+			                  ? ACPI_IVHD_DEV_ALIAS_RANGE
+			                  : ACPI_IVHD_DEV_RANGE_START,
+			                  range->devid, dev->devid, alias))
+				return false;
+			range = NULL;
+			break;
+
+		case ACPI_IVHD_DEV_SPECIAL: {
+			struct acpi_ivhd_dev_special *special = (void *) dev;
+			if (!add_ivhd_dev(id, dev->type, special->devid, special->devid, 0))
+				return false;
+			sysinfo.ivhd_dev.list[sysinfo.ivhd_dev.count - 1].handle  = special->handle;
+			sysinfo.ivhd_dev.list[sysinfo.ivhd_dev.count - 1].variety = special->variety;
+			break;
+		}
+
+		case ACPI_IVHD_DEV_ACPI_HID:
+			if (!add_ivhd_dev(id, dev->type, dev->devid, dev->devid, 0))
+				return false;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Parse IVRS IVMD blocks.
+ */
+static bool parse_ivrs_ivmd(struct acpi_ivrs_ivmd *ivmd)
+{
+	/* Populate the sysinfo structure. */
+	if (!vector_reserve(&sysinfo.ivmd))
+		return false;
+	uint32_t n = sysinfo.ivmd.count++;
+	sysinfo.ivmd.list[n].addr  = ivmd->start;
+	sysinfo.ivmd.list[n].size  = ivmd->length;
+	sysinfo.ivmd.list[n].flags = ivmd->header.flags;
+
+	/* Work out the range of devices the block applies to. */
+	switch (ivmd->header.type) {
+	case ACPI_IVRS_TYPE_IVMD_ALL:
+		sysinfo.ivmd.list[n].first = 0;
+		sysinfo.ivmd.list[n].last  = 0xffff;
+		break;
+	case ACPI_IVRS_TYPE_IVMD_SELECT:
+		sysinfo.ivmd.list[n].first = ivmd->header.devid;
+		sysinfo.ivmd.list[n].last  = ivmd->header.devid;
+		break;
+	case ACPI_IVRS_TYPE_IVMD_RANGE:
+		sysinfo.ivmd.list[n].first = ivmd->header.devid;
+		sysinfo.ivmd.list[n].last  = ivmd->aux;
+		break;
+	}
+
+	serial_printf("[*] IVMD #%d found at %X size %X\n",
+	              sysinfo.ivmd.count, ivmd->start, ivmd->length);
+	return true;
+}
+
+/*
+ * Parse the AMD I/O Virtualization Reporting Structure (IVRS).
+ */
+static bool parse_ivrs(struct acpi_ivrs *ivrs)
+{
+	struct acpi_ivrs_header *header;
+	char *end = (char *) ivrs + ivrs->header.length;
+	uint8_t ivhd_type = 0;
+
+	serial_puts("[*] ACPI IVRS table found\n");
+
+	/*
+	 * The same IOMMU may be described by several IVHD blocks of different
+	 * types, only use the most featureful type we know about.
+	 */
+	for (header = (void *) (ivrs + 1);
+	     (char *) header < end && header->length != 0;
+	     header = (void *) ((char *) header + header->length)) {
+		if ((header->type == ACPI_IVRS_TYPE_IVHD_LEGACY ||
+		     header->type == ACPI_IVRS_TYPE_IVHD_EFR ||
+		     header->type == ACPI_IVRS_TYPE_IVHD_ACPI) &&
+		    header->type > ivhd_type)
+			ivhd_type = header->type;
+	}
+
+	/* Walk the list of entries. */
+	for (header = (void *) (ivrs + 1);
+	     (char *) header < end;
+	     header = (void *) ((char *) header + header->length)) {
+
+		/* Ignore entries with a zero length. */
+		if (header->length == 0) {
+			serial_puts("[!] Warning: IVRS entry with zero length, ignoring the rest of the table.\n");
+			break;
+		}
+
+		/* Catch IVHDs. */
+		if (header->type == ivhd_type &&
+		    !parse_ivrs_ivhd((struct acpi_ivrs_ivhd *) header))
+			return false;
+
+		/* Catch IVMDs. */
+		if ((header->type == ACPI_IVRS_TYPE_IVMD_ALL ||
+		     header->type == ACPI_IVRS_TYPE_IVMD_SELECT ||
+		     header->type == ACPI_IVRS_TYPE_IVMD_RANGE) &&
+		    !parse_ivrs_ivmd((struct acpi_ivrs_ivmd *) header))
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Parse the PCI Express memory mapped configuration space table (MCFG).
+ */
+static bool parse_mcfg(struct acpi_mcfg *mcfg)
+{
+	serial_puts("[*] ACPI MCFG table found\n");
+
+	/* Walk the list of entries. */
+	struct acpi_mcfg_entry *entry = (void *) (mcfg + 1);
+	for (; (char *) (entry + 1) <= (char *) mcfg + mcfg->header.length; entry++) {
+		if (!vector_reserve(&sysinfo.pci))
 			return false;
+		sysinfo.pci.list[sysinfo.pci.count].addr      = entry->base;
+		sysinfo.pci.list[sysinfo.pci.count].segment   = entry->segment;
+		sysinfo.pci.list[sysinfo.pci.count].start_bus = entry->start_bus;
+		sysinfo.pci.list[sysinfo.pci.count].end_bus   = entry->end_bus;
+		sysinfo.pci.count++;
+
+		serial_printf("[*] PCI segment %d buses %d-%d configuration space at %X\n",
+		              entry->segment, entry->start_bus, entry->end_bus,
+		              entry->base);
+	}
+
+	return true;
+}
+
+/*
+ * Record the proximity domain of a processor.
+ */
+static bool add_cpu_affinity(uint32_t apic_id, uint32_t domain, uint32_t flags)
+{
+	if (!(flags & ACPI_SRAT_ENABLED))
+		return true;
+
+	if (!vector_reserve(&sysinfo.cpu_affinity))
+		return false;
+	sysinfo.cpu_affinity.list[sysinfo.cpu_affinity.count].apic_id = apic_id;
+	sysinfo.cpu_affinity.list[sysinfo.cpu_affinity.count].domain  = domain;
+	sysinfo.cpu_affinity.count++;
+	serial_printf("[*] CPU with APIC ID %d in proximity domain %d\n", apic_id, domain);
+	return true;
+}
+
+/*
+ * Parse SRAT processor local APIC affinity entries.
+ */
+static bool parse_srat_lapic(struct acpi_srat_lapic *lapic)
+{
+	uint32_t domain = lapic->domain_lo | lapic->domain_hi[0] << 8 |
+	                  lapic->domain_hi[1] << 16 | lapic->domain_hi[2] << 24;
+
+	return add_cpu_affinity(lapic->apic_id, domain, lapic->flags);
+}
+PARSER(PARSER_SRAT, ACPI_SRAT_TYPE_LAPIC, parse_srat_lapic);
+
+/*
+ * Parse SRAT processor local x2APIC affinity entries.
+ */
+static bool parse_srat_x2apic(struct acpi_srat_x2apic *x2apic)
+{
+	return add_cpu_affinity(x2apic->apic_id, x2apic->domain, x2apic->flags);
+}
+PARSER(PARSER_SRAT, ACPI_SRAT_TYPE_X2APIC, parse_srat_x2apic);
 
-		/* Catch RMRRs. */
-		if (header->type == ACPI_DMAR_TYPE_RMRR &&
-		    !parse_dmar_rmrr((struct acpi_dmar_rmrr *) header))
+/*
+ * Parse SRAT memory affinity entries.
+ */
+static bool parse_srat_memory(struct acpi_srat_memory *memory)
+{
+	if (!(memory->flags & ACPI_SRAT_ENABLED) || !memory->length)
+		return true;
+
+	if (!vector_reserve(&sysinfo.memory_affinity))
+		return false;
+	sysinfo.memory_affinity.list[sysinfo.memory_affinity.count].addr   = memory->base;
+	sysinfo.memory_affinity.list[sysinfo.memory_affinity.count].size   = memory->length;
+	sysinfo.memory_affinity.list[sysinfo.memory_affinity.count].domain = memory->domain;
+	sysinfo.memory_affinity.list[sysinfo.memory_affinity.count].flags  = memory->flags;
+	sysinfo.memory_affinity.count++;
+	serial_printf("[*] Memory range %X-%X in proximity domain %d\n",
+	              memory->base, memory->base + memory->length - 1, memory->domain);
+	return true;
+}
+PARSER(PARSER_SRAT, ACPI_SRAT_TYPE_MEMORY, parse_srat_memory);
+
+/*
+ * Parse the System Resource Affinity Table (SRAT).
+ */
+static bool parse_srat(struct acpi_srat *srat)
+{
+	serial_puts("[*] ACPI SRAT table found\n");
+
+	/* Walk the list of entries. */
+	struct acpi_srat_header *header = (void *) (srat + 1);
+	while ((char *) header < (char *) srat + srat->header.length) {
+
+		/* Ignore entries with a zero length. */
+		if (header->length == 0) {
+			serial_puts("[!] Warning: SRAT entry with zero length, ignoring the rest of the table.\n");
+			break;
+		}
+
+		/* Pass the entry to its parser. */
+		if (!parser_dispatch(PARSER_SRAT, header->type, header))
 			return false;
 
 		/* Jump to the next entry. */
@@ -170,42 +826,203 @@ static bool parse_dmar(struct acpi_dmar *dmar)
 }
 
 /*
- * Parse the ACPI tables.
+ * Decode an AML integer constant (ZeroOp, OneOp, OnesOp or a byte, word or
+ * dword constant), truncated to 8 bits. Returns a pointer past the constant,
+ * or NULL if it is not one.
  */
-bool acpi_parse_tables(void)
+static const uint8_t *aml_byte_const(const uint8_t *aml, uint8_t *value)
+{
+	switch (aml[0]) {
+	case 0x00: *value = 0;      return aml + 1;
+	case 0x01: *value = 1;      return aml + 1;
+	case 0xff: *value = 0xff;   return aml + 1;
+	case 0x0a: *value = aml[1]; return aml + 2;
+	case 0x0b: *value = aml[1]; return aml + 3;
+	case 0x0c: *value = aml[1]; return aml + 5;
+	default:   return NULL;
+	}
+}
+
+/*
+ * Look up the SLP_TYPa and SLP_TYPb values of the S5 (soft off) sleep state in
+ * the DSDT. The ACPI namespace isn't loaded yet when the FADT is parsed, so
+ * search for the \_S5 name object which is usually a plain package of
+ * integers. This is superseded by acpi_evaluate_s5() once the AML is loaded.
+ */
+static void find_s5(struct acpi_header *dsdt)
+{
+	const uint8_t *aml = (const uint8_t *) (dsdt + 1);
+	const uint8_t *end = (const uint8_t *) dsdt + dsdt->length;
+
+	for (; aml + 11 <= end; aml++) {
+		/* NameOp, optional root prefix, "_S5_" and PackageOp. */
+		if (memcmp((char *) aml, "_S5_", 4) != 0 || aml[4] != 0x12)
+			continue;
+		if (aml[-1] != 0x08 && (aml[-1] != '\\' || aml[-2] != 0x08))
+			continue;
+
+		/* Skip the package length and element count. */
+		const uint8_t *p = aml + 5;
+		p += 1 + (p[0] >> 6) + 1;
+
+		p = aml_byte_const(p, &sysinfo.power.slp_typa);
+		if (p && aml_byte_const(p, &sysinfo.power.slp_typb)) {
+			sysinfo.power.s5 = true;
+			serial_printf("[*] ACPI S5 sleep type %d/%d\n",
+			              sysinfo.power.slp_typa, sysinfo.power.slp_typb);
+		}
+		return;
+	}
+}
+
+/*
+ * Evaluate the \_S5 object of the loaded ACPI namespace, which may also be
+ * defined in an SSDT, falling back on the result of the DSDT search.
+ */
+void acpi_evaluate_s5(void)
+{
+	struct aml_node *s5 = aml_lookup(aml_root(), "\\_S5_");
+	struct aml_object package;
+	uint64_t typa, typb;
+
+	if (!s5 || !aml_evaluate(s5, 0, NULL, &package) || package.type != AML_PACKAGE ||
+	    package.size < 2 || !aml_to_integer(&package.package[0], &typa) ||
+	    !aml_to_integer(&package.package[1], &typb)) {
+		if (!sysinfo.power.s5)
+			serial_puts("[!] Warning: ACPI \\_S5 object not found\n");
+		return;
+	}
+
+	if (!sysinfo.power.s5 || sysinfo.power.slp_typa != (uint8_t) typa ||
+	    sysinfo.power.slp_typb != (uint8_t) typb)
+		serial_printf("[*] ACPI S5 sleep type %d/%d from the namespace\n",
+		              (uint8_t) typa, (uint8_t) typb);
+	sysinfo.power.s5 = true;
+	sysinfo.power.slp_typa = typa;
+	sysinfo.power.slp_typb = typb;
+}
+
+/*
+ * Pick the I/O port of a PM1 control block, preferring the extended address.
+ */
+static uint16_t fadt_pm1_port(uint32_t port, struct acpi_gas *gas, bool has_gas)
+{
+	if (has_gas && gas->address && gas->space_id == ACPI_GAS_SPACE_IO)
+		return gas->address;
+	return port;
+}
+
+/*
+ * Parse the Fixed ACPI Description Table (FADT) for the reset and sleep
+ * controls.
+ */
+static void parse_fadt(struct acpi_fadt *fadt)
+{
+	serial_puts("[*] ACPI FADT table found\n");
+	sysinfo.power.fadt = true;
+
+	uint32_t flags = ACPI_FADT_HAS(fadt, flags) ? fadt->flags : 0;
+	sysinfo.power.hw_reduced = flags & ACPI_FADT_HW_REDUCED;
+
+	/* Reset register. */
+	if (ACPI_FADT_HAS(fadt, reset_value) && (flags & ACPI_FADT_RESET_REG_SUP) &&
+	    fadt->reset_reg.address && fadt->reset_reg.space_id <= ACPI_GAS_SPACE_PCI) {
+		sysinfo.power.reset_reg = true;
+		sysinfo.power.reset_space = fadt->reset_reg.space_id;
+		sysinfo.power.reset_addr = fadt->reset_reg.address;
+		sysinfo.power.reset_value = fadt->reset_value;
+		serial_printf("[*] ACPI reset register %X (space %d) value %x\n",
+		              sysinfo.power.reset_addr, sysinfo.power.reset_space,
+		              sysinfo.power.reset_value);
+	}
+
+	/* Sleep controls. */
+	sysinfo.power.smi_cmd = fadt->smi_cmd;
+	sysinfo.power.acpi_enable = fadt->acpi_enable;
+	sysinfo.power.pm1a_cnt = fadt_pm1_port(fadt->pm1a_cnt_blk, &fadt->x_pm1a_cnt_blk,
+	                                       ACPI_FADT_HAS(fadt, x_pm1a_cnt_blk));
+	sysinfo.power.pm1b_cnt = fadt_pm1_port(fadt->pm1b_cnt_blk, &fadt->x_pm1b_cnt_blk,
+	                                       ACPI_FADT_HAS(fadt, x_pm1b_cnt_blk));
+	if (ACPI_FADT_HAS(fadt, sleep_control_reg)) {
+		sysinfo.power.sleep_control_space = fadt->sleep_control_reg.space_id;
+		sysinfo.power.sleep_control = fadt->sleep_control_reg.address;
+	}
+
+	/* Look up the S5 sleep type in the DSDT. */
+	uint64_t dsdt = fadt->dsdt;
+	if (ACPI_FADT_HAS(fadt, x_dsdt) && fadt->x_dsdt)
+		dsdt = fadt->x_dsdt;
+	if (dsdt && !(dsdt >> 32)) {
+		sysinfo.dsdt.addr = dsdt;
+		find_s5((struct acpi_header *) (uint32_t) dsdt);
+	}
+}
+
+/*
+ * Find an ACPI system description table by its signature, index selects
+ * between the tables sharing a signature such as the SSDTs.
+ */
+struct acpi_header *acpi_find_table(char *signature, uint32_t index)
 {
 	struct acpi_rsdt *rsdt = (void *) sysinfo.rsdt.addr;
-	bool madt_found = false;
-	bool dmar_found = false;
 
 	/* Walk the list of ACPI system description tables. */
 	int nentries = (rsdt->header.length - sizeof (rsdt->header)) / 4;
 	for (int i = 0; i < nentries; i++) {
 		struct acpi_header *header = (void *) rsdt->entry[i];
 
-		/* Parse the MADT table. */
-		if (!memcmp(header->signature, "APIC", 4)) {
-			if (parse_madt((struct acpi_madt *) header))
-				madt_found = true;
-			continue;
-		}
-
-		/* Parse the DMAR table. */
-		if (!memcmp(header->signature, "DMAR", 4)) {
-			if (parse_dmar((struct acpi_dmar *) header))
-				dmar_found = true;
-			continue;
-		}
+		if (!memcmp(header->signature, signature, 4) && index-- == 0)
+			return header;
 	}
+	return NULL;
+}
+
+/*
+ * Parse the ACPI tables.
+ */
+bool acpi_parse_tables(void)
+{
+	struct acpi_header *header;
 
-	/* Make sure that the tables were found. */
-	if (!madt_found) {
+	/* Parse the FADT first so that on_exit works even if parsing fails. */
+	if ((header = acpi_find_table("FACP", 0)))
+		parse_fadt((struct acpi_fadt *) header);
+
+	/*
+	 * Parse the MCFG table first, it is optional but needed to resolve the
+	 * device scopes of the DMAR table on other segments than 0.
+	 */
+	if ((header = acpi_find_table("MCFG", 0)) &&
+	    !parse_mcfg((struct acpi_mcfg *) header))
+		return false;
+
+	/* Parse the MADT table. */
+	if (!(header = acpi_find_table("APIC", 0)) ||
+	    !parse_madt((struct acpi_madt *) header)) {
 		serial_puts("[X] Error: ACPI MADT table not found!\n");
 		return false;
 	}
-	if (!dmar_found) {
-		serial_puts("[X] Error: ACPI DMAR table not found!\n");
+
+	/* Parse the SRAT table, which only NUMA systems have. */
+	if ((header = acpi_find_table("SRAT", 0)) &&
+	    !parse_srat((struct acpi_srat *) header))
+		return false;
+
+	/* Parse the Intel DMAR table. */
+	struct acpi_header *dmar = acpi_find_table("DMAR", 0);
+	if (dmar && !parse_dmar((struct acpi_dmar *) dmar))
+		return false;
+
+	/* Parse the AMD IVRS table. */
+	struct acpi_header *ivrs = acpi_find_table("IVRS", 0);
+	if (ivrs && !parse_ivrs((struct acpi_ivrs *) ivrs))
+		return false;
+
+	/* Make sure that an IOMMU is described. */
+	if (!dmar && !ivrs) {
+		serial_puts("[X] Error: ACPI DMAR or IVRS table not found!\n");
 		return false;
 	}
+
 	return true;
 }
@@ -0,0 +1,65 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "acpi.h"
+#include "amdvi.h"
+#include "serial.h"
+#include "sysinfo.h"
+
+#define AMDVI_EFR_REG     0x30
+
+/*
+ * Read a 32-bit register from a specific IOMMU. The caller must make sure the
+ * register is below 4GiB.
+ */
+static inline uint32_t amdvi_read32(uint32_t ivhd_id, uint32_t offset)
+{
+	return *(volatile uint32_t *) (uint32_t) (sysinfo.ivhd.list[ivhd_id].addr + offset);
+}
+
+/*
+ * Scan the AMD-Vi stuff.
+ */
+bool amdvi_scan(void)
+{
+	/* Early exit if there's no IOMMU. */
+	if (sysinfo.ivhd.count == 0)
+		return true;
+
+	/*
+	 * Legacy IVHD blocks don't carry the extended feature register, read
+	 * it from the IOMMU itself when it is reachable.
+	 */
+	for (int i = 0; i < sysinfo.ivhd.count; i++) {
+		if (sysinfo.ivhd.list[i].type != ACPI_IVRS_TYPE_IVHD_LEGACY)
+			continue;
+		if ((sysinfo.ivhd.list[i].addr + AMDVI_EFR_REG + 8) >> 32) {
+			serial_printf("[!] Warning: AMD IOMMU #%d above 4GiB, assuming default features\n",
+			              i + 1);
+			continue;
+		}
+		sysinfo.ivhd.list[i].efr = amdvi_read32(i, AMDVI_EFR_REG)
+			| ((uint64_t) amdvi_read32(i, AMDVI_EFR_REG + 4) << 32);
+	}
+
+	/*
+	 * All IOMMUs must be able to walk the IO page tables, use the smallest
+	 * number of host page table levels they all support.
+	 */
+	uint32_t levels = 6;
+	for (int i = 0; i < sysinfo.ivhd.count; i++) {
+		uint64_t efr = sysinfo.ivhd.list[i].efr;
+		serial_printf("[*] AMD IOMMU #%d extended features %X\n", i + 1, efr);
+		if (AMDVI_HOST_LEVELS(efr) < levels)
+			levels = AMDVI_HOST_LEVELS(efr);
+	}
+	sysinfo.amdvi.num_iopt_levels = levels;
+
+	return true;
+}
@@ -0,0 +1,1747 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/*
+ * Minimal AML interpreter. It loads the DSDT and SSDTs into a namespace and
+ * evaluates the few objects we need, such as the PCI interrupt routing tables.
+ * Only the subset of the language used by firmware for these objects is
+ * supported, anything else makes the evaluation fail. Writes to hardware are
+ * refused and stores to memory regions are kept by the interpreter, we never
+ * want to change the platform state.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "aml.h"
+#include "config.h"
+#include "pci.h"
+#include "serial.h"
+#include "utils.h"
+
+/* Limits protecting against runaway firmware code. */
+#define AML_MAX_DEPTH           16
+#define AML_MAX_LOOPS           0x10000
+
+/* Opcodes, the extended ones are prefixed with AML_EXT_PREFIX. */
+#define AML_ZERO                0x00
+#define AML_ONE                 0x01
+#define AML_ALIAS               0x06
+#define AML_NAME                0x08
+#define AML_BYTE_PREFIX         0x0a
+#define AML_WORD_PREFIX         0x0b
+#define AML_DWORD_PREFIX        0x0c
+#define AML_STRING_PREFIX       0x0d
+#define AML_QWORD_PREFIX        0x0e
+#define AML_SCOPE               0x10
+#define AML_BUFFER_OP           0x11
+#define AML_PACKAGE_OP          0x12
+#define AML_VAR_PACKAGE         0x13
+#define AML_METHOD              0x14
+#define AML_EXTERNAL            0x15
+#define AML_DUAL_NAME_PREFIX    0x2e
+#define AML_MULTI_NAME_PREFIX   0x2f
+#define AML_EXT_PREFIX          0x5b
+#define AML_ROOT_CHAR           0x5c
+#define AML_PARENT_PREFIX       0x5e
+#define AML_LOCAL0              0x60
+#define AML_LOCAL7              0x67
+#define AML_ARG0                0x68
+#define AML_ARG6                0x6e
+#define AML_STORE               0x70
+#define AML_REF_OF              0x71
+#define AML_ADD                 0x72
+#define AML_SUBTRACT            0x74
+#define AML_INCREMENT           0x75
+#define AML_DECREMENT           0x76
+#define AML_MULTIPLY            0x77
+#define AML_DIVIDE              0x78
+#define AML_SHIFT_LEFT          0x79
+#define AML_SHIFT_RIGHT         0x7a
+#define AML_AND                 0x7b
+#define AML_NAND                0x7c
+#define AML_OR                  0x7d
+#define AML_NOR                 0x7e
+#define AML_XOR                 0x7f
+#define AML_NOT                 0x80
+#define AML_DEREF_OF            0x83
+#define AML_NOTIFY              0x86
+#define AML_SIZE_OF             0x87
+#define AML_INDEX               0x88
+#define AML_CREATE_DWORD_FIELD  0x8a
+#define AML_CREATE_WORD_FIELD   0x8b
+#define AML_CREATE_BYTE_FIELD   0x8c
+#define AML_CREATE_BIT_FIELD    0x8d
+#define AML_OBJECT_TYPE         0x8e
+#define AML_CREATE_QWORD_FIELD  0x8f
+#define AML_LAND                0x90
+#define AML_LOR                 0x91
+#define AML_LNOT                0x92
+#define AML_LEQUAL              0x93
+#define AML_LGREATER            0x94
+#define AML_LLESS               0x95
+#define AML_TO_BUFFER           0x96
+#define AML_TO_INTEGER          0x99
+#define AML_MOD                 0x85
+#define AML_COPY_OBJECT         0x9d
+#define AML_CONTINUE            0x9f
+#define AML_IF                  0xa0
+#define AML_ELSE                0xa1
+#define AML_WHILE               0xa2
+#define AML_NOOP                0xa3
+#define AML_RETURN              0xa4
+#define AML_BREAK               0xa5
+#define AML_ONES                0xff
+
+#define AML_EXT_MUTEX           0x01
+#define AML_EXT_EVENT           0x02
+#define AML_EXT_COND_REF_OF     0x12
+#define AML_EXT_CREATE_FIELD    0x13
+#define AML_EXT_STALL           0x21
+#define AML_EXT_SLEEP           0x22
+#define AML_EXT_ACQUIRE         0x23
+#define AML_EXT_SIGNAL          0x24
+#define AML_EXT_WAIT            0x25
+#define AML_EXT_RESET           0x26
+#define AML_EXT_RELEASE         0x27
+#define AML_EXT_REVISION        0x30
+#define AML_EXT_DEBUG           0x31
+#define AML_EXT_TIMER           0x33
+#define AML_EXT_REGION          0x80
+#define AML_EXT_FIELD           0x81
+#define AML_EXT_DEVICE          0x82
+#define AML_EXT_PROCESSOR       0x83
+#define AML_EXT_POWER_RES       0x84
+#define AML_EXT_THERMAL_ZONE    0x85
+#define AML_EXT_INDEX_FIELD     0x86
+#define AML_EXT_BANK_FIELD      0x87
+
+/* Operation region address spaces. */
+#define AML_SPACE_MEMORY        0
+#define AML_SPACE_IO            1
+#define AML_SPACE_PCI           2
+
+/*
+ * Outcome of executing a term.
+ */
+enum aml_status {
+	AML_STATUS_OK,
+	AML_STATUS_RETURN,
+	AML_STATUS_BREAK,
+	AML_STATUS_CONTINUE,
+	AML_STATUS_ERROR,
+};
+
+/*
+ * Method invocation context.
+ */
+struct aml_frame {
+	struct aml_node   *scope;
+	struct aml_object  args[7];
+	struct aml_object  locals[8];
+	struct aml_object  retval;
+	uint32_t           depth;
+};
+
+/*
+ * Parsed name string.
+ */
+struct aml_name {
+	bool           root;
+	uint32_t       parents;
+	uint32_t       count;
+	const uint8_t *segs;
+};
+
+/* Namespace nodes, node 0 is the root. */
+static struct aml_node aml_nodes[CONFIG_AML_MAX_NODES];
+static uint32_t aml_num_nodes;
+
+/* Object heap, never freed. */
+static uint8_t aml_heap[CONFIG_AML_HEAP_SIZE] __attribute__((aligned(8)));
+static uint32_t aml_heap_used;
+
+/*
+ * Bytes stored to memory regions, read back instead of the platform memory
+ * which may be device registers.
+ */
+static struct aml_store {
+	uint32_t addr;
+	uint8_t  value;
+} aml_stores[CONFIG_AML_MAX_STORES];
+static uint32_t aml_num_stores;
+
+/* Integers are 32-bit wide in revision 1 tables. */
+static uint64_t aml_ones = ~0ULL;
+
+static enum aml_status aml_term(struct aml_frame *f, const uint8_t **pp,
+                                struct aml_object *res);
+static enum aml_status aml_block(struct aml_frame *f, const uint8_t *p,
+                                 const uint8_t *end);
+static bool aml_read_node(struct aml_node *node, struct aml_object *res);
+
+/*
+ * Allocate zeroed memory from the interpreter heap.
+ */
+static void *aml_alloc(uint32_t size)
+{
+	size = (size + 7) & ~7;
+	if (size > sizeof (aml_heap) - aml_heap_used) {
+		serial_puts("[!] Warning: AML heap exhausted, please raise CONFIG_AML_HEAP_SIZE\n");
+		return NULL;
+	}
+
+	void *ptr = &aml_heap[aml_heap_used];
+	aml_heap_used += size;
+	memset(ptr, 0, size);
+	return ptr;
+}
+
+/*
+ * Decode a package length, returns a pointer past it and sets the end of the
+ * package.
+ */
+static const uint8_t *aml_pkglen(const uint8_t *p, const uint8_t **end)
+{
+	uint32_t bytes = p[0] >> 6;
+	uint32_t len = bytes ? p[0] & 0xf : p[0] & 0x3f;
+
+	for (uint32_t i = 0; i < bytes; i++)
+		len |= (uint32_t) p[1 + i] << (4 + 8 * i);
+	*end = p + len;
+	return p + 1 + bytes;
+}
+
+/*
+ * Check whether a byte starts a name string.
+ */
+static bool aml_is_name(uint8_t c)
+{
+	return (c >= 'A' && c <= 'Z') || c == '_' || c == AML_ROOT_CHAR ||
+		c == AML_PARENT_PREFIX || c == AML_DUAL_NAME_PREFIX ||
+		c == AML_MULTI_NAME_PREFIX;
+}
+
+/*
+ * Decode a name string, returns a pointer past it.
+ */
+static const uint8_t *aml_parse_name(const uint8_t *p, struct aml_name *name)
+{
+	name->root = false;
+	name->parents = 0;
+	if (*p == AML_ROOT_CHAR) {
+		name->root = true;
+		p++;
+	} else {
+		while (*p == AML_PARENT_PREFIX) {
+			name->parents++;
+			p++;
+		}
+	}
+
+	switch (*p) {
+	case AML_ZERO:
+		name->count = 0;
+		p++;
+		break;
+	case AML_DUAL_NAME_PREFIX:
+		name->count = 2;
+		p++;
+		break;
+	case AML_MULTI_NAME_PREFIX:
+		name->count = p[1];
+		p += 2;
+		break;
+	default:
+		name->count = 1;
+	}
+	name->segs = p;
+	return p + 4 * name->count;
+}
+
+/*
+ * Get the n-th segment of a name string.
+ */
+static uint32_t aml_name_seg(struct aml_name *name, uint32_t n)
+{
+	return AML_SEG(name->segs + 4 * n);
+}
+
+/*
+ * Find a direct child of a namespace node.
+ */
+static struct aml_node *aml_child(struct aml_node *parent, uint32_t seg)
+{
+	for (struct aml_node *node = parent->child; node; node = node->sibling)
+		if (node->name == seg)
+			return node;
+	return NULL;
+}
+
+/*
+ * Follow aliases to the actual object.
+ */
+static struct aml_node *aml_follow(struct aml_node *node)
+{
+	for (uint32_t i = 0; node && node->type == AML_NODE_ALIAS && i < AML_MAX_DEPTH; i++)
+		node = node->alias;
+	return node;
+}
+
+/*
+ * Resolve a name string relative to a scope. Single segment names are searched
+ * for in the parent scopes too.
+ */
+static struct aml_node *aml_resolve(struct aml_node *scope, struct aml_name *name)
+{
+	struct aml_node *node = name->root ? &aml_nodes[0] : scope;
+
+	for (uint32_t i = 0; i < name->parents && node; i++)
+		node = node->parent;
+	if (!node || name->count == 0)
+		return node;
+
+	if (!name->root && name->parents == 0 && name->count == 1) {
+		for (; node; node = node->parent) {
+			struct aml_node *child = aml_child(node, aml_name_seg(name, 0));
+			if (child)
+				return aml_follow(child);
+		}
+		return NULL;
+	}
+
+	for (uint32_t i = 0; i < name->count && node; i++)
+		node = aml_child(node, aml_name_seg(name, i));
+	return aml_follow(node);
+}
+
+/*
+ * Create a namespace node, or return the existing one with the same name.
+ */
+static struct aml_node *aml_create(struct aml_node *scope, struct aml_name *name,
+                                   uint8_t type)
+{
+	struct aml_node *parent = name->root ? &aml_nodes[0] : scope;
+
+	for (uint32_t i = 0; i < name->parents && parent; i++)
+		parent = parent->parent;
+	if (!parent || name->count == 0)
+		return NULL;
+	for (uint32_t i = 0; i + 1 < name->count && parent; i++)
+		parent = aml_child(parent, aml_name_seg(name, i));
+	if (!parent)
+		return NULL;
+
+	uint32_t seg = aml_name_seg(name, name->count - 1);
+	struct aml_node *node = aml_child(parent, seg);
+	if (node)
+		return node;
+
+	if (aml_num_nodes == CONFIG_AML_MAX_NODES) {
+		serial_puts("[!] Warning: AML namespace full, please raise CONFIG_AML_MAX_NODES\n");
+		return NULL;
+	}
+	node = &aml_nodes[aml_num_nodes++];
+	memset((char *) node, 0, sizeof (*node));
+	node->name = seg;
+	node->type = type;
+	node->parent = parent;
+	node->sibling = parent->child;
+	parent->child = node;
+	return node;
+}
+
+/*
+ * Delete the nodes created since the namespace had the given size. They are
+ * always the first children of their parents.
+ */
+static void aml_truncate(uint32_t count)
+{
+	while (aml_num_nodes > count) {
+		struct aml_node *node = &aml_nodes[--aml_num_nodes];
+		node->parent->child = node->sibling;
+	}
+}
+
+/*
+ * Convert an object to an integer.
+ */
+bool aml_to_integer(struct aml_object *object, uint64_t *value)
+{
+	switch (object->type) {
+	case AML_INTEGER:
+		*value = object->integer;
+		return true;
+	case AML_BUFFER:
+		*value = 0;
+		for (uint32_t i = 0; i < object->size && i < 8; i++)
+			*value |= (uint64_t) object->buffer[i] << (i * 8);
+		*value &= aml_ones;
+		return true;
+	case AML_STRING:
+		*value = 0;
+		for (uint32_t i = 0; i < object->size; i++) {
+			uint8_t c = object->buffer[i];
+			if (c >= '0' && c <= '9')
+				*value = (*value << 4) | (c - '0');
+			else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+				*value = (*value << 4) | ((c | 0x20) - 'a' + 10);
+			else if (c != 'x' && c != 'X')
+				break;
+		}
+		*value &= aml_ones;
+		return true;
+	case AML_ELEMENT:
+		return aml_to_integer(object->element, value);
+	case AML_BYTE:
+		*value = *object->buffer;
+		return true;
+	case AML_REFERENCE: {
+		struct aml_object res;
+		return aml_read_node(object->node, &res) && res.type != AML_REFERENCE &&
+			aml_to_integer(&res, value);
+	}
+	default:
+		return false;
+	}
+}
+
+/*
+ * Read from an operation region.
+ */
+static bool aml_region_read(struct aml_node *region, uint32_t offset, uint32_t size,
+                            uint64_t *value)
+{
+	uint64_t addr = region->region.base + offset;
+
+	switch (region->space) {
+	case AML_SPACE_MEMORY:
+		if ((addr + size) >> 32)
+			return false;
+		switch (size) {
+		case 1: *value = *(volatile uint8_t *) (uint32_t) addr; break;
+		case 2: *value = *(volatile uint16_t *) (uint32_t) addr; break;
+		case 4: *value = *(volatile uint32_t *) (uint32_t) addr; break;
+		case 8: *value = *(volatile uint64_t *) (uint32_t) addr; break;
+		default: return false;
+		}
+		for (uint32_t i = 0; i < aml_num_stores; i++) {
+			uint32_t byte = aml_stores[i].addr - (uint32_t) addr;
+			if (aml_stores[i].addr >= addr && byte < size) {
+				*value &= ~(0xffULL << (byte * 8));
+				*value |= (uint64_t) aml_stores[i].value << (byte * 8);
+			}
+		}
+		return true;
+	case AML_SPACE_IO:
+		switch (size) {
+		case 1: *value = in8(addr); return true;
+		case 2: *value = in16(addr); return true;
+		case 4: *value = in32(addr); return true;
+		}
+		return false;
+	case AML_SPACE_PCI: {
+		/* The region belongs to the device it is declared in. */
+		uint64_t adr;
+		uint16_t segment;
+		uint8_t bus;
+		if (!aml_evaluate_integer(region->parent, "_ADR", &adr) ||
+		    !aml_pci_bus(region->parent->parent, &segment, &bus))
+			return false;
+		uint32_t value32 = pci_read32(segment, bus, (adr >> 16) & 0x1f, adr & 0x7,
+		                              addr & ~0x3);
+		switch (size) {
+		case 1: *value = (uint8_t) (value32 >> ((addr & 3) * 8)); return true;
+		case 2: *value = (uint16_t) (value32 >> ((addr & 2) * 8)); return true;
+		case 4: *value = value32; return true;
+		}
+		return false;
+	}
+	default:
+		return false;
+	}
+}
+
+/*
+ * Write to an operation region. Only memory regions are written to, these
+ * hold the firmware variables such as the interrupt model. The stores are
+ * kept by the interpreter and never reach the platform memory.
+ */
+static bool aml_region_write(struct aml_node *region, uint32_t offset, uint32_t size,
+                             uint64_t value)
+{
+	uint64_t addr = region->region.base + offset;
+
+	if (region->space != AML_SPACE_MEMORY || ((addr + size) >> 32))
+		return false;
+	for (uint32_t byte = 0; byte < size; byte++) {
+		uint32_t i = 0;
+		while (i < aml_num_stores && aml_stores[i].addr != addr + byte)
+			i++;
+		if (i == CONFIG_AML_MAX_STORES) {
+			serial_puts("[!] Warning: AML memory stores exhausted, please raise CONFIG_AML_MAX_STORES\n");
+			return false;
+		}
+		if (i == aml_num_stores)
+			aml_num_stores++;
+		aml_stores[i].addr = addr + byte;
+		aml_stores[i].value = value >> (byte * 8);
+	}
+	return true;
+}
+
+/*
+ * Read or write a field unit or buffer field of up to 64 bits, one access unit
+ * at a time.
+ */
+static bool aml_field_access(struct aml_node *node, uint64_t *value, bool write)
+{
+	uint32_t size = node->access;
+	uint32_t bits = size * 8;
+	uint32_t pos = node->field.offset;
+	uint32_t done = 0;
+	uint64_t result = 0;
+
+	if (node->field.width > 64)
+		return false;
+
+	while (done < node->field.width) {
+		uint32_t unit = (pos / bits) * size;
+		uint32_t shift = pos % bits;
+		uint32_t n = bits - shift;
+		if (n > node->field.width - done)
+			n = node->field.width - done;
+		uint64_t mask = n == 64 ? ~0ULL : (1ULL << n) - 1;
+		uint64_t data = 0;
+
+		if (node->type == AML_NODE_BUFFER_FIELD) {
+			if (unit >= node->field.buffer->size)
+				return false;
+			data = node->field.buffer->buffer[unit];
+		} else if (!aml_region_read(node->field.region, unit, size, &data)) {
+			return false;
+		}
+
+		if (write) {
+			data &= ~(mask << shift);
+			data |= ((*value >> done) & mask) << shift;
+			if (node->type == AML_NODE_BUFFER_FIELD)
+				node->field.buffer->buffer[unit] = data;
+			else if (!aml_region_write(node->field.region, unit, size, data))
+				return false;
+		} else {
+			result |= ((data >> shift) & mask) << done;
+		}
+		done += n;
+		pos += n;
+	}
+
+	if (!write)
+		*value = result;
+	return true;
+}
+
+/*
+ * Parse a package or variable package, the opcode has been consumed.
+ */
+static enum aml_status aml_package(struct aml_frame *f, const uint8_t **pp,
+                                   bool var, struct aml_object *res)
+{
+	const uint8_t *end;
+	const uint8_t *p = aml_pkglen(*pp, &end);
+	uint64_t count;
+
+	if (var) {
+		struct aml_object num;
+		if (aml_term(f, &p, &num) != AML_STATUS_OK || !aml_to_integer(&num, &count))
+			return AML_STATUS_ERROR;
+	} else {
+		count = *p++;
+	}
+
+	res->type = AML_PACKAGE;
+	res->size = count;
+	res->package = aml_alloc(count * sizeof (struct aml_object));
+	if (count && !res->package)
+		return AML_STATUS_ERROR;
+
+	/* Elements are data objects or names, the latter are not evaluated. */
+	for (uint32_t i = 0; i < count && p < end; i++) {
+		if (aml_is_name(*p)) {
+			struct aml_name name;
+			p = aml_parse_name(p, &name);
+			res->package[i].type = AML_REFERENCE;
+			res->package[i].node = aml_resolve(f->scope, &name);
+		} else if (aml_term(f, &p, &res->package[i]) != AML_STATUS_OK) {
+			return AML_STATUS_ERROR;
+		}
+	}
+
+	*pp = end;
+	return AML_STATUS_OK;
+}
+
+/*
+ * Parse a buffer, the opcode has been consumed. The contents are copied as
+ * they may be modified through buffer fields.
+ */
+static enum aml_status aml_buffer(struct aml_frame *f, const uint8_t **pp,
+                                  struct aml_object *res)
+{
+	const uint8_t *end;
+	const uint8_t *p = aml_pkglen(*pp, &end);
+	struct aml_object num;
+	uint64_t size;
+
+	if (aml_term(f, &p, &num) != AML_STATUS_OK || !aml_to_integer(&num, &size) ||
+	    size > sizeof (aml_heap))
+		return AML_STATUS_ERROR;
+
+	res->type = AML_BUFFER;
+	res->size = size;
+	res->buffer = aml_alloc(size);
+	if (size && !res->buffer)
+		return AML_STATUS_ERROR;
+	for (uint32_t i = 0; i < size && p + i < end; i++)
+		res->buffer[i] = p[i];
+
+	*pp = end;
+	return AML_STATUS_OK;
+}
+
+/*
+ * Get the value of a namespace node. Names are evaluated on first use, in the
+ * scope they are declared in.
+ */
+static bool aml_read_node(struct aml_node *node, struct aml_object *res)
+{
+	switch (node->type) {
+	case AML_NODE_NAME:
+		if (!node->value) {
+			struct aml_frame frame = { .scope = node->parent };
+			const uint8_t *p = node->aml;
+			struct aml_object *value = aml_alloc(sizeof (*value));
+			if (!value || aml_term(&frame, &p, value) != AML_STATUS_OK)
+				return false;
+			node->value = value;
+		}
+		*res = *node->value;
+		return true;
+	case AML_NODE_METHOD:
+		return aml_evaluate(node, 0, NULL, res);
+	case AML_NODE_FIELD:
+	case AML_NODE_BUFFER_FIELD:
+		res->type = AML_INTEGER;
+		return aml_field_access(node, &res->integer, false);
+	default:
+		res->type = AML_REFERENCE;
+		res->node = node;
+		return true;
+	}
+}
+
+/*
+ * Store an object into a namespace node, converting it to the type of the
+ * current value like the implicit conversion rules of the specification.
+ */
+static bool aml_write_node(struct aml_node *node, struct aml_object *obj)
+{
+	uint64_t value;
+
+	switch (node->type) {
+	case AML_NODE_NAME: {
+		struct aml_object cur;
+		if (!aml_read_node(node, &cur))
+			return false;
+		if (cur.type == AML_INTEGER) {
+			if (!aml_to_integer(obj, &value))
+				return false;
+			node->value->integer = value & aml_ones;
+		} else if (cur.type == AML_BUFFER && obj->type == AML_BUFFER) {
+			for (uint32_t i = 0; i < cur.size; i++)
+				cur.buffer[i] = i < obj->size ? obj->buffer[i] : 0;
+		} else {
+			*node->value = *obj;
+		}
+		return true;
+	}
+	case AML_NODE_FIELD:
+	case AML_NODE_BUFFER_FIELD:
+		return aml_to_integer(obj, &value) && aml_field_access(node, &value, true);
+	default:
+		return false;
+	}
+}
+
+/*
+ * Store an object through a reference.
+ */
+static bool aml_write_ref(struct aml_object *ref, struct aml_object *obj)
+{
+	uint64_t value;
+
+	switch (ref->type) {
+	case AML_REFERENCE:
+		return ref->node && aml_write_node(ref->node, obj);
+	case AML_ELEMENT:
+		*ref->element = *obj;
+		return true;
+	case AML_BYTE:
+		if (!aml_to_integer(obj, &value))
+			return false;
+		*ref->buffer = value;
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Parse a target operand and store an object into it.
+ */
+static enum aml_status aml_store(struct aml_frame *f, const uint8_t **pp,
+                                 struct aml_object *obj)
+{
+	const uint8_t *p = *pp;
+
+	if (*p == AML_ZERO) {
+		*pp = p + 1;
+		return AML_STATUS_OK;
+	}
+	if (*p >= AML_LOCAL0 && *p <= AML_LOCAL7) {
+		f->locals[*p - AML_LOCAL0] = *obj;
+		*pp = p + 1;
+		return AML_STATUS_OK;
+	}
+	if (*p >= AML_ARG0 && *p <= AML_ARG6) {
+		struct aml_object *arg = &f->args[*p - AML_ARG0];
+		*pp = p + 1;
+		if (arg->type == AML_REFERENCE || arg->type == AML_ELEMENT || arg->type == AML_BYTE)
+			return aml_write_ref(arg, obj) ? AML_STATUS_OK : AML_STATUS_ERROR;
+		*arg = *obj;
+		return AML_STATUS_OK;
+	}
+	if (p[0] == AML_EXT_PREFIX && p[1] == AML_EXT_DEBUG) {
+		*pp = p + 2;
+		return AML_STATUS_OK;
+	}
+	if (aml_is_name(*p)) {
+		struct aml_name name;
+		*pp = aml_parse_name(p, &name);
+		struct aml_node *node = aml_resolve(f->scope, &name);
+		return node && aml_write_node(node, obj) ? AML_STATUS_OK : AML_STATUS_ERROR;
+	}
+
+	/* Index(), RefOf() or DerefOf() yielding a reference. */
+	struct aml_object ref;
+	if (aml_term(f, pp, &ref) != AML_STATUS_OK)
+		return AML_STATUS_ERROR;
+	return aml_write_ref(&ref, obj) ? AML_STATUS_OK : AML_STATUS_ERROR;
+}
+
+/*
+ * Evaluate a term argument to an integer.
+ */
+static enum aml_status aml_integer(struct aml_frame *f, const uint8_t **pp,
+                                   uint64_t *value)
+{
+	struct aml_object obj;
+
+	if (aml_term(f, pp, &obj) != AML_STATUS_OK || !aml_to_integer(&obj, value))
+		return AML_STATUS_ERROR;
+	return AML_STATUS_OK;
+}
+
+/*
+ * Compare two objects for the logical operators, returns <0, 0 or >0.
+ */
+static bool aml_compare(struct aml_object *a, struct aml_object *b, int *cmp)
+{
+	if (a->type == AML_STRING || a->type == AML_BUFFER) {
+		if (b->type != a->type)
+			return false;
+		for (uint32_t i = 0; i < a->size && i < b->size; i++) {
+			if (a->buffer[i] != b->buffer[i]) {
+				*cmp = a->buffer[i] < b->buffer[i] ? -1 : 1;
+				return true;
+			}
+		}
+		*cmp = a->size == b->size ? 0 : a->size < b->size ? -1 : 1;
+		return true;
+	}
+
+	uint64_t x, y;
+	if (!aml_to_integer(a, &x) || !aml_to_integer(b, &y))
+		return false;
+	*cmp = x == y ? 0 : x < y ? -1 : 1;
+	return true;
+}
+
+/*
+ * Evaluate an integer arithmetic or logical operator, the opcode has been
+ * consumed.
+ */
+static enum aml_status aml_arith(struct aml_frame *f, const uint8_t **pp, uint8_t op,
+                                 struct aml_object *res)
+{
+	uint64_t a, b = 0, rem;
+
+	if (aml_integer(f, pp, &a) != AML_STATUS_OK)
+		return AML_STATUS_ERROR;
+	if (op != AML_NOT && aml_integer(f, pp, &b) != AML_STATUS_OK)
+		return AML_STATUS_ERROR;
+
+	res->type = AML_INTEGER;
+	switch (op) {
+	case AML_ADD:         res->integer = a + b; break;
+	case AML_SUBTRACT:    res->integer = a - b; break;
+	case AML_MULTIPLY:    res->integer = a * b; break;
+	case AML_SHIFT_LEFT:  res->integer = b < 64 ? a << b : 0; break;
+	case AML_SHIFT_RIGHT: res->integer = b < 64 ? a >> b : 0; break;
+	case AML_AND:         res->integer = a & b; break;
+	case AML_NAND:        res->integer = ~(a & b); break;
+	case AML_OR:          res->integer = a | b; break;
+	case AML_NOR:         res->integer = ~(a | b); break;
+	case AML_XOR:         res->integer = a ^ b; break;
+	case AML_NOT:         res->integer = ~a; break;
+	case AML_MOD:
+		if (b == 0)
+			return AML_STATUS_ERROR;
+		divide64(a, b, &res->integer);
+		break;
+	case AML_DIVIDE: {
+		if (b == 0)
+			return AML_STATUS_ERROR;
+		res->integer = divide64(a, b, &rem);
+		struct aml_object remainder = { .type = AML_INTEGER, .integer = rem };
+		if (aml_store(f, pp, &remainder) != AML_STATUS_OK)
+			return AML_STATUS_ERROR;
+		break;
+	}
+	}
+	res->integer &= aml_ones;
+
+	return aml_store(f, pp, res);
+}
+
+/*
+ * Evaluate a logical operator, the opcode has been consumed.
+ */
+static enum aml_status aml_logic(struct aml_frame *f, const uint8_t **pp, uint8_t op,
+                                 bool invert, struct aml_object *res)
+{
+	struct aml_object a, b;
+	uint64_t x, y;
+	int cmp;
+	bool value;
+
+	switch (op) {
+	case AML_LAND:
+	case AML_LOR:
+		if (aml_integer(f, pp, &x) != AML_STATUS_OK ||
+		    aml_integer(f, pp, &y) != AML_STATUS_OK)
+			return AML_STATUS_ERROR;
+		value = op == AML_LAND ? x && y : x || y;
+		break;
+	case AML_LNOT:
+		if (aml_integer(f, pp, &x) != AML_STATUS_OK)
+			return AML_STATUS_ERROR;
+		value = !x;
+		break;
+	default:
+		if (aml_term(f, pp, &a) != AML_STATUS_OK ||
+		    aml_term(f, pp, &b) != AML_STATUS_OK ||
+		    !aml_compare(&a, &b, &cmp))
+			return AML_STATUS_ERROR;
+		value = op == AML_LEQUAL ? cmp == 0 : op == AML_LGREATER ? cmp > 0 : cmp < 0;
+	}
+
+	res->type = AML_INTEGER;
+	res->integer = value != invert ? aml_ones : 0;
+	return AML_STATUS_OK;
+}
+
+/*
+ * Create a buffer field, the opcode has been consumed. A zero width means the
+ * width follows the bit index, as in CreateField().
+ */
+static enum aml_status aml_create_field(struct aml_frame *f, const uint8_t **pp,
+                                        uint32_t width)
+{
+	struct aml_object buf;
+	uint64_t index, bits = width;
+	struct aml_name name;
+
+	if (aml_term(f, pp, &buf) != AML_STATUS_OK ||
+	    aml_integer(f, pp, &index) != AML_STATUS_OK ||
+	    (!width && aml_integer(f, pp, &bits) != AML_STATUS_OK))
+		return AML_STATUS_ERROR;
+	*pp = aml_parse_name(*pp, &name);
+
+	/* Fields must alias the storage of the named buffer. */
+	if (buf.type == AML_REFERENCE && buf.node && buf.node->type == AML_NODE_NAME &&
+	    buf.node->value)
+		buf = *buf.node->value;
+	if (buf.type != AML_BUFFER)
+		return AML_STATUS_ERROR;
+
+	struct aml_node *node = aml_create(f->scope, &name, AML_NODE_BUFFER_FIELD);
+	if (!node)
+		return AML_STATUS_ERROR;
+	node->type = AML_NODE_BUFFER_FIELD;
+	node->access = 1;
+	node->field.buffer = aml_alloc(sizeof (buf));
+	if (!node->field.buffer)
+		return AML_STATUS_ERROR;
+	*node->field.buffer = buf;
+	node->field.offset = width <= 1 ? index : index * 8;
+	node->field.width = bits;
+	return AML_STATUS_OK;
+}
+
+/*
+ * Declare the field units of a Field(), the opcode has been consumed.
+ */
+static enum aml_status aml_field(struct aml_frame *f, const uint8_t **pp)
+{
+	static const uint8_t access_sizes[] = {1, 1, 2, 4, 8, 1};
+	const uint8_t *end;
+	const uint8_t *p = aml_pkglen(*pp, &end);
+	struct aml_name name;
+	uint32_t offset = 0;
+
+	p = aml_parse_name(p, &name);
+	struct aml_node *region = aml_resolve(f->scope, &name);
+	uint8_t flags = *p++;
+	uint8_t access = access_sizes[(flags & 0xf) < 6 ? flags & 0xf : 0];
+
+	/* Walk the field list, named fields and reserved fields have a length. */
+	while (p < end) {
+		uint32_t bits;
+		if (*p == 0x00 || aml_is_name(*p)) {
+			const uint8_t *seg = p;
+			uint32_t len = p[*p == 0x00 ? 1 : 4];
+			uint32_t bytes = len >> 6;
+			const uint8_t *q = p + (*p == 0x00 ? 1 : 4);
+			bits = bytes ? len & 0xf : len & 0x3f;
+			for (uint32_t i = 0; i < bytes; i++)
+				bits |= (uint32_t) q[1 + i] << (4 + 8 * i);
+			p = q + 1 + bytes;
+			if (*seg != 0x00 && region) {
+				struct aml_name field = { .count = 1, .segs = seg };
+				struct aml_node *node = aml_create(f->scope, &field, AML_NODE_FIELD);
+				if (!node)
+					return AML_STATUS_ERROR;
+				node->type = AML_NODE_FIELD;
+				node->access = access;
+				node->field.region = region;
+				node->field.offset = offset;
+				node->field.width = bits;
+			}
+			offset += bits;
+		} else if (*p == 0x01) {        /* AccessField */
+			access = access_sizes[(p[1] & 0xf) < 6 ? p[1] & 0xf : 0];
+			p += 3;
+		} else if (*p == 0x03) {        /* ExtendedAccessField */
+			access = access_sizes[(p[1] & 0xf) < 6 ? p[1] & 0xf : 0];
+			p += 4;
+		} else {                        /* ConnectField and others */
+			break;
+		}
+	}
+
+	*pp = end;
+	return AML_STATUS_OK;
+}
+
+/*
+ * Skip the data object of a Name() declaration, it is only evaluated when
+ * used to keep the heap small.
+ */
+static const uint8_t *aml_skip_data(const uint8_t *p)
+{
+	const uint8_t *end;
+	struct aml_name name;
+
+	switch (*p) {
+	case AML_ZERO:
+	case AML_ONE:
+	case AML_ONES:
+		return p + 1;
+	case AML_BYTE_PREFIX:
+		return p + 2;
+	case AML_WORD_PREFIX:
+		return p + 3;
+	case AML_DWORD_PREFIX:
+		return p + 5;
+	case AML_QWORD_PREFIX:
+		return p + 9;
+	case AML_STRING_PREFIX:
+		return p + strlen((char *) p + 1) + 2;
+	case AML_BUFFER_OP:
+	case AML_PACKAGE_OP:
+	case AML_VAR_PACKAGE:
+		aml_pkglen(p + 1, &end);
+		return end;
+	case AML_EXT_PREFIX:
+		return p[1] == AML_EXT_REVISION ? p + 2 : NULL;
+	default:
+		return aml_is_name(*p) ? aml_parse_name(p, &name) : NULL;
+	}
+}
+
+/*
+ * Invoke a control method.
+ */
+static bool aml_invoke(struct aml_node *method, uint32_t argc, struct aml_object *args,
+                       struct aml_object *res, uint32_t depth)
+{
+	struct aml_frame frame;
+	uint32_t num_nodes = aml_num_nodes;
+
+	if (depth >= AML_MAX_DEPTH)
+		return false;
+
+	memset((char *) &frame, 0, sizeof (frame));
+	frame.scope = method;
+	frame.depth = depth;
+	for (uint32_t i = 0; i < argc && i < 7; i++)
+		frame.args[i] = args[i];
+
+	enum aml_status status = aml_block(&frame, method->aml, method->end);
+
+	/* Objects declared by the method only live as long as the invocation. */
+	aml_truncate(num_nodes);
+
+	if (status == AML_STATUS_ERROR)
+		return false;
+	*res = frame.retval;
+	return true;
+}
+
+/*
+ * Execute the body of a named scope such as a device. Errors are contained to
+ * the body so that one unsupported construct doesn't hide the rest of the
+ * namespace.
+ */
+static enum aml_status aml_scope(struct aml_frame *f, struct aml_node *node,
+                                 const uint8_t *p, const uint8_t *end)
+{
+	if (!node)
+		return AML_STATUS_ERROR;
+
+	struct aml_node *scope = f->scope;
+	f->scope = node;
+	enum aml_status status = aml_block(f, p, end);
+	f->scope = scope;
+	return status == AML_STATUS_ERROR ? AML_STATUS_OK : status;
+}
+
+/*
+ * Execute an If() and its optional Else(), the opcode has been consumed.
+ */
+static enum aml_status aml_if(struct aml_frame *f, const uint8_t **pp)
+{
+	const uint8_t *end, *else_end;
+	const uint8_t *p = aml_pkglen(*pp, &end);
+	enum aml_status status = AML_STATUS_OK;
+	uint64_t predicate;
+
+	if (aml_integer(f, &p, &predicate) != AML_STATUS_OK)
+		return AML_STATUS_ERROR;
+
+	if (predicate)
+		status = aml_block(f, p, end);
+	p = end;
+
+	if (*p == AML_ELSE) {
+		const uint8_t *body = aml_pkglen(p + 1, &else_end);
+		if (!predicate)
+			status = aml_block(f, body, else_end);
+		p = else_end;
+	}
+
+	*pp = p;
+	return status;
+}
+
+/*
+ * Execute a While() loop, the opcode has been consumed.
+ */
+static enum aml_status aml_while(struct aml_frame *f, const uint8_t **pp)
+{
+	const uint8_t *end;
+	const uint8_t *start = aml_pkglen(*pp, &end);
+
+	*pp = end;
+	for (uint32_t i = 0; i < AML_MAX_LOOPS; i++) {
+		const uint8_t *p = start;
+		uint64_t predicate;
+
+		if (aml_integer(f, &p, &predicate) != AML_STATUS_OK)
+			return AML_STATUS_ERROR;
+		if (!predicate)
+			return AML_STATUS_OK;
+
+		enum aml_status status = aml_block(f, p, end);
+		if (status == AML_STATUS_BREAK)
+			return AML_STATUS_OK;
+		if (status != AML_STATUS_OK && status != AML_STATUS_CONTINUE)
+			return status;
+	}
+
+	return AML_STATUS_ERROR;
+}
+
+/*
+ * Execute an Index(), yielding a reference to the element.
+ */
+static enum aml_status aml_index(struct aml_frame *f, const uint8_t **pp,
+                                 struct aml_object *res)
+{
+	struct aml_object src;
+	uint64_t index;
+
+	if (aml_term(f, pp, &src) != AML_STATUS_OK ||
+	    aml_integer(f, pp, &index) != AML_STATUS_OK)
+		return AML_STATUS_ERROR;
+	if (src.type == AML_REFERENCE && !aml_read_node(src.node, &src))
+		return AML_STATUS_ERROR;
+	if ((src.type != AML_PACKAGE && src.type != AML_BUFFER && src.type != AML_STRING) ||
+	    index >= src.size)
+		return AML_STATUS_ERROR;
+
+	if (src.type == AML_PACKAGE) {
+		res->type = AML_ELEMENT;
+		res->element = &src.package[index];
+	} else {
+		res->type = AML_BYTE;
+		res->buffer = &src.buffer[index];
+	}
+	return aml_store(f, pp, res);
+}
+
+/*
+ * Execute a DerefOf().
+ */
+static enum aml_status aml_deref(struct aml_frame *f, const uint8_t **pp,
+                                 struct aml_object *res)
+{
+	struct aml_object ref;
+
+	if (aml_term(f, pp, &ref) != AML_STATUS_OK)
+		return AML_STATUS_ERROR;
+
+	switch (ref.type) {
+	case AML_REFERENCE:
+		return ref.node && aml_read_node(ref.node, res) ? AML_STATUS_OK : AML_STATUS_ERROR;
+	case AML_ELEMENT:
+		*res = *ref.element;
+		if (res->type == AML_REFERENCE && res->node)
+			return aml_read_node(res->node, res) ? AML_STATUS_OK : AML_STATUS_ERROR;
+		return AML_STATUS_OK;
+	case AML_BYTE:
+		res->type = AML_INTEGER;
+		res->integer = *ref.buffer;
+		return AML_STATUS_OK;
+	default:
+		return AML_STATUS_ERROR;
+	}
+}
+
+/*
+ * Execute an Increment() or Decrement(). The operand is a simple name or
+ * variable, so it can be parsed twice.
+ */
+static enum aml_status aml_increment(struct aml_frame *f, const uint8_t **pp,
+                                     int64_t delta, struct aml_object *res)
+{
+	const uint8_t *target = *pp;
+	uint64_t value;
+
+	if (aml_integer(f, pp, &value) != AML_STATUS_OK)
+		return AML_STATUS_ERROR;
+	res->type = AML_INTEGER;
+	res->integer = (value + delta) & aml_ones;
+	return aml_store(f, &target, res);
+}
+
+/*
+ * Execute an extended opcode, the prefix has been consumed.
+ */
+static enum aml_status aml_ext_term(struct aml_frame *f, const uint8_t **pp,
+                                    struct aml_object *res)
+{
+	const uint8_t *p = *pp;
+	const uint8_t *end;
+	struct aml_name name;
+	struct aml_node *node;
+	struct aml_object tmp;
+	uint8_t node_type;
+	enum aml_status status = AML_STATUS_OK;
+
+	switch (*p++) {
+	case AML_EXT_MUTEX:
+		p = aml_parse_name(p, &name);
+		status = aml_create(f->scope, &name, AML_NODE_MUTEX) ? AML_STATUS_OK : AML_STATUS_ERROR;
+		p++;
+		break;
+	case AML_EXT_EVENT:
+		p = aml_parse_name(p, &name);
+		status = aml_create(f->scope, &name, AML_NODE_EVENT) ? AML_STATUS_OK : AML_STATUS_ERROR;
+		break;
+	case AML_EXT_COND_REF_OF:
+		if (!aml_is_name(*p))
+			return AML_STATUS_ERROR;
+		p = aml_parse_name(p, &name);
+		tmp.type = AML_REFERENCE;
+		tmp.node = aml_resolve(f->scope, &name);
+		res->type = AML_INTEGER;
+		res->integer = tmp.node ? aml_ones : 0;
+		if (tmp.node)
+			status = aml_store(f, &p, &tmp);
+		else
+			status = aml_store(f, &p, res);
+		break;
+	case AML_EXT_STALL:
+	case AML_EXT_SLEEP:
+	case AML_EXT_SIGNAL:
+	case AML_EXT_RESET:
+	case AML_EXT_RELEASE:
+		status = aml_term(f, &p, &tmp);
+		break;
+	case AML_EXT_ACQUIRE:
+		status = aml_term(f, &p, &tmp);
+		p += 2;
+		res->type = AML_INTEGER;
+		res->integer = 0;
+		break;
+	case AML_EXT_WAIT:
+		if (aml_term(f, &p, &tmp) != AML_STATUS_OK)
+			return AML_STATUS_ERROR;
+		status = aml_term(f, &p, &tmp);
+		res->type = AML_INTEGER;
+		res->integer = 0;
+		break;
+	case AML_EXT_REVISION:
+		res->type = AML_INTEGER;
+		res->integer = 1;
+		break;
+	case AML_EXT_TIMER:
+		res->type = AML_INTEGER;
+		res->integer = 0;
+		break;
+	case AML_EXT_CREATE_FIELD:
+		status = aml_create_field(f, &p, 0);
+		break;
+	case AML_EXT_REGION: {
+		uint64_t base, length;
+		p = aml_parse_name(p, &name);
+		uint8_t space = *p++;
+		if (aml_integer(f, &p, &base) != AML_STATUS_OK ||
+		    aml_integer(f, &p, &length) != AML_STATUS_OK ||
+		    !(node = aml_create(f->scope, &name, AML_NODE_REGION)))
+			return AML_STATUS_ERROR;
+		node->type = AML_NODE_REGION;
+		node->space = space;
+		node->region.base = base;
+		node->region.length = length;
+		break;
+	}
+	case AML_EXT_FIELD:
+		status = aml_field(f, &p);
+		break;
+	case AML_EXT_INDEX_FIELD:
+	case AML_EXT_BANK_FIELD:
+		/* Accessing these would require writes to hardware. */
+		aml_pkglen(p, &end);
+		p = end;
+		break;
+	case AML_EXT_DEVICE:
+	case AML_EXT_THERMAL_ZONE:
+		node_type = p[-1] == AML_EXT_DEVICE ? AML_NODE_DEVICE : AML_NODE_THERMAL;
+		p = aml_pkglen(p, &end);
+		p = aml_parse_name(p, &name);
+		status = aml_scope(f, aml_create(f->scope, &name, node_type), p, end);
+		p = end;
+		break;
+	case AML_EXT_PROCESSOR:
+		p = aml_pkglen(p, &end);
+		p = aml_parse_name(p, &name);
+		node = aml_create(f->scope, &name, AML_NODE_PROCESSOR);
+		status = aml_scope(f, node, p + 6, end);
+		p = end;
+		break;
+	case AML_EXT_POWER_RES:
+		p = aml_pkglen(p, &end);
+		p = aml_parse_name(p, &name);
+		node = aml_create(f->scope, &name, AML_NODE_POWER);
+		status = aml_scope(f, node, p + 3, end);
+		p = end;
+		break;
+	default:
+		return AML_STATUS_ERROR;
+	}
+
+	*pp = p;
+	return status;
+}
+
+/*
+ * Execute a single term, the value of expressions is returned in res.
+ */
+static enum aml_status aml_term(struct aml_frame *f, const uint8_t **pp,
+                                struct aml_object *res)
+{
+	const uint8_t *p = *pp;
+	const uint8_t *end;
+	uint8_t op = *p;
+	struct aml_name name;
+	struct aml_node *node;
+	struct aml_object tmp;
+	enum aml_status status = AML_STATUS_OK;
+
+	res->type = AML_UNINITIALISED;
+
+	/* Names evaluate to their object, or invoke the method. */
+	if (aml_is_name(op)) {
+		p = aml_parse_name(p, &name);
+		node = aml_resolve(f->scope, &name);
+		if (!node)
+			return AML_STATUS_ERROR;
+		if (node->type == AML_NODE_METHOD) {
+			struct aml_object args[7];
+			for (uint32_t i = 0; i < node->argc; i++)
+				if (aml_term(f, &p, &args[i]) != AML_STATUS_OK)
+					return AML_STATUS_ERROR;
+			if (!aml_invoke(node, node->argc, args, res, f->depth + 1))
+				return AML_STATUS_ERROR;
+		} else if (!aml_read_node(node, res)) {
+			return AML_STATUS_ERROR;
+		}
+		*pp = p;
+		return AML_STATUS_OK;
+	}
+
+	p++;
+	if (op >= AML_LOCAL0 && op <= AML_LOCAL7) {
+		*res = f->locals[op - AML_LOCAL0];
+		*pp = p;
+		return AML_STATUS_OK;
+	}
+	if (op >= AML_ARG0 && op <= AML_ARG6) {
+		*res = f->args[op - AML_ARG0];
+		*pp = p;
+		return AML_STATUS_OK;
+	}
+
+	switch (op) {
+	/* Data objects. */
+	case AML_ZERO:
+	case AML_ONE:
+		res->type = AML_INTEGER;
+		res->integer = op;
+		break;
+	case AML_ONES:
+		res->type = AML_INTEGER;
+		res->integer = aml_ones;
+		break;
+	case AML_BYTE_PREFIX:
+	case AML_WORD_PREFIX:
+	case AML_DWORD_PREFIX:
+	case AML_QWORD_PREFIX: {
+		uint32_t size = op == AML_BYTE_PREFIX ? 1 : op == AML_WORD_PREFIX ? 2 :
+			op == AML_DWORD_PREFIX ? 4 : 8;
+		res->type = AML_INTEGER;
+		res->integer = 0;
+		for (uint32_t i = 0; i < size; i++)
+			res->integer |= (uint64_t) p[i] << (i * 8);
+		p += size;
+		break;
+	}
+	case AML_STRING_PREFIX:
+		res->type = AML_STRING;
+		res->size = strlen((char *) p);
+		res->buffer = (uint8_t *) p;
+		p += res->size + 1;
+		break;
+	case AML_BUFFER_OP:
+		status = aml_buffer(f, &p, res);
+		break;
+	case AML_PACKAGE_OP:
+	case AML_VAR_PACKAGE:
+		status = aml_package(f, &p, op == AML_VAR_PACKAGE, res);
+		break;
+
+	/* Declarations. */
+	case AML_NAME:
+		p = aml_parse_name(p, &name);
+		node = aml_create(f->scope, &name, AML_NODE_NAME);
+		if (!node)
+			return AML_STATUS_ERROR;
+		node->type = AML_NODE_NAME;
+		node->aml = p;
+		node->value = NULL;
+		p = aml_skip_data(p);
+		if (!p)
+			return AML_STATUS_ERROR;
+		break;
+	case AML_SCOPE:
+		p = aml_pkglen(p, &end);
+		p = aml_parse_name(p, &name);
+		node = aml_resolve(f->scope, &name);
+		if (!node)
+			node = aml_create(f->scope, &name, AML_NODE_SCOPE);
+		status = aml_scope(f, node, p, end);
+		p = end;
+		break;
+	case AML_METHOD:
+		p = aml_pkglen(p, &end);
+		p = aml_parse_name(p, &name);
+		node = aml_create(f->scope, &name, AML_NODE_METHOD);
+		if (!node)
+			return AML_STATUS_ERROR;
+		node->type = AML_NODE_METHOD;
+		node->argc = *p & 0x7;
+		node->aml = p + 1;
+		node->end = end;
+		p = end;
+		break;
+	case AML_EXTERNAL:
+		p = aml_parse_name(p, &name) + 2;
+		break;
+	case AML_ALIAS: {
+		struct aml_name alias;
+		p = aml_parse_name(p, &name);
+		p = aml_parse_name(p, &alias);
+		node = aml_create(f->scope, &alias, AML_NODE_ALIAS);
+		if (!node)
+			return AML_STATUS_ERROR;
+		node->alias = aml_resolve(f->scope, &name);
+		break;
+	}
+	case AML_CREATE_DWORD_FIELD:
+		status = aml_create_field(f, &p, 32);
+		break;
+	case AML_CREATE_WORD_FIELD:
+		status = aml_create_field(f, &p, 16);
+		break;
+	case AML_CREATE_BYTE_FIELD:
+		status = aml_create_field(f, &p, 8);
+		break;
+	case AML_CREATE_BIT_FIELD:
+		status = aml_create_field(f, &p, 1);
+		break;
+	case AML_CREATE_QWORD_FIELD:
+		status = aml_create_field(f, &p, 64);
+		break;
+
+	/* Expressions. */
+	case AML_STORE:
+	case AML_COPY_OBJECT:
+		if (aml_term(f, &p, res) != AML_STATUS_OK)
+			return AML_STATUS_ERROR;
+		status = aml_store(f, &p, res);
+		break;
+	case AML_REF_OF:
+		if (!aml_is_name(*p))
+			return AML_STATUS_ERROR;
+		p = aml_parse_name(p, &name);
+		res->type = AML_REFERENCE;
+		res->node = aml_resolve(f->scope, &name);
+		if (!res->node)
+			return AML_STATUS_ERROR;
+		break;
+	case AML_ADD:
+	case AML_SUBTRACT:
+	case AML_MULTIPLY:
+	case AML_DIVIDE:
+	case AML_MOD:
+	case AML_SHIFT_LEFT:
+	case AML_SHIFT_RIGHT:
+	case AML_AND:
+	case AML_NAND:
+	case AML_OR:
+	case AML_NOR:
+	case AML_XOR:
+	case AML_NOT:
+		status = aml_arith(f, &p, op, res);
+		break;
+	case AML_INCREMENT:
+	case AML_DECREMENT:
+		status = aml_increment(f, &p, op == AML_INCREMENT ? 1 : -1, res);
+		break;
+	case AML_LNOT:
+		if (*p == AML_LEQUAL || *p == AML_LGREATER || *p == AML_LLESS) {
+			op = *p++;
+			status = aml_logic(f, &p, op, true, res);
+			break;
+		}
+		status = aml_logic(f, &p, op, false, res);
+		break;
+	case AML_LAND:
+	case AML_LOR:
+	case AML_LEQUAL:
+	case AML_LGREATER:
+	case AML_LLESS:
+		status = aml_logic(f, &p, op, false, res);
+		break;
+	case AML_DEREF_OF:
+		status = aml_deref(f, &p, res);
+		break;
+	case AML_SIZE_OF:
+		if (aml_term(f, &p, &tmp) != AML_STATUS_OK)
+			return AML_STATUS_ERROR;
+		if (tmp.type != AML_STRING && tmp.type != AML_BUFFER && tmp.type != AML_PACKAGE)
+			return AML_STATUS_ERROR;
+		res->type = AML_INTEGER;
+		res->integer = tmp.size;
+		break;
+	case AML_INDEX:
+		status = aml_index(f, &p, res);
+		break;
+	case AML_TO_INTEGER:
+		res->type = AML_INTEGER;
+		if (aml_integer(f, &p, &res->integer) != AML_STATUS_OK)
+			return AML_STATUS_ERROR;
+		status = aml_store(f, &p, res);
+		break;
+	case AML_TO_BUFFER:
+		if (aml_term(f, &p, res) != AML_STATUS_OK)
+			return AML_STATUS_ERROR;
+		if (res->type == AML_INTEGER) {
+			uint64_t value = res->integer;
+			res->type = AML_BUFFER;
+			res->size = aml_ones == ~0ULL ? 8 : 4;
+			res->buffer = aml_alloc(8);
+			if (!res->buffer)
+				return AML_STATUS_ERROR;
+			for (uint32_t i = 0; i < res->size; i++)
+				res->buffer[i] = value >> (i * 8);
+		} else if (res->type != AML_BUFFER) {
+			return AML_STATUS_ERROR;
+		}
+		status = aml_store(f, &p, res);
+		break;
+	case AML_NOTIFY:
+		if (aml_term(f, &p, &tmp) != AML_STATUS_OK)
+			return AML_STATUS_ERROR;
+		status = aml_term(f, &p, &tmp);
+		break;
+
+	/* Control flow. */
+	case AML_IF:
+		status = aml_if(f, &p);
+		break;
+	case AML_ELSE:
+		/* Only reached after a taken If(). */
+		aml_pkglen(p, &end);
+		p = end;
+		break;
+	case AML_WHILE:
+		status = aml_while(f, &p);
+		break;
+	case AML_NOOP:
+		break;
+	case AML_RETURN:
+		if (aml_term(f, &p, &f->retval) != AML_STATUS_OK)
+			return AML_STATUS_ERROR;
+		status = AML_STATUS_RETURN;
+		break;
+	case AML_BREAK:
+		status = AML_STATUS_BREAK;
+		break;
+	case AML_CONTINUE:
+		status = AML_STATUS_CONTINUE;
+		break;
+
+	case AML_EXT_PREFIX:
+		status = aml_ext_term(f, &p, res);
+		break;
+	default:
+		return AML_STATUS_ERROR;
+	}
+
+	*pp = p;
+	return status;
+}
+
+/*
+ * Execute a list of terms.
+ */
+static enum aml_status aml_block(struct aml_frame *f, const uint8_t *p,
+                                 const uint8_t *end)
+{
+	while (p < end) {
+		struct aml_object res;
+		enum aml_status status = aml_term(f, &p, &res);
+		if (status != AML_STATUS_OK)
+			return status;
+	}
+	return AML_STATUS_OK;
+}
+
+/*
+ * Load a definition block (DSDT or SSDT) into the namespace.
+ */
+bool aml_load_table(struct acpi_header *table)
+{
+	static const char *predefined[] = {"_GPE", "_PR_", "_SB_", "_SI_", "_TZ_"};
+
+	/* Create the root and the predefined scopes on first use. */
+	if (aml_num_nodes == 0) {
+		memset((char *) &aml_nodes[0], 0, sizeof (aml_nodes[0]));
+		aml_nodes[0].name = AML_SEG("\\___");
+		aml_num_nodes = 1;
+		for (uint32_t i = 0; i < sizeof (predefined) / sizeof (predefined[0]); i++) {
+			struct aml_name name = { .count = 1, .segs = (const uint8_t *) predefined[i] };
+			aml_create(&aml_nodes[0], &name, AML_NODE_SCOPE);
+		}
+	}
+
+	/* The DSDT revision sets the integer width. */
+	if (!memcmp(table->signature, "DSDT", 4) && table->revision < 2)
+		aml_ones = 0xffffffff;
+
+	struct aml_frame frame = { .scope = &aml_nodes[0] };
+	const uint8_t *p = (const uint8_t *) (table + 1);
+	const uint8_t *end = (const uint8_t *) table + table->length;
+
+	while (p < end) {
+		struct aml_object res;
+		const uint8_t *term = p;
+		if (aml_term(&frame, &p, &res) == AML_STATUS_ERROR) {
+			serial_printf("[!] Warning: unsupported AML at offset %x of %c%c%c%c, skipping the rest\n",
+			              term - (const uint8_t *) table,
+			              table->signature[0], table->signature[1],
+			              table->signature[2], table->signature[3]);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Get the root of the namespace, NULL if no table was loaded.
+ */
+struct aml_node *aml_root(void)
+{
+	return aml_num_nodes ? &aml_nodes[0] : NULL;
+}
+
+/*
+ * Look up an object by its path, such as "_PRT" or "\\_SB_.PCI0". Relative
+ * paths are not searched for in the parent scopes.
+ */
+struct aml_node *aml_lookup(struct aml_node *scope, const char *path)
+{
+	struct aml_node *node = scope;
+
+	if (*path == '\\') {
+		node = aml_root();
+		path++;
+	}
+	while (node && *path) {
+		node = aml_follow(aml_child(node, AML_SEG(path)));
+		path += 4;
+		if (*path == '.')
+			path++;
+	}
+	return node;
+}
+
+/*
+ * Evaluate an object, invoking it if it is a method.
+ */
+bool aml_evaluate(struct aml_node *node, uint32_t argc, struct aml_object *args,
+                  struct aml_object *result)
+{
+	if (node->type == AML_NODE_METHOD)
+		return aml_invoke(node, argc, args, result, 0);
+	return aml_read_node(node, result);
+}
+
+/*
+ * Evaluate an object relative to a scope to an integer. Returns false if it
+ * doesn't exist or cannot be evaluated.
+ */
+bool aml_evaluate_integer(struct aml_node *scope, const char *path, uint64_t *value)
+{
+	struct aml_node *node = aml_lookup(scope, path);
+	struct aml_object obj;
+
+	return node && aml_evaluate(node, 0, NULL, &obj) && aml_to_integer(&obj, value);
+}
+
+/*
+ * Check whether an identifier object (integer EISA ID or string) matches.
+ */
+static bool aml_match_id(struct aml_object *id, uint32_t eisaid, const char *str)
+{
+	if (id->type == AML_INTEGER)
+		return id->integer == eisaid;
+	if (id->type == AML_STRING)
+		return id->size == strlen((char *) str) &&
+			!memcmp((char *) id->buffer, (char *) str, id->size);
+	if (id->type == AML_PACKAGE) {
+		for (uint32_t i = 0; i < id->size; i++)
+			if (aml_match_id(&id->package[i], eisaid, str))
+				return true;
+	}
+	return false;
+}
+
+/*
+ * Check whether a device is a PCI host bridge, from its hardware or compatible
+ * identifiers.
+ */
+bool aml_is_pci_root(struct aml_node *device)
+{
+	static const char *names[] = {"_HID", "_CID"};
+	struct aml_object id;
+
+	for (uint32_t i = 0; i < 2; i++) {
+		struct aml_node *node = aml_lookup(device, names[i]);
+		if (node && aml_evaluate(node, 0, NULL, &id) &&
+		    (aml_match_id(&id, AML_EISAID_PNP0A03, "PNP0A03") ||
+		     aml_match_id(&id, AML_EISAID_PNP0A08, "PNP0A08")))
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Find the PCI segment and bus number behind a host bridge or PCI-to-PCI
+ * bridge device.
+ */
+bool aml_pci_bus(struct aml_node *device, uint16_t *segment, uint8_t *bus)
+{
+	uint64_t value;
+
+	if (!device || device->type != AML_NODE_DEVICE)
+		return false;
+
+	if (aml_is_pci_root(device)) {
+		*segment = aml_evaluate_integer(device, "_SEG", &value) ? value : 0;
+		*bus = aml_evaluate_integer(device, "_BBN", &value) ? value : 0;
+		return true;
+	}
+
+	/* A bridge, its secondary bus is programmed by the firmware. */
+	uint8_t parent_bus;
+	if (!aml_evaluate_integer(device, "_ADR", &value) ||
+	    !aml_pci_bus(device->parent, segment, &parent_bus))
+		return false;
+
+	uint8_t dev = (value >> 16) & 0x1f, fun = value & 0x7;
+	if (!pci_exists(*segment, parent_bus, dev, fun) ||
+	    (pci_read8(*segment, parent_bus, dev, fun, PCI_HEADER_TYPE)
+	     & PCI_HEADER_TYPE_MASK) != PCI_HEADER_TYPE_BRIDGE)
+		return false;
+	*bus = pci_read8(*segment, parent_bus, dev, fun, PCI_SECONDARY_BUS);
+	return true;
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "config.h"
+#include "serial.h"
+#include "utils.h"
+
+/* Initial capacity of the growable vectors. */
+#define VECTOR_MIN_CAPACITY     8
+
+/*
+ * Scratch memory pool. Allocations are never freed, we only ever run once and
+ * the whole pool is part of the image which the target doesn't use anyway.
+ */
+static char arena[CONFIG_ARENA_SIZE] __attribute__((aligned(16)));
+static uint32_t arena_top;
+
+/*
+ * Allocate zeroed memory from the arena. NULL is returned when the arena is
+ * exhausted.
+ */
+void *arena_alloc(uint32_t size)
+{
+	size = (size + 15) & ~15;
+	if (size > sizeof (arena) - arena_top) {
+		serial_printf("[X] Error: out of memory allocating %d bytes, please raise CONFIG_ARENA_SIZE\n",
+		              size);
+		return NULL;
+	}
+
+	char *ptr = &arena[arena_top];
+	arena_top += size;
+	memset(ptr, 0, size);
+	return ptr;
+}
+
+/*
+ * Make room for one more element in a growable vector, doubling its capacity
+ * when full.
+ */
+bool arena_vector_reserve(void **list, uint32_t count, uint32_t *capacity,
+                          uint32_t elemsize)
+{
+	if (count < *capacity)
+		return true;
+
+	uint32_t newcap = *capacity ? *capacity * 2 : VECTOR_MIN_CAPACITY;
+	char *newlist = arena_alloc(newcap * elemsize);
+	if (newlist == NULL)
+		return false;
+
+	if (*list)
+		memcpy(newlist, *list, count * elemsize);
+	*list = newlist;
+	*capacity = newcap;
+	return true;
+}
@@ -0,0 +1,408 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/*
+ * Chainloading of the first multiboot2 module, with the machine file passed
+ * in a multiboot2 info tag, so that the next stage gets the machine file
+ * without another reboot. The module is loaded like a multiboot2 boot loader
+ * would: from its ELF program headers or its address header tag. The copy
+ * happens in a trampoline placed in free memory, as the module is usually
+ * linked at the same address as machinedump.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "chainload.h"
+#include "elf.h"
+#include "multiboot2.h"
+#include "serial.h"
+#include "sysinfo.h"
+#include "utils.h"
+
+#define PAGE_SIZE               0x1000
+
+/* Trampoline code, see entry.S. */
+extern char chainload_trampoline[];
+extern char chainload_trampoline_end[];
+
+/* Segments of the image being loaded, and its entry point. */
+static struct chainload_segment segments[CHAINLOAD_MAX_SEGMENTS];
+static uint32_t num_segments;
+static uint32_t entry;
+
+/*
+ * Memory still read until the jump or handed over to the next stage: the
+ * modules and the original multiboot2 info.
+ */
+static uint32_t keep[CHAINLOAD_MAX_MODULES + 1][2];
+static uint32_t num_keep;
+
+/*
+ * Check whether two ranges of addresses overlap.
+ */
+static bool overlaps(uint64_t base1, uint64_t end1, uint64_t base2, uint64_t end2)
+{
+	return base1 < end2 && base2 < end1;
+}
+
+/*
+ * Add a segment to load, source relative to the module.
+ */
+static bool add_segment(uint64_t dst, uint32_t src, uint64_t filesz, uint64_t memsz)
+{
+	if (!memsz)
+		return true;
+	if ((dst + memsz) >> 32 || filesz > memsz) {
+		serial_printf("[X] Error: chainloaded segment at %X doesn't fit below 4GiB!\n", dst);
+		return false;
+	}
+	if (num_segments == CHAINLOAD_MAX_SEGMENTS) {
+		serial_puts("[X] Error: too many segments to chainload!\n");
+		return false;
+	}
+	segments[num_segments].dst = dst;
+	segments[num_segments].src = src;
+	segments[num_segments].filesz = filesz;
+	segments[num_segments].memsz = memsz;
+	num_segments++;
+	return true;
+}
+
+/*
+ * Get the segments and the entry point from the ELF program headers. Like
+ * GRUB, the physical addresses are used and the entry point is translated
+ * to the physical address of the segment holding it.
+ */
+static bool load_elf(uint32_t start, uint32_t size)
+{
+	struct elf_ident *ident = (void *) start;
+
+	if (size < sizeof (struct elf64_header) || memcmp(ident->magic, ELF_MAGIC, 4) ||
+	    ident->data != ELF_DATA_LSB) {
+		serial_puts("[X] Error: chainloaded module isn't a little-endian ELF file!\n");
+		return false;
+	}
+
+	if (ident->class == ELF_CLASS_32) {
+		struct elf32_header *header = (void *) start;
+		if (header->type != ELF_TYPE_EXEC || header->machine != ELF_MACHINE_386 ||
+		    header->phentsize != sizeof (struct elf32_phdr) ||
+		    header->phoff + header->phnum * sizeof (struct elf32_phdr) > size)
+			goto invalid;
+		entry = header->entry;
+		for (uint32_t i = 0; i < header->phnum; i++) {
+			struct elf32_phdr *phdr = (void *) (start + header->phoff) + i * header->phentsize;
+			if (phdr->type != ELF_PT_LOAD)
+				continue;
+			if ((uint64_t) phdr->offset + phdr->filesz > size)
+				goto invalid;
+			if (entry >= phdr->vaddr && entry - phdr->vaddr < phdr->memsz)
+				entry = entry - phdr->vaddr + phdr->paddr;
+			if (!add_segment(phdr->paddr, phdr->offset, phdr->filesz, phdr->memsz))
+				return false;
+		}
+		return true;
+	}
+
+	if (ident->class == ELF_CLASS_64) {
+		struct elf64_header *header = (void *) start;
+		if (header->type != ELF_TYPE_EXEC || header->machine != ELF_MACHINE_X86_64 ||
+		    header->phentsize != sizeof (struct elf64_phdr) ||
+		    header->phoff + header->phnum * sizeof (struct elf64_phdr) > size)
+			goto invalid;
+		uint64_t entry64 = header->entry;
+		for (uint32_t i = 0; i < header->phnum; i++) {
+			struct elf64_phdr *phdr =
+				(void *) (start + (uint32_t) header->phoff) + i * header->phentsize;
+			if (phdr->type != ELF_PT_LOAD)
+				continue;
+			if (phdr->offset + phdr->filesz > size)
+				goto invalid;
+			if (entry64 >= phdr->vaddr && entry64 - phdr->vaddr < phdr->memsz)
+				entry64 = entry64 - phdr->vaddr + phdr->paddr;
+			if (!add_segment(phdr->paddr, phdr->offset, phdr->filesz, phdr->memsz))
+				return false;
+		}
+		if (entry64 >> 32) {
+			serial_puts("[X] Error: chainloaded entry point above 4GiB!\n");
+			return false;
+		}
+		entry = entry64;
+		return true;
+	}
+
+invalid:
+	serial_puts("[X] Error: chainloaded module isn't a valid x86 ELF executable!\n");
+	return false;
+}
+
+/*
+ * Find the multiboot2 header of the module and get the segments to load and
+ * the entry point.
+ */
+static bool load_module(uint32_t start, uint32_t size)
+{
+	struct multiboot2_header *header = NULL;
+	uint32_t offset;
+
+	for (offset = 0; offset + sizeof (*header) <= size &&
+	     offset < MULTIBOOT2_HEADER_SEARCH; offset += 8) {
+		struct multiboot2_header *h = (void *) (start + offset);
+		if (h->magic == MULTIBOOT2_HEADER_MAGIC && h->architecture == 0 &&
+		    h->magic + h->architecture + h->header_length + h->checksum == 0) {
+			header = h;
+			break;
+		}
+	}
+	if (!header || offset + header->header_length > size) {
+		serial_puts("[X] Error: chainloaded module has no multiboot2 header!\n");
+		return false;
+	}
+
+	/* Walk the header tags. */
+	struct multiboot2_header_tag_address *address = NULL;
+	struct multiboot2_header_tag_entry *entry_tag = NULL;
+	uint32_t tag_addr = (uint32_t) (header + 1);
+	uint32_t tag_endaddr = (uint32_t) header + header->header_length;
+	while (tag_addr + sizeof (struct multiboot2_header_tag) <= tag_endaddr) {
+		struct multiboot2_header_tag *tag = (void *) tag_addr;
+		if (tag->type == MULTIBOOT2_HEADER_TAG_END)
+			break;
+
+		switch (tag->type) {
+		case MULTIBOOT2_HEADER_TAG_ADDRESS:
+			address = (void *) (tag + 1);
+			break;
+		case MULTIBOOT2_HEADER_TAG_ENTRY_ADDRESS:
+			entry_tag = (void *) (tag + 1);
+			break;
+		case MULTIBOOT2_HEADER_TAG_INFORMATION_REQUEST:
+		case MULTIBOOT2_HEADER_TAG_CONSOLE_FLAGS:
+		case MULTIBOOT2_HEADER_TAG_FRAMEBUFFER:
+		case MULTIBOOT2_HEADER_TAG_MODULE_ALIGN:
+		case MULTIBOOT2_HEADER_TAG_RELOCATABLE:
+			/* What we pass is what we have, and it's loaded where linked. */
+			break;
+		default:
+			if (!(tag->flags & MULTIBOOT2_HEADER_TAG_OPTIONAL)) {
+				serial_printf("[X] Error: chainloaded module needs multiboot2 header tag %d!\n",
+				              tag->type);
+				return false;
+			}
+		}
+		tag_addr += roundup64(tag->size);
+	}
+
+	/* The address tag takes precedence over the ELF program headers. */
+	if (address) {
+		uint32_t src = offset - (address->header_addr - address->load_addr);
+		uint32_t filesz = address->load_end_addr ?
+			address->load_end_addr - address->load_addr : size - src;
+		uint32_t memsz = address->bss_end_addr ?
+			address->bss_end_addr - address->load_addr : filesz;
+		if (src > size || filesz > size - src || memsz < filesz) {
+			serial_puts("[X] Error: invalid chainloaded multiboot2 address tag!\n");
+			return false;
+		}
+		if (!add_segment(address->load_addr, src, filesz, memsz))
+			return false;
+	} else if (!load_elf(start, size)) {
+		return false;
+	}
+	if (entry_tag)
+		entry = entry_tag->entry_addr;
+	return true;
+}
+
+/*
+ * Collect the ranges to keep, the original multiboot2 info and every module
+ * as the other ones are passed on to the next stage.
+ */
+static bool find_keep(uint32_t info_addr)
+{
+	struct multiboot2_info_header *info = (void *) info_addr;
+
+	keep[0][0] = info_addr;
+	keep[0][1] = info_addr + info->total_size;
+	num_keep = 1;
+
+	uint32_t tag_addr = info_addr + sizeof (*info);
+	while (tag_addr < info_addr + info->total_size) {
+		struct multiboot2_tag_header *tag = (void *) tag_addr;
+		if (tag->type == MULTIBOOT2_INFO_TAG_END)
+			break;
+		if (tag->type == MULTIBOOT2_INFO_TAG_MODULE) {
+			struct multiboot2_tag_module *module = (void *) (tag + 1);
+			if (num_keep == CHAINLOAD_MAX_MODULES + 1) {
+				serial_puts("[X] Error: too many multiboot2 modules to chainload!\n");
+				return false;
+			}
+			keep[num_keep][0] = module->mod_start;
+			keep[num_keep][1] = module->mod_end;
+			num_keep++;
+		}
+		tag_addr = roundup64(tag_addr + tag->size);
+	}
+	return true;
+}
+
+/*
+ * Find free memory below 4GiB for the hand-off block, out of the way of the
+ * segments it is copied to and of the ranges to keep. The highest fit is
+ * taken. The machinedump image is already left out of the memory regions.
+ */
+static uint32_t find_block(uint32_t size)
+{
+	uint32_t best = 0;
+
+	for (uint32_t i = 0; i < sysinfo.memory.count; i++) {
+		uint64_t base = (sysinfo.memory.list[i].addr + PAGE_SIZE - 1) & ~(uint64_t) (PAGE_SIZE - 1);
+		uint64_t end = sysinfo.memory.list[i].addr + sysinfo.memory.list[i].size;
+		if (end > 0x100000000ULL)
+			end = 0x100000000ULL;
+		if (end < base + size)
+			continue;
+
+		/* Try the top of the region, then below the lowest conflicting range. */
+		uint64_t addr = (end - size) & ~(uint64_t) (PAGE_SIZE - 1);
+		while (addr >= base) {
+			uint64_t conflict = 0;
+			for (uint32_t j = 0; j < num_keep; j++)
+				if (overlaps(addr, addr + size, keep[j][0], keep[j][1]) &&
+				    (!conflict || keep[j][0] < conflict))
+					conflict = keep[j][0];
+			for (uint32_t j = 0; j < num_segments; j++)
+				if (overlaps(addr, addr + size, segments[j].dst,
+				             (uint64_t) segments[j].dst + segments[j].memsz) &&
+				    (!conflict || segments[j].dst < conflict))
+					conflict = segments[j].dst;
+			if (!conflict) {
+				if (addr > best)
+					best = addr;
+				break;
+			}
+			if (conflict < base + size)
+				break;
+			addr = (conflict - size) & ~(uint64_t) (PAGE_SIZE - 1);
+		}
+	}
+	return best;
+}
+
+/*
+ * Append a tag to the multiboot2 info structure being built, returns its data.
+ */
+static void *add_tag(uint32_t *mbi_end, uint32_t type, uint32_t size)
+{
+	struct multiboot2_tag_header *tag = (void *) *mbi_end;
+
+	tag->type = type;
+	tag->size = sizeof (*tag) + size;
+	*mbi_end = roundup64(*mbi_end + tag->size);
+	return tag + 1;
+}
+
+/*
+ * Load the first multiboot2 module and jump to it, with the multiboot2 info
+ * of machinedump minus the module, the module command line, and the machine
+ * file output by dump in a MULTIBOOT2_INFO_TAG_MACHINE_FILE tag. Only returns
+ * on error.
+ */
+bool chainload(uint32_t info_addr, void (*dump)(void))
+{
+	struct multiboot2_tag_header *module_tag = multiboot2_tag(MULTIBOOT2_INFO_TAG_MODULE);
+	if (!module_tag) {
+		serial_puts("[X] Error: no multiboot2 module to chainload!\n");
+		return false;
+	}
+	struct multiboot2_tag_module *module = (void *) (module_tag + 1);
+	const char *cmdline = (const char *) (module + 1);
+	if (module->mod_end <= module->mod_start || !load_module(module->mod_start,
+	                                                         module->mod_end - module->mod_start))
+		return false;
+	if (!find_keep(info_addr))
+		return false;
+	for (uint32_t i = 0; i < num_segments; i++) {
+		/* The original multiboot2 info is no longer read once the segments are copied. */
+		for (uint32_t j = 1; j < num_keep; j++) {
+			if (overlaps(segments[i].dst, (uint64_t) segments[i].dst + segments[i].memsz,
+			             keep[j][0], keep[j][1])) {
+				serial_printf("[X] Error: chainloaded segment at %x overlaps a module!\n",
+				              segments[i].dst);
+				return false;
+			}
+		}
+	}
+
+	/* Size the machine file, and the hand-off block. */
+	uint32_t length;
+	serial_window_begin(0, 0, true);
+	dump();
+	serial_window_end(&length);
+
+	struct multiboot2_info_header *info = (void *) info_addr;
+	uint32_t code_size = chainload_trampoline_end - chainload_trampoline;
+	uint32_t code_offset = sizeof (struct chainload_block) + num_segments * sizeof (segments[0]);
+	uint32_t mbi_offset = roundup64(code_offset + code_size);
+	uint32_t size = mbi_offset + info->total_size + roundup64(strlen((char *) cmdline) + 1) +
+		roundup64(length + 1) + 3 * sizeof (struct multiboot2_tag_header);
+
+	uint32_t addr = find_block(size);
+	if (!addr) {
+		serial_puts("[X] Error: no free memory to chainload the module!\n");
+		return false;
+	}
+
+	/* The segment list and the trampoline code. */
+	struct chainload_block *block = (void *) addr;
+	block->entry = entry;
+	block->mbi = addr + mbi_offset;
+	block->num_segments = num_segments;
+	for (uint32_t i = 0; i < num_segments; i++) {
+		block->segment[i] = segments[i];
+		block->segment[i].src += module->mod_start;
+	}
+	memcpy((char *) addr + code_offset, chainload_trampoline, code_size);
+
+	/*
+	 * The multiboot2 info, with the tags describing machinedump itself or
+	 * the chainloaded module left out.
+	 */
+	uint32_t mbi_end = block->mbi + sizeof (struct multiboot2_info_header);
+	char *tag_cmdline = add_tag(&mbi_end, MULTIBOOT2_INFO_TAG_COMMAND_LINE,
+	                            strlen((char *) cmdline) + 1);
+	memcpy(tag_cmdline, (char *) cmdline, strlen((char *) cmdline) + 1);
+
+	uint32_t tag_addr = info_addr + sizeof (*info);
+	while (tag_addr < info_addr + info->total_size) {
+		struct multiboot2_tag_header *tag = (void *) tag_addr;
+		if (tag->type == MULTIBOOT2_INFO_TAG_END)
+			break;
+		if (tag->type != MULTIBOOT2_INFO_TAG_COMMAND_LINE &&
+		    tag->type != MULTIBOOT2_INFO_TAG_ELF_SYMBOLS &&
+		    tag->type != MULTIBOOT2_INFO_TAG_LOAD_BASE_PADDR && tag != module_tag)
+			memcpy(add_tag(&mbi_end, tag->type, tag->size - sizeof (*tag)),
+			       (char *) (tag + 1), tag->size - sizeof (*tag));
+		tag_addr = roundup64(tag_addr + tag->size);
+	}
+
+	char *machine_file = add_tag(&mbi_end, MULTIBOOT2_INFO_TAG_MACHINE_FILE, length + 1);
+	serial_capture_begin(machine_file, length);
+	dump();
+	serial_window_end(NULL);
+	machine_file[length] = '\0';
+
+	add_tag(&mbi_end, MULTIBOOT2_INFO_TAG_END, 0);
+	struct multiboot2_info_header *mbi = (void *) block->mbi;
+	mbi->total_size = mbi_end - block->mbi;
+	mbi->reserved = 0;
+
+	serial_printf("[*] Chainloading %s at %x with the machine file at %x\n",
+	              cmdline, entry, (uint32_t) machine_file);
+	((void (*)(struct chainload_block *)) (addr + code_offset))(block);
+	return false;
+}
@@ -0,0 +1,212 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/*
+ * Console discovery. The firmware advertises its console in the SPCR table,
+ * and its debug ports in the DBG2 table, which is how servers expose the BMC
+ * serial-over-LAN port when it isn't one of the legacy I/O port UARTs.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "acpi.h"
+#include "console.h"
+#include "options.h"
+#include "pci.h"
+#include "serial.h"
+#include "utils.h"
+
+/*
+ * Check whether a DBG2 serial port subtype is a 16550 UART we can drive.
+ */
+static bool console_16550(uint16_t subtype)
+{
+	return subtype == ACPI_DBG2_16550 ||
+	       subtype == ACPI_DBG2_16550_SUBSET ||
+	       subtype == ACPI_DBG2_16550_GAS;
+}
+
+/*
+ * Describe a 16550 UART from the generic address structure of its registers.
+ * Memory mapped registers are accessed with the access size of the structure,
+ * and spaced by it too unless the register width of a 16550 described by
+ * GAS is larger. The baud rate is left to the firmware.
+ */
+static bool console_from_gas(struct acpi_gas *gas, uint16_t subtype, struct serial_config *serial)
+{
+	if (gas->space_id == ACPI_GAS_SPACE_IO) {
+		if (!gas->address || gas->address > 0xffff)
+			return false;
+		*serial = (struct serial_config) SERIAL_CONFIG_PORT(gas->address);
+		serial->baud = 0;
+		return true;
+	}
+
+	if (gas->space_id != ACPI_GAS_SPACE_MEMORY || !gas->address)
+		return false;
+	if (gas->address >> 32) {
+		serial_printf("[!] Warning: console registers at %X are above 4GiB\n", gas->address);
+		return false;
+	}
+
+	uint8_t width = gas->bit_width / 8;
+	if (gas->access_size)
+		width = 1 << (gas->access_size - 1);
+	if (width != 1 && width != 2 && width != 4) {
+		if (gas->access_size)
+			return false;
+		width = 1;
+	}
+
+	uint8_t stride = width;
+	if (subtype == ACPI_DBG2_16550_GAS && gas->bit_width / 8 > width &&
+	    (gas->bit_width == 16 || gas->bit_width == 32))
+		stride = gas->bit_width / 8;
+
+	*serial = (struct serial_config) {
+		.mmio   = true,
+		.base   = gas->address,
+		.stride = stride,
+		.width  = width,
+		.clock  = CONFIG_SERIAL_CLOCK,
+	};
+	return true;
+}
+
+/*
+ * Make sure that the PCI UART of the SPCR decodes its registers, taking them
+ * from its first BAR if the table doesn't give their address.
+ */
+static bool console_pci(struct acpi_spcr *spcr, struct acpi_gas *gas)
+{
+	uint16_t segment = spcr->pci_segment;
+	uint8_t bus = spcr->pci_bus, dev = spcr->pci_device, fun = spcr->pci_function;
+
+	if (!pci_exists(segment, bus, dev, fun)) {
+		serial_printf("[!] Warning: SPCR PCI UART %x:%x.%x not found\n", bus, dev, fun);
+		return false;
+	}
+
+	if (!gas->address) {
+		uint32_t bar = pci_read32(segment, bus, dev, fun, PCI_BAR0);
+		if (bar & PCI_BAR_IO) {
+			gas->space_id = ACPI_GAS_SPACE_IO;
+			gas->address = bar & PCI_BAR_IO_MASK;
+		} else {
+			gas->space_id = ACPI_GAS_SPACE_MEMORY;
+			gas->address = bar & PCI_BAR_MEM_MASK;
+			if (bar & PCI_BAR_MEM_64)
+				gas->address |= (uint64_t) pci_read32(segment, bus, dev, fun, PCI_BAR0 + 4) << 32;
+		}
+	}
+
+	uint8_t command = pci_read8(segment, bus, dev, fun, PCI_COMMAND);
+	command |= gas->space_id == ACPI_GAS_SPACE_IO ? PCI_COMMAND_IO : PCI_COMMAND_MEMORY;
+	pci_write8(segment, bus, dev, fun, PCI_COMMAND, command);
+	return true;
+}
+
+/*
+ * Describe the console of the SPCR table, with its baud rate and, from
+ * revision 3, the input clock of the UART.
+ */
+static bool console_from_spcr(struct acpi_spcr *spcr, struct serial_config *serial)
+{
+	struct acpi_gas gas = spcr->base_address;
+
+	if (spcr->header.length < offsetof(struct acpi_spcr, uart_clock)) {
+		serial_puts("[!] Warning: malformed SPCR table, ignored\n");
+		return false;
+	}
+	if (!console_16550(spcr->interface_type)) {
+		serial_printf("[!] Warning: SPCR console type %x not supported\n", spcr->interface_type);
+		return false;
+	}
+	if (spcr->pci_device_id != ACPI_SPCR_NO_PCI && !console_pci(spcr, &gas))
+		return false;
+	if (!console_from_gas(&gas, spcr->interface_type, serial))
+		return false;
+
+	switch (spcr->baud_rate) {
+	case ACPI_SPCR_BAUD_9600:   serial->baud = 9600;   break;
+	case ACPI_SPCR_BAUD_19200:  serial->baud = 19200;  break;
+	case ACPI_SPCR_BAUD_57600:  serial->baud = 57600;  break;
+	case ACPI_SPCR_BAUD_115200: serial->baud = 115200; break;
+	default:                    serial->baud = 0;      break;
+	}
+	if (ACPI_SPCR_HAS(spcr, uart_clock, 3) && spcr->uart_clock)
+		serial->clock = spcr->uart_clock;
+	if (ACPI_SPCR_HAS(spcr, precise_baud_rate, 4) && spcr->precise_baud_rate)
+		serial->baud = spcr->precise_baud_rate;
+	return true;
+}
+
+/*
+ * Describe the first 16550 serial port of the DBG2 table.
+ */
+static bool console_from_dbg2(struct acpi_dbg2 *dbg2, struct serial_config *serial)
+{
+	uint32_t addr = (uint32_t) dbg2 + dbg2->info_offset;
+	uint32_t end = (uint32_t) dbg2 + dbg2->header.length;
+
+	for (uint32_t i = 0; i < dbg2->info_count; i++) {
+		struct acpi_dbg2_device *device = (void *) addr;
+		if (addr + sizeof (*device) > end || device->length < sizeof (*device) ||
+		    addr + device->length > end) {
+			serial_puts("[!] Warning: malformed DBG2 device, ignored\n");
+			return false;
+		}
+		addr += device->length;
+
+		if (device->port_type != ACPI_DBG2_TYPE_SERIAL || !console_16550(device->port_subtype) ||
+		    !device->num_registers ||
+		    device->base_address_offset + sizeof (struct acpi_gas) > device->length)
+			continue;
+
+		struct acpi_gas *gas = (void *) ((uint32_t) device + device->base_address_offset);
+		if (console_from_gas(gas, device->port_subtype, serial))
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Switch to the console advertised by the firmware, the SPCR one or else the
+ * first 16550 debug port of the DBG2 table, at the baud rate the firmware
+ * uses. The current console is kept if neither table describes one we can
+ * drive.
+ */
+void console_discover(void)
+{
+	struct serial_config serial;
+	struct acpi_header *header;
+	char *source;
+
+	if ((header = acpi_find_table("SPCR", 0)) &&
+	    console_from_spcr((struct acpi_spcr *) header, &serial))
+		source = "SPCR";
+	else if ((header = acpi_find_table("DBG2", 0)) &&
+	         console_from_dbg2((struct acpi_dbg2 *) header, &serial))
+		source = "DBG2";
+	else
+		return;
+
+	/* Nothing to do if already there, unless the baud rate changes. */
+	if (serial.mmio == options.serial.mmio && serial.base == options.serial.base &&
+	    (!serial.baud || (serial.baud == options.serial.baud && serial.clock == options.serial.clock)))
+		return;
+
+	serial_printf("[*] Switching to the %s console at %x\n", source, serial.base);
+	options.serial = serial;
+	serial_init();
+	serial_printf("[*] %s console: %s %x, register stride %d, width %d, ",
+	              source, serial.mmio ? "MMIO" : "port", serial.base, serial.stride, serial.width);
+	if (serial.baud)
+		serial_printf("%d baud from a %dHz clock\n", serial.baud, serial.clock);
+	else
+		serial_puts("baud rate set by the firmware\n");
+}
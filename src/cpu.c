@@ -0,0 +1,213 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cpu.h"
+#include "idt.h"
+#include "serial.h"
+#include "sysinfo.h"
+#include "utils.h"
+
+enum cpuid_reg { EAX, EBX, ECX, EDX };
+
+/*
+ * Location of each feature flag in the CPUID leaves.
+ */
+static const struct {
+	const char *name;
+	uint32_t    leaf;
+	uint8_t     subleaf;
+	uint8_t     reg;
+	uint8_t     bit;
+} cpu_features[CPU_NUM_FEATURES] = {
+	[CPU_FEATURE_PGE]          = {"pge",                0x1,        0, EDX, 13},
+	[CPU_FEATURE_PAT]          = {"pat",                0x1,        0, EDX, 16},
+	[CPU_FEATURE_PCID]         = {"pcid",               0x1,        0, ECX, 17},
+	[CPU_FEATURE_SSE4_2]       = {"sse4_2",             0x1,        0, ECX, 20},
+	[CPU_FEATURE_X2APIC]       = {"x2apic",             0x1,        0, ECX, 21},
+	[CPU_FEATURE_TSC_DEADLINE] = {"tsc_deadline_timer", 0x1,        0, ECX, 24},
+	[CPU_FEATURE_XSAVE]        = {"xsave",              0x1,        0, ECX, 26},
+	[CPU_FEATURE_AVX]          = {"avx",                0x1,        0, ECX, 28},
+	[CPU_FEATURE_RDRAND]       = {"rdrand",             0x1,        0, ECX, 30},
+	[CPU_FEATURE_HYPERVISOR]   = {"hypervisor",         0x1,        0, ECX, 31},
+	[CPU_FEATURE_IDA]          = {"ida",                0x6,        0, EAX, 1},
+	[CPU_FEATURE_HWP]          = {"hwp",                0x6,        0, EAX, 7},
+	[CPU_FEATURE_FSGSBASE]     = {"fsgsbase",           0x7,        0, EBX, 0},
+	[CPU_FEATURE_AVX2]         = {"avx2",               0x7,        0, EBX, 5},
+	[CPU_FEATURE_SMEP]         = {"smep",               0x7,        0, EBX, 7},
+	[CPU_FEATURE_INVPCID]      = {"invpcid",            0x7,        0, EBX, 10},
+	[CPU_FEATURE_AVX512F]      = {"avx512f",            0x7,        0, EBX, 16},
+	[CPU_FEATURE_AVX512DQ]     = {"avx512dq",           0x7,        0, EBX, 17},
+	[CPU_FEATURE_RDSEED]       = {"rdseed",             0x7,        0, EBX, 18},
+	[CPU_FEATURE_SMAP]         = {"smap",               0x7,        0, EBX, 20},
+	[CPU_FEATURE_AVX512BW]     = {"avx512bw",           0x7,        0, EBX, 30},
+	[CPU_FEATURE_AVX512VL]     = {"avx512vl",           0x7,        0, EBX, 31},
+	[CPU_FEATURE_UMIP]         = {"umip",               0x7,        0, ECX, 2},
+	[CPU_FEATURE_PKU]          = {"pku",                0x7,        0, ECX, 3},
+	[CPU_FEATURE_LA57]         = {"la57",               0x7,        0, ECX, 16},
+	[CPU_FEATURE_AMX_BF16]     = {"amx_bf16",           0x7,        0, EDX, 22},
+	[CPU_FEATURE_AMX_TILE]     = {"amx_tile",           0x7,        0, EDX, 24},
+	[CPU_FEATURE_AMX_INT8]     = {"amx_int8",           0x7,        0, EDX, 25},
+	[CPU_FEATURE_XSAVEOPT]     = {"xsaveopt",           0xd,        1, EAX, 0},
+	[CPU_FEATURE_XSAVEC]       = {"xsavec",             0xd,        1, EAX, 1},
+	[CPU_FEATURE_XSAVES]       = {"xsaves",             0xd,        1, EAX, 3},
+	[CPU_FEATURE_NX]           = {"nx",                 0x80000001, 0, EDX, 20},
+	[CPU_FEATURE_PDPE1GB]      = {"pdpe1gb",            0x80000001, 0, EDX, 26},
+	[CPU_FEATURE_RDTSCP]       = {"rdtscp",             0x80000001, 0, EDX, 27},
+	[CPU_FEATURE_NONSTOP_TSC]  = {"nonstop_tsc",        0x80000007, 0, EDX, 8},
+};
+
+/*
+ * Get the printable name of a processor feature.
+ */
+const char *cpu_feature_name(uint32_t feature)
+{
+	return cpu_features[feature].name;
+}
+
+/*
+ * Query a CPUID leaf, returning all zeroes for leaves the processor doesn't
+ * implement rather than the data of the highest leaf.
+ */
+static void cpuid_checked(uint32_t leaf, uint32_t subleaf, uint32_t regs[4])
+{
+	uint32_t max;
+
+	cpuid(leaf & 0x80000000, 0, &max, &regs[EBX], &regs[ECX], &regs[EDX]);
+	if (leaf > max) {
+		regs[EAX] = regs[EBX] = regs[ECX] = regs[EDX] = 0;
+		return;
+	}
+	cpuid(leaf, subleaf, &regs[EAX], &regs[EBX], &regs[ECX], &regs[EDX]);
+}
+
+/*
+ * Collect the boot processor identification, features, XSAVE layout,
+ * frequencies and performance monitoring capabilities, so that the kernel can
+ * be specialised at build time.
+ */
+static void cpu_profile(void)
+{
+	uint32_t regs[4];
+	uint64_t msr, rem;
+
+	/* Vendor and brand strings. */
+	cpuid_checked(0, 0, regs);
+	memcpy(&sysinfo.cpu_info.vendor[0], (char *) &regs[EBX], 4);
+	memcpy(&sysinfo.cpu_info.vendor[4], (char *) &regs[EDX], 4);
+	memcpy(&sysinfo.cpu_info.vendor[8], (char *) &regs[ECX], 4);
+	for (uint32_t i = 0; i < 3; i++) {
+		cpuid_checked(0x80000002 + i, 0, regs);
+		memcpy(&sysinfo.cpu_info.brand[i * 16], (char *) regs, 16);
+	}
+
+	/* Family, model and stepping, including the extended fields. */
+	cpuid_checked(1, 0, regs);
+	sysinfo.cpu_info.family = (regs[EAX] >> 8) & 0xf;
+	sysinfo.cpu_info.model = (regs[EAX] >> 4) & 0xf;
+	sysinfo.cpu_info.stepping = regs[EAX] & 0xf;
+	if (sysinfo.cpu_info.family == 0xf)
+		sysinfo.cpu_info.family += (regs[EAX] >> 20) & 0xff;
+	if (sysinfo.cpu_info.family >= 0x6)
+		sysinfo.cpu_info.model |= ((regs[EAX] >> 16) & 0xf) << 4;
+
+	/* Address widths. */
+	cpuid_checked(0x80000008, 0, regs);
+	sysinfo.cpu_info.phys_bits = regs[EAX] ? regs[EAX] & 0xff : 36;
+	sysinfo.cpu_info.virt_bits = regs[EAX] ? (regs[EAX] >> 8) & 0xff : 32;
+
+	/* Feature flags. */
+	for (uint32_t i = 0; i < CPU_NUM_FEATURES; i++) {
+		cpuid_checked(cpu_features[i].leaf, cpu_features[i].subleaf, regs);
+		if ((regs[cpu_features[i].reg] >> cpu_features[i].bit) & 1)
+			sysinfo.cpu_info.features |= 1ULL << i;
+	}
+
+	/* XSAVE state components, the first two live in the legacy area. */
+	if (cpu_has(CPU_FEATURE_XSAVE)) {
+		cpuid_checked(0xd, 0, regs);
+		sysinfo.cpu_info.xsave_mask = regs[EAX] | ((uint64_t) regs[EDX] << 32);
+		sysinfo.cpu_info.xsave_size = regs[ECX];
+		for (uint32_t i = 2; i < 64; i++) {
+			if (!((sysinfo.cpu_info.xsave_mask >> i) & 1))
+				continue;
+			cpuid_checked(0xd, i, regs);
+			sysinfo.cpu_info.xsave_component[i].size = regs[EAX];
+			sysinfo.cpu_info.xsave_component[i].offset = regs[EBX];
+		}
+	}
+
+	/* Nominal frequencies, when enumerated. */
+	cpuid_checked(0x16, 0, regs);
+	sysinfo.cpu_info.base_mhz = regs[EAX] & 0xffff;
+	sysinfo.cpu_info.max_mhz = regs[EBX] & 0xffff;
+	sysinfo.cpu_info.bus_mhz = regs[ECX] & 0xffff;
+
+	/*
+	 * TSC frequency from the crystal clock ratio. Without the crystal
+	 * frequency the TSC runs at the base frequency.
+	 */
+	cpuid_checked(0x15, 0, regs);
+	if (regs[EAX] && regs[EBX] && regs[ECX])
+		sysinfo.cpu_info.tsc_hz = divide64((uint64_t) regs[ECX] * regs[EBX], regs[EAX], &rem);
+	else if (sysinfo.cpu_info.base_mhz)
+		sysinfo.cpu_info.tsc_hz = (uint64_t) sysinfo.cpu_info.base_mhz * 1000000;
+
+	/* Ratio MSRs, these are model specific so they may fault. */
+	if (rdmsr_safe(MSR_PLATFORM_INFO, &msr))
+		sysinfo.cpu_info.base_ratio = (msr >> 8) & 0xff;
+	if (cpu_has(CPU_FEATURE_IDA) && rdmsr_safe(MSR_TURBO_RATIO_LIMIT, &msr))
+		sysinfo.cpu_info.turbo_ratios = msr;
+	if (cpu_has(CPU_FEATURE_HWP) && rdmsr_safe(MSR_IA32_HWP_CAPABILITIES, &msr))
+		sysinfo.cpu_info.hwp_caps = msr;
+
+	/* Architectural performance monitoring. */
+	cpuid_checked(0xa, 0, regs);
+	sysinfo.cpu_info.pmu_version = regs[EAX] & 0xff;
+	sysinfo.cpu_info.pmu_counters = (regs[EAX] >> 8) & 0xff;
+	sysinfo.cpu_info.pmu_counter_width = (regs[EAX] >> 16) & 0xff;
+	if (sysinfo.cpu_info.pmu_version > 1) {
+		sysinfo.cpu_info.pmu_fixed_counters = regs[EDX] & 0x1f;
+		sysinfo.cpu_info.pmu_fixed_counter_width = (regs[EDX] >> 5) & 0xff;
+	}
+
+	serial_printf("[*] CPU %s family %x model %x stepping %x\n",
+	              sysinfo.cpu_info.vendor, sysinfo.cpu_info.family,
+	              sysinfo.cpu_info.model, sysinfo.cpu_info.stepping);
+}
+
+/*
+ * Scan the features of the boot processor.
+ */
+bool cpu_scan(void)
+{
+	uint32_t eax, ebx, ecx, edx;
+
+	cpu_profile();
+
+	cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+
+	/* Check for x2APIC support, and whether the firmware enabled it. */
+	sysinfo.apic.x2apic = ecx & CPUID_1_ECX_X2APIC;
+	if (sysinfo.apic.x2apic && (edx & CPUID_1_EDX_MSR))
+		sysinfo.apic.x2apic_enabled = rdmsr(MSR_IA32_APIC_BASE) & MSR_APIC_BASE_EXTD;
+	serial_printf("[*] x2APIC %s\n",
+	              !sysinfo.apic.x2apic ? "not supported" :
+	              sysinfo.apic.x2apic_enabled ? "supported and enabled" : "supported");
+
+	/* APIC IDs above 254 can only be reached in x2APIC mode. */
+	for (uint32_t i = 0; i < sysinfo.cpu.count; i++) {
+		if (sysinfo.cpu.list[i].apic_id >= 0xff && !sysinfo.apic.x2apic) {
+			serial_printf("[X] Error: CPU with APIC ID %d requires x2APIC support\n",
+			              sysinfo.cpu.list[i].apic_id);
+			return false;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,290 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/*
+ * Processor idle states. The MWAIT sub-states come from CPUID leaf 5 and the
+ * platform idle states from the ACPI LPIT, merged by MWAIT hint. On request
+ * the wake latency of each MWAIT state is measured on the boot processor:
+ * the LAPIC timer is armed and the time to its interrupt is compared between
+ * waiting in the state and polling in C0.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "acpi.h"
+#include "arena.h"
+#include "cpu.h"
+#include "cstate.h"
+#include "idt.h"
+#include "options.h"
+#include "serial.h"
+#include "sysinfo.h"
+#include "utils.h"
+
+/* 8259 PIC interrupt mask registers. */
+#define PIC1_DATA               0x21
+#define PIC2_DATA               0xa1
+
+/* Interrupt handlers, defined in entry.S. */
+extern void lapic_timer_handler(void);
+extern void spurious_handler(void);
+
+/* TSC at the timer interrupt, also the line monitored by MWAIT. */
+static volatile uint64_t wake_tsc __attribute__((aligned(64)));
+
+/*
+ * Access a local APIC register, through MSRs in x2APIC mode.
+ */
+static uint32_t lapic_read(uint32_t reg)
+{
+	if (sysinfo.apic.x2apic_enabled)
+		return rdmsr(MSR_X2APIC_BASE + (reg >> 4));
+	return *(volatile uint32_t *) ((uint32_t) sysinfo.apic.addr + reg);
+}
+
+static void lapic_write(uint32_t reg, uint32_t value)
+{
+	if (sysinfo.apic.x2apic_enabled)
+		wrmsr(MSR_X2APIC_BASE + (reg >> 4), value);
+	else
+		*(volatile uint32_t *) ((uint32_t) sysinfo.apic.addr + reg) = value;
+}
+
+/*
+ * LAPIC timer interrupt, called from entry.S.
+ */
+void cstate_timer_interrupt(void)
+{
+	wake_tsc = rdtsc();
+	lapic_write(LAPIC_REG_EOI, 0);
+}
+
+/*
+ * Get the idle state with the given MWAIT hint, adding it if new. States
+ * without hint are always added.
+ */
+static bool cstate_entry(uint32_t hint, uint32_t *index)
+{
+	for (uint32_t i = 0; hint != CSTATE_NO_HINT && i < sysinfo.cstate.count; i++) {
+		if (sysinfo.cstate.list[i].hint == hint) {
+			*index = i;
+			return true;
+		}
+	}
+
+	if (!vector_reserve(&sysinfo.cstate))
+		return false;
+	*index = sysinfo.cstate.count++;
+	sysinfo.cstate.list[*index].hint = hint;
+	return true;
+}
+
+/*
+ * Enumerate the MWAIT sub-states of CPUID leaf 5.
+ */
+static bool cstate_scan_mwait(void)
+{
+	uint32_t eax, ebx, ecx, edx;
+
+	cpuid(0, 0, &eax, &ebx, &ecx, &edx);
+	if (eax < 5)
+		return true;
+	cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+	if (!(ecx & CPUID_1_ECX_MONITOR))
+		return true;
+
+	cpuid(5, 0, &eax, &ebx, &ecx, &edx);
+	sysinfo.cstate.mwait = true;
+	sysinfo.cstate.monitor_min = eax;
+	sysinfo.cstate.monitor_max = ebx;
+	sysinfo.cstate.break_on_interrupt = ecx & CPUID_5_ECX_IBE;
+	if (!(ecx & CPUID_5_ECX_EMX)) {
+		serial_puts("[!] Warning: MWAIT sub-states not enumerated\n");
+		return true;
+	}
+
+	for (uint32_t n = 1; n < 8; n++) {
+		for (uint32_t sub = 0; sub < CPUID_5_EDX_SUBSTATES(edx, n); sub++) {
+			uint32_t index;
+			if (!cstate_entry(MWAIT_HINT(n, sub), &index))
+				return false;
+			serial_printf("[*] MWAIT C%d sub-state %d, hint %x\n", n, sub, MWAIT_HINT(n, sub));
+		}
+	}
+	return true;
+}
+
+/*
+ * Add the native C-states of the LPIT, merged with the MWAIT state they
+ * enter when their entry trigger is an MWAIT hint.
+ */
+static bool cstate_scan_lpit(struct acpi_lpit *lpit)
+{
+	uint32_t addr = (uint32_t) (lpit + 1);
+	uint32_t end = (uint32_t) lpit + lpit->header.length;
+
+	while (addr + sizeof (struct acpi_lpit_header) <= end) {
+		struct acpi_lpit_header *header = (void *) addr;
+		if (header->length < sizeof (*header) || addr + header->length > end) {
+			serial_puts("[!] Warning: malformed LPIT entry, ignored\n");
+			break;
+		}
+		addr += header->length;
+
+		if (header->type != ACPI_LPIT_TYPE_NATIVE || header->length < sizeof (struct acpi_lpit_native))
+			continue;
+
+		struct acpi_lpit_native *native = (void *) header;
+		uint32_t hint = CSTATE_NO_HINT;
+		if (native->entry_trigger.space_id == ACPI_GAS_SPACE_FFH)
+			hint = native->entry_trigger.address;
+
+		uint32_t index;
+		if (!cstate_entry(hint, &index))
+			return false;
+		sysinfo.cstate.list[index].lpit = true;
+		sysinfo.cstate.list[index].uid = header->uid;
+		sysinfo.cstate.list[index].disabled = header->flags & ACPI_LPIT_FLAG_DISABLED;
+		sysinfo.cstate.list[index].residency_us = native->residency;
+		sysinfo.cstate.list[index].latency_us = native->latency;
+		serial_printf("[*] LPIT state %d: residency %dus, latency %dus\n",
+		              header->uid, native->residency, native->latency);
+	}
+	return true;
+}
+
+/*
+ * Time from arming the LAPIC timer to its interrupt, either polling in C0 or
+ * waiting in MWAIT with the given hint. Returns 0 on timeout.
+ */
+static uint64_t cstate_timer_round(uint32_t hint, bool idle)
+{
+	wake_tsc = 0;
+	uint64_t start = rdtsc();
+	lapic_write(LAPIC_REG_TIMER_ICR, CSTATE_TIMER_COUNT);
+
+	while (!wake_tsc) {
+		if (!idle) {
+			__asm__ __volatile__ ("sti; pause; cli" ::: "memory");
+		} else {
+			__asm__ __volatile__ ("monitor" : : "a" (&wake_tsc), "c" (0), "d" (0));
+			if (!wake_tsc)
+				__asm__ __volatile__ ("sti; mwait; cli" : : "a" (hint), "c" (0) : "memory");
+		}
+		if (!wake_tsc && rdtsc() - start > CSTATE_TIMEOUT) {
+			lapic_write(LAPIC_REG_TIMER_ICR, 0);
+			return 0;
+		}
+	}
+	return wake_tsc - start;
+}
+
+/*
+ * Measure the wake latency of the MWAIT states, as the extra time to the
+ * timer interrupt compared to polling.
+ */
+static void cstate_measure(void)
+{
+	if (!cpu_has(CPU_FEATURE_NONSTOP_TSC)) {
+		serial_puts("[!] Warning: the TSC may stop in idle states, wake latency not measured\n");
+		return;
+	}
+	if (!sysinfo.apic.x2apic_enabled &&
+	    (!(rdmsr(MSR_IA32_APIC_BASE) & MSR_APIC_BASE_ENABLE) || sysinfo.apic.addr >> 32)) {
+		serial_puts("[!] Warning: local APIC unusable, wake latency not measured\n");
+		return;
+	}
+
+	/* Take over the local APIC timer with the 8259 PICs masked. */
+	uint8_t pic1 = in8(PIC1_DATA);
+	uint8_t pic2 = in8(PIC2_DATA);
+	uint32_t svr = lapic_read(LAPIC_REG_SVR);
+	uint32_t tpr = lapic_read(LAPIC_REG_TPR);
+	uint32_t lvt = lapic_read(LAPIC_REG_LVT_TIMER);
+	uint32_t dcr = lapic_read(LAPIC_REG_TIMER_DCR);
+	out8(PIC1_DATA, 0xff);
+	out8(PIC2_DATA, 0xff);
+	idt_set_gate(IDT_VECTOR_LAPIC_TIMER, lapic_timer_handler);
+	idt_set_gate(IDT_VECTOR_SPURIOUS, spurious_handler);
+	lapic_write(LAPIC_REG_SVR, LAPIC_SVR_ENABLE | IDT_VECTOR_SPURIOUS);
+	lapic_write(LAPIC_REG_TPR, 0);
+	lapic_write(LAPIC_REG_TIMER_DCR, LAPIC_TIMER_DIV_1);
+	lapic_write(LAPIC_REG_LVT_TIMER, IDT_VECTOR_LAPIC_TIMER);
+
+	/* The fastest polling round is the reference. */
+	uint64_t poll = ~0ULL;
+	for (uint32_t i = 0; i < CSTATE_MEASURE_ROUNDS; i++) {
+		uint64_t cycles = cstate_timer_round(0, false);
+		if (!cycles) {
+			serial_puts("[!] Warning: no LAPIC timer interrupt, wake latency not measured\n");
+			goto restore;
+		}
+		if (cycles < poll)
+			poll = cycles;
+	}
+
+	for (uint32_t i = 0; i < sysinfo.cstate.count; i++) {
+		uint32_t hint = sysinfo.cstate.list[i].hint;
+		uint64_t min = ~0ULL, max = 0;
+		uint32_t j;
+		if (hint == CSTATE_NO_HINT || sysinfo.cstate.list[i].disabled)
+			continue;
+
+		for (j = 0; j < CSTATE_MEASURE_ROUNDS; j++) {
+			uint64_t cycles = cstate_timer_round(hint, true);
+			if (!cycles)
+				break;
+			cycles = cycles > poll ? cycles - poll : 0;
+			if (cycles < min)
+				min = cycles;
+			if (cycles > max)
+				max = cycles;
+		}
+		if (j < CSTATE_MEASURE_ROUNDS) {
+			serial_printf("[!] Warning: no LAPIC timer interrupt in MWAIT hint %x, wake latency not measured\n",
+			              hint);
+			continue;
+		}
+		sysinfo.cstate.list[i].measured = true;
+		sysinfo.cstate.list[i].wake_min = min;
+		sysinfo.cstate.list[i].wake_max = max;
+		serial_printf("[*] MWAIT hint %x wakes in %d to %d TSC cycles\n", hint,
+		              sysinfo.cstate.list[i].wake_min, sysinfo.cstate.list[i].wake_max);
+	}
+
+restore:
+	lapic_write(LAPIC_REG_LVT_TIMER, lvt | LAPIC_LVT_MASKED);
+	lapic_write(LAPIC_REG_TIMER_ICR, 0);
+	lapic_write(LAPIC_REG_TIMER_DCR, dcr);
+	lapic_write(LAPIC_REG_LVT_TIMER, lvt);
+	lapic_write(LAPIC_REG_TPR, tpr);
+	lapic_write(LAPIC_REG_SVR, svr);
+	out8(PIC1_DATA, pic1);
+	out8(PIC2_DATA, pic2);
+}
+
+/*
+ * Enumerate the processor idle states, and measure their wake latency if
+ * requested.
+ */
+bool cstate_scan(void)
+{
+	struct acpi_header *lpit;
+
+	if (!cstate_scan_mwait())
+		return false;
+	if ((lpit = acpi_find_table("LPIT", 0)) && !cstate_scan_lpit((struct acpi_lpit *) lpit))
+		return false;
+
+	if (options.measure_cstates) {
+		if (sysinfo.cstate.mwait)
+			cstate_measure();
+		else
+			serial_puts("[!] Warning: MWAIT not supported, wake latency not measured\n");
+	}
+	return true;
+}
@@ -0,0 +1,1204 @@
+/*
+ * Copyright 2023, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/*
+ * Output of the machine file, whole or as sections streamed along the
+ * discovery phases, and the command loop serving it again. The replay tool
+ * prints it from the same code.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "acpi.h"
+#include "amdvi.h"
+#include "cpu.h"
+#include "cstate.h"
+#include "dump.h"
+#include "efi.h"
+#include "fingerprint.h"
+#include "hypervisor.h"
+#include "ioapic.h"
+#include "memory.h"
+#include "mtrr.h"
+#include "prt.h"
+#include "serial.h"
+#include "smbios.h"
+#include "sysinfo.h"
+#include "utils.h"
+#include "vtd.h"
+
+/*
+ * Kernel device, an MMIO region that the kernel needs to access.
+ */
+struct kdev {
+	char     name[16];
+	uint64_t base;
+	uint64_t size;
+};
+
+/*
+ * Format a numbered name such as "ioapic.0".
+ */
+static void numbered_name(char *name, const char *prefix, uint32_t n)
+{
+	char *p = name;
+	char digits[10];
+	int i = 0;
+
+	while (*prefix)
+		*p++ = *prefix++;
+	*p++ = '.';
+	do {
+		digits[i++] = '0' + n % 10;
+		n /= 10;
+	} while (n);
+	while (i)
+		*p++ = digits[--i];
+	*p = '\0';
+}
+
+/*
+ * Look up the n-th kernel device. Returns false past the last one.
+ */
+static bool get_kdev(uint32_t n, struct kdev *kdev)
+{
+	if (n == 0) {
+		memcpy(kdev->name, "apic", 5);
+		kdev->base = sysinfo.apic.addr;
+		kdev->size = 4096;
+		return true;
+	}
+	n--;
+
+	if (n < sysinfo.ioapic.count) {
+		numbered_name(kdev->name, "ioapic", n);
+		kdev->base = sysinfo.ioapic.list[n].addr;
+		kdev->size = 4096;
+		return true;
+	}
+	n -= sysinfo.ioapic.count;
+
+	if (n < sysinfo.drhu.count) {
+		numbered_name(kdev->name, "drhu", n);
+		kdev->base = sysinfo.drhu.list[n].addr;
+		kdev->size = 4096;
+		return true;
+	}
+	n -= sysinfo.drhu.count;
+
+	if (n < sysinfo.ivhd.count) {
+		numbered_name(kdev->name, "ivhd", n);
+		kdev->base = sysinfo.ivhd.list[n].addr;
+		kdev->size = AMDVI_MMIO_SIZE;
+		return true;
+	}
+
+	return false;
+}
+
+/*
+ * Output the memory types of a physical range, split where the type changes.
+ * The effective type is the one of pages mapped with the first PAT entry, as
+ * without any of the PWT, PCD and PAT bits set.
+ */
+static void dump_memory_types(const char *name, uint64_t base, uint64_t size, bool *first)
+{
+	uint64_t end = base + size;
+
+	while (base < end) {
+		uint8_t type;
+		size = mtrr_range_type(base, end - base, &type);
+		serial_printf("%s\n"
+		              "            {\n"
+		              "                \"name\": \"%s\",\n"
+		              "                \"base\": %D,\n"
+		              "                \"size\": %D,\n"
+		              "                \"type\": \"%s\",\n"
+		              "                \"effectiveType\": \"%s\"\n"
+		              "            }",
+		              *first ? "" : ",", name, base, size, mtrr_type_name(type),
+		              mtrr_type_name(mtrr_effective_type(type, 0)));
+		*first = false;
+		base += size;
+	}
+}
+
+/*
+ * Output the machine fingerprint, to cache the images built for identical
+ * machines.
+ */
+static void section_fingerprint(void)
+{
+	serial_printf("    \"fingerprint\": {\n"
+	              "        \"crc32c\": %d,\n"
+	              "        \"acpi\": %s\n"
+	              "    }",
+	              fingerprint(),
+	              options.fingerprint_acpi ? "true" : "false");
+}
+
+/*
+ * Output the RAM regions.
+ */
+static void section_memory(void)
+{
+	serial_puts("    \"memory\": [\n");
+	for (uint32_t i = 0; i < sysinfo.memory.count; i++) {
+		uint64_t base2m, base1g;
+		uint64_t size2m = memory_aligned_extent(i, MEMORY_PAGE_SIZE_2M, &base2m);
+		uint64_t size1g = memory_aligned_extent(i, MEMORY_PAGE_SIZE_1G, &base1g);
+
+		serial_printf("        {\n"
+		              "            \"base\": %D,\n"
+		              "            \"size\": %D,\n",
+		              sysinfo.memory.list[i].addr,
+		              sysinfo.memory.list[i].size);
+		serial_printf("            \"aligned2M\": {\n"
+		              "                \"base\": %D,\n"
+		              "                \"size\": %D\n"
+		              "            },\n"
+		              "            \"aligned1G\": {\n"
+		              "                \"base\": %D,\n"
+		              "                \"size\": %D\n"
+		              "            }\n"
+	                      "        }%s\n",
+		              size2m ? base2m : 0, size2m,
+		              size1g ? base1g : 0, size1g,
+		              i + 1 == sysinfo.memory.count ? "" : ",");
+	}
+	serial_puts("    ]");
+}
+
+/*
+ * Output the EFI memory regions with notable attributes.
+ */
+static void section_efi_memory(void)
+{
+	serial_puts("    \"efiMemory\": [");
+	for (uint32_t i = 0; i < sysinfo.efi_memory.count; i++) {
+		uint64_t attribute = sysinfo.efi_memory.list[i].attribute;
+
+		serial_printf("%s\n"
+		              "        {\n"
+		              "            \"base\": %D,\n"
+		              "            \"size\": %D,\n"
+		              "            \"type\": \"%s\",\n",
+		              i == 0 ? "" : ",",
+		              sysinfo.efi_memory.list[i].addr,
+		              sysinfo.efi_memory.list[i].size,
+		              efi_memory_type_name(sysinfo.efi_memory.list[i].type));
+		serial_printf("            \"runtime\": %s,\n"
+		              "            \"specificPurpose\": %s,\n"
+		              "            \"moreReliable\": %s\n"
+		              "        }",
+		              attribute & EFI_MEMORY_RUNTIME ? "true" : "false",
+		              attribute & EFI_MEMORY_SP ? "true" : "false",
+		              attribute & EFI_MEMORY_MORE_RELIABLE ? "true" : "false");
+	}
+	serial_puts("\n    ]");
+}
+
+/*
+ * Output the kernel devices.
+ */
+static void section_kdevs(void)
+{
+	serial_puts("    \"kdevs\": [");
+	struct kdev kdev;
+	for (uint32_t i = 0; get_kdev(i, &kdev); i++) {
+		serial_printf("%s\n"
+		              "        {\n"
+		              "            \"name\": \"%s\",\n"
+		              "            \"base\": %D,\n"
+		              "            \"size\": %D\n"
+		              "        }",
+		              i == 0 ? "" : ",",
+		              kdev.name, kdev.base, kdev.size);
+	}
+	serial_puts("\n    ]");
+}
+
+/*
+ * Output the effective memory types of the RAM and kernel devices.
+ */
+static void section_memory_types(void)
+{
+	serial_printf("    \"memoryTypes\": {\n"
+	              "        \"mtrrSupported\": %s,\n"
+	              "        \"mtrrEnabled\": %s,\n"
+	              "        \"defaultType\": \"%s\",\n"
+	              "        \"pat\": [",
+	              sysinfo.mtrr.supported ? "true" : "false",
+	              sysinfo.mtrr.enabled ? "true" : "false",
+	              mtrr_type_name(sysinfo.mtrr.default_type));
+	for (uint32_t i = 0; sysinfo.mtrr.pat_supported && i < 8; i++)
+		serial_printf("%s\"%s\"", i == 0 ? "" : ", ",
+		              mtrr_type_name((sysinfo.mtrr.pat >> (i * 8)) & 0x7));
+	serial_puts("],\n"
+	            "        \"ranges\": [");
+	bool first = true;
+	char name[16];
+	struct kdev kdev;
+	for (uint32_t i = 0; i < sysinfo.memory.count; i++) {
+		numbered_name(name, "memory", i);
+		dump_memory_types(name, sysinfo.memory.list[i].addr,
+		                  sysinfo.memory.list[i].size, &first);
+	}
+	for (uint32_t i = 0; get_kdev(i, &kdev); i++)
+		dump_memory_types(kdev.name, kdev.base, kdev.size, &first);
+	serial_puts("\n        ],\n"
+	            "        \"nonWbRam\": [");
+	first = true;
+	for (uint32_t i = 0; i < sysinfo.memory.count; i++) {
+		uint64_t base = sysinfo.memory.list[i].addr;
+		uint64_t end = base + sysinfo.memory.list[i].size;
+
+		while (base < end) {
+			uint8_t type;
+			uint64_t size = mtrr_range_type(base, end - base, &type);
+			if (type != MTRR_TYPE_WB) {
+				serial_printf("%s\n"
+				              "            {\n"
+				              "                \"base\": %D,\n"
+				              "                \"size\": %D,\n"
+				              "                \"type\": \"%s\"\n"
+				              "            }",
+				              first ? "" : ",", base, size, mtrr_type_name(type));
+				first = false;
+			}
+			base += size;
+		}
+	}
+	serial_puts("\n        ]\n"
+	            "    }");
+}
+
+/*
+ * Output the memory devices and the RAM regions they back.
+ */
+static void section_dimms(void)
+{
+	serial_puts("    \"dimms\": [");
+	for (uint32_t i = 0; i < sysinfo.dimm.count; i++) {
+		serial_printf("%s\n"
+		              "        {\n"
+		              "            \"handle\": %d,\n"
+		              "            \"locator\": \"%s\",\n"
+		              "            \"bankLocator\": \"%s\",\n"
+		              "            \"size\": %D,\n",
+		              i == 0 ? "" : ",",
+		              sysinfo.dimm.list[i].handle,
+		              sysinfo.dimm.list[i].locator,
+		              sysinfo.dimm.list[i].bank_locator,
+		              sysinfo.dimm.list[i].size);
+		serial_printf("            \"type\": \"%s\",\n"
+		              "            \"formFactor\": \"%s\",\n"
+		              "            \"speed\": %d,\n"
+		              "            \"configuredSpeed\": %d,\n"
+		              "            \"ranks\": %d,\n"
+		              "            \"dataWidth\": %d,\n"
+		              "            \"totalWidth\": %d,\n"
+		              "            \"manufacturer\": \"%s\",\n"
+		              "            \"partNumber\": \"%s\",\n"
+		              "            \"ranges\": [",
+		              smbios_memory_type_name(sysinfo.dimm.list[i].type),
+		              smbios_form_factor_name(sysinfo.dimm.list[i].form_factor),
+		              sysinfo.dimm.list[i].speed,
+		              sysinfo.dimm.list[i].configured_speed,
+		              sysinfo.dimm.list[i].ranks,
+		              sysinfo.dimm.list[i].data_width,
+		              sysinfo.dimm.list[i].total_width,
+		              sysinfo.dimm.list[i].manufacturer,
+		              sysinfo.dimm.list[i].part_number);
+		bool first = true;
+		for (uint32_t j = 0; sysinfo.dimm.list[i].size && j < sysinfo.dimm_range.count; j++) {
+			uint16_t handle = sysinfo.dimm_range.list[j].device ?
+				sysinfo.dimm.list[i].handle : sysinfo.dimm.list[i].array;
+			if (sysinfo.dimm_range.list[j].handle != handle)
+				continue;
+
+			uint64_t base = sysinfo.dimm_range.list[j].addr;
+			uint64_t end = base + sysinfo.dimm_range.list[j].size;
+			serial_printf("%s\n"
+			              "                {\n"
+			              "                    \"base\": %D,\n"
+			              "                    \"size\": %D,\n"
+			              "                    \"device\": %s,\n"
+			              "                    \"interleavePosition\": %d,\n"
+			              "                    \"interleaveDepth\": %d,\n"
+			              "                    \"memory\": [",
+			              first ? "" : ",", base, end - base,
+			              sysinfo.dimm_range.list[j].device ? "true" : "false",
+			              sysinfo.dimm_range.list[j].interleave_position,
+			              sysinfo.dimm_range.list[j].interleave_depth);
+			bool first_region = true;
+			for (uint32_t k = 0; k < sysinfo.memory.count; k++) {
+				uint64_t addr = sysinfo.memory.list[k].addr;
+				if (addr < end && addr + sysinfo.memory.list[k].size > base) {
+					serial_printf("%s%d", first_region ? "" : ", ", k);
+					first_region = false;
+				}
+			}
+			serial_puts("]\n"
+			            "                }");
+			first = false;
+		}
+		serial_printf("%s]\n"
+		              "        }",
+		              first ? "" : "\n            ");
+	}
+	serial_puts("\n    ]");
+}
+
+/*
+ * Output the isolation groups of the PCI functions behind a DRHU, as lists of
+ * requester IDs.
+ */
+static void section_drhu_groups(uint32_t drhu)
+{
+	bool first = true;
+
+	for (uint32_t i = 0; i < sysinfo.pcidev.count; i++) {
+		if (sysinfo.pcidev.list[i].group != i || sysinfo.pcidev.list[i].drhu != drhu)
+			continue;
+		serial_printf("%s\n                [", first ? "" : ",");
+		for (uint32_t j = i, n = 0; j < sysinfo.pcidev.count; j++) {
+			if (sysinfo.pcidev.list[j].group == i)
+				serial_printf("%s%d", n++ ? ", " : "", sysinfo.pcidev.list[j].devid);
+		}
+		serial_puts("]");
+		first = false;
+	}
+	if (!first)
+		serial_puts("\n            ");
+}
+
+/*
+ * Output the capabilities of a DMA Remapping Hardware Unit.
+ */
+static void section_drhu_capabilities(uint64_t cap, uint64_t ecap)
+{
+	serial_printf("            \"capabilities\": {\n"
+	              "                \"domains\": %d,\n"
+	              "                \"mgaw\": %d,\n"
+	              "                \"sagaw\": %d,\n"
+	              "                \"superpage2M\": %s,\n"
+	              "                \"superpage1G\": %s,\n"
+	              "                \"pageSelectiveInvalidation\": %s,\n"
+	              "                \"faultRecordingRegisters\": %d,\n",
+	              1 << (4 + 2 * VTD_CAP_ND(cap)),
+	              VTD_CAP_MGAW(cap),
+	              VTD_CAP_SAGAW(cap),
+	              VTD_CAP_SLLPS(cap) & VTD_SLLPS_2M ? "true" : "false",
+	              VTD_CAP_SLLPS(cap) & VTD_SLLPS_1G ? "true" : "false",
+	              VTD_CAP_PSI(cap) ? "true" : "false",
+	              VTD_CAP_NFR(cap));
+	serial_printf("                \"coherent\": %s,\n"
+	              "                \"queuedInvalidation\": %s,\n"
+	              "                \"interruptRemapping\": %s,\n"
+	              "                \"extendedInterruptMode\": %s,\n"
+	              "                \"passThrough\": %s,\n"
+	              "                \"snoopControl\": %s\n"
+	              "            },\n",
+	              VTD_ECAP_C(ecap) ? "true" : "false",
+	              VTD_ECAP_QI(ecap) ? "true" : "false",
+	              VTD_ECAP_IR(ecap) ? "true" : "false",
+	              VTD_ECAP_EIM(ecap) ? "true" : "false",
+	              VTD_ECAP_PT(ecap) ? "true" : "false",
+	              VTD_ECAP_SC(ecap) ? "true" : "false");
+}
+
+/*
+ * Output the DMA Remapping Hardware Units, their device scopes and the
+ * isolation groups of the PCI functions behind them.
+ */
+static void section_drhus(void)
+{
+	serial_puts("    \"drhus\": [\n");
+	for (uint32_t i = 0; i < sysinfo.drhu.count; i++) {
+		serial_printf("        {\n"
+		              "            \"base\": %D,\n"
+		              "            \"segment\": %d,\n"
+		              "            \"includePciAll\": %s,\n",
+		              sysinfo.drhu.list[i].addr,
+		              sysinfo.drhu.list[i].segment,
+		              sysinfo.drhu.list[i].include_pci_all ? "true" : "false");
+		if (sysinfo.drhu.list[i].cap_unknown)
+			serial_puts("            \"capabilities\": null,\n");
+		else
+			section_drhu_capabilities(sysinfo.drhu.list[i].cap,
+			                          sysinfo.drhu.list[i].ecap);
+		serial_puts("            \"scopes\": [");
+		bool first = true;
+		for (uint32_t j = 0; j < sysinfo.devscope.count; j++) {
+			if (sysinfo.devscope.list[j].drhu != i)
+				continue;
+			serial_printf("%s\n"
+			              "                {\n"
+			              "                    \"type\": \"%s\",\n"
+			              "                    \"enumId\": %d,\n"
+			              "                    \"devid\": %d",
+			              first ? "" : ",",
+			              dmar_devscope_type_name(sysinfo.devscope.list[j].type),
+			              sysinfo.devscope.list[j].enum_id,
+			              sysinfo.devscope.list[j].devid);
+			if (sysinfo.devscope.list[j].type == ACPI_DMAR_SCOPE_TYPE_BRIDGE)
+				serial_printf(",\n"
+				              "                    \"secondaryBus\": %d,\n"
+				              "                    \"subordinateBus\": %d",
+				              sysinfo.devscope.list[j].secondary_bus,
+				              sysinfo.devscope.list[j].subordinate_bus);
+			serial_puts("\n                }");
+			first = false;
+		}
+		serial_printf("%s],\n"
+		              "            \"groups\": [",
+		              first ? "" : "\n            ");
+		section_drhu_groups(i);
+		serial_printf("]\n"
+		              "        }%s\n",
+		              i + 1 == sysinfo.drhu.count ? "" : ",");
+	}
+	serial_puts("    ]");
+}
+
+/*
+ * Output the AMD IOMMUs and the devices behind them.
+ */
+static void section_ivhds(void)
+{
+	serial_puts("    \"ivhds\": [\n");
+	for (uint32_t i = 0; i < sysinfo.ivhd.count; i++) {
+		uint64_t efr = sysinfo.ivhd.list[i].efr;
+
+		serial_printf("        {\n"
+		              "            \"base\": %D,\n"
+		              "            \"segment\": %d,\n"
+		              "            \"devid\": %d,\n"
+		              "            \"type\": %d,\n",
+		              sysinfo.ivhd.list[i].addr,
+		              sysinfo.ivhd.list[i].segment,
+		              sysinfo.ivhd.list[i].devid,
+		              sysinfo.ivhd.list[i].type);
+		serial_printf("            \"features\": {\n"
+		              "                \"hostLevels\": %d,\n"
+		              "                \"coherent\": %s,\n"
+		              "                \"iotlb\": %s,\n"
+		              "                \"prefetch\": %s,\n"
+		              "                \"ppr\": %s,\n"
+		              "                \"x2apic\": %s,\n"
+		              "                \"noExecute\": %s,\n",
+		              AMDVI_HOST_LEVELS(efr),
+		              sysinfo.ivhd.list[i].flags & AMDVI_IVHD_COHERENT ? "true" : "false",
+		              sysinfo.ivhd.list[i].flags & AMDVI_IVHD_IOTLB ? "true" : "false",
+		              AMDVI_EFR_PREF(efr) ? "true" : "false",
+		              AMDVI_EFR_PPR(efr) ? "true" : "false",
+		              AMDVI_EFR_XT(efr) ? "true" : "false",
+		              AMDVI_EFR_NX(efr) ? "true" : "false");
+		serial_printf("                \"guestTranslation\": %s,\n"
+		              "                \"guestLevels\": %d,\n"
+		              "                \"invalidateAll\": %s,\n"
+		              "                \"guestVirtualApic\": %s,\n"
+		              "                \"hardwareErrors\": %s,\n"
+		              "                \"perfCounters\": %s\n"
+		              "            },\n"
+		              "            \"devices\": [",
+		              AMDVI_EFR_GT(efr) ? "true" : "false",
+		              4 + AMDVI_EFR_GATS(efr),
+		              AMDVI_EFR_IA(efr) ? "true" : "false",
+		              AMDVI_EFR_GA(efr) ? "true" : "false",
+		              AMDVI_EFR_HE(efr) ? "true" : "false",
+		              AMDVI_EFR_PC(efr) ? "true" : "false");
+		bool first = true;
+		for (uint32_t j = 0; j < sysinfo.ivhd_dev.count; j++) {
+			if (sysinfo.ivhd_dev.list[j].ivhd != i)
+				continue;
+			serial_printf("%s\n"
+			              "                {\n"
+			              "                    \"type\": \"%s\",\n"
+			              "                    \"first\": %d,\n"
+			              "                    \"last\": %d",
+			              first ? "" : ",",
+			              ivhd_dev_type_name(sysinfo.ivhd_dev.list[j].type,
+			                                 sysinfo.ivhd_dev.list[j].variety),
+			              sysinfo.ivhd_dev.list[j].first,
+			              sysinfo.ivhd_dev.list[j].last);
+			if (sysinfo.ivhd_dev.list[j].type == ACPI_IVHD_DEV_ALIAS_SELECT ||
+			    sysinfo.ivhd_dev.list[j].type == ACPI_IVHD_DEV_ALIAS_RANGE)
+				serial_printf(",\n"
+				              "                    \"alias\": %d",
+				              sysinfo.ivhd_dev.list[j].alias);
+			if (sysinfo.ivhd_dev.list[j].type == ACPI_IVHD_DEV_SPECIAL)
+				serial_printf(",\n"
+				              "                    \"handle\": %d",
+				              sysinfo.ivhd_dev.list[j].handle);
+			serial_puts("\n                }");
+			first = false;
+		}
+		serial_printf("%s]\n"
+		              "        }%s\n",
+		              first ? "" : "\n            ",
+		              i + 1 == sysinfo.ivhd.count ? "" : ",");
+	}
+	serial_puts("    ]");
+}
+
+/*
+ * Output the IVMDs.
+ */
+static void section_ivmds(void)
+{
+	serial_puts("    \"ivmds\": [\n");
+	for (uint32_t i = 0; i < sysinfo.ivmd.count; i++) {
+		serial_printf("        {\n"
+		              "            \"first\": %d,\n"
+		              "            \"last\": %d,\n"
+		              "            \"base\": %D,\n"
+		              "            \"size\": %D,\n"
+		              "            \"unity\": %s,\n"
+		              "            \"read\": %s,\n"
+		              "            \"write\": %s,\n"
+		              "            \"exclusion\": %s\n"
+		              "        }%s\n",
+		              sysinfo.ivmd.list[i].first,
+		              sysinfo.ivmd.list[i].last,
+		              sysinfo.ivmd.list[i].addr,
+		              sysinfo.ivmd.list[i].size,
+		              sysinfo.ivmd.list[i].flags & ACPI_IVMD_FLAG_UNITY ? "true" : "false",
+		              sysinfo.ivmd.list[i].flags & ACPI_IVMD_FLAG_READ ? "true" : "false",
+		              sysinfo.ivmd.list[i].flags & ACPI_IVMD_FLAG_WRITE ? "true" : "false",
+		              sysinfo.ivmd.list[i].flags & ACPI_IVMD_FLAG_EXCLUSION ? "true" : "false",
+		              i + 1 == sysinfo.ivmd.count ? "" : ",");
+	}
+	serial_puts("    ]");
+}
+
+/*
+ * Output the hypervisor interfaces, empty on bare metal.
+ */
+static void section_hypervisor(void)
+{
+	serial_printf("    \"hypervisor\": {\n"
+	              "        \"virtualised\": %s,\n"
+	              "        \"invariantTsc\": %s,\n"
+	              "        \"interfaces\": [\n",
+	              cpu_has(CPU_FEATURE_HYPERVISOR) ? "true" : "false",
+	              cpu_has(CPU_FEATURE_NONSTOP_TSC) ? "true" : "false");
+	for (uint32_t i = 0; i < sysinfo.hypervisor.count; i++) {
+		serial_printf("            {\n"
+		              "                \"base\": %d,\n"
+		              "                \"maxLeaf\": %d,\n"
+		              "                \"vendor\": \"%s\",\n"
+		              "                \"signature\": \"%s\",\n"
+		              "                \"version\": \"%d.%d\",\n"
+		              "                \"tscKHz\": %d,\n"
+		              "                \"apicKHz\": %d,\n"
+		              "                \"features\": [",
+		              sysinfo.hypervisor.list[i].base,
+		              sysinfo.hypervisor.list[i].max_leaf,
+		              hypervisor_vendor_name(sysinfo.hypervisor.list[i].vendor),
+		              sysinfo.hypervisor.list[i].signature,
+		              sysinfo.hypervisor.list[i].version >> 16,
+		              sysinfo.hypervisor.list[i].version & 0xffff,
+		              sysinfo.hypervisor.list[i].tsc_khz,
+		              sysinfo.hypervisor.list[i].apic_khz);
+		bool first_feature = true;
+		for (uint32_t j = 0; j < HV_NUM_FEATURES; j++) {
+			if (!((sysinfo.hypervisor.list[i].features >> j) & 1))
+				continue;
+			serial_printf("%s\"%s\"", first_feature ? "" : ", ", hypervisor_feature_name(j));
+			first_feature = false;
+		}
+		serial_printf("]\n"
+		              "            }%s\n",
+		              i + 1 == sysinfo.hypervisor.count ? "" : ",");
+	}
+	serial_puts("        ]\n"
+	            "    }");
+}
+
+/*
+ * Output the processor idle states.
+ */
+static void section_cstates(void)
+{
+	serial_printf("    \"cstates\": {\n"
+	              "        \"mwait\": %s,\n"
+	              "        \"breakOnInterrupt\": %s,\n"
+	              "        \"monitorLineMin\": %d,\n"
+	              "        \"monitorLineMax\": %d,\n"
+	              "        \"states\": [\n",
+	              sysinfo.cstate.mwait ? "true" : "false",
+	              sysinfo.cstate.break_on_interrupt ? "true" : "false",
+	              sysinfo.cstate.monitor_min, sysinfo.cstate.monitor_max);
+	for (uint32_t i = 0; i < sysinfo.cstate.count; i++) {
+		uint32_t hint = sysinfo.cstate.list[i].hint;
+		bool mwait = hint != CSTATE_NO_HINT;
+		serial_printf("            {\n"
+		              "                \"mwait\": %s,\n"
+		              "                \"hint\": %d,\n"
+		              "                \"cstate\": %d,\n"
+		              "                \"substate\": %d,\n"
+		              "                \"lpit\": %s,\n"
+		              "                \"uid\": %d,\n"
+		              "                \"enabled\": %s,\n"
+		              "                \"residencyUs\": %d,\n"
+		              "                \"latencyUs\": %d,\n"
+		              "                \"measured\": %s,\n"
+		              "                \"wakeCyclesMin\": %d,\n"
+		              "                \"wakeCyclesMax\": %d\n"
+		              "            }%s\n",
+		              mwait ? "true" : "false",
+		              mwait ? hint : 0,
+		              mwait ? ((hint >> 4) & 0xf) + 1 : 0,
+		              mwait ? hint & 0xf : 0,
+		              sysinfo.cstate.list[i].lpit ? "true" : "false",
+		              sysinfo.cstate.list[i].uid,
+		              sysinfo.cstate.list[i].disabled ? "false" : "true",
+		              sysinfo.cstate.list[i].residency_us,
+		              sysinfo.cstate.list[i].latency_us,
+		              sysinfo.cstate.list[i].measured ? "true" : "false",
+		              sysinfo.cstate.list[i].wake_min,
+		              sysinfo.cstate.list[i].wake_max,
+		              i + 1 == sysinfo.cstate.count ? "" : ",");
+	}
+	serial_puts("        ]\n"
+	            "    }");
+}
+
+/*
+ * Output the boot processor profile.
+ */
+static void section_cpu(void)
+{
+	const char *brand = sysinfo.cpu_info.brand;
+	while (*brand == ' ')
+		brand++;
+	serial_printf("    \"cpu\": {\n"
+	              "        \"vendor\": \"%s\",\n"
+	              "        \"brand\": \"%s\",\n"
+	              "        \"family\": %d,\n"
+	              "        \"model\": %d,\n"
+	              "        \"stepping\": %d,\n"
+	              "        \"physAddrBits\": %d,\n"
+	              "        \"virtAddrBits\": %d,\n"
+	              "        \"features\": [",
+	              sysinfo.cpu_info.vendor, brand, sysinfo.cpu_info.family,
+	              sysinfo.cpu_info.model, sysinfo.cpu_info.stepping,
+	              sysinfo.cpu_info.phys_bits, sysinfo.cpu_info.virt_bits);
+	bool first_feature = true;
+	for (uint32_t i = 0; i < CPU_NUM_FEATURES; i++) {
+		if (!cpu_has(i))
+			continue;
+		serial_printf("%s\"%s\"", first_feature ? "" : ", ", cpu_feature_name(i));
+		first_feature = false;
+	}
+	serial_printf("],\n"
+	              "        \"xsave\": {\n"
+	              "            \"features\": %D,\n"
+	              "            \"maxSize\": %d,\n"
+	              "            \"components\": [",
+	              sysinfo.cpu_info.xsave_mask, sysinfo.cpu_info.xsave_size);
+	bool first_component = true;
+	for (uint32_t i = 2; i < 64; i++) {
+		if (!sysinfo.cpu_info.xsave_component[i].size)
+			continue;
+		serial_printf("%s\n"
+		              "                {\n"
+		              "                    \"id\": %d,\n"
+		              "                    \"size\": %d,\n"
+		              "                    \"offset\": %d\n"
+		              "                }",
+		              first_component ? "" : ",", i,
+		              sysinfo.cpu_info.xsave_component[i].size,
+		              sysinfo.cpu_info.xsave_component[i].offset);
+		first_component = false;
+	}
+	serial_printf("\n            ]\n"
+	              "        },\n"
+	              "        \"frequency\": {\n"
+	              "            \"baseMHz\": %d,\n"
+	              "            \"maxMHz\": %d,\n"
+	              "            \"busMHz\": %d,\n"
+	              "            \"tscHz\": %D,\n"
+	              "            \"baseRatio\": %d,\n"
+	              "            \"turboRatios\": [",
+	              sysinfo.cpu_info.base_mhz, sysinfo.cpu_info.max_mhz,
+	              sysinfo.cpu_info.bus_mhz, sysinfo.cpu_info.tsc_hz,
+	              sysinfo.cpu_info.base_ratio);
+	for (uint32_t i = 0; i < 8 && (sysinfo.cpu_info.turbo_ratios >> (i * 8)) & 0xff; i++)
+		serial_printf("%s%d", i == 0 ? "" : ", ",
+		              (uint32_t) (sysinfo.cpu_info.turbo_ratios >> (i * 8)) & 0xff);
+	serial_printf("],\n"
+	              "            \"hwpHighest\": %d,\n"
+	              "            \"hwpGuaranteed\": %d,\n"
+	              "            \"hwpEfficient\": %d,\n"
+	              "            \"hwpLowest\": %d\n"
+	              "        },\n",
+	              sysinfo.cpu_info.hwp_caps & 0xff,
+	              (sysinfo.cpu_info.hwp_caps >> 8) & 0xff,
+	              (sysinfo.cpu_info.hwp_caps >> 16) & 0xff,
+	              sysinfo.cpu_info.hwp_caps >> 24);
+	serial_printf("        \"pmu\": {\n"
+	              "            \"version\": %d,\n"
+	              "            \"counters\": %d,\n"
+	              "            \"counterWidth\": %d,\n"
+	              "            \"fixedCounters\": %d,\n"
+	              "            \"fixedCounterWidth\": %d\n"
+	              "        }\n"
+	              "    }",
+	              sysinfo.cpu_info.pmu_version, sysinfo.cpu_info.pmu_counters,
+	              sysinfo.cpu_info.pmu_counter_width,
+	              sysinfo.cpu_info.pmu_fixed_counters,
+	              sysinfo.cpu_info.pmu_fixed_counter_width);
+}
+
+/*
+ * Output the processors.
+ */
+static void section_cpus(void)
+{
+	serial_printf("    \"x2apic\": %s,\n"
+	              "    \"cpus\": [\n",
+	              sysinfo.apic.x2apic ? "true" : "false");
+	for (uint32_t i = 0; i < sysinfo.cpu.count; i++) {
+		serial_printf("        {\n"
+		              "            \"apicId\": %d,\n"
+		              "            \"uid\": %d,\n"
+		              "            \"enabled\": %s,\n"
+		              "            \"onlineCapable\": %s\n"
+		              "        }%s\n",
+		              sysinfo.cpu.list[i].apic_id,
+		              sysinfo.cpu.list[i].uid,
+		              sysinfo.cpu.list[i].flags & ACPI_MADT_LAPIC_ENABLED ? "true" : "false",
+		              sysinfo.cpu.list[i].flags & ACPI_MADT_LAPIC_ONLINE_CAPABLE ? "true" : "false",
+		              i + 1 == sysinfo.cpu.count ? "" : ",");
+	}
+	serial_puts("    ]");
+}
+
+/*
+ * Output the proximity domains of the processors and memory ranges, empty on
+ * machines without a SRAT.
+ */
+static void section_numa(void)
+{
+	serial_puts("    \"numa\": {\n"
+	            "        \"cpus\": [\n");
+	for (uint32_t i = 0; i < sysinfo.cpu_affinity.count; i++) {
+		serial_printf("            {\n"
+		              "                \"apicId\": %d,\n"
+		              "                \"domain\": %d\n"
+		              "            }%s\n",
+		              sysinfo.cpu_affinity.list[i].apic_id,
+		              sysinfo.cpu_affinity.list[i].domain,
+		              i + 1 == sysinfo.cpu_affinity.count ? "" : ",");
+	}
+	serial_puts("        ],\n"
+	            "        \"memory\": [\n");
+	for (uint32_t i = 0; i < sysinfo.memory_affinity.count; i++) {
+		serial_printf("            {\n"
+		              "                \"base\": %D,\n"
+		              "                \"size\": %D,\n"
+		              "                \"domain\": %d,\n"
+		              "                \"hotpluggable\": %s,\n"
+		              "                \"nonVolatile\": %s\n"
+		              "            }%s\n",
+		              sysinfo.memory_affinity.list[i].addr,
+		              sysinfo.memory_affinity.list[i].size,
+		              sysinfo.memory_affinity.list[i].domain,
+		              sysinfo.memory_affinity.list[i].flags & ACPI_SRAT_HOTPLUGGABLE ? "true" : "false",
+		              sysinfo.memory_affinity.list[i].flags & ACPI_SRAT_NON_VOLATILE ? "true" : "false",
+		              i + 1 == sysinfo.memory_affinity.count ? "" : ",");
+	}
+	serial_puts("        ]\n"
+	            "    }");
+}
+
+/*
+ * Output the interrupt routing.
+ */
+static void section_interrupts(void)
+{
+	serial_puts("    \"interrupts\": {\n"
+	            "        \"ioapics\": [\n");
+	for (uint32_t i = 0; i < sysinfo.ioapic.count; i++) {
+		serial_printf("            {\n"
+		              "                \"id\": %d,\n"
+		              "                \"base\": %d,\n"
+		              "                \"version\": %d,\n"
+		              "                \"gsiBase\": %d,\n"
+		              "                \"pins\": %d\n"
+		              "            }%s\n",
+		              sysinfo.ioapic.list[i].id,
+		              sysinfo.ioapic.list[i].addr,
+		              sysinfo.ioapic.list[i].version,
+		              sysinfo.ioapic.list[i].gsi_base,
+		              sysinfo.ioapic.list[i].num_entries,
+		              i + 1 == sysinfo.ioapic.count ? "" : ",");
+	}
+	serial_puts("        ],\n"
+	            "        \"isa\": [\n");
+	bool first = true;
+	for (uint8_t irq = 0; irq < IOAPIC_NUM_ISA_IRQS; irq++) {
+		uint16_t flags;
+		uint32_t gsi;
+
+		if (!ioapic_isa_irq_gsi(irq, &gsi, &flags))
+			continue;
+		serial_printf("%s"
+		              "            {\n"
+		              "                \"irq\": %d,\n"
+		              "                \"gsi\": %d,\n"
+		              "                \"polarity\": \"%s\",\n"
+		              "                \"trigger\": \"%s\"\n"
+		              "            }",
+		              first ? "" : ",\n", irq, gsi,
+		              madt_polarity_name(flags),
+		              madt_trigger_name(flags));
+		first = false;
+	}
+	serial_puts("\n"
+	            "        ],\n"
+	            "        \"overrides\": [\n");
+	for (uint32_t i = 0; i < sysinfo.int_override.count; i++) {
+		serial_printf("            {\n"
+		              "                \"bus\": %d,\n"
+		              "                \"source\": %d,\n"
+		              "                \"gsi\": %d,\n"
+		              "                \"polarity\": \"%s\",\n"
+		              "                \"trigger\": \"%s\"\n"
+		              "            }%s\n",
+		              sysinfo.int_override.list[i].bus,
+		              sysinfo.int_override.list[i].source,
+		              sysinfo.int_override.list[i].gsi,
+		              madt_polarity_name(sysinfo.int_override.list[i].flags),
+		              madt_trigger_name(sysinfo.int_override.list[i].flags),
+		              i + 1 == sysinfo.int_override.count ? "" : ",");
+	}
+	serial_puts("        ],\n"
+	            "        \"nmis\": [\n");
+	for (uint32_t i = 0; i < sysinfo.nmi.count; i++) {
+		if (sysinfo.nmi.list[i].lapic)
+			serial_printf("            {\n"
+			              "                \"uid\": %d,\n"
+			              "                \"lint\": %d,\n",
+			              sysinfo.nmi.list[i].uid,
+			              sysinfo.nmi.list[i].lint);
+		else
+			serial_printf("            {\n"
+			              "                \"gsi\": %d,\n",
+			              sysinfo.nmi.list[i].gsi);
+		serial_printf("                \"polarity\": \"%s\",\n"
+		              "                \"trigger\": \"%s\"\n"
+		              "            }%s\n",
+		              madt_polarity_name(sysinfo.nmi.list[i].flags),
+		              madt_trigger_name(sysinfo.nmi.list[i].flags),
+		              i + 1 == sysinfo.nmi.count ? "" : ",");
+	}
+	serial_puts("        ],\n"
+	            "        \"pci\": [\n");
+	for (uint32_t i = 0; i < sysinfo.prt.count; i++) {
+		serial_printf("            {\n"
+		              "                \"segment\": %d,\n"
+		              "                \"bus\": %d,\n"
+		              "                \"device\": %d,\n"
+		              "                \"pin\": \"%s\",\n"
+		              "                \"gsi\": %d,\n",
+		              sysinfo.prt.list[i].segment,
+		              sysinfo.prt.list[i].bus,
+		              sysinfo.prt.list[i].device,
+		              prt_pin_name(sysinfo.prt.list[i].pin),
+		              sysinfo.prt.list[i].gsi);
+		if (sysinfo.prt.list[i].link[0])
+			serial_printf("                \"link\": \"%s\",\n",
+			              sysinfo.prt.list[i].link);
+		serial_printf("                \"polarity\": \"%s\",\n"
+		              "                \"trigger\": \"%s\"\n"
+		              "            }%s\n",
+		              madt_polarity_name(sysinfo.prt.list[i].flags),
+		              madt_trigger_name(sysinfo.prt.list[i].flags),
+		              i + 1 == sysinfo.prt.count ? "" : ",");
+	}
+	serial_puts("        ]\n"
+	            "    }");
+}
+
+/*
+ * Output the RMRRs.
+ */
+static void section_rmrrs(void)
+{
+	serial_puts("    \"rmrrs\": [\n");
+	if (sysinfo.rmrr.count > 0) {
+		for (int i = 0; i < sysinfo.rmrr.count; i++) {
+			serial_printf("        {\n"
+			              "            \"segment\": %d,\n"
+			              "            \"devid\": %d,\n"
+			              "            \"base\":  %D,\n"
+			              "            \"limit\": %D\n"
+			              "        }%s\n",
+			              sysinfo.rmrr.list[i].segment,
+			              sysinfo.rmrr.list[i].devid,
+			              sysinfo.rmrr.list[i].addr,
+			              sysinfo.rmrr.list[i].limit,
+			              i + 1 == sysinfo.rmrr.count ? "" : ",");
+		}
+	}
+	serial_puts("    ]");
+}
+
+/*
+ * Output the Microkit bootinfo parameters.
+ */
+static void section_bootinfo(void)
+{
+	serial_printf("    \"bootinfo\": {\n"
+	              "        \"numIOPTLevels\": %d,\n"
+	              "        \"ioptPageSizes\": [4096%s%s]\n"
+	              "    }",
+	              sysinfo.drhu.count ? sysinfo.vtd.num_iopt_levels
+	                                 : sysinfo.amdvi.num_iopt_levels,
+	              sysinfo.vtd.superpages & VTD_SLLPS_2M ? ", 2097152" : "",
+	              sysinfo.vtd.superpages & VTD_SLLPS_1G ? ", 1073741824" : "");
+}
+
+/*
+ * Sections of the machine file, in output order, with the phase after which
+ * their content is complete.
+ */
+static const struct section {
+	const char *name;
+	enum phase  phase;
+	void      (*dump)(void);
+} sections[] = {
+	{ "fingerprint", PHASE_DONE,   section_fingerprint  },
+	{ "memory",      PHASE_MEMORY, section_memory       },
+	{ "efiMemory",   PHASE_ACPI,   section_efi_memory   },
+	{ "kdevs",       PHASE_ACPI,   section_kdevs        },
+	{ "memoryTypes", PHASE_MTRR,   section_memory_types },
+	{ "dimms",       PHASE_SMBIOS, section_dimms        },
+	{ "drhus",       PHASE_VTD,    section_drhus        },
+	{ "ivhds",       PHASE_AMDVI,  section_ivhds        },
+	{ "ivmds",       PHASE_ACPI,   section_ivmds        },
+	{ "cpu",         PHASE_CPU,    section_cpu          },
+	{ "cpus",        PHASE_CPU,    section_cpus         },
+	{ "numa",        PHASE_ACPI,   section_numa         },
+	{ "hypervisor",  PHASE_CPU,    section_hypervisor   },
+	{ "cstates",     PHASE_CSTATE, section_cstates      },
+	{ "interrupts",  PHASE_IOAPIC, section_interrupts   },
+	{ "rmrrs",       PHASE_ACPI,   section_rmrrs        },
+	{ "bootinfo",    PHASE_AMDVI,  section_bootinfo     },
+};
+
+#define NUM_SECTIONS (sizeof (sections) / sizeof (sections[0]))
+
+/* Sections in the order they were sent, indexed by sequence number. */
+static uint8_t section_order[NUM_SECTIONS];
+static uint32_t num_sections_sent;
+
+/* Maximum length of a command line received in the command loop. */
+#define SERVE_LINE_SIZE 64
+
+/*
+ * Give a section its sequence number, the first time it is sent.
+ */
+static uint32_t section_seq(uint32_t index)
+{
+	for (uint32_t seq = 0; seq < num_sections_sent; seq++)
+		if (section_order[seq] == index)
+			return seq;
+	section_order[num_sections_sent] = index;
+	return num_sections_sent++;
+}
+
+/*
+ * Output a section as a self-contained json object.
+ */
+static void section_object(uint32_t index)
+{
+	serial_puts("{\n");
+	sections[index].dump();
+	serial_puts("\n}\n");
+}
+
+/*
+ * Output the machine file as a json object, without the framing.
+ */
+void machine_file_object(void)
+{
+	serial_puts("{\n");
+	for (uint32_t i = 0; i < NUM_SECTIONS; i++) {
+		section_seq(i);
+		sections[i].dump();
+		serial_puts(i + 1 == NUM_SECTIONS ? "\n" : ",\n");
+	}
+	serial_puts("}\n");
+}
+
+/*
+ * Output the machine file in json format over the serial line.
+ */
+void dump_machine_file(void)
+{
+	serial_puts("\n"
+	            "-----BEGIN MACHINE FILE BLOCK-----\n");
+	machine_file_object();
+	serial_puts("-----END MACHINE FILE BLOCK-----\n");
+}
+
+/*
+ * Stream a section framed with its sequence number and the CRC32C of the
+ * object.
+ */
+static void stream_section(uint32_t index)
+{
+	uint32_t seq = section_seq(index);
+
+	serial_printf("-----BEGIN MACHINE SECTION %d %s-----\n", seq, sections[index].name);
+	serial_window_begin(0, UINT32_MAX, false);
+	section_object(index);
+	uint32_t crc = serial_window_end(NULL);
+	serial_printf("-----END MACHINE SECTION %d %x-----\n", seq, crc);
+}
+
+/*
+ * End a discovery phase, streaming the sections it completes.
+ */
+void phase_done(enum phase phase)
+{
+	if (options.dump != OPTION_DUMP_SECTIONS)
+		return;
+	for (uint32_t i = 0; i < NUM_SECTIONS; i++)
+		if (sections[i].phase == phase)
+			stream_section(i);
+}
+
+/*
+ * List the sections sent so far, with the length and CRC32C of their objects.
+ */
+static void serve_list(void)
+{
+	serial_puts("-----BEGIN MACHINE SECTION LIST-----\n");
+	for (uint32_t seq = 0; seq < num_sections_sent; seq++) {
+		uint32_t length;
+		serial_window_begin(0, UINT32_MAX, true);
+		section_object(section_order[seq]);
+		uint32_t crc = serial_window_end(&length);
+		serial_printf("@%d %s %d %x\n", seq, sections[section_order[seq]].name, length, crc);
+	}
+	serial_printf("-----END MACHINE SECTION LIST %d-----\n", num_sections_sent);
+}
+
+/*
+ * Send a byte range of the object of a section. The data is followed by a
+ * newline that isn't part of the chunk.
+ */
+static void serve_chunk(uint32_t seq, uint32_t offset, uint32_t length)
+{
+	uint32_t total;
+
+	serial_printf("-----BEGIN MACHINE CHUNK %d %d-----\n", seq, offset);
+	serial_window_begin(offset, offset + length < offset ? UINT32_MAX : offset + length, false);
+	section_object(section_order[seq]);
+	uint32_t crc = serial_window_end(&total);
+	uint32_t sent = offset >= total ? 0 : total - offset < length ? total - offset : length;
+	serial_printf("\n-----END MACHINE CHUNK %d %d %d %x-----\n", seq, offset, sent, crc);
+}
+
+/*
+ * Read a command line from the serial port, ignoring empty lines. Returns
+ * false if the line is too long.
+ */
+static bool serve_read_line(char *line)
+{
+	uint32_t len = 0;
+	bool overflow = false;
+
+	for (;;) {
+		uint8_t c = serial_getc();
+		if (c == '\r' || c == '\n') {
+			if (len || overflow)
+				break;
+			continue;
+		}
+		if (len + 1 < SERVE_LINE_SIZE)
+			line[len++] = c;
+		else
+			overflow = true;
+	}
+	line[len] = '\0';
+	return !overflow;
+}
+
+/*
+ * Parse the next number of a command line.
+ */
+static bool serve_number(char **line, uint32_t *value)
+{
+	char *token = get_token(line);
+	uint64_t val;
+
+	if (!token || !strtou64(token, &val) || val >> 32)
+		return false;
+	*value = val;
+	return true;
+}
+
+/*
+ * Command loop, entered instead of halting the machine. A host tool can list
+ * the sections sent so far and get them again, whole or in chunks, when the
+ * serial line lost some of the data. The commands are:
+ *
+ *   LIST                      list the sections with their length and CRC32C
+ *   SECTION <seq>             send a section again
+ *   CHUNK <seq> <off> <len>   send a byte range of a section object
+ *   FILE                      send the whole machine file again
+ *
+ * Anything else is answered with a NAK line.
+ */
+void serve(void)
+{
+	char line[SERVE_LINE_SIZE];
+
+	serial_puts("[*] Waiting for commands on the serial port\n");
+	for (;;) {
+		uint32_t seq, offset, length;
+
+		if (!serve_read_line(line)) {
+			serial_puts("-----NAK line too long-----\n");
+			continue;
+		}
+
+		char *args = line;
+		char *command = get_token(&args);
+		if (!command)
+			continue;
+
+		if (!strcmp(command, "LIST")) {
+			serve_list();
+		} else if (!strcmp(command, "SECTION") && serve_number(&args, &seq)) {
+			if (seq < num_sections_sent)
+				stream_section(section_order[seq]);
+			else
+				serial_puts("-----NAK no such section-----\n");
+		} else if (!strcmp(command, "CHUNK") && serve_number(&args, &seq) &&
+		           serve_number(&args, &offset) && serve_number(&args, &length)) {
+			if (seq < num_sections_sent)
+				serve_chunk(seq, offset, length);
+			else
+				serial_puts("-----NAK no such section-----\n");
+		} else if (!strcmp(command, "FILE")) {
+			if (num_sections_sent == NUM_SECTIONS)
+				dump_machine_file();
+			else
+				serial_puts("-----NAK incomplete machine file-----\n");
+		} else {
+			serial_puts("-----NAK bad command-----\n");
+		}
+	}
+}
@@ -0,0 +1,207 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/*
+ * EFI boot information: the EFI memory map and the configuration tables of
+ * the EFI system table, both passed by the boot loader in multiboot2 tags.
+ * Boot services have been exited by then, only the runtime data is left.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "efi.h"
+#include "memory.h"
+#include "multiboot2.h"
+#include "parser.h"
+#include "serial.h"
+#include "sysinfo.h"
+#include "utils.h"
+
+const struct efi_guid efi_guid_acpi10 =
+	{ 0xeb9d2d30, 0x2d88, 0x11d3, { 0x9a, 0x16, 0x00, 0x90, 0x27, 0x3f, 0xc1, 0x4d } };
+const struct efi_guid efi_guid_acpi20 =
+	{ 0x8868e871, 0xe4f1, 0x11d3, { 0xbc, 0x22, 0x00, 0x80, 0xc7, 0x3c, 0x88, 0x81 } };
+const struct efi_guid efi_guid_smbios =
+	{ 0xeb9d2d31, 0x2d88, 0x11d3, { 0x9a, 0x16, 0x00, 0x90, 0x27, 0x3f, 0xc1, 0x4d } };
+const struct efi_guid efi_guid_smbios3 =
+	{ 0xf2fd1544, 0x9794, 0x4a2c, { 0x99, 0x2e, 0xe5, 0xbb, 0xcf, 0x20, 0xe3, 0x94 } };
+
+/* EFI system table, 0 if not passed or above 4GiB. */
+static uint32_t efi_systab;
+static bool efi_systab64;
+
+/*
+ * Return a printable name for an EFI memory type.
+ */
+const char *efi_memory_type_name(uint32_t type)
+{
+	switch (type) {
+	case EFI_RESERVED_MEMORY_TYPE:        return "reserved";
+	case EFI_LOADER_CODE:                 return "loaderCode";
+	case EFI_LOADER_DATA:                 return "loaderData";
+	case EFI_BOOT_SERVICES_CODE:          return "bootServicesCode";
+	case EFI_BOOT_SERVICES_DATA:          return "bootServicesData";
+	case EFI_RUNTIME_SERVICES_CODE:       return "runtimeServicesCode";
+	case EFI_RUNTIME_SERVICES_DATA:       return "runtimeServicesData";
+	case EFI_CONVENTIONAL_MEMORY:         return "conventional";
+	case EFI_UNUSABLE_MEMORY:             return "unusable";
+	case EFI_ACPI_RECLAIM_MEMORY:         return "acpiReclaim";
+	case EFI_ACPI_MEMORY_NVS:             return "acpiNvs";
+	case EFI_MEMORY_MAPPED_IO:            return "mmio";
+	case EFI_MEMORY_MAPPED_IO_PORT_SPACE: return "mmioPortSpace";
+	case EFI_PAL_CODE:                    return "palCode";
+	case EFI_PERSISTENT_MEMORY:           return "persistent";
+	case EFI_UNACCEPTED_MEMORY:           return "unaccepted";
+	default:                              return "unknown";
+	}
+}
+
+/*
+ * Check whether a region is free once boot services are exited. Specific
+ * purpose memory is set aside for particular uses and isn't general RAM.
+ */
+static bool efi_memory_usable(const struct efi_memory_descriptor *d)
+{
+	if (d->attribute & EFI_MEMORY_SP)
+		return false;
+
+	switch (d->type) {
+	case EFI_LOADER_CODE:
+	case EFI_LOADER_DATA:
+	case EFI_BOOT_SERVICES_CODE:
+	case EFI_BOOT_SERVICES_DATA:
+	case EFI_CONVENTIONAL_MEMORY:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Parse the multiboot2 EFI memory map tag, keeping the regions with notable
+ * attributes, and the usable ones for boot loaders that don't pass the legacy
+ * memory map.
+ */
+static bool parse_efi_mmap_tag(struct multiboot2_tag_header *tag_header)
+{
+	struct multiboot2_tag_efi_mmap *tag = (void *) (tag_header + 1);
+	uint32_t saddr = (uint32_t) (tag + 1);
+	uint32_t eaddr = (uint32_t) tag_header + tag_header->size;
+	bool usable = !multiboot2_tag(MULTIBOOT2_INFO_TAG_MEMORY_MAP);
+
+	serial_puts("[*] Multiboot2 EFI memory map tag found\n");
+	if (tag->descr_size < sizeof (struct efi_memory_descriptor)) {
+		serial_printf("[!] Warning: EFI memory descriptors of %d bytes, ignored\n",
+		              tag->descr_size);
+		return true;
+	}
+
+	for (uint32_t addr = saddr; addr + tag->descr_size <= eaddr; addr += tag->descr_size) {
+		struct efi_memory_descriptor *d = (void *) addr;
+		uint64_t size = d->num_pages << EFI_PAGE_SHIFT;
+
+		if (usable && efi_memory_usable(d) && !memory_add(d->phys_start, size))
+			return false;
+
+		if (!(d->attribute & (EFI_MEMORY_RUNTIME | EFI_MEMORY_SP | EFI_MEMORY_MORE_RELIABLE)))
+			continue;
+
+		serial_printf("[*] EFI %s region at %X size %X attributes %X\n",
+		              efi_memory_type_name(d->type), d->phys_start, size, d->attribute);
+
+		if (!vector_reserve(&sysinfo.efi_memory))
+			return false;
+		sysinfo.efi_memory.list[sysinfo.efi_memory.count].addr = d->phys_start;
+		sysinfo.efi_memory.list[sysinfo.efi_memory.count].size = size;
+		sysinfo.efi_memory.list[sysinfo.efi_memory.count].attribute = d->attribute;
+		sysinfo.efi_memory.list[sysinfo.efi_memory.count].type = d->type;
+		sysinfo.efi_memory.count++;
+	}
+
+	return true;
+}
+PARSER(PARSER_MULTIBOOT2, MULTIBOOT2_INFO_TAG_EFI_MEMORY_MAP, parse_efi_mmap_tag);
+
+/*
+ * Parse the multiboot2 EFI system table tags.
+ */
+static bool parse_efi32_tag(struct multiboot2_tag_header *tag_header)
+{
+	struct multiboot2_tag_efi32 *tag = (void *) (tag_header + 1);
+
+	serial_printf("[*] Multiboot2 EFI 32-bit system table tag found at %x\n", tag->pointer);
+	if (!efi_systab) {
+		efi_systab = tag->pointer;
+		efi_systab64 = false;
+	}
+	return true;
+}
+PARSER(PARSER_MULTIBOOT2, MULTIBOOT2_INFO_TAG_EFI32_SYSTEM_TABLE, parse_efi32_tag);
+
+static bool parse_efi64_tag(struct multiboot2_tag_header *tag_header)
+{
+	struct multiboot2_tag_efi64 *tag = (void *) (tag_header + 1);
+
+	serial_printf("[*] Multiboot2 EFI 64-bit system table tag found at %X\n", tag->pointer);
+	if (tag->pointer >> 32) {
+		serial_puts("[!] Warning: EFI system table above 4GiB, ignored\n");
+		return true;
+	}
+	efi_systab = tag->pointer;
+	efi_systab64 = true;
+	return true;
+}
+PARSER(PARSER_MULTIBOOT2, MULTIBOOT2_INFO_TAG_EFI64_SYSTEM_TABLE, parse_efi64_tag);
+
+/*
+ * Get the location of the EFI system table and of its configuration table.
+ */
+bool efi_system_table(uint64_t *addr, uint32_t *size, uint64_t *config, uint32_t *config_size)
+{
+	if (!efi_systab)
+		return false;
+
+	*addr = efi_systab;
+	if (efi_systab64) {
+		struct efi_system_table64 *st = (void *) efi_systab;
+		*size = sizeof (*st);
+		*config = st->config_table;
+		*config_size = st->num_config_entries * sizeof (struct efi_config_entry64);
+	} else {
+		struct efi_system_table32 *st = (void *) efi_systab;
+		*size = sizeof (*st);
+		*config = st->config_table;
+		*config_size = st->num_config_entries * sizeof (struct efi_config_entry32);
+	}
+	return true;
+}
+
+/*
+ * Look up a table in the EFI configuration table, returns NULL if absent or
+ * above 4GiB.
+ */
+void *efi_config_table(const struct efi_guid *guid)
+{
+	uint64_t addr, config;
+	uint32_t size, config_size;
+
+	if (!efi_system_table(&addr, &size, &config, &config_size) || (config + config_size) >> 32)
+		return NULL;
+
+	uint32_t entry_size = efi_systab64 ? sizeof (struct efi_config_entry64) :
+	                                     sizeof (struct efi_config_entry32);
+	for (uint32_t p = config; p < config + config_size; p += entry_size) {
+		if (memcmp((char *) p, (char *) guid, sizeof (*guid)))
+			continue;
+
+		uint64_t table = efi_systab64 ? ((struct efi_config_entry64 *) p)->table :
+		                                ((struct efi_config_entry32 *) p)->table;
+		return table >> 32 ? NULL : (void *) (uint32_t) table;
+	}
+	return NULL;
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/*
+ * Machine fingerprint, a hash of the hardware description that is the same
+ * for identical machines. Build systems key their image caches on it.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "acpi.h"
+#include "cpu.h"
+#include "fingerprint.h"
+#include "options.h"
+#include "sysinfo.h"
+
+/* Reflected CRC32C (Castagnoli) polynomial. */
+#define CRC32C_POLY             0x82f63b78
+
+/*
+ * Hash the elements of a growable vector, but not its capacity or location.
+ */
+#define crc32c_vector(crc, vec)                                 \
+	crc32c(crc32c(crc, &(vec).count, sizeof ((vec).count)), \
+	       (vec).list, (vec).count * sizeof (*(vec).list))
+
+/*
+ * Update a CRC32C in software, one byte at a time from a lookup table.
+ */
+static uint32_t crc32c_sw(uint32_t crc, const uint8_t *p, uint32_t len)
+{
+	static uint32_t table[256];
+
+	if (!table[1]) {
+		for (uint32_t i = 0; i < 256; i++) {
+			uint32_t c = i;
+			for (int j = 0; j < 8; j++)
+				c = c & 1 ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+			table[i] = c;
+		}
+	}
+
+	while (len--)
+		crc = table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	return crc;
+}
+
+/*
+ * Update a CRC32C with the SSE4.2 instruction, four bytes at a time.
+ */
+static uint32_t crc32c_hw(uint32_t crc, const uint8_t *p, uint32_t len)
+{
+	for (; len >= 4; len -= 4, p += 4)
+		__asm__ ("crc32l %1, %0" : "+r" (crc) : "rm" (*(const uint32_t *) p));
+	for (; len; len--, p++)
+		__asm__ ("crc32b %1, %0" : "+r" (crc) : "rm" (*p));
+	return crc;
+}
+
+/*
+ * Update a CRC32C over a buffer. Start with 0, the complement is handled
+ * here.
+ */
+uint32_t crc32c(uint32_t crc, const void *buf, uint32_t len)
+{
+	if (cpu_has(CPU_FEATURE_SSE4_2))
+		return ~crc32c_hw(~crc, buf, len);
+	return ~crc32c_sw(~crc, buf, len);
+}
+
+/*
+ * Hash the raw ACPI tables listed in the RSDT, and the DSDT.
+ */
+static uint32_t fingerprint_acpi(uint32_t crc)
+{
+	struct acpi_rsdt *rsdt = (void *) sysinfo.rsdt.addr;
+	struct acpi_header *dsdt = (void *) sysinfo.dsdt.addr;
+
+	int nentries = (rsdt->header.length - sizeof (rsdt->header)) / 4;
+	for (int i = 0; i < nentries; i++) {
+		struct acpi_header *header = (void *) rsdt->entry[i];
+		crc = crc32c(crc, header, header->length);
+	}
+	if (dsdt)
+		crc = crc32c(crc, dsdt, dsdt->length);
+	return crc;
+}
+
+/*
+ * Compute the machine fingerprint. The sysinfo structure is hashed section by
+ * section, leaving out the pointers and capacities of the vectors and the
+ * location of the ACPI tables, which may change with the firmware version.
+ * Unused parts of the sections are zeroed, so padding hashes consistently.
+ */
+uint32_t fingerprint(void)
+{
+	uint32_t crc = 0;
+
+	crc = crc32c_vector(crc, sysinfo.memory);
+	crc = crc32c_vector(crc, sysinfo.efi_memory);
+	crc = crc32c(crc, &sysinfo.apic, sizeof (sysinfo.apic));
+	crc = crc32c_vector(crc, sysinfo.cpu);
+	crc = crc32c(crc, &sysinfo.cpu_info, sizeof (sysinfo.cpu_info));
+	crc = crc32c_vector(crc, sysinfo.hypervisor);
+
+	/* The measured wake latencies vary from boot to boot, leave them out. */
+	crc = crc32c(crc, &sysinfo.cstate, offsetof(typeof(sysinfo.cstate), count));
+	crc = crc32c(crc, &sysinfo.cstate.count, sizeof (sysinfo.cstate.count));
+	for (uint32_t i = 0; i < sysinfo.cstate.count; i++)
+		crc = crc32c(crc, &sysinfo.cstate.list[i], offsetof(typeof(*sysinfo.cstate.list), measured));
+
+	crc = crc32c_vector(crc, sysinfo.ioapic);
+	crc = crc32c_vector(crc, sysinfo.int_override);
+	crc = crc32c_vector(crc, sysinfo.nmi);
+	crc = crc32c_vector(crc, sysinfo.prt);
+	crc = crc32c_vector(crc, sysinfo.pci);
+	crc = crc32c_vector(crc, sysinfo.drhu);
+	crc = crc32c_vector(crc, sysinfo.devscope);
+	crc = crc32c_vector(crc, sysinfo.pcidev);
+	crc = crc32c_vector(crc, sysinfo.rmrr);
+	crc = crc32c_vector(crc, sysinfo.ivhd);
+	crc = crc32c_vector(crc, sysinfo.ivhd_dev);
+	crc = crc32c_vector(crc, sysinfo.ivmd);
+	crc = crc32c(crc, &sysinfo.amdvi, sizeof (sysinfo.amdvi));
+	crc = crc32c(crc, &sysinfo.vtd, sizeof (sysinfo.vtd));
+	crc = crc32c(crc, &sysinfo.power, sizeof (sysinfo.power));
+	crc = crc32c_vector(crc, sysinfo.dimm);
+	crc = crc32c_vector(crc, sysinfo.dimm_range);
+	crc = crc32c(crc, &sysinfo.mtrr, offsetof(typeof(sysinfo.mtrr), var));
+	crc = crc32c_vector(crc, sysinfo.mtrr.var);
+
+	if (options.fingerprint_acpi)
+		crc = fingerprint_acpi(crc);
+
+	return crc;
+}
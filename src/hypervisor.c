@@ -0,0 +1,227 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/*
+ * Hypervisor detection. When running virtualised the hypervisor interfaces
+ * are found in the CPUID leaves from 0x40000000, their paravirtual features
+ * tell the kernel which exits it can avoid.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "cpu.h"
+#include "hypervisor.h"
+#include "serial.h"
+#include "sysinfo.h"
+#include "utils.h"
+
+enum cpuid_reg { EAX, EBX, ECX, EDX };
+
+/* Hyper-V interface signature, in leaf 1 EAX. */
+#define HYPERV_INTERFACE_HV1    0x31237648
+
+/*
+ * Signatures of the known hypervisors, in leaf 0 EBX, ECX and EDX.
+ */
+static const struct {
+	const char *signature;
+	const char *name;
+} hypervisor_vendors[] = {
+	[HYPERVISOR_UNKNOWN] = {"",                         "unknown"},
+	[HYPERVISOR_KVM]     = {"KVMKVMKVM\0\0\0",          "kvm"},
+	[HYPERVISOR_HYPERV]  = {"Microsoft Hv",             "hyperv"},
+	[HYPERVISOR_XEN]     = {"XenVMMXenVMM",             "xen"},
+	[HYPERVISOR_VMWARE]  = {"VMwareVMware",             "vmware"},
+};
+
+#define HYPERVISOR_NUM_VENDORS  (sizeof (hypervisor_vendors) / sizeof (hypervisor_vendors[0]))
+
+/*
+ * Location of each feature flag, as an offset from the base leaf of the
+ * interface of its vendor.
+ */
+static const struct {
+	const char *name;
+	uint8_t     vendor;
+	uint8_t     leaf;
+	uint8_t     reg;
+	uint8_t     bit;
+} hypervisor_features[HV_NUM_FEATURES] = {
+	[HV_FEATURE_KVM_CLOCKSOURCE]            = {"kvmclock",              HYPERVISOR_KVM,    1, EAX, 0},
+	[HV_FEATURE_KVM_NOP_IO_DELAY]           = {"nopiodelay",            HYPERVISOR_KVM,    1, EAX, 1},
+	[HV_FEATURE_KVM_CLOCKSOURCE2]           = {"kvmclock2",             HYPERVISOR_KVM,    1, EAX, 3},
+	[HV_FEATURE_KVM_ASYNC_PF]               = {"async_pf",              HYPERVISOR_KVM,    1, EAX, 4},
+	[HV_FEATURE_KVM_STEAL_TIME]             = {"steal_time",            HYPERVISOR_KVM,    1, EAX, 5},
+	[HV_FEATURE_KVM_PV_EOI]                 = {"pv_eoi",                HYPERVISOR_KVM,    1, EAX, 6},
+	[HV_FEATURE_KVM_PV_UNHALT]              = {"pv_unhalt",             HYPERVISOR_KVM,    1, EAX, 7},
+	[HV_FEATURE_KVM_PV_TLB_FLUSH]           = {"pv_tlb_flush",          HYPERVISOR_KVM,    1, EAX, 9},
+	[HV_FEATURE_KVM_ASYNC_PF_VMEXIT]        = {"async_pf_vmexit",       HYPERVISOR_KVM,    1, EAX, 10},
+	[HV_FEATURE_KVM_PV_SEND_IPI]            = {"pv_send_ipi",           HYPERVISOR_KVM,    1, EAX, 11},
+	[HV_FEATURE_KVM_POLL_CONTROL]           = {"poll_control",          HYPERVISOR_KVM,    1, EAX, 12},
+	[HV_FEATURE_KVM_PV_SCHED_YIELD]         = {"pv_sched_yield",        HYPERVISOR_KVM,    1, EAX, 13},
+	[HV_FEATURE_KVM_ASYNC_PF_INT]           = {"async_pf_int",          HYPERVISOR_KVM,    1, EAX, 14},
+	[HV_FEATURE_KVM_MSI_EXT_DEST_ID]        = {"msi_ext_dest_id",       HYPERVISOR_KVM,    1, EAX, 15},
+	[HV_FEATURE_KVM_HC_MAP_GPA_RANGE]       = {"hc_map_gpa_range",      HYPERVISOR_KVM,    1, EAX, 16},
+	[HV_FEATURE_KVM_MIGRATION_CONTROL]      = {"migration_control",     HYPERVISOR_KVM,    1, EAX, 17},
+	[HV_FEATURE_KVM_CLOCKSOURCE_STABLE]     = {"clocksource_stable",    HYPERVISOR_KVM,    1, EAX, 24},
+	[HV_FEATURE_KVM_HINTS_REALTIME]         = {"hints_realtime",        HYPERVISOR_KVM,    1, EDX, 0},
+	[HV_FEATURE_HYPERV_TIME_REF_COUNT]      = {"time_ref_count",        HYPERVISOR_HYPERV, 3, EAX, 1},
+	[HV_FEATURE_HYPERV_SYNIC]               = {"synic",                 HYPERVISOR_HYPERV, 3, EAX, 2},
+	[HV_FEATURE_HYPERV_STIMER]              = {"stimer",                HYPERVISOR_HYPERV, 3, EAX, 3},
+	[HV_FEATURE_HYPERV_APIC_ACCESS]         = {"apic_access",           HYPERVISOR_HYPERV, 3, EAX, 4},
+	[HV_FEATURE_HYPERV_HYPERCALL]           = {"hypercall",             HYPERVISOR_HYPERV, 3, EAX, 5},
+	[HV_FEATURE_HYPERV_VP_INDEX]            = {"vp_index",              HYPERVISOR_HYPERV, 3, EAX, 6},
+	[HV_FEATURE_HYPERV_REFERENCE_TSC]       = {"reference_tsc",         HYPERVISOR_HYPERV, 3, EAX, 9},
+	[HV_FEATURE_HYPERV_FREQUENCY_MSRS]      = {"frequency_msrs",        HYPERVISOR_HYPERV, 3, EAX, 11},
+	[HV_FEATURE_HYPERV_REENLIGHTENMENT]     = {"reenlightenment",       HYPERVISOR_HYPERV, 3, EAX, 13},
+	[HV_FEATURE_HYPERV_TSC_INVARIANT]       = {"tsc_invariant",         HYPERVISOR_HYPERV, 3, EAX, 15},
+	[HV_FEATURE_HYPERV_LOCAL_TLB_FLUSH]     = {"local_tlb_flush",       HYPERVISOR_HYPERV, 4, EAX, 1},
+	[HV_FEATURE_HYPERV_REMOTE_TLB_FLUSH]    = {"remote_tlb_flush",      HYPERVISOR_HYPERV, 4, EAX, 2},
+	[HV_FEATURE_HYPERV_APIC_ACCESS_RECOMMENDED] = {"apic_access_recommended", HYPERVISOR_HYPERV, 4, EAX, 3},
+	[HV_FEATURE_HYPERV_RELAXED_TIMING]      = {"relaxed_timing",        HYPERVISOR_HYPERV, 4, EAX, 5},
+	[HV_FEATURE_HYPERV_CLUSTER_IPI]         = {"cluster_ipi",           HYPERVISOR_HYPERV, 4, EAX, 10},
+	[HV_FEATURE_HYPERV_EX_PROCESSOR_MASKS]  = {"ex_processor_masks",    HYPERVISOR_HYPERV, 4, EAX, 11},
+	[HV_FEATURE_HYPERV_ENLIGHTENED_VMCS]    = {"enlightened_vmcs",      HYPERVISOR_HYPERV, 4, EAX, 14},
+	[HV_FEATURE_HYPERV_APIC_OVERLAY_ASSIST] = {"apic_overlay_assist",   HYPERVISOR_HYPERV, 6, EAX, 0},
+	[HV_FEATURE_HYPERV_MSR_BITMAPS]         = {"msr_bitmaps",           HYPERVISOR_HYPERV, 6, EAX, 1},
+	[HV_FEATURE_HYPERV_SLAT]                = {"slat",                  HYPERVISOR_HYPERV, 6, EAX, 3},
+	[HV_FEATURE_HYPERV_DMA_REMAPPING]       = {"dma_remapping",         HYPERVISOR_HYPERV, 6, EAX, 4},
+	[HV_FEATURE_HYPERV_INTERRUPT_REMAPPING] = {"interrupt_remapping",   HYPERVISOR_HYPERV, 6, EAX, 5},
+	[HV_FEATURE_XEN_TSC_EMULATED]           = {"tsc_emulated",          HYPERVISOR_XEN,    3, EAX, 0},
+	[HV_FEATURE_XEN_HOST_TSC_RELIABLE]      = {"host_tsc_reliable",     HYPERVISOR_XEN,    3, EAX, 1},
+	[HV_FEATURE_XEN_RDTSCP]                 = {"rdtscp",                HYPERVISOR_XEN,    3, EAX, 2},
+	[HV_FEATURE_XEN_APIC_ACCESS_VIRT]       = {"apic_access_virt",      HYPERVISOR_XEN,    4, EAX, 0},
+	[HV_FEATURE_XEN_X2APIC_VIRT]            = {"x2apic_virt",           HYPERVISOR_XEN,    4, EAX, 1},
+	[HV_FEATURE_XEN_IOMMU_MAPPINGS]         = {"iommu_mappings",        HYPERVISOR_XEN,    4, EAX, 2},
+	[HV_FEATURE_XEN_VCPU_ID]                = {"vcpu_id",               HYPERVISOR_XEN,    4, EAX, 3},
+	[HV_FEATURE_XEN_DOMID]                  = {"domid",                 HYPERVISOR_XEN,    4, EAX, 4},
+	[HV_FEATURE_XEN_EXT_DEST_ID]            = {"ext_dest_id",           HYPERVISOR_XEN,    4, EAX, 5},
+	[HV_FEATURE_XEN_UPCALL_VECTOR]          = {"upcall_vector",         HYPERVISOR_XEN,    4, EAX, 6},
+};
+
+/*
+ * Get the printable name of a hypervisor vendor or feature.
+ */
+const char *hypervisor_vendor_name(uint32_t vendor)
+{
+	return hypervisor_vendors[vendor].name;
+}
+
+const char *hypervisor_feature_name(uint32_t feature)
+{
+	return hypervisor_features[feature].name;
+}
+
+/*
+ * Query a leaf of a hypervisor interface, returning all zeroes past its
+ * maximum leaf.
+ */
+static void hypervisor_cpuid(uint32_t base, uint32_t max_leaf, uint32_t leaf, uint32_t regs[4])
+{
+	if (base + leaf > max_leaf) {
+		regs[EAX] = regs[EBX] = regs[ECX] = regs[EDX] = 0;
+		return;
+	}
+	cpuid(base + leaf, 0, &regs[EAX], &regs[EBX], &regs[ECX], &regs[EDX]);
+}
+
+/*
+ * Describe the hypervisor interface at a base leaf.
+ */
+static bool hypervisor_add(uint32_t base, uint32_t max_leaf, const uint32_t signature[3])
+{
+	uint32_t regs[4];
+
+	if (!vector_reserve(&sysinfo.hypervisor))
+		return false;
+	uint32_t index = sysinfo.hypervisor.count++;
+	sysinfo.hypervisor.list[index].base = base;
+	sysinfo.hypervisor.list[index].max_leaf = max_leaf;
+
+	/* Keep the signature printable, it goes into a json string. */
+	char *name = sysinfo.hypervisor.list[index].signature;
+	for (uint32_t i = 0; i < 12; i++) {
+		char c = signature[i / 4] >> ((i % 4) * 8);
+		if (c >= ' ' && c <= '~' && c != '"' && c != '\\')
+			*name++ = c;
+	}
+
+	uint32_t vendor = HYPERVISOR_UNKNOWN;
+	for (uint32_t i = 1; i < HYPERVISOR_NUM_VENDORS; i++)
+		if (!memcmp((char *) signature, (char *) hypervisor_vendors[i].signature, 12))
+			vendor = i;
+
+	/* Hyper-V compatible interfaces announce themselves in leaf 1. */
+	hypervisor_cpuid(base, max_leaf, 1, regs);
+	if (vendor == HYPERVISOR_UNKNOWN && regs[EAX] == HYPERV_INTERFACE_HV1)
+		vendor = HYPERVISOR_HYPERV;
+	sysinfo.hypervisor.list[index].vendor = vendor;
+
+	/* Version, as major << 16 | minor. */
+	if (vendor == HYPERVISOR_XEN) {
+		sysinfo.hypervisor.list[index].version = regs[EAX];
+	} else if (vendor == HYPERVISOR_HYPERV) {
+		hypervisor_cpuid(base, max_leaf, 2, regs);
+		sysinfo.hypervisor.list[index].version = regs[EBX];
+	}
+
+	for (uint32_t i = 0; i < HV_NUM_FEATURES; i++) {
+		if (hypervisor_features[i].vendor != vendor)
+			continue;
+		hypervisor_cpuid(base, max_leaf, hypervisor_features[i].leaf, regs);
+		if ((regs[hypervisor_features[i].reg] >> hypervisor_features[i].bit) & 1)
+			sysinfo.hypervisor.list[index].features |= 1ULL << i;
+	}
+
+	/* TSC and APIC bus frequencies, from the generic timing leaf. */
+	if (vendor == HYPERVISOR_XEN) {
+		hypervisor_cpuid(base, max_leaf, 3, regs);
+		sysinfo.hypervisor.list[index].tsc_khz = regs[ECX];
+	} else {
+		hypervisor_cpuid(base, max_leaf, CPUID_HYPERVISOR_TIMING, regs);
+		sysinfo.hypervisor.list[index].tsc_khz = regs[EAX];
+		sysinfo.hypervisor.list[index].apic_khz = regs[EBX];
+	}
+
+	serial_printf("[*] Hypervisor interface %s (%s) at leaf %x\n",
+	              sysinfo.hypervisor.list[index].signature,
+	              hypervisor_vendor_name(vendor), base);
+	return true;
+}
+
+/*
+ * Look for hypervisor interfaces, when the processor says it runs
+ * virtualised.
+ */
+bool hypervisor_scan(void)
+{
+	if (!cpu_has(CPU_FEATURE_HYPERVISOR))
+		return true;
+
+	for (uint32_t i = 0; i < CPUID_HYPERVISOR_BLOCKS; i++) {
+		uint32_t base = CPUID_HYPERVISOR_BASE + i * CPUID_HYPERVISOR_STRIDE;
+		uint32_t max_leaf, signature[3];
+
+		/* Unused blocks don't point inside themselves. */
+		cpuid(base, 0, &max_leaf, &signature[0], &signature[1], &signature[2]);
+
+		/* Old KVM versions leave the maximum leaf at 0. */
+		if (!max_leaf && !memcmp((char *) signature,
+		                         (char *) hypervisor_vendors[HYPERVISOR_KVM].signature, 12))
+			max_leaf = base + 1;
+
+		if (max_leaf < base || max_leaf >= base + CPUID_HYPERVISOR_STRIDE)
+			continue;
+		if (!hypervisor_add(base, max_leaf, signature))
+			return false;
+	}
+
+	if (!sysinfo.hypervisor.count)
+		serial_puts("[!] Warning: running virtualised, but no hypervisor interface found\n");
+	return true;
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "idt.h"
+#include "serial.h"
+
+#define IDT_GATE_INTERRUPT32    0x8e
+
+/*
+ * Interrupt descriptor table entry.
+ */
+struct idt_gate {
+	uint16_t offset_low;
+	uint16_t selector;
+	uint8_t  reserved;
+	uint8_t  type;
+	uint16_t offset_high;
+} __attribute__((packed));
+
+/*
+ * Interrupt descriptor table register.
+ */
+struct idt_register {
+	uint16_t limit;
+	uint32_t base;
+} __attribute__((packed));
+
+static struct idt_gate idt[IDT_NUM_VECTORS];
+
+/* General protection fault handler, defined in entry.S. */
+extern void gp_handler(void);
+
+/*
+ * Install an interrupt gate, using the code segment set up by the boot loader.
+ */
+void idt_set_gate(uint32_t vector, void (*handler)(void))
+{
+	uint16_t cs;
+
+	__asm__ __volatile__ ("mov %%cs,%0":"=r" (cs));
+	idt[vector].offset_low = (uint32_t) handler;
+	idt[vector].offset_high = (uint32_t) handler >> 16;
+	idt[vector].selector = cs;
+	idt[vector].reserved = 0;
+	idt[vector].type = IDT_GATE_INTERRUPT32;
+}
+
+/*
+ * Load a minimal interrupt descriptor table, the boot loader doesn't hand us
+ * one. Only general protection faults are handled so that probing optional
+ * MSRs doesn't bring the machine down.
+ */
+void idt_init(void)
+{
+	struct idt_register idtr = {
+		.limit = sizeof (idt) - 1,
+		.base  = (uint32_t) idt,
+	};
+
+	idt_set_gate(IDT_VECTOR_GP, gp_handler);
+	__asm__ __volatile__ ("lidt %0": :"m" (idtr));
+}
+
+/*
+ * Report an unexpected exception, called from entry.S before hanging.
+ */
+void idt_fatal(uint32_t vector, uint32_t error, uint32_t eip)
+{
+	serial_printf("[X] Error: unexpected exception %d (error code %x) at %x\n",
+	              vector, error, eip);
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ioapic.h"
+#include "serial.h"
+#include "sysinfo.h"
+
+#define IOAPIC_REGSEL     0x00
+#define IOAPIC_WIN        0x10
+#define IOAPIC_VER_REG    0x01
+
+/*
+ * Read an indirect register from a specific I/O APIC.
+ */
+static inline uint32_t ioapic_read(uint32_t ioapic_id, uint32_t reg)
+{
+	uint32_t base = sysinfo.ioapic.list[ioapic_id].addr;
+
+	*(volatile uint32_t *) (base + IOAPIC_REGSEL) = reg;
+	return *(volatile uint32_t *) (base + IOAPIC_WIN);
+}
+
+/*
+ * Look up the GSI and the MPS INTI flags of a legacy ISA interrupt. Returns
+ * false if the interrupt isn't overridden and its identity mapped GSI is the
+ * target of another ISA override, such as IRQ 2 when IRQ 0 goes to GSI 2.
+ */
+bool ioapic_isa_irq_gsi(uint8_t irq, uint32_t *gsi, uint16_t *flags)
+{
+	for (uint32_t i = 0; i < sysinfo.int_override.count; i++) {
+		if (sysinfo.int_override.list[i].bus == 0 &&
+		    sysinfo.int_override.list[i].source == irq) {
+			*flags = sysinfo.int_override.list[i].flags;
+			*gsi = sysinfo.int_override.list[i].gsi;
+			return true;
+		}
+	}
+	for (uint32_t i = 0; i < sysinfo.int_override.count; i++)
+		if (sysinfo.int_override.list[i].bus == 0 &&
+		    sysinfo.int_override.list[i].gsi == irq)
+			return false;
+	*flags = 0;
+	*gsi = irq;
+	return true;
+}
+
+/*
+ * Scan the I/O APICs.
+ */
+bool ioapic_scan(void)
+{
+	/* Read the version and the number of redirection entries. */
+	for (uint32_t i = 0; i < sysinfo.ioapic.count; i++) {
+		uint32_t ver = ioapic_read(i, IOAPIC_VER_REG);
+
+		sysinfo.ioapic.list[i].version     = ver & 0xff;
+		sysinfo.ioapic.list[i].num_entries = ((ver >> 16) & 0xff) + 1;
+		serial_printf("[*] I/O APIC #%d version %x handles GSIs %d-%d\n",
+		              i + 1,
+		              sysinfo.ioapic.list[i].version,
+		              sysinfo.ioapic.list[i].gsi_base,
+		              sysinfo.ioapic.list[i].gsi_base
+		              + sysinfo.ioapic.list[i].num_entries - 1);
+	}
+
+	/* Make sure that the GSI ranges don't overlap. */
+	for (uint32_t i = 0; i < sysinfo.ioapic.count; i++) {
+		for (uint32_t j = i + 1; j < sysinfo.ioapic.count; j++) {
+			uint32_t si = sysinfo.ioapic.list[i].gsi_base;
+			uint32_t ei = si + sysinfo.ioapic.list[i].num_entries;
+			uint32_t sj = sysinfo.ioapic.list[j].gsi_base;
+			uint32_t ej = sj + sysinfo.ioapic.list[j].num_entries;
+
+			if (si < ej && sj < ei) {
+				serial_printf("[X] Error: I/O APICs #%d and #%d have overlapping GSIs\n",
+				              i + 1, j + 1);
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
@@ -8,8 +8,23 @@
 #include <stdint.h>
 
 #include "acpi.h"
+#include "amdvi.h"
+#include "chainload.h"
+#include "console.h"
+#include "cpu.h"
+#include "cstate.h"
+#include "dump.h"
+#include "hypervisor.h"
+#include "idt.h"
+#include "ioapic.h"
+#include "memory.h"
 #include "multiboot2.h"
+#include "mtrr.h"
+#include "prt.h"
+#include "pvh.h"
+#include "rawdump.h"
 #include "serial.h"
+#include "smbios.h"
 #include "sysinfo.h"
 #include "utils.h"
 #include "vtd.h"
@@ -19,121 +34,115 @@ struct sysinfo sysinfo;
 
 /* Global program options, with default values. */
 struct options options = {
-	.serial_port = CONFIG_SERIAL_PORT,
-	.on_exit     = OPTION_ON_EXIT_HANG,
+	.serial          = SERIAL_CONFIG_PORT(CONFIG_SERIAL_PORT),
+	.serial_firmware = true,
+	.on_exit         = OPTION_ON_EXIT_HANG,
 };
 
-/*
- * Output the machine file in json format over the serial line.
- */
-static void dump_machine_file(void)
-{
-	/* Opening tag. */
-	serial_puts("\n"
-	            "-----BEGIN MACHINE FILE BLOCK-----\n"
-	            "{\n");
-
-	/* Memory regions. */
-	serial_puts("    \"memory\": [\n");
-	for (uint32_t i = 0; i < sysinfo.memory.count; i++) {
-		serial_printf("        {\n"
-		              "            \"base\": %D,\n"
-		              "            \"size\": %D\n"
-	                      "        }%s\n",
-		              sysinfo.memory.list[i].addr,
-		              sysinfo.memory.list[i].size,
-		              i + 1 == sysinfo.memory.count ? "" : ",");
-	}
-	serial_puts("    ],\n");
-
-	/* Kernel devices. */
-	serial_printf("    \"kdevs\": [\n"
-	              "        {\n"
-	              "            \"name\": \"apic\",\n"
-	              "            \"base\": %D,\n"
-	              "            \"size\": 4096\n"
-	              "        }",
-	              sysinfo.apic.addr);
-	for (uint32_t i = 0; i < sysinfo.ioapic.count; i++) {
-		serial_printf(",\n"
-		              "        {\n"
-		              "            \"name\": \"ioapic.%d\",\n"
-		              "            \"base\": %d,\n"
-		              "            \"size\": 4096\n"
-		              "        }",
-		              i, sysinfo.ioapic.addr[i]);
-	}
-
-	for (uint32_t i = 0; i < sysinfo.drhu.count; i++) {
-		serial_printf(",\n"
-		              "        {\n"
-		              "            \"name\": \"drhu.%d\",\n"
-		              "            \"base\": %d,\n"
-		              "            \"size\": 4096\n"
-		              "        }",
-		              i, sysinfo.drhu.addr[i]);
-	}
-	serial_puts("\n    ],\n");
-
-	/* RMRRs. */
-	serial_puts("    \"rmrrs\": [\n");
-	if (sysinfo.rmrr.count > 0) {
-		for (int i = 0; i < sysinfo.rmrr.count; i++) {
-			serial_printf("        {\n"
-			              "            \"devid\": %d,\n"
-			              "            \"base\":  %d,\n"
-			              "            \"limit\": %d\n"
-			              "        }%s\n",
-			              sysinfo.rmrr.list[i].devid,
-			              sysinfo.rmrr.list[i].addr,
-			              sysinfo.rmrr.list[i].limit,
-			              i + 1 == sysinfo.rmrr.count ? "" : ",");
-		}
-	}
-	serial_puts("    ],\n");
-
-	/* Bootinfo. */
-	serial_printf("    \"bootinfo\": {\n"
-	              "        \"numIOPTLevels\": %d\n"
-	              "    }\n",
-	              sysinfo.vtd.num_iopt_levels);
-
-	/* Closing tag. */
-	serial_puts("}\n"
-	            "-----END MACHINE FILE BLOCK-----\n");
-}
-
 /*
  * Discover the hardware and print the machine file.
  */
 int main(uint32_t multiboot_magic, uint32_t multiboot_info)
 {
 	memset((char *) &sysinfo, 0, sizeof (sysinfo));
-	options.serial_port = CONFIG_SERIAL_PORT;
+	options.serial = (struct serial_config) SERIAL_CONFIG_PORT(CONFIG_SERIAL_PORT);
+	options.serial_firmware = true;
 
 	/* Initialise the default serial port to have some early output. */
 	serial_init();
 
+	/* Catch faults from probing optional processor features. */
+	idt_init();
+
 	/* Parse the multiboot info structure. */
 	if (multiboot_magic == MULTIBOOT2_BOOT_MAGIC) {
 		serial_puts("[*] Multiboot2 boot loader detected\n");
 		if (multiboot2_parse_info(multiboot_info) == false)
 			return options.on_exit;
+	} else if (multiboot_magic == PVH_BOOT_MAGIC) {
+		serial_puts("[*] PVH boot detected\n");
+		multiboot_info = pvh_to_multiboot2(multiboot_info);
+		if (!multiboot_info || multiboot2_parse_info(multiboot_info) == false)
+			return options.on_exit;
 	} else {
-		serial_puts("[X] Error: unsupported boot loader (not multiboot2 compliant)!\n");
+		serial_puts("[X] Error: unsupported boot loader (not multiboot2 or PVH compliant)!\n");
 		return options.on_exit;
 	}
 
+	/* Move to the firmware console unless a serial port was given. */
+	if (options.serial_firmware)
+		console_discover();
+
+	/* Stream the raw firmware tables first, in case parsing them fails. */
+	if (options.dump == OPTION_DUMP_RAW || options.dump == OPTION_DUMP_BOTH) {
+		if (rawdump(multiboot_info) == false || options.dump == OPTION_DUMP_RAW)
+			return options.on_exit;
+	}
+
 	/* Parse the ACPI tables. */
 	if (acpi_parse_tables() == false)
 		return options.on_exit;
+	phase_done(PHASE_ACPI);
+
+	/* Clean up the memory map now that the reserved ranges are known. */
+	if (memory_finalise() == false)
+		return options.on_exit;
+	phase_done(PHASE_MEMORY);
+
+	/* Look up the processor features. */
+	if (cpu_scan() == false || hypervisor_scan() == false)
+		return options.on_exit;
+	phase_done(PHASE_CPU);
+
+	/* Evaluate the PCI interrupt routing from the ACPI namespace. */
+	if (prt_scan() == false)
+		return options.on_exit;
+	phase_done(PHASE_PRT);
+
+	/* Look up the S5 sleep type in the ACPI namespace, to shut down. */
+	acpi_evaluate_s5();
+
+	/* Look up the memory devices backing the RAM. */
+	if (smbios_scan() == false)
+		return options.on_exit;
+	phase_done(PHASE_SMBIOS);
+
+	/* Read the memory type range registers and page attribute table. */
+	if (mtrr_scan() == false)
+		return options.on_exit;
+	phase_done(PHASE_MTRR);
+
+	/* Look up the I/O APIC versions and number of inputs. */
+	if (ioapic_scan() == false)
+		return options.on_exit;
+	phase_done(PHASE_IOAPIC);
 
 	/* Look up the number of VT-D IOPT levels. */
 	if (vtd_scan() == false)
 		return options.on_exit;
+	phase_done(PHASE_VTD);
 
-	/* Output the json file. */
-	dump_machine_file();
+	/* Look up the AMD IOMMU features and number of IOPT levels. */
+	if (amdvi_scan() == false)
+		return options.on_exit;
+	phase_done(PHASE_AMDVI);
+
+	/* Enumerate the idle states, measuring their wake latency last. */
+	if (cstate_scan() == false)
+		return options.on_exit;
+	phase_done(PHASE_CSTATE);
+
+	/* Output the json file, or the sections that remain to be streamed. */
+	if (options.dump == OPTION_DUMP_SECTIONS)
+		phase_done(PHASE_DONE);
+	else
+		dump_machine_file();
+
+	/* Boot the next stage with the machine file, serve it if that fails. */
+	if (options.on_exit == OPTION_ON_EXIT_CHAINLOAD) {
+		chainload(multiboot_info, machine_file_object);
+		return OPTION_ON_EXIT_HANG;
+	}
 
 	return options.on_exit;
 }
@@ -0,0 +1,180 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "memory.h"
+#include "serial.h"
+#include "sysinfo.h"
+
+/* Boundaries of the machinedump image, provided by the linker script. */
+extern char __image_start[];
+extern char __image_end[];
+
+/* x86 high memory begins at 1MB. */
+#define HIGHMEM_BASE_ADDR       0x100000
+
+/*
+ * Add a usable memory region from the boot loader memory map, low memory
+ * (below 1MB) is ignored.
+ */
+bool memory_add(uint64_t addr, uint64_t size)
+{
+	if (addr < HIGHMEM_BASE_ADDR)
+		return true;
+
+	serial_printf("[*] Found a usable memory area at %X size %X\n", addr, size);
+
+	if (!vector_reserve(&sysinfo.memory))
+		return false;
+	sysinfo.memory.list[sysinfo.memory.count].addr = addr;
+	sysinfo.memory.list[sysinfo.memory.count].size = size;
+	sysinfo.memory.count++;
+	return true;
+}
+
+/*
+ * Sort the memory regions by base address.
+ */
+static void memory_sort(void)
+{
+	for (uint32_t i = 1; i < sysinfo.memory.count; i++) {
+		uint64_t addr = sysinfo.memory.list[i].addr;
+		uint64_t size = sysinfo.memory.list[i].size;
+		uint32_t j = i;
+
+		for (; j > 0 && sysinfo.memory.list[j - 1].addr > addr; j--)
+			sysinfo.memory.list[j] = sysinfo.memory.list[j - 1];
+		sysinfo.memory.list[j].addr = addr;
+		sysinfo.memory.list[j].size = size;
+	}
+}
+
+/*
+ * Merge adjacent or overlapping memory regions. The list must be sorted.
+ */
+static void memory_coalesce(void)
+{
+	uint32_t n = 0;
+
+	for (uint32_t i = 0; i < sysinfo.memory.count; i++) {
+		uint64_t addr = sysinfo.memory.list[i].addr;
+		uint64_t end  = addr + sysinfo.memory.list[i].size;
+
+		if (n > 0) {
+			uint64_t prev_end = sysinfo.memory.list[n - 1].addr
+				+ sysinfo.memory.list[n - 1].size;
+			if (addr <= prev_end) {
+				if (end > prev_end)
+					sysinfo.memory.list[n - 1].size = end - sysinfo.memory.list[n - 1].addr;
+				continue;
+			}
+		}
+		sysinfo.memory.list[n].addr = addr;
+		sysinfo.memory.list[n].size = end - addr;
+		n++;
+	}
+	sysinfo.memory.count = n;
+}
+
+/*
+ * Remove the range [base, end) from the memory regions. The list must be
+ * sorted and stays sorted.
+ */
+static bool memory_remove(uint64_t base, uint64_t end)
+{
+	for (uint32_t i = 0; i < sysinfo.memory.count; i++) {
+		uint64_t rbase = sysinfo.memory.list[i].addr;
+		uint64_t rend  = rbase + sysinfo.memory.list[i].size;
+
+		if (end <= rbase || base >= rend)
+			continue;
+
+		/* Drop the whole region. */
+		if (base <= rbase && end >= rend) {
+			for (uint32_t j = i + 1; j < sysinfo.memory.count; j++)
+				sysinfo.memory.list[j - 1] = sysinfo.memory.list[j];
+			sysinfo.memory.count--;
+			i--;
+			continue;
+		}
+
+		/* Cut the head or the tail of the region. */
+		if (base <= rbase) {
+			sysinfo.memory.list[i].addr = end;
+			sysinfo.memory.list[i].size = rend - end;
+			continue;
+		}
+		sysinfo.memory.list[i].size = base - rbase;
+		if (end >= rend)
+			continue;
+
+		/* Split the region in two. */
+		if (!vector_reserve(&sysinfo.memory))
+			return false;
+		for (uint32_t j = sysinfo.memory.count; j > i + 1; j--)
+			sysinfo.memory.list[j] = sysinfo.memory.list[j - 1];
+		sysinfo.memory.list[i + 1].addr = end;
+		sysinfo.memory.list[i + 1].size = rend - end;
+		sysinfo.memory.count++;
+		i++;
+	}
+	return true;
+}
+
+/*
+ * Compute the largest sub-extent of a memory region whose base and size are
+ * both aligned to a power of two. The size is returned, and is 0 if the
+ * region doesn't contain a single aligned block.
+ */
+uint64_t memory_aligned_extent(uint32_t region, uint64_t align, uint64_t *base)
+{
+	uint64_t start = sysinfo.memory.list[region].addr;
+	uint64_t end   = start + sysinfo.memory.list[region].size;
+
+	start = (start + align - 1) & ~(align - 1);
+	end   = end & ~(align - 1);
+
+	*base = start;
+	return end > start ? end - start : 0;
+}
+
+/*
+ * Post-process the list of usable memory regions: sort and merge them, and
+ * carve out the ranges that are reserved for device DMA (RMRRs and IVMDs) as
+ * well as the machinedump image itself.
+ */
+bool memory_finalise(void)
+{
+	memory_sort();
+	memory_coalesce();
+
+	for (uint32_t i = 0; i < sysinfo.rmrr.count; i++)
+		if (!memory_remove(sysinfo.rmrr.list[i].addr,
+		                   sysinfo.rmrr.list[i].limit + 1))
+			return false;
+
+	for (uint32_t i = 0; i < sysinfo.ivmd.count; i++)
+		if (!memory_remove(sysinfo.ivmd.list[i].addr,
+		                   sysinfo.ivmd.list[i].addr + sysinfo.ivmd.list[i].size))
+			return false;
+
+	if (!memory_remove((uint32_t) __image_start, (uint32_t) __image_end))
+		return false;
+
+	for (uint32_t i = 0; i < sysinfo.memory.count; i++) {
+		uint64_t base;
+		uint64_t size = memory_aligned_extent(i, MEMORY_PAGE_SIZE_2M, &base);
+		serial_printf("[*] Usable memory at %X size %X (%X bytes of 2MiB pages)\n",
+		              sysinfo.memory.list[i].addr,
+		              sysinfo.memory.list[i].size,
+		              size);
+	}
+
+	return true;
+}
@@ -0,0 +1,269 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "cpu.h"
+#include "mtrr.h"
+#include "serial.h"
+#include "sysinfo.h"
+#include "utils.h"
+
+#define MTRR_FIXED_LIMIT        0x100000ULL
+
+/*
+ * Get the printable name of a memory type.
+ */
+const char *mtrr_type_name(uint8_t type)
+{
+	switch (type) {
+	case MTRR_TYPE_UC:    return "UC";
+	case MTRR_TYPE_WC:    return "WC";
+	case MTRR_TYPE_WT:    return "WT";
+	case MTRR_TYPE_WP:    return "WP";
+	case MTRR_TYPE_WB:    return "WB";
+	case MTRR_TYPE_UC_:   return "UC-";
+	case MTRR_TYPE_MIXED: return "mixed";
+	default:              return "reserved";
+	}
+}
+
+/*
+ * Get the index of the fixed range MTRR entry covering an address below 1MiB,
+ * and the end of the range it covers.
+ */
+static uint32_t mtrr_fixed_index(uint32_t addr, uint64_t *end)
+{
+	if (addr < 0x80000) {
+		*end = (addr & ~0xffff) + 0x10000;
+		return addr >> 16;
+	}
+	if (addr < 0xc0000) {
+		*end = (addr & ~0x3fff) + 0x4000;
+		return 8 + ((addr - 0x80000) >> 14);
+	}
+	*end = (addr & ~0xfff) + 0x1000;
+	return 24 + ((addr - 0xc0000) >> 12);
+}
+
+/*
+ * Compute the memory type of a single address from the MTRRs, following the
+ * precedence rules of the Intel SDM volume 3, section 12.11.4.1.
+ */
+static uint8_t mtrr_point_type(uint64_t addr)
+{
+	uint64_t end;
+	bool match = false;
+	uint8_t type = 0;
+
+	/* Without MTRRs the memory type is only decided by the PAT. */
+	if (!sysinfo.mtrr.supported)
+		return MTRR_TYPE_WB;
+	if (!sysinfo.mtrr.enabled)
+		return MTRR_TYPE_UC;
+
+	if (addr < MTRR_FIXED_LIMIT && sysinfo.mtrr.fixed_enabled)
+		return sysinfo.mtrr.fixed[mtrr_fixed_index(addr, &end)];
+
+	for (uint32_t i = 0; i < sysinfo.mtrr.var.count; i++) {
+		uint64_t base = sysinfo.mtrr.var.list[i].base;
+		uint8_t var_type = sysinfo.mtrr.var.list[i].type;
+
+		if (addr < base || addr - base >= sysinfo.mtrr.var.list[i].size)
+			continue;
+
+		if (!match)
+			type = var_type;
+		else if (type == MTRR_TYPE_UC || var_type == MTRR_TYPE_UC)
+			type = MTRR_TYPE_UC;
+		else if ((type == MTRR_TYPE_WT && var_type == MTRR_TYPE_WB) ||
+		         (type == MTRR_TYPE_WB && var_type == MTRR_TYPE_WT))
+			type = MTRR_TYPE_WT;
+		else if (type != var_type)
+			type = MTRR_TYPE_MIXED;
+		match = true;
+	}
+
+	return match ? type : sysinfo.mtrr.default_type;
+}
+
+/*
+ * Get the first address above addr where the memory type may change.
+ */
+static uint64_t mtrr_next_boundary(uint64_t addr)
+{
+	uint64_t next = ~0ULL;
+
+	if (addr < MTRR_FIXED_LIMIT) {
+		if (sysinfo.mtrr.fixed_enabled)
+			mtrr_fixed_index(addr, &next);
+		else
+			next = MTRR_FIXED_LIMIT;
+	}
+
+	for (uint32_t i = 0; i < sysinfo.mtrr.var.count; i++) {
+		uint64_t base = sysinfo.mtrr.var.list[i].base;
+		uint64_t end = base + sysinfo.mtrr.var.list[i].size;
+
+		if (base > addr && base < next)
+			next = base;
+		if (end > addr && end < next)
+			next = end;
+	}
+
+	return next;
+}
+
+/*
+ * Compute the memory type at the start of a range. Returns how many bytes from
+ * the base have that same type, which is at most the size of the range.
+ */
+uint64_t mtrr_range_type(uint64_t base, uint64_t size, uint8_t *type)
+{
+	uint64_t addr = base;
+
+	*type = mtrr_point_type(base);
+	while (addr - base < size) {
+		addr = mtrr_next_boundary(addr);
+		if (addr - base >= size || mtrr_point_type(addr) != *type)
+			break;
+	}
+
+	return addr - base < size ? addr - base : size;
+}
+
+/*
+ * Combine the memory type of a range from the MTRRs with the PAT entry of a
+ * page, following the Intel SDM volume 3, table 12-7.
+ */
+uint8_t mtrr_effective_type(uint8_t type, uint32_t pat_index)
+{
+	/* The PAT resets to WB, WT, UC- and UC, repeated. */
+	uint64_t pat = sysinfo.mtrr.pat_supported ? sysinfo.mtrr.pat : 0x0007040600070406ULL;
+	uint8_t pat_type = (pat >> (pat_index * 8)) & 0x7;
+
+	if (type == MTRR_TYPE_MIXED)
+		return MTRR_TYPE_MIXED;
+
+	switch (pat_type) {
+	case MTRR_TYPE_UC:
+	case MTRR_TYPE_WC:
+		return pat_type;
+	case MTRR_TYPE_UC_:
+		return type == MTRR_TYPE_WC ? MTRR_TYPE_WC : MTRR_TYPE_UC;
+	case MTRR_TYPE_WT:
+	case MTRR_TYPE_WP:
+	case MTRR_TYPE_WB:
+		if (type == MTRR_TYPE_UC || (type == MTRR_TYPE_WC && pat_type != MTRR_TYPE_WB))
+			return MTRR_TYPE_UC;
+		if (type == MTRR_TYPE_WC || type == MTRR_TYPE_WB)
+			return type == MTRR_TYPE_WC ? MTRR_TYPE_WC : pat_type;
+		if (type == MTRR_TYPE_WP || pat_type == MTRR_TYPE_WP)
+			return MTRR_TYPE_WP;
+		return MTRR_TYPE_WT;
+	default:
+		return pat_type;
+	}
+}
+
+/*
+ * Read the memory type range registers and the page attribute table.
+ */
+bool mtrr_scan(void)
+{
+	uint32_t eax, ebx, ecx, edx;
+	uint32_t phys_bits = 36;
+
+	cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+	if (!(edx & CPUID_1_EDX_MSR))
+		return true;
+	sysinfo.mtrr.supported = edx & CPUID_1_EDX_MTRR;
+	sysinfo.mtrr.pat_supported = edx & CPUID_1_EDX_PAT;
+
+	if (sysinfo.mtrr.pat_supported)
+		sysinfo.mtrr.pat = rdmsr(MSR_PAT);
+
+	if (!sysinfo.mtrr.supported) {
+		serial_puts("[!] Warning: MTRRs not supported\n");
+		return true;
+	}
+
+	/* Variable range masks are only meaningful up to the physical address width. */
+	cpuid(0x80000000, 0, &eax, &ebx, &ecx, &edx);
+	if (eax >= 0x80000008) {
+		cpuid(0x80000008, 0, &eax, &ebx, &ecx, &edx);
+		phys_bits = eax & 0xff;
+	}
+	sysinfo.mtrr.phys_mask = ((1ULL << phys_bits) - 1) & ~0xfffULL;
+
+	uint64_t cap = rdmsr(MSR_MTRRCAP);
+	uint64_t def_type = rdmsr(MSR_MTRR_DEF_TYPE);
+	sysinfo.mtrr.enabled = def_type & MTRR_DEF_TYPE_E;
+	sysinfo.mtrr.fixed_enabled = (cap & MTRRCAP_FIX) && (def_type & MTRR_DEF_TYPE_FE);
+	sysinfo.mtrr.default_type = def_type & 0xff;
+
+	/* Each fixed range MSR holds the type of eight consecutive ranges. */
+	if (sysinfo.mtrr.fixed_enabled) {
+		uint32_t msrs[11] = {
+			MSR_MTRR_FIX_64K, MSR_MTRR_FIX_16K, MSR_MTRR_FIX_16K + 1,
+			MSR_MTRR_FIX_4K,  MSR_MTRR_FIX_4K + 1, MSR_MTRR_FIX_4K + 2,
+			MSR_MTRR_FIX_4K + 3, MSR_MTRR_FIX_4K + 4, MSR_MTRR_FIX_4K + 5,
+			MSR_MTRR_FIX_4K + 6, MSR_MTRR_FIX_4K + 7,
+		};
+		for (uint32_t i = 0; i < 11; i++) {
+			uint64_t value = rdmsr(msrs[i]);
+			for (uint32_t j = 0; j < 8; j++)
+				sysinfo.mtrr.fixed[i * 8 + j] = value >> (j * 8);
+		}
+	}
+
+	for (uint32_t i = 0; i < MTRRCAP_VCNT(cap); i++) {
+		uint64_t base = rdmsr(MSR_MTRR_PHYSBASE(i));
+		uint64_t mask = rdmsr(MSR_MTRR_PHYSMASK(i));
+
+		if (!(mask & MTRR_PHYSMASK_VALID))
+			continue;
+
+		/* Only contiguous masks are supported, which is all firmware uses. */
+		mask &= sysinfo.mtrr.phys_mask;
+		uint64_t size = (~mask & sysinfo.mtrr.phys_mask) + 0x1000;
+		if (size & (size - 1)) {
+			serial_printf("[!] Warning: ignoring non-contiguous variable MTRR %d\n", i);
+			continue;
+		}
+
+		if (vector_reserve(&sysinfo.mtrr.var) == false)
+			return false;
+		sysinfo.mtrr.var.list[sysinfo.mtrr.var.count].base = base & mask;
+		sysinfo.mtrr.var.list[sysinfo.mtrr.var.count].size = size;
+		sysinfo.mtrr.var.list[sysinfo.mtrr.var.count].type = base & 0xff;
+		sysinfo.mtrr.var.count++;
+	}
+
+	serial_printf("[*] MTRRs %s, default type %s, %d variable ranges in use\n",
+	              sysinfo.mtrr.enabled ? "enabled" : "disabled",
+	              mtrr_type_name(sysinfo.mtrr.default_type),
+	              sysinfo.mtrr.var.count);
+
+	/* Usable RAM that isn't write-back is a major performance problem. */
+	for (uint32_t i = 0; i < sysinfo.memory.count; i++) {
+		uint64_t addr = sysinfo.memory.list[i].addr;
+		uint64_t end = addr + sysinfo.memory.list[i].size;
+
+		while (addr < end) {
+			uint8_t type;
+			uint64_t size = mtrr_range_type(addr, end - addr, &type);
+			if (type != MTRR_TYPE_WB)
+				serial_printf("[!] Warning: RAM %X-%X is %s, not write-back\n",
+				              addr, addr + size - 1, mtrr_type_name(type));
+			addr += size;
+		}
+	}
+
+	return true;
+}
@@ -7,83 +7,23 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "efi.h"
+#include "memory.h"
 #include "multiboot2.h"
+#include "parser.h"
 #include "serial.h"
 #include "sysinfo.h"
 #include "utils.h"
 
-/* x86 high memory begins at 1MB. */
-#define HIGHMEM_BASE_ADDR       0x100000
+/* The first info tag of each type, recorded by multiboot2_parse_info(). */
+static struct multiboot2_tag_header *tags[MULTIBOOT2_NUM_TAGS];
 
 /*
- * Round a number up to the next 64-bit boundary.
+ * Return the first multiboot2 info tag of a type, or NULL if there is none.
  */
-static uint32_t roundup64(uint32_t n)
+struct multiboot2_tag_header *multiboot2_tag(uint32_t type)
 {
-	if (n & 7)
-		n = (n & ~7) + 8;
-	return n;
-}
-
-/*
- * Find and return a multiboot2 info tag.
- */
-struct multiboot2_tag_header *multiboot2_find_tag(uint32_t info_addr, uint32_t type)
-{
-	struct multiboot2_info_header *info_header = (void *) info_addr;
-	uint32_t tag_addr    = info_addr + sizeof (*info_header);
-	uint32_t tag_endaddr = info_addr + info_header->total_size;
-
-	/* Walk the list of tags. */
-	while (tag_addr < tag_endaddr) {
-		struct multiboot2_tag_header *tag_header = (void *) tag_addr;
-
-		/* Return the tag if found. */
-		if (tag_header->type == type)
-			return tag_header;
-
-		/* Break on the end tag. */
-		if (tag_header->type == MULTIBOOT2_INFO_TAG_END)
-			break;
-
-		/* Continue to the next tag. */
-		tag_addr = roundup64(tag_addr + tag_header->size);
-	}
-
-	/* Not found. */
-	return NULL;
-}
-
-/*
- * Split a string into space-separated tokens and return the first token. The
- * input string is modified in place to insert string terminating 0 bytes, and
- * the string pointer is moved to the end of the token on success to be called
- * iteratively.
- */
-static char *get_token(char **string)
-{
-	/* Strip any leading space. */
-	char *token = *string;
-	while (*token == ' ')
-		token++;
-
-	/* Jump past the token and zero-terminate it. */
-	char *end = token;
-	while (*end) {
-		if (*end == ' ') {
-			*end++ = 0;
-			break;
-		}
-		end++;
-	}
-
-	/* Return NULL when there aren't any more tokens. */
-	if (end == token)
-		return NULL;
-
-	/* Otherwise return the token and bump the string pointer. */
-	*string = end;
-	return token;
+	return type < MULTIBOOT2_NUM_TAGS ? tags[type] : NULL;
 }
 
 /*
@@ -106,6 +46,63 @@ static void get_token_key_value(char *string, char **key, char **value)
 	return;
 }
 
+/*
+ * Split the next comma-separated field off a string, like get_token().
+ */
+static char *get_field(char **string)
+{
+	char *field = *string;
+	if (!field)
+		return NULL;
+
+	char *end = field;
+	while (*end && *end != ',')
+		end++;
+	*string = *end ? end + 1 : NULL;
+	*end = 0;
+	return field;
+}
+
+/*
+ * Parse the serial port option, either an I/O port or "mmio,<address>" with
+ * optional register stride and access width in bytes. The firmware divisor
+ * is kept for memory mapped UARTs as their clock is unknown.
+ */
+static bool parse_serial(char *value, struct serial_config *serial)
+{
+	char *field = get_field(&value);
+	uint64_t val = 0;
+
+	if (strcmp(field, "mmio")) {
+		if (value || !strtou64(field, &val) || val >= 0x3ff)
+			return false;
+		*serial = (struct serial_config) SERIAL_CONFIG_PORT(val);
+		return true;
+	}
+
+	if (!(field = get_field(&value)) || !strtou64(field, &val) || !val || val >> 32)
+		return false;
+	*serial = (struct serial_config) {
+		.mmio   = true,
+		.base   = val,
+		.stride = 1,
+		.width  = 1,
+	};
+
+	if ((field = get_field(&value))) {
+		if (!strtou64(field, &val) || (val != 1 && val != 2 && val != 4))
+			return false;
+		serial->stride = val;
+		serial->width = val;
+	}
+	if ((field = get_field(&value))) {
+		if (!strtou64(field, &val) || (val != 1 && val != 2 && val != 4) || val > serial->stride)
+			return false;
+		serial->width = val;
+	}
+	return !value;
+}
+
 /*
  * Parse the multiboot2 command line tag.
  */
@@ -130,11 +127,15 @@ static bool parse_command_line(struct multiboot2_tag_header *tag_header)
 
 		/* Option: serial port. */
 		if (!strcmp(key, "serial")) {
-			uint64_t val = 0;
-
-			if (value && strtou64(value, &val) && val < 0x3ff) {
-				serial_printf("[*] Switching to serial port %X\n", val);
-				options.serial_port = (uint16_t) val;
+			struct serial_config serial;
+
+			if (value && parse_serial(value, &serial)) {
+				if (serial.mmio)
+					serial_printf("[*] Switching to MMIO serial port %x\n", serial.base);
+				else
+					serial_printf("[*] Switching to serial port %x\n", serial.base);
+				options.serial = serial;
+				options.serial_firmware = false;
 				serial_init();
 				continue;
 			} else {
@@ -158,11 +159,71 @@ static bool parse_command_line(struct multiboot2_tag_header *tag_header)
 					options.on_exit = OPTION_ON_EXIT_SHUTDOWN;
 					continue;
 				}
+				if (!strcmp(value, "chainload")) {
+					options.on_exit = OPTION_ON_EXIT_CHAINLOAD;
+					continue;
+				}
 			}
 			serial_printf("[X] Cannot parse on_exit option\n");
 			return false;
 		}
 
+		/* Option: dump. */
+		if (!strcmp(key, "dump")) {
+			if (value) {
+				if (!strcmp(value, "json")) {
+					options.dump = OPTION_DUMP_JSON;
+					continue;
+				}
+				if (!strcmp(value, "raw")) {
+					options.dump = OPTION_DUMP_RAW;
+					continue;
+				}
+				if (!strcmp(value, "both")) {
+					options.dump = OPTION_DUMP_BOTH;
+					continue;
+				}
+				if (!strcmp(value, "sections")) {
+					options.dump = OPTION_DUMP_SECTIONS;
+					continue;
+				}
+			}
+			serial_printf("[X] Cannot parse dump option\n");
+			return false;
+		}
+
+		/* Option: fingerprint. */
+		if (!strcmp(key, "fingerprint")) {
+			if (value) {
+				if (!strcmp(value, "sysinfo")) {
+					options.fingerprint_acpi = false;
+					continue;
+				}
+				if (!strcmp(value, "acpi")) {
+					options.fingerprint_acpi = true;
+					continue;
+				}
+			}
+			serial_printf("[X] Cannot parse fingerprint option\n");
+			return false;
+		}
+
+		/* Option: cstates. */
+		if (!strcmp(key, "cstates")) {
+			if (value) {
+				if (!strcmp(value, "list")) {
+					options.measure_cstates = false;
+					continue;
+				}
+				if (!strcmp(value, "measure")) {
+					options.measure_cstates = true;
+					continue;
+				}
+			}
+			serial_printf("[X] Cannot parse cstates option\n");
+			return false;
+		}
+
 		/* Unknown option. */
 		serial_printf("[X] Invalid command line option: %s\n", key);
 		return false;
@@ -170,6 +231,7 @@ static bool parse_command_line(struct multiboot2_tag_header *tag_header)
 
 	return true;
 }
+PARSER(PARSER_MULTIBOOT2, MULTIBOOT2_INFO_TAG_COMMAND_LINE, parse_command_line);
 
 /*
  * Parse the multiboot2 memory map tag.
@@ -186,36 +248,28 @@ static bool parse_mmap_tag(struct multiboot2_tag_header *tag_header)
 	for (uint32_t addr = saddr; addr < eaddr; addr += tag->entry_size) {
 		struct multiboot2_tag_mmap_entry *m = (struct multiboot2_tag_mmap_entry *) addr;
 
-		/* Ignore unusable or low memory (below 1MB). */
-		if (m->type != MULTIBOOT2_MMAP_TYPE_USEABLE || m->addr < HIGHMEM_BASE_ADDR)
-			continue;
-
-		serial_printf("[*] Found a usable memory area at %X size %X\n", m->addr, m->size);
-
-		/* Populate the sysinfo structure. */
-		if (sysinfo.memory.count == MAX_MEMORY_REGIONS) {
-			serial_puts("[X] Error: too many memory regions provided by boot loader!\n");
+		if (m->type == MULTIBOOT2_MMAP_TYPE_USEABLE && !memory_add(m->addr, m->size))
 			return false;
-		}
-		sysinfo.memory.list[sysinfo.memory.count].addr = m->addr;
-		sysinfo.memory.list[sysinfo.memory.count].size = m->size;
-		sysinfo.memory.count++;
 	}
 
 	return true;
 }
+PARSER(PARSER_MULTIBOOT2, MULTIBOOT2_INFO_TAG_MEMORY_MAP, parse_mmap_tag);
 
 /*
- * Parse the multiboot2 ACPI 1.0 RSDP tag.
+ * Parse the multiboot2 ACPI 1.0 RSDP tag, the ACPI 2.0 one takes precedence
+ * whatever the order of the tags.
  */
 static bool parse_rsdp1_tag(struct multiboot2_tag_header *tag_header)
 {
 	struct multiboot2_tag_rsdp1 *tag = (void *) (tag_header + 1);
 
 	serial_puts("[*] Multiboot2 ACPI 1.0 RSDP tag found\n");
-	sysinfo.rsdt.addr = tag->rsdt_address;
+	if (!tags[MULTIBOOT2_INFO_TAG_ACPI_NEW_RSDP])
+		sysinfo.rsdt.addr = tag->rsdt_address;
 	return true;
 }
+PARSER(PARSER_MULTIBOOT2, MULTIBOOT2_INFO_TAG_ACPI_OLD_RSDP, parse_rsdp1_tag);
 
 /*
  * Parse the multiboot2 ACPI 2.0 RSDP tag.
@@ -228,39 +282,62 @@ static bool parse_rsdp2_tag(struct multiboot2_tag_header *tag_header)
 	sysinfo.rsdt.addr = tag->rsdt_address;
 	return true;
 }
+PARSER(PARSER_MULTIBOOT2, MULTIBOOT2_INFO_TAG_ACPI_NEW_RSDP, parse_rsdp2_tag);
 
 /*
- * Parse the multiboot2 info structure.
+ * Parse the multiboot2 info structure. The tags are walked once to record the
+ * first one of each type, then passed to the parsers registered for their
+ * type, the command line being parsed first so that the options apply to the
+ * output of the other parsers.
  */
 bool multiboot2_parse_info(uint32_t info_addr)
 {
-	struct multiboot2_tag_header *tag;
+	struct multiboot2_info_header *info_header = (void *) info_addr;
+	uint32_t tag_addr    = info_addr + sizeof (*info_header);
+	uint32_t tag_endaddr = info_addr + info_header->total_size;
 
-	/* Find the command line first. */
-	if ((tag = multiboot2_find_tag(info_addr, MULTIBOOT2_INFO_TAG_COMMAND_LINE))) {
-		if (!parse_command_line(tag))
-			return false;
+	/* Walk the list of tags, they come in no particular order. */
+	while (tag_addr < tag_endaddr) {
+		struct multiboot2_tag_header *tag_header = (void *) tag_addr;
+
+		/* Break on the end tag. */
+		if (tag_header->type == MULTIBOOT2_INFO_TAG_END)
+			break;
+
+		if (tag_header->type < MULTIBOOT2_NUM_TAGS && !tags[tag_header->type])
+			tags[tag_header->type] = tag_header;
+
+		/* Continue to the next tag. */
+		tag_addr = roundup64(tag_addr + tag_header->size);
 	}
 
-	/* Find and parse the memory map tag. */
-	if ((tag = multiboot2_find_tag(info_addr, MULTIBOOT2_INFO_TAG_MEMORY_MAP))) {
-		if (!parse_mmap_tag(tag))
+	/* Pass the recorded tags to their parsers, the command line first. */
+	struct multiboot2_tag_header *cmdline = tags[MULTIBOOT2_INFO_TAG_COMMAND_LINE];
+	if (cmdline && !parser_dispatch(PARSER_MULTIBOOT2, cmdline->type, cmdline))
+		return false;
+	for (uint32_t type = 0; type < MULTIBOOT2_NUM_TAGS; type++)
+		if (tags[type] && tags[type] != cmdline &&
+		    !parser_dispatch(PARSER_MULTIBOOT2, type, tags[type]))
 			return false;
-	} else {
+
+	/*
+	 * Check for the mandatory tags. On EFI, the memory map and the RSDP can
+	 * also come from the EFI memory map and configuration table.
+	 */
+	if (!tags[MULTIBOOT2_INFO_TAG_MEMORY_MAP] && !tags[MULTIBOOT2_INFO_TAG_EFI_MEMORY_MAP]) {
 		serial_puts("[X] Error: multiboot2 memory map tag missing!\n");
 		return false;
 	}
-
-	/* Find and parse an ACPI RSDP tags. */
-	if ((tag = multiboot2_find_tag(info_addr, MULTIBOOT2_INFO_TAG_ACPI_NEW_RSDP))) {
-		if (!parse_rsdp2_tag(tag))
+	if (!tags[MULTIBOOT2_INFO_TAG_ACPI_NEW_RSDP] && !tags[MULTIBOOT2_INFO_TAG_ACPI_OLD_RSDP]) {
+		struct multiboot2_tag_rsdp1 *rsdp = efi_config_table(&efi_guid_acpi20);
+		if (!rsdp)
+			rsdp = efi_config_table(&efi_guid_acpi10);
+		if (!rsdp) {
+			serial_puts("[X] Error: multiboot ACPI tag missing!\n");
 			return false;
-	} else if ((tag = multiboot2_find_tag(info_addr, MULTIBOOT2_INFO_TAG_ACPI_OLD_RSDP))) {
-		if (!parse_rsdp1_tag(tag))
-			return false;
-	} else {
-		serial_puts("[X] Error: multiboot ACPI tag missing!\n");
-		return false;
+		}
+		serial_puts("[*] ACPI RSDP found in the EFI configuration table\n");
+		sysinfo.rsdt.addr = rsdp->rsdt_address;
 	}
 
 	return true;
@@ -0,0 +1,51 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "parser.h"
+#include "serial.h"
+
+/* Bounds of the parsers section, see linker.ld. */
+extern const struct parser __start_parsers[];
+extern const struct parser __stop_parsers[];
+
+/* Parsers indexed by table and entry type, built on first use. */
+static bool (*parser_index[PARSER_NUM_TABLES][PARSER_MAX_TYPES])(void *entry);
+static bool parser_indexed;
+
+/*
+ * Build the dispatch index from the registered parsers.
+ */
+static void parser_build_index(void)
+{
+	for (const struct parser *p = __start_parsers; p < __stop_parsers; p++) {
+		if (p->table >= PARSER_NUM_TABLES || p->type >= PARSER_MAX_TYPES) {
+			serial_printf("[!] Warning: parser for table %d type %d out of range, ignoring\n",
+			              p->table, p->type);
+			continue;
+		}
+		if (parser_index[p->table][p->type])
+			serial_printf("[!] Warning: duplicate parser for table %d type %d\n",
+			              p->table, p->type);
+		parser_index[p->table][p->type] = p->parse;
+	}
+	parser_indexed = true;
+}
+
+/*
+ * Pass an entry to the parser registered for its type. Entries without a
+ * parser are skipped.
+ */
+bool parser_dispatch(enum parser_table table, uint32_t type, void *entry)
+{
+	if (!parser_indexed)
+		parser_build_index();
+	if (type >= PARSER_MAX_TYPES || !parser_index[table][type])
+		return true;
+	return parser_index[table][type](entry);
+}
@@ -0,0 +1,244 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "pci.h"
+#include "serial.h"
+#include "sysinfo.h"
+#include "utils.h"
+
+/* Legacy configuration access mechanism #1 ports. */
+#define PCI_CONFIG_ADDRESS      0xcf8
+#define PCI_CONFIG_DATA         0xcfc
+
+/*
+ * Look up the memory mapped configuration space of a PCI segment and bus. The
+ * ECAM window must be below 4GiB to be reachable as we run without paging.
+ * NULL is returned if the bus isn't covered by any MCFG entry.
+ */
+static volatile uint32_t *pci_ecam(uint16_t segment, uint8_t bus, uint8_t dev,
+                                   uint8_t fun, uint16_t offset)
+{
+	for (uint32_t i = 0; i < sysinfo.pci.count; i++) {
+		if (sysinfo.pci.list[i].segment != segment ||
+		    bus < sysinfo.pci.list[i].start_bus ||
+		    bus > sysinfo.pci.list[i].end_bus)
+			continue;
+
+		uint64_t addr = sysinfo.pci.list[i].addr
+			+ ((uint32_t) bus << 20)
+			+ ((uint32_t) dev << 15)
+			+ ((uint32_t) fun << 12)
+			+ (offset & 0xffc);
+		if (addr >> 32)
+			return NULL;
+		return (volatile uint32_t *) (uint32_t) addr;
+	}
+	return NULL;
+}
+
+/*
+ * Read a 32-bit register from the configuration space of a PCI function. The
+ * memory mapped configuration space is used when available, otherwise we fall
+ * back to the legacy I/O ports which only reach segment 0. Reads of
+ * unreachable functions return all ones, like absent devices do.
+ */
+uint32_t pci_read32(uint16_t segment, uint8_t bus, uint8_t dev, uint8_t fun,
+                    uint16_t offset)
+{
+	volatile uint32_t *reg = pci_ecam(segment, bus, dev, fun, offset);
+	if (reg)
+		return *reg;
+
+	if (segment != 0 || offset >= 0x100)
+		return 0xffffffff;
+
+	out32(PCI_CONFIG_ADDRESS, 0x80000000
+	      | ((uint32_t) bus << 16)
+	      | ((uint32_t) dev << 11)
+	      | ((uint32_t) fun << 8)
+	      | (offset & 0xfc));
+	return in32(PCI_CONFIG_DATA);
+}
+
+/*
+ * Read a 16-bit register from the configuration space of a PCI function.
+ */
+uint16_t pci_read16(uint16_t segment, uint8_t bus, uint8_t dev, uint8_t fun,
+                    uint16_t offset)
+{
+	return pci_read32(segment, bus, dev, fun, offset) >> ((offset & 2) * 8);
+}
+
+/*
+ * Read an 8-bit register from the configuration space of a PCI function.
+ */
+uint8_t pci_read8(uint16_t segment, uint8_t bus, uint8_t dev, uint8_t fun,
+                  uint16_t offset)
+{
+	return pci_read32(segment, bus, dev, fun, offset) >> ((offset & 3) * 8);
+}
+
+/*
+ * Check whether a PCI function is present.
+ */
+bool pci_exists(uint16_t segment, uint8_t bus, uint8_t dev, uint8_t fun)
+{
+	return pci_read16(segment, bus, dev, fun, PCI_VENDOR_ID) != 0xffff;
+}
+
+/*
+ * Write an 8-bit register in the configuration space of a PCI function.
+ * Writes to unreachable functions are dropped.
+ */
+void pci_write8(uint16_t segment, uint8_t bus, uint8_t dev, uint8_t fun,
+                uint16_t offset, uint8_t value)
+{
+	volatile uint32_t *reg = pci_ecam(segment, bus, dev, fun, offset);
+	if (reg) {
+		*((volatile uint8_t *) reg + (offset & 3)) = value;
+		return;
+	}
+
+	if (segment != 0 || offset >= 0x100)
+		return;
+
+	out32(PCI_CONFIG_ADDRESS, 0x80000000
+	      | ((uint32_t) bus << 16)
+	      | ((uint32_t) dev << 11)
+	      | ((uint32_t) fun << 8)
+	      | (offset & 0xfc));
+	out8(PCI_CONFIG_DATA + (offset & 3), value);
+}
+
+/*
+ * Find a capability of a PCI function, returning its offset or 0. The walk is
+ * bounded in case the list loops.
+ */
+static uint8_t pci_find_cap(uint16_t segment, uint8_t bus, uint8_t dev, uint8_t fun,
+                            uint8_t id)
+{
+	if (!(pci_read16(segment, bus, dev, fun, PCI_STATUS) & PCI_STATUS_CAP_LIST))
+		return 0;
+
+	uint8_t pos = pci_read8(segment, bus, dev, fun, PCI_CAPABILITY_LIST) & 0xfc;
+	for (uint32_t ttl = 48; pos >= 0x40 && ttl; ttl--) {
+		if (pci_read8(segment, bus, dev, fun, pos) == id)
+			return pos;
+		pos = pci_read8(segment, bus, dev, fun, pos + 1) & 0xfc;
+	}
+	return 0;
+}
+
+/*
+ * Find an extended capability of a PCI Express function, returning its
+ * offset or 0. They can't be reached through the legacy I/O ports.
+ */
+static uint16_t pci_find_ext_cap(uint16_t segment, uint8_t bus, uint8_t dev, uint8_t fun,
+                                 uint16_t id)
+{
+	uint16_t pos = PCI_EXT_CAP_BASE;
+	for (uint32_t ttl = (0x1000 - PCI_EXT_CAP_BASE) / 8; pos >= PCI_EXT_CAP_BASE && ttl; ttl--) {
+		uint32_t header = pci_read32(segment, bus, dev, fun, pos);
+		if (header == 0 || header == 0xffffffff)
+			return 0;
+		if (PCI_EXT_CAP_ID(header) == id)
+			return pos;
+		pos = PCI_EXT_CAP_NEXT(header);
+	}
+	return 0;
+}
+
+/*
+ * Record a PCI function, with its bridge windows and what is needed to tell
+ * whether it isolates the functions below it from each other.
+ */
+static bool pci_add_function(uint16_t segment, uint8_t bus, uint8_t dev, uint8_t fun,
+                             bool multifunction)
+{
+	if (!vector_reserve(&sysinfo.pcidev))
+		return false;
+	uint32_t n = sysinfo.pcidev.count++;
+	sysinfo.pcidev.list[n].parent        = PCI_NO_PARENT;
+	sysinfo.pcidev.list[n].segment       = segment;
+	sysinfo.pcidev.list[n].devid         = PCI_DEVID(bus, dev, fun);
+	sysinfo.pcidev.list[n].class         = pci_read32(segment, bus, dev, fun, PCI_CLASS_REVISION) >> 16;
+	sysinfo.pcidev.list[n].multifunction = multifunction;
+	sysinfo.pcidev.list[n].pcie_type     = PCI_EXP_TYPE_NONE;
+
+	if ((pci_read8(segment, bus, dev, fun, PCI_HEADER_TYPE) & PCI_HEADER_TYPE_MASK)
+	    == PCI_HEADER_TYPE_BRIDGE) {
+		sysinfo.pcidev.list[n].bridge          = true;
+		sysinfo.pcidev.list[n].secondary_bus   = pci_read8(segment, bus, dev, fun, PCI_SECONDARY_BUS);
+		sysinfo.pcidev.list[n].subordinate_bus = pci_read8(segment, bus, dev, fun, PCI_SUBORDINATE_BUS);
+	}
+
+	uint8_t exp = pci_find_cap(segment, bus, dev, fun, PCI_CAP_ID_EXP);
+	if (!exp)
+		return true;
+	sysinfo.pcidev.list[n].pcie_type =
+		PCI_EXP_FLAGS_TYPE(pci_read16(segment, bus, dev, fun, exp + PCI_EXP_FLAGS));
+
+	uint16_t acs = pci_find_ext_cap(segment, bus, dev, fun, PCI_EXT_CAP_ID_ACS);
+	if (acs) {
+		sysinfo.pcidev.list[n].acs      = true;
+		sysinfo.pcidev.list[n].acs_cap  = pci_read16(segment, bus, dev, fun, acs + PCI_ACS_CAP);
+		sysinfo.pcidev.list[n].acs_ctrl = pci_read16(segment, bus, dev, fun, acs + PCI_ACS_CTRL);
+	}
+	return true;
+}
+
+/*
+ * Enumerate the PCI functions of a bus.
+ */
+static bool pci_scan_bus(uint16_t segment, uint8_t bus)
+{
+	for (uint8_t dev = 0; dev < 32; dev++) {
+		if (!pci_exists(segment, bus, dev, 0))
+			continue;
+
+		bool multifunction = pci_read8(segment, bus, dev, 0, PCI_HEADER_TYPE)
+		                     & PCI_HEADER_TYPE_MULTI;
+		for (uint8_t fun = 0; fun < (multifunction ? 8 : 1); fun++) {
+			if (pci_exists(segment, bus, dev, fun) &&
+			    !pci_add_function(segment, bus, dev, fun, multifunction))
+				return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Enumerate the PCI functions of a segment and link each of them to the
+ * bridge above it. Every bus is probed, so that the root buses of all the
+ * host bridges are found.
+ */
+bool pci_scan(uint16_t segment)
+{
+	uint32_t first = sysinfo.pcidev.count;
+
+	for (uint32_t bus = 0; bus < 256; bus++) {
+		if (!pci_scan_bus(segment, bus))
+			return false;
+	}
+
+	for (uint32_t i = first; i < sysinfo.pcidev.count; i++) {
+		uint8_t bus = sysinfo.pcidev.list[i].devid >> 8;
+		for (uint32_t j = first; j < sysinfo.pcidev.count; j++) {
+			if (sysinfo.pcidev.list[j].bridge && sysinfo.pcidev.list[j].secondary_bus == bus &&
+			    bus != 0 && j != i) {
+				sysinfo.pcidev.list[i].parent = j;
+				break;
+			}
+		}
+	}
+
+	serial_printf("[*] PCI segment %d: %d functions\n", segment, sysinfo.pcidev.count - first);
+	return true;
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "acpi.h"
+#include "pci.h"
+#include "power.h"
+#include "serial.h"
+#include "sysinfo.h"
+#include "utils.h"
+
+/*
+ * Busy wait for roughly the given number of microseconds, each access to the
+ * POST code port takes about one microsecond.
+ */
+static void power_delay(uint32_t us)
+{
+	while (us--)
+		in8(0x80);
+}
+
+/*
+ * Write a byte to a register described by an ACPI generic address.
+ */
+static void power_write_gas(uint8_t space, uint64_t addr, uint8_t value)
+{
+	switch (space) {
+	case ACPI_GAS_SPACE_MEMORY:
+		if (!(addr >> 32))
+			*(volatile uint8_t *) (uint32_t) addr = value;
+		break;
+	case ACPI_GAS_SPACE_IO:
+		out8(addr, value);
+		break;
+	case ACPI_GAS_SPACE_PCI:
+		/* Device, function and offset on bus 0 of segment 0. */
+		pci_write8(0, 0, addr >> 32, addr >> 16, addr, value);
+		break;
+	}
+}
+
+/*
+ * Reset the machine, trying the ACPI reset register, the keyboard controller
+ * and the reset control register in turn. Returns if none of them worked.
+ */
+void power_reboot(void)
+{
+	serial_puts("[*] Rebooting\n");
+
+	if (sysinfo.power.reset_reg) {
+		power_write_gas(sysinfo.power.reset_space, sysinfo.power.reset_addr,
+		                sysinfo.power.reset_value);
+		power_delay(50000);
+	}
+
+	/* The FADT flag is unreliable, probe the keyboard controller anyway. */
+	if (in8(KBC_COMMAND_PORT) != 0xff) {
+		for (uint32_t i = 0; i < 10000 && (in8(KBC_COMMAND_PORT) & KBC_STATUS_INPUT_FULL); i++)
+			power_delay(1);
+		out8(KBC_COMMAND_PORT, KBC_COMMAND_RESET);
+		power_delay(50000);
+	}
+
+	/* Hardware-reduced platforms don't have the reset control register. */
+	if (!sysinfo.power.hw_reduced) {
+		out8(RESET_CONTROL_PORT, RESET_CONTROL_SYS_RST);
+		power_delay(10);
+		out8(RESET_CONTROL_PORT, RESET_CONTROL_SYS_RST | RESET_CONTROL_RST_CPU);
+		power_delay(50000);
+	}
+
+	serial_puts("[!] Warning: reset failed\n");
+}
+
+/*
+ * Enter the S5 (soft off) sleep state. Returns if the machine is still on.
+ */
+void power_shutdown(void)
+{
+	if (!sysinfo.power.s5) {
+		serial_puts("[!] Warning: ACPI S5 state unknown, cannot shut down\n");
+		return;
+	}
+
+	serial_puts("[*] Shutting down\n");
+
+	/* Hardware-reduced platforms use the sleep control register instead. */
+	if (sysinfo.power.hw_reduced) {
+		if (sysinfo.power.sleep_control)
+			power_write_gas(sysinfo.power.sleep_control_space,
+			                sysinfo.power.sleep_control,
+			                ACPI_SLEEP_SLP_TYP(sysinfo.power.slp_typa) | ACPI_SLEEP_SLP_EN);
+		power_delay(50000);
+		serial_puts("[!] Warning: shutdown failed\n");
+		return;
+	}
+
+	if (!sysinfo.power.pm1a_cnt) {
+		serial_puts("[!] Warning: no ACPI PM1 control block, cannot shut down\n");
+		return;
+	}
+
+	/* The firmware may have left the machine in legacy mode, switch to ACPI. */
+	if (!(in16(sysinfo.power.pm1a_cnt) & ACPI_PM1_SCI_EN) &&
+	    sysinfo.power.smi_cmd && sysinfo.power.acpi_enable) {
+		out8(sysinfo.power.smi_cmd, sysinfo.power.acpi_enable);
+		for (uint32_t i = 0; i < 300 && !(in16(sysinfo.power.pm1a_cnt) & ACPI_PM1_SCI_EN); i++)
+			power_delay(1000);
+	}
+
+	/* Program the sleep type first, then set the sleep enable bit. */
+	uint16_t pm1a = in16(sysinfo.power.pm1a_cnt) & ~(ACPI_PM1_SLP_TYP_MASK | ACPI_PM1_SLP_EN);
+	pm1a |= ACPI_PM1_SLP_TYP(sysinfo.power.slp_typa);
+	out16(sysinfo.power.pm1a_cnt, pm1a);
+	if (sysinfo.power.pm1b_cnt) {
+		uint16_t pm1b = in16(sysinfo.power.pm1b_cnt) & ~(ACPI_PM1_SLP_TYP_MASK | ACPI_PM1_SLP_EN);
+		pm1b |= ACPI_PM1_SLP_TYP(sysinfo.power.slp_typb);
+		out16(sysinfo.power.pm1b_cnt, pm1b);
+		out16(sysinfo.power.pm1b_cnt, pm1b | ACPI_PM1_SLP_EN);
+	}
+	out16(sysinfo.power.pm1a_cnt, pm1a | ACPI_PM1_SLP_EN);
+	power_delay(50000);
+
+	serial_puts("[!] Warning: shutdown failed\n");
+}
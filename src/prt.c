@@ -0,0 +1,225 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "acpi.h"
+#include "aml.h"
+#include "arena.h"
+#include "ioapic.h"
+#include "prt.h"
+#include "serial.h"
+#include "sysinfo.h"
+
+/* Resource descriptors, see ACPI 6.5 section 6.4. */
+#define PRT_RES_LARGE           0x80
+#define PRT_RES_SMALL_TYPE(tag) (((tag) >> 3) & 0xf)
+#define PRT_RES_SMALL_LEN(tag)  ((tag) & 0x7)
+#define PRT_RES_IRQ             0x04
+#define PRT_RES_END             0x0f
+#define PRT_RES_EXT_IRQ         0x89
+
+/* Interrupt flags of the IRQ descriptors. */
+#define PRT_IRQ_EDGE            0x01
+#define PRT_IRQ_ACTIVE_LOW      0x08
+#define PRT_EXT_IRQ_EDGE        0x02
+#define PRT_EXT_IRQ_ACTIVE_LOW  0x04
+
+/* Without a link device, PCI interrupts are level triggered and active low. */
+#define PRT_DEFAULT_FLAGS       (ACPI_MADT_POLARITY_ACTIVE_LOW | (ACPI_MADT_TRIGGER_LEVEL << 2))
+
+/*
+ * Return a printable name for a PCI interrupt pin.
+ */
+const char *prt_pin_name(uint8_t pin)
+{
+	static const char *names[] = {"INTA", "INTB", "INTC", "INTD"};
+
+	return pin < 4 ? names[pin] : "unknown";
+}
+
+/*
+ * Convert the interrupt flags of a resource descriptor to MPS INTI flags.
+ */
+static uint16_t prt_inti_flags(bool edge, bool active_low)
+{
+	return (active_low ? ACPI_MADT_POLARITY_ACTIVE_LOW : ACPI_MADT_POLARITY_ACTIVE_HIGH) |
+		((edge ? ACPI_MADT_TRIGGER_EDGE : ACPI_MADT_TRIGGER_LEVEL) << 2);
+}
+
+/*
+ * Find the interrupt currently assigned to a PCI interrupt link device from
+ * its current resource settings.
+ */
+static bool prt_link_irq(struct aml_node *link, uint32_t *gsi, uint16_t *flags)
+{
+	struct aml_node *crs = aml_lookup(link, "_CRS");
+	struct aml_object res;
+
+	if (!crs || !aml_evaluate(crs, 0, NULL, &res) || res.type != AML_BUFFER)
+		return false;
+
+	const uint8_t *p = res.buffer;
+	const uint8_t *end = res.buffer + res.size;
+	while (p < end) {
+		if (*p & PRT_RES_LARGE) {
+			if (p + 3 > end)
+				return false;
+			uint32_t len = p[1] | (p[2] << 8);
+			if (*p == PRT_RES_EXT_IRQ && len >= 6 && p[4] > 0 && p + 9 <= end) {
+				*gsi = p[5] | (p[6] << 8) | (p[7] << 16) | ((uint32_t) p[8] << 24);
+				*flags = prt_inti_flags(p[3] & PRT_EXT_IRQ_EDGE,
+				                        p[3] & PRT_EXT_IRQ_ACTIVE_LOW);
+				return true;
+			}
+			p += 3 + len;
+			continue;
+		}
+
+		uint32_t type = PRT_RES_SMALL_TYPE(*p);
+		uint32_t len = PRT_RES_SMALL_LEN(*p);
+		if (type == PRT_RES_END)
+			break;
+		if (type == PRT_RES_IRQ && len >= 2 && p + 3 <= end) {
+			uint16_t mask = p[1] | (p[2] << 8);
+			uint16_t isa_flags;
+			uint8_t irq;
+			if (!mask)
+				return false;
+			for (irq = 0; !(mask & 1); mask >>= 1)
+				irq++;
+			/* The descriptor holds an ISA IRQ, which may be overridden to another GSI. */
+			if (!ioapic_isa_irq_gsi(irq, gsi, &isa_flags))
+				return false;
+			/* Without the information byte, the interrupt is edge triggered and active high. */
+			uint8_t info = len >= 3 && p + 4 <= end ? p[3] : PRT_IRQ_EDGE;
+			*flags = prt_inti_flags(info & PRT_IRQ_EDGE, info & PRT_IRQ_ACTIVE_LOW);
+			return true;
+		}
+		p += 1 + len;
+	}
+
+	return false;
+}
+
+/*
+ * Evaluate the _PRT of a PCI root or bridge and record its entries. Returns
+ * false only if the arena is exhausted.
+ */
+static bool prt_parse(struct aml_node *device, struct aml_node *prt)
+{
+	struct aml_object table;
+	uint16_t segment;
+	uint8_t bus;
+
+	if (!aml_pci_bus(device, &segment, &bus)) {
+		serial_puts("[!] Warning: cannot find the PCI bus of a _PRT, skipping it\n");
+		return true;
+	}
+	if (!aml_evaluate(prt, 0, NULL, &table) || table.type != AML_PACKAGE) {
+		serial_printf("[!] Warning: cannot evaluate the _PRT of PCI bus %x:%x\n",
+		              segment, bus);
+		return true;
+	}
+
+	for (uint32_t i = 0; i < table.size; i++) {
+		struct aml_object *entry = &table.package[i];
+		uint64_t addr, pin, index;
+
+		if (entry->type == AML_ELEMENT)
+			entry = entry->element;
+		if (entry->type != AML_PACKAGE || entry->size < 4 ||
+		    !aml_to_integer(&entry->package[0], &addr) ||
+		    !aml_to_integer(&entry->package[1], &pin) ||
+		    !aml_to_integer(&entry->package[3], &index)) {
+			serial_printf("[!] Warning: malformed _PRT entry on PCI bus %x:%x\n",
+			              segment, bus);
+			continue;
+		}
+
+		/* Either a GSI, or the index of the interrupt of a link device. */
+		struct aml_object *source = &entry->package[2];
+		struct aml_node *link = NULL;
+		uint32_t gsi = index;
+		uint16_t flags = PRT_DEFAULT_FLAGS;
+		if (source->type == AML_REFERENCE && source->node &&
+		    source->node->type == AML_NODE_DEVICE) {
+			link = source->node;
+			if (!prt_link_irq(link, &gsi, &flags)) {
+				serial_printf("[!] Warning: no interrupt assigned to PCI link %c%c%c%c\n",
+				              link->name & 0xff, (link->name >> 8) & 0xff,
+				              (link->name >> 16) & 0xff, link->name >> 24);
+				continue;
+			}
+		}
+
+		if (!vector_reserve(&sysinfo.prt))
+			return false;
+		sysinfo.prt.list[sysinfo.prt.count].segment = segment;
+		sysinfo.prt.list[sysinfo.prt.count].bus = bus;
+		sysinfo.prt.list[sysinfo.prt.count].device = (addr >> 16) & 0x1f;
+		sysinfo.prt.list[sysinfo.prt.count].pin = pin;
+		sysinfo.prt.list[sysinfo.prt.count].gsi = gsi;
+		sysinfo.prt.list[sysinfo.prt.count].flags = flags;
+		for (uint32_t j = 0; j < 4; j++)
+			sysinfo.prt.list[sysinfo.prt.count].link[j] = link ? link->name >> (j * 8) : 0;
+		sysinfo.prt.list[sysinfo.prt.count].link[4] = '\0';
+		sysinfo.prt.count++;
+	}
+
+	return true;
+}
+
+/*
+ * Walk the namespace looking for devices with a _PRT.
+ */
+static bool prt_walk(struct aml_node *node)
+{
+	for (struct aml_node *child = node->child; child; child = child->sibling) {
+		if (child->type != AML_NODE_DEVICE && child->type != AML_NODE_SCOPE)
+			continue;
+		struct aml_node *prt = aml_lookup(child, "_PRT");
+		if (child->type == AML_NODE_DEVICE && prt && !prt_parse(child, prt))
+			return false;
+		if (!prt_walk(child))
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Evaluate the PCI interrupt routing of the ACPI namespace. The interpreter
+ * only supports a subset of AML, failures are reported as warnings and the
+ * routing is left out.
+ */
+bool prt_scan(void)
+{
+	struct acpi_header *table;
+
+	if (!sysinfo.dsdt.addr) {
+		serial_puts("[!] Warning: no DSDT, PCI interrupt routing unknown\n");
+		return true;
+	}
+
+	/* Load the DSDT, then the SSDTs that extend it. */
+	aml_load_table((struct acpi_header *) sysinfo.dsdt.addr);
+	for (uint32_t i = 0; (table = acpi_find_table("SSDT", i)); i++)
+		aml_load_table(table);
+
+	/* Tell the firmware that we use the I/O APIC interrupt model. */
+	struct aml_node *pic = aml_lookup(aml_root(), "\\_PIC");
+	struct aml_object mode = { .type = AML_INTEGER, .integer = 1 };
+	struct aml_object res;
+	if (pic && !aml_evaluate(pic, 1, &mode, &res))
+		serial_puts("[!] Warning: cannot evaluate \\_PIC(1)\n");
+
+	if (!prt_walk(aml_root()))
+		return false;
+	serial_printf("[*] Found %d PCI interrupt routes\n", sysinfo.prt.count);
+
+	return true;
+}
@@ -0,0 +1,165 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/*
+ * PVH boot support. The start info structure is translated into a multiboot2
+ * info structure, so that the rest of the code, including the raw dump, sees
+ * the same boot information whatever the boot protocol.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "multiboot2.h"
+#include "pvh.h"
+#include "serial.h"
+#include "utils.h"
+
+/* Legacy BIOS area searched for the RSDP when the start info doesn't give it. */
+#define PVH_BIOS_SCAN_START     0xe0000
+#define PVH_BIOS_SCAN_END       0x100000
+
+/* ACPI 1.0 and 2.0 RSDP sizes. */
+#define PVH_RSDP1_SIZE          20
+#define PVH_RSDP2_SIZE          36
+
+static uint8_t pvh_info[CONFIG_PVH_INFO_SIZE] __attribute__((aligned(8)));
+static uint32_t pvh_info_size;
+
+/*
+ * Append a tag to the multiboot2 info structure, returns its data or NULL if
+ * the structure is full.
+ */
+static void *pvh_add_tag(uint32_t type, uint32_t size)
+{
+	struct multiboot2_tag_header *tag = (void *) (pvh_info + pvh_info_size);
+	uint32_t total = (sizeof (*tag) + size + 7) & ~7;
+
+	if (pvh_info_size + total > sizeof (pvh_info)) {
+		serial_puts("[X] Error: PVH start info too large to translate!\n");
+		return NULL;
+	}
+	memset((char *) tag, 0, total);
+	tag->type = type;
+	tag->size = sizeof (*tag) + size;
+	pvh_info_size += total;
+	return tag + 1;
+}
+
+/*
+ * Append a string tag, the command line of the kernel or of a module.
+ */
+static char *pvh_add_string(uint32_t type, uint32_t header_size, uint64_t string_addr)
+{
+	const char *string = (const char *) (uint32_t) string_addr;
+	uint32_t length = string_addr && !(string_addr >> 32) ? strlen((char *) string) : 0;
+
+	char *data = pvh_add_tag(type, header_size + length + 1);
+	if (data)
+		memcpy(data + header_size, (char *) string, length);
+	return data;
+}
+
+/*
+ * Check the signature and checksum of an RSDP candidate.
+ */
+static bool pvh_rsdp_valid(const uint8_t *rsdp)
+{
+	uint8_t sum = 0;
+
+	if (memcmp((char *) rsdp, "RSD PTR ", 8))
+		return false;
+	for (uint32_t i = 0; i < PVH_RSDP1_SIZE; i++)
+		sum += rsdp[i];
+	return sum == 0;
+}
+
+/*
+ * Find the RSDP in the BIOS area, for hypervisors that leave it out of the
+ * start info.
+ */
+static uint32_t pvh_find_rsdp(void)
+{
+	for (uint32_t p = PVH_BIOS_SCAN_START; p < PVH_BIOS_SCAN_END; p += 16)
+		if (pvh_rsdp_valid((uint8_t *) p))
+			return p;
+	return 0;
+}
+
+/*
+ * Build a multiboot2 info structure from the PVH start info, returns its
+ * address or 0 on error.
+ */
+uint32_t pvh_to_multiboot2(uint32_t start_info_addr)
+{
+	struct pvh_start_info *start_info = (void *) start_info_addr;
+
+	if (start_info->magic != PVH_BOOT_MAGIC) {
+		serial_puts("[X] Error: invalid PVH start info magic!\n");
+		return 0;
+	}
+	if (start_info->version < 1 || !start_info->memmap_paddr ||
+	    (start_info->memmap_paddr >> 32) || !start_info->memmap_entries) {
+		serial_puts("[X] Error: PVH start info without a memory map!\n");
+		return 0;
+	}
+
+	pvh_info_size = sizeof (struct multiboot2_info_header);
+
+	/* The command line comes first, for its options to apply to the rest. */
+	if (!pvh_add_string(MULTIBOOT2_INFO_TAG_COMMAND_LINE, 0, start_info->cmdline_paddr) ||
+	    !pvh_add_string(MULTIBOOT2_INFO_TAG_BOOTLOADER_NAME, 0, (uint32_t) "PVH"))
+		return 0;
+
+	/* The memory map entries have the same layout. */
+	uint32_t mmap_size = start_info->memmap_entries * sizeof (struct pvh_memmap_entry);
+	struct multiboot2_tag_mmap *mmap =
+		pvh_add_tag(MULTIBOOT2_INFO_TAG_MEMORY_MAP, sizeof (*mmap) + mmap_size);
+	if (!mmap)
+		return 0;
+	mmap->entry_size = sizeof (struct pvh_memmap_entry);
+	mmap->entry_version = 0;
+	memcpy((char *) (mmap + 1), (char *) (uint32_t) start_info->memmap_paddr, mmap_size);
+
+	/* Copy the RSDP, the tag depends on the ACPI revision. */
+	uint32_t rsdp = start_info->rsdp_paddr >> 32 ? 0 : start_info->rsdp_paddr;
+	if (!rsdp)
+		rsdp = pvh_find_rsdp();
+	if (rsdp) {
+		bool rsdp2 = ((struct multiboot2_tag_rsdp1 *) rsdp)->revision >= 2;
+		uint32_t size = rsdp2 ? PVH_RSDP2_SIZE : PVH_RSDP1_SIZE;
+		void *tag = pvh_add_tag(rsdp2 ? MULTIBOOT2_INFO_TAG_ACPI_NEW_RSDP :
+		                        MULTIBOOT2_INFO_TAG_ACPI_OLD_RSDP, size);
+		if (!tag)
+			return 0;
+		memcpy((char *) tag, (char *) rsdp, size);
+	}
+
+	/* The modules, which must be below 4GiB like with multiboot2. */
+	struct pvh_module *module = (void *) (uint32_t) start_info->modlist_paddr;
+	for (uint32_t i = 0; i < start_info->nr_modules && !(start_info->modlist_paddr >> 32); i++) {
+		if ((module[i].paddr + module[i].size) >> 32) {
+			serial_printf("[!] Warning: PVH module %d is above 4GiB, ignored\n", i);
+			continue;
+		}
+		struct multiboot2_tag_module *tag =
+			(void *) pvh_add_string(MULTIBOOT2_INFO_TAG_MODULE, sizeof (*tag),
+			                        module[i].cmdline_paddr);
+		if (!tag)
+			return 0;
+		tag->mod_start = module[i].paddr;
+		tag->mod_end = module[i].paddr + module[i].size;
+	}
+
+	if (!pvh_add_tag(MULTIBOOT2_INFO_TAG_END, 0))
+		return 0;
+
+	struct multiboot2_info_header *info = (void *) pvh_info;
+	info->total_size = pvh_info_size;
+	info->reserved = 0;
+	return (uint32_t) pvh_info;
+}
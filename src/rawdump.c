@@ -0,0 +1,264 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/*
+ * Raw dump of the firmware tables, for offline analysis with the replay tool.
+ * The records are described in rawdump.h.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "acpi.h"
+#include "efi.h"
+#include "fingerprint.h"
+#include "multiboot2.h"
+#include "rawdump.h"
+#include "serial.h"
+#include "smbios.h"
+#include "sysinfo.h"
+#include "utils.h"
+
+/* Maximum number of distinct blobs, tables listed twice are sent once. */
+#define RAWDUMP_MAX_RECORDS     128
+
+/*
+ * Encoder output, either counting the encoded bytes or sending them in base64.
+ */
+struct rawdump_out {
+	bool     count_only;
+	uint32_t count;
+	uint32_t bits;
+	uint32_t nbits;
+	uint32_t column;
+};
+
+static uint32_t rawdump_addrs[RAWDUMP_MAX_RECORDS];
+static uint32_t rawdump_num_records;
+static uint64_t rawdump_bytes;
+
+/*
+ * Output one base64 character, wrapping the lines.
+ */
+static void rawdump_putc(struct rawdump_out *out, uint32_t sextet)
+{
+	static const char symbols[] =
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+	serial_putc(sextet < 64 ? symbols[sextet] : '=');
+	if (++out->column == RAWDUMP_LINE_LENGTH) {
+		serial_putc('\n');
+		out->column = 0;
+	}
+}
+
+/*
+ * Output one encoded byte.
+ */
+static void rawdump_put(struct rawdump_out *out, uint8_t byte)
+{
+	out->count++;
+	if (out->count_only)
+		return;
+
+	out->bits = (out->bits << 8) | byte;
+	out->nbits += 8;
+	if (out->nbits == 24) {
+		for (int i = 3; i >= 0; i--)
+			rawdump_putc(out, (out->bits >> (i * 6)) & 0x3f);
+		out->bits = 0;
+		out->nbits = 0;
+	}
+}
+
+/*
+ * Flush the pending base64 group with padding, and end the line.
+ */
+static void rawdump_flush(struct rawdump_out *out)
+{
+	if (out->nbits) {
+		uint32_t chars = out->nbits / 6 + 1;
+		out->bits <<= 24 - out->nbits;
+		for (uint32_t i = 0; i < 4; i++)
+			rawdump_putc(out, i < chars ? (out->bits >> ((3 - i) * 6)) & 0x3f : 64);
+	}
+	if (out->column)
+		serial_putc('\n');
+}
+
+/*
+ * Run-length encode a buffer.
+ */
+static void rawdump_rle(struct rawdump_out *out, const uint8_t *data, uint32_t size)
+{
+	uint32_t literal = 0;
+
+	for (uint32_t i = 0; i < size;) {
+		uint32_t run = 1;
+		while (i + run < size && run < RAWDUMP_RLE_MAX_RUN && data[i + run] == data[i])
+			run++;
+
+		if (run >= RAWDUMP_RLE_MIN_RUN || literal == RAWDUMP_RLE_MAX_LITERAL) {
+			if (literal) {
+				rawdump_put(out, literal - 1);
+				for (uint32_t j = i - literal; j < i; j++)
+					rawdump_put(out, data[j]);
+				literal = 0;
+			}
+			if (run >= RAWDUMP_RLE_MIN_RUN) {
+				rawdump_put(out, RAWDUMP_RLE_RUN + run - RAWDUMP_RLE_MIN_RUN);
+				rawdump_put(out, data[i]);
+				i += run;
+				continue;
+			}
+		}
+		literal++;
+		i++;
+	}
+
+	if (literal) {
+		rawdump_put(out, literal - 1);
+		for (uint32_t j = size - literal; j < size; j++)
+			rawdump_put(out, data[j]);
+	}
+}
+
+/*
+ * Send one blob, run-length encoded if that makes it smaller. Blobs that were
+ * already sent are skipped.
+ */
+static void rawdump_record(const char *kind, uint64_t addr, uint32_t size)
+{
+	if (!addr || !size)
+		return;
+	if ((addr + size - 1) >> 32) {
+		serial_printf("[!] Warning: %s blob at %X is above 4GiB, not dumped\n", kind, addr);
+		return;
+	}
+	for (uint32_t i = 0; i < rawdump_num_records; i++)
+		if (rawdump_addrs[i] == addr)
+			return;
+	if (rawdump_num_records == RAWDUMP_MAX_RECORDS) {
+		serial_printf("[!] Warning: too many blobs, %s at %X not dumped\n", kind, addr);
+		return;
+	}
+	rawdump_addrs[rawdump_num_records++] = addr;
+
+	const uint8_t *data = (const uint8_t *) (uint32_t) addr;
+	struct rawdump_out out = { .count_only = true };
+	rawdump_rle(&out, data, size);
+	bool rle = out.count < size;
+
+	serial_printf("@%s %x %d %s %x\n", kind, (uint32_t) addr, size, rle ? "rle" : "plain",
+	              crc32c(0, data, size));
+	memset((char *) &out, 0, sizeof (out));
+	if (rle) {
+		rawdump_rle(&out, data, size);
+	} else {
+		for (uint32_t i = 0; i < size; i++)
+			rawdump_put(&out, data[i]);
+	}
+	rawdump_flush(&out);
+	rawdump_bytes += out.count;
+}
+
+/*
+ * Send an ACPI table, and the DSDT when it is the FADT.
+ */
+static void rawdump_acpi_table(uint64_t addr)
+{
+	if (!addr || (addr >> 32))
+		return;
+
+	struct acpi_header *header = (void *) (uint32_t) addr;
+	rawdump_record("acpi", addr, header->length);
+
+	if (!memcmp(header->signature, "FACP", 4)) {
+		struct acpi_fadt *fadt = (void *) header;
+		rawdump_acpi_table(fadt->dsdt);
+		if (ACPI_FADT_HAS(fadt, x_dsdt))
+			rawdump_acpi_table(fadt->x_dsdt);
+	}
+}
+
+/*
+ * Send the ACPI tables listed in the RSDT, and in the XSDT if there is one.
+ */
+static void rawdump_acpi(void)
+{
+	struct acpi_rsdt *rsdt = (void *) sysinfo.rsdt.addr;
+
+	rawdump_acpi_table(sysinfo.rsdt.addr);
+	for (uint32_t i = 0; i < (rsdt->header.length - sizeof (rsdt->header)) / 4; i++)
+		rawdump_acpi_table(rsdt->entry[i]);
+
+	struct multiboot2_tag_header *tag = multiboot2_tag(MULTIBOOT2_INFO_TAG_ACPI_NEW_RSDP);
+	if (!tag)
+		return;
+	struct multiboot2_tag_rsdp2 *rsdp = (void *) (tag + 1);
+	if (!rsdp->xsdt_address || (rsdp->xsdt_address >> 32))
+		return;
+
+	struct acpi_header *xsdt = (void *) (uint32_t) rsdp->xsdt_address;
+	uint64_t *entry = (uint64_t *) (xsdt + 1);
+	rawdump_acpi_table(rsdp->xsdt_address);
+	for (uint32_t i = 0; i < (xsdt->length - sizeof (*xsdt)) / 8; i++)
+		rawdump_acpi_table(entry[i]);
+}
+
+/*
+ * Send the EFI system table, its configuration table and the RSDPs it lists,
+ * which locate the ACPI tables when the boot loader doesn't pass them.
+ */
+static void rawdump_efi(void)
+{
+	uint64_t addr, config;
+	uint32_t size, config_size;
+
+	if (!efi_system_table(&addr, &size, &config, &config_size))
+		return;
+	rawdump_record("efi", addr, size);
+	rawdump_record("efi", config, config_size);
+
+	/* The RSDPs have the layout of the multiboot2 tags. */
+	void *rsdp = efi_config_table(&efi_guid_acpi20);
+	if (rsdp)
+		rawdump_record("efi", (uint32_t) rsdp, sizeof (struct multiboot2_tag_rsdp2));
+	rsdp = efi_config_table(&efi_guid_acpi10);
+	if (rsdp)
+		rawdump_record("efi", (uint32_t) rsdp, sizeof (struct multiboot2_tag_rsdp1));
+}
+
+/*
+ * Send the SMBIOS structure table.
+ */
+static void rawdump_smbios(void)
+{
+	uint64_t addr;
+	uint32_t size;
+
+	if (smbios_find_table(&addr, &size))
+		rawdump_record("smbios", addr, size);
+}
+
+/*
+ * Stream the multiboot2 info structure, with the memory map and the SMBIOS
+ * entry point, the EFI system table, the ACPI tables and the SMBIOS tables.
+ */
+bool rawdump(uint32_t info_addr)
+{
+	struct multiboot2_info_header *info = (void *) info_addr;
+
+	serial_puts("\n" RAWDUMP_BEGIN "\n");
+	rawdump_record("mbi", info_addr, info->total_size);
+	rawdump_efi();
+	rawdump_acpi();
+	rawdump_smbios();
+	serial_puts(RAWDUMP_END "\n");
+
+	serial_printf("[*] Raw dump of %d blobs in %D bytes\n", rawdump_num_records, rawdump_bytes);
+	return true;
+}
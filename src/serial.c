@@ -8,26 +8,45 @@
 #include "serial.h"
 #include "utils.h"
 
+struct serial_window serial_window;
+
 /*
- * Initialise the serial port.
+ * Initialise the serial port. The divisor is left as programmed by the
+ * firmware when the baud rate isn't known.
  *
  * This code comes from seL4 (src/plat/pc99/machine/io.c).
  */
 void serial_init(void)
 {
-	while (!(in8(options.serial_port + 5) & 0x60)) /* wait until not busy */
+	while (!(serial_in(UART_LSR) & 0x60)) /* wait until not busy */
 		;
 
-	out8(options.serial_port + 1, 0x00); /* disable generating interrupts */
-	out8(options.serial_port + 3, 0x80); /* line control register: command: set divisor */
-	out8(options.serial_port,     0x01); /* set low byte of divisor to 0x01 = 115200 baud */
-	out8(options.serial_port + 1, 0x00); /* set high byte of divisor to 0x00 */
-	out8(options.serial_port + 3, 0x03); /* line control register: set 8 bit, no parity, 1 stop bit */
-	out8(options.serial_port + 4, 0x0b); /* modem control register: set DTR/RTS/OUT2 */
+	serial_out(UART_IER, 0x00); /* disable generating interrupts */
+	if (options.serial.baud) {
+		uint32_t divisor = options.serial.clock / (16 * options.serial.baud);
+		if (!divisor)
+			divisor = 1;
+		serial_out(UART_LCR, 0x80);            /* line control register: command: set divisor */
+		serial_out(UART_DATA, divisor & 0xff); /* set low byte of divisor, 0x01 = 115200 baud at 1.8432MHz */
+		serial_out(UART_IER, divisor >> 8);    /* set high byte of divisor */
+		serial_out(UART_LCR, 0x03);            /* line control register: set 8 bit, no parity, 1 stop bit */
+	}
+	serial_out(UART_MCR, 0x0b); /* modem control register: set DTR/RTS/OUT2 */
+	serial_out(UART_FCR, 0x07); /* FIFO control register: enable and clear the FIFOs */
+
+	serial_in(UART_DATA); /* clear receiver */
+	serial_in(UART_LSR);  /* clear line status */
+	serial_in(UART_MSR);  /* clear modem status */
+}
 
-	in8(options.serial_port);     /* clear receiver */
-	in8(options.serial_port + 5); /* clear line status */
-	in8(options.serial_port + 6); /* clear modem status */
+/*
+ * Read a character from the serial port, waiting for one.
+ */
+uint8_t serial_getc(void)
+{
+	while (!(serial_in(UART_LSR) & UART_LSR_DATA_READY)) /* wait for received data */
+		;
+	return serial_in(UART_DATA);
 }
 
 /*
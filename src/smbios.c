@@ -0,0 +1,313 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "efi.h"
+#include "multiboot2.h"
+#include "serial.h"
+#include "smbios.h"
+#include "sysinfo.h"
+#include "utils.h"
+
+/* Legacy BIOS area searched for the entry point, on 16-byte boundaries. */
+#define SMBIOS_SCAN_START       0xf0000
+#define SMBIOS_SCAN_END         0x100000
+
+/*
+ * Return a printable name for a memory device type.
+ */
+const char *smbios_memory_type_name(uint8_t type)
+{
+	switch (type) {
+	case 0x12: return "DDR";
+	case 0x13: return "DDR2";
+	case 0x14: return "DDR2 FB-DIMM";
+	case 0x18: return "DDR3";
+	case 0x1a: return "DDR4";
+	case 0x1b: return "LPDDR";
+	case 0x1c: return "LPDDR2";
+	case 0x1d: return "LPDDR3";
+	case 0x1e: return "LPDDR4";
+	case 0x1f: return "Logical non-volatile device";
+	case 0x20: return "HBM";
+	case 0x21: return "HBM2";
+	case 0x22: return "DDR5";
+	case 0x23: return "LPDDR5";
+	case 0x24: return "HBM3";
+	default:   return "unknown";
+	}
+}
+
+/*
+ * Return a printable name for a memory device form factor.
+ */
+const char *smbios_form_factor_name(uint8_t form_factor)
+{
+	switch (form_factor) {
+	case 0x09: return "DIMM";
+	case 0x0b: return "Row of chips";
+	case 0x0d: return "SODIMM";
+	case 0x0f: return "FB-DIMM";
+	case 0x10: return "Die";
+	default:   return "unknown";
+	}
+}
+
+/*
+ * Check the checksum of an entry point structure.
+ */
+static bool smbios_checksum(const uint8_t *entry, uint32_t length)
+{
+	uint8_t sum = 0;
+
+	for (uint32_t i = 0; i < length; i++)
+		sum += entry[i];
+	return sum == 0;
+}
+
+/*
+ * Get the structure table from an entry point, if valid.
+ */
+static bool smbios_entry_table(const void *entry, uint64_t *addr, uint32_t *size)
+{
+	if (!memcmp((char *) entry, "_SM3_", 5)) {
+		const struct smbios_entry64 *ep = entry;
+		if (!smbios_checksum(entry, ep->length))
+			return false;
+		*addr = ep->table_address;
+		*size = ep->table_max_size;
+		return true;
+	}
+	if (!memcmp((char *) entry, "_SM_", 4)) {
+		const struct smbios_entry32 *ep = entry;
+		if (!smbios_checksum(entry, ep->length))
+			return false;
+		*addr = ep->table_address;
+		*size = ep->table_length;
+		return true;
+	}
+	return false;
+}
+
+/*
+ * Find the SMBIOS structure table, from the entry point passed by the boot
+ * loader, listed in the EFI configuration table, or else in the legacy BIOS
+ * area.
+ */
+bool smbios_find_table(uint64_t *addr, uint32_t *size)
+{
+	struct multiboot2_tag_header *tag = multiboot2_tag(MULTIBOOT2_INFO_TAG_SMBIOS_TABLES);
+	if (tag)
+		return smbios_entry_table((struct multiboot2_tag_smbios *) (tag + 1) + 1, addr, size);
+
+	void *entry = efi_config_table(&efi_guid_smbios3);
+	if (entry && smbios_entry_table(entry, addr, size))
+		return true;
+	entry = efi_config_table(&efi_guid_smbios);
+	if (entry && smbios_entry_table(entry, addr, size))
+		return true;
+
+	/* The 64-bit entry point takes precedence. */
+	for (uint32_t p = SMBIOS_SCAN_START; p < SMBIOS_SCAN_END; p += 16)
+		if (!memcmp((char *) p, "_SM3_", 5) && smbios_entry_table((void *) p, addr, size))
+			return true;
+	for (uint32_t p = SMBIOS_SCAN_START; p < SMBIOS_SCAN_END; p += 16)
+		if (!memcmp((char *) p, "_SM_", 4) && smbios_entry_table((void *) p, addr, size))
+			return true;
+	return false;
+}
+
+/*
+ * Copy a string of a structure, numbered from 1, and make it safe to print in
+ * json.
+ */
+static void smbios_string(const struct smbios_header *header, const uint8_t *end,
+                          uint8_t n, char *buf, uint32_t size)
+{
+	const char *s = (const char *) header + header->length;
+	uint32_t len = 0;
+
+	if (n) {
+		while (--n && (const uint8_t *) s < end && *s)
+			s += strlen((char *) s) + 1;
+		while ((const uint8_t *) s < end && *s == ' ')
+			s++;
+		for (; (const uint8_t *) s < end && *s && len + 1 < size; s++)
+			buf[len++] = *s >= ' ' && *s <= '~' && *s != '"' && *s != '\\' ? *s : '?';
+		while (len && buf[len - 1] == ' ')
+			len--;
+	}
+	buf[len] = '\0';
+}
+
+/*
+ * Parse a Memory Device structure.
+ */
+static bool smbios_memory_device(const struct smbios_memory_device *dev, const uint8_t *end)
+{
+	if (!SMBIOS_HAS(dev, speed))
+		return true;
+	if (!vector_reserve(&sysinfo.dimm))
+		return false;
+
+	uint64_t size = 0;
+	if (dev->size == SMBIOS_SIZE_EXTENDED && SMBIOS_HAS(dev, extended_size))
+		size = (uint64_t) (dev->extended_size & 0x7fffffff) << 20;
+	else if (dev->size != SMBIOS_SIZE_UNKNOWN && (dev->size & SMBIOS_SIZE_KB))
+		size = (uint64_t) (dev->size & ~SMBIOS_SIZE_KB) << 10;
+	else if (dev->size != SMBIOS_SIZE_UNKNOWN)
+		size = (uint64_t) dev->size << 20;
+
+	uint32_t speed = dev->speed;
+	if (speed == SMBIOS_SPEED_EXTENDED && SMBIOS_HAS(dev, extended_speed))
+		speed = dev->extended_speed;
+	uint32_t configured_speed = SMBIOS_HAS(dev, configured_speed) ? dev->configured_speed : 0;
+	if (configured_speed == SMBIOS_SPEED_EXTENDED && SMBIOS_HAS(dev, extended_configured_speed))
+		configured_speed = dev->extended_configured_speed;
+
+	struct smbios_header *header = (void *) dev;
+	uint32_t i = sysinfo.dimm.count;
+	sysinfo.dimm.list[i].size = size;
+	sysinfo.dimm.list[i].speed = speed;
+	sysinfo.dimm.list[i].configured_speed = configured_speed;
+	sysinfo.dimm.list[i].handle = dev->header.handle;
+	sysinfo.dimm.list[i].array = dev->array_handle;
+	sysinfo.dimm.list[i].total_width = dev->total_width;
+	sysinfo.dimm.list[i].data_width = dev->data_width;
+	sysinfo.dimm.list[i].type = dev->memory_type;
+	sysinfo.dimm.list[i].form_factor = dev->form_factor;
+	sysinfo.dimm.list[i].ranks = SMBIOS_HAS(dev, attributes) ? dev->attributes & 0xf : 0;
+	smbios_string(header, end, dev->device_locator,
+	              sysinfo.dimm.list[i].locator, sizeof (sysinfo.dimm.list[i].locator));
+	smbios_string(header, end, dev->bank_locator,
+	              sysinfo.dimm.list[i].bank_locator, sizeof (sysinfo.dimm.list[i].bank_locator));
+	if (SMBIOS_HAS(dev, part_number)) {
+		smbios_string(header, end, dev->manufacturer, sysinfo.dimm.list[i].manufacturer,
+		              sizeof (sysinfo.dimm.list[i].manufacturer));
+		smbios_string(header, end, dev->part_number, sysinfo.dimm.list[i].part_number,
+		              sizeof (sysinfo.dimm.list[i].part_number));
+	}
+	sysinfo.dimm.count++;
+
+	if (size)
+		serial_printf("[*] DIMM %s: %D MiB %s at %d MT/s\n",
+		              sysinfo.dimm.list[i].locator, size >> 20,
+		              smbios_memory_type_name(dev->memory_type), configured_speed);
+	return true;
+}
+
+/*
+ * Record the physical address range of a memory device or array, given in
+ * KiB unless the extended fields are used. The range is skipped if the
+ * structure is too short to hold the extended fields it refers to.
+ */
+static bool smbios_range(uint32_t start, uint32_t end, bool extended, uint64_t extended_start,
+                         uint64_t extended_end, uint16_t handle, bool device,
+                         uint8_t position, uint8_t depth)
+{
+	uint64_t addr, size;
+
+	if (start == SMBIOS_ADDR_EXTENDED) {
+		if (!extended || extended_end < extended_start)
+			return true;
+		addr = extended_start;
+		size = extended_end - extended_start + 1;
+	} else {
+		if (end < start)
+			return true;
+		addr = (uint64_t) start << 10;
+		size = ((uint64_t) end - start + 1) << 10;
+	}
+
+	if (!vector_reserve(&sysinfo.dimm_range))
+		return false;
+	sysinfo.dimm_range.list[sysinfo.dimm_range.count].addr = addr;
+	sysinfo.dimm_range.list[sysinfo.dimm_range.count].size = size;
+	sysinfo.dimm_range.list[sysinfo.dimm_range.count].handle = handle;
+	sysinfo.dimm_range.list[sysinfo.dimm_range.count].device = device;
+	sysinfo.dimm_range.list[sysinfo.dimm_range.count].interleave_position = position;
+	sysinfo.dimm_range.list[sysinfo.dimm_range.count].interleave_depth = depth;
+	sysinfo.dimm_range.count++;
+	return true;
+}
+
+/*
+ * Parse the memory devices and their physical address ranges from the SMBIOS
+ * tables. They are informative only, the tables being absent or above 4GiB
+ * isn't an error.
+ */
+bool smbios_scan(void)
+{
+	uint64_t addr;
+	uint32_t size;
+
+	if (!smbios_find_table(&addr, &size)) {
+		serial_puts("[!] Warning: SMBIOS tables not found, no memory device inventory\n");
+		return true;
+	}
+	if ((addr + size) >> 32) {
+		serial_puts("[!] Warning: SMBIOS tables above 4GiB, no memory device inventory\n");
+		return true;
+	}
+
+	/* Walk the structures, the ranges are kept until we know which to use. */
+	const uint8_t *p = (const uint8_t *) (uint32_t) addr;
+	const uint8_t *end = p + size;
+	bool device_ranges = false;
+	while (p + sizeof (struct smbios_header) <= end) {
+		const struct smbios_header *header = (const void *) p;
+		if (header->length < sizeof (*header) || header->type == SMBIOS_TYPE_END)
+			break;
+
+		const uint8_t *next = p + header->length;
+		while (next + 1 < end && (next[0] || next[1]))
+			next++;
+		next += 2;
+
+		if (header->type == SMBIOS_TYPE_MEMORY_DEVICE) {
+			if (!smbios_memory_device((const void *) header, next))
+				return false;
+		} else if (header->type == SMBIOS_TYPE_MEMORY_ARRAY_MAPPED) {
+			const struct smbios_array_mapped *map = (const void *) header;
+			bool extended = SMBIOS_HAS(map, extended_end);
+			if (SMBIOS_HAS(map, array_handle) &&
+			    !smbios_range(map->start, map->end, extended,
+			                  extended ? map->extended_start : 0,
+			                  extended ? map->extended_end : 0,
+			                  map->array_handle, false, 0, 0))
+				return false;
+		} else if (header->type == SMBIOS_TYPE_MEMORY_DEVICE_MAPPED) {
+			const struct smbios_device_mapped *map = (const void *) header;
+			bool extended = SMBIOS_HAS(map, extended_end);
+			if (SMBIOS_HAS(map, interleave_depth)) {
+				if (!smbios_range(map->start, map->end, extended,
+				                  extended ? map->extended_start : 0,
+				                  extended ? map->extended_end : 0,
+				                  map->device_handle, true,
+				                  map->interleave_position, map->interleave_depth))
+					return false;
+				device_ranges = true;
+			}
+		}
+		p = next;
+	}
+
+	/* Device ranges are more precise, drop the array ones if we have them. */
+	if (device_ranges) {
+		uint32_t n = 0;
+		for (uint32_t i = 0; i < sysinfo.dimm_range.count; i++)
+			if (sysinfo.dimm_range.list[i].device)
+				sysinfo.dimm_range.list[n++] = sysinfo.dimm_range.list[i];
+		sysinfo.dimm_range.count = n;
+	}
+
+	serial_printf("[*] Found %d memory device slots\n", sysinfo.dimm.count);
+	return true;
+}
@@ -7,25 +7,180 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "acpi.h"
+#include "pci.h"
 #include "serial.h"
 #include "sysinfo.h"
 #include "vtd.h"
 
 #define VTD_CAP_REG       0x08
-#define VTD_SAGAW         8
+#define VTD_ECAP_REG      0x10
 #define VTD_SAGAW_2_LEVEL 0x01
 #define VTD_SAGAW_3_LEVEL 0x02
 #define VTD_SAGAW_4_LEVEL 0x04
 #define VTD_SAGAW_5_LEVEL 0x08
 #define VTD_SAGAW_6_LEVEL 0x10
 
+/*
+ * ACS controls that keep peer-to-peer requests from bypassing the IOMMU, as
+ * required by Linux to put functions in separate IOMMU groups.
+ */
+#define VTD_ACS_ISOLATION (PCI_ACS_SV | PCI_ACS_RR | PCI_ACS_CR | PCI_ACS_UF)
+
 /*
  * Read a 32-bit register from a specific IOMMU. Note while paging is enabled
- * we assume a 1:1 virtual mapping so we can use physical memory addresses.
+ * we assume a 1:1 virtual mapping so we can use physical memory addresses,
+ * the registers of the IOMMU must be below 4GiB.
  */
 static inline uint32_t vtd_read32(uint32_t drhu_id, uint32_t offset)
 {
-    return *(volatile uint32_t *)(sysinfo.drhu.addr[drhu_id] + offset);
+    return *(volatile uint32_t *)((uint32_t) sysinfo.drhu.list[drhu_id].addr + offset);
+}
+
+/*
+ * Read a 64-bit register from a specific IOMMU, as two 32-bit accesses.
+ */
+static inline uint64_t vtd_read64(uint32_t drhu_id, uint32_t offset)
+{
+	uint32_t lo = vtd_read32(drhu_id, offset);
+	uint32_t hi = vtd_read32(drhu_id, offset + 4);
+	return ((uint64_t) hi << 32) | lo;
+}
+
+/*
+ * Find the DRHU translating the requests of a PCI function: the one with a
+ * device scope covering it, or else the catch-all DRHU of its segment.
+ */
+static uint32_t vtd_find_drhu(uint16_t segment, uint16_t devid)
+{
+	for (uint32_t i = 0; i < sysinfo.devscope.count; i++) {
+		uint32_t drhu = sysinfo.devscope.list[i].drhu;
+		uint8_t type = sysinfo.devscope.list[i].type;
+		uint8_t bus = devid >> 8;
+
+		if (sysinfo.drhu.list[drhu].segment != segment ||
+		    (type != ACPI_DMAR_SCOPE_TYPE_ENDPOINT && type != ACPI_DMAR_SCOPE_TYPE_BRIDGE))
+			continue;
+		if (sysinfo.devscope.list[i].devid == devid)
+			return drhu;
+		if (type == ACPI_DMAR_SCOPE_TYPE_BRIDGE && sysinfo.devscope.list[i].secondary_bus &&
+		    bus >= sysinfo.devscope.list[i].secondary_bus &&
+		    bus <= sysinfo.devscope.list[i].subordinate_bus)
+			return drhu;
+	}
+
+	for (uint32_t i = 0; i < sysinfo.drhu.count; i++) {
+		if (sysinfo.drhu.list[i].include_pci_all && sysinfo.drhu.list[i].segment == segment)
+			return i;
+	}
+	return VTD_NO_DRHU;
+}
+
+/*
+ * Check whether a PCI function keeps the functions below it, or the other
+ * functions of its slot, from reaching each other without going through the
+ * IOMMU. This follows the reading of the PCIe specification of Linux
+ * pci_acs_enabled(): conventional PCI and PCI bridges never isolate, ports
+ * need ACS, and other functions only need it when multi-function. ACS
+ * controls that aren't implemented don't apply.
+ */
+static bool vtd_acs_enabled(uint32_t i)
+{
+	switch (sysinfo.pcidev.list[i].pcie_type) {
+	case PCI_EXP_TYPE_NONE:
+	case PCI_EXP_TYPE_PCI_BRIDGE:
+	case PCI_EXP_TYPE_PCIE_BRIDGE:
+	case PCI_EXP_TYPE_RC_EC:
+		return false;
+	case PCI_EXP_TYPE_ROOT_PORT:
+	case PCI_EXP_TYPE_DOWNSTREAM:
+		break;
+	case PCI_EXP_TYPE_ENDPOINT:
+	case PCI_EXP_TYPE_LEG_END:
+	case PCI_EXP_TYPE_UPSTREAM:
+	case PCI_EXP_TYPE_RC_END:
+		if (!sysinfo.pcidev.list[i].multifunction)
+			return true;
+		break;
+	default:
+		return true;
+	}
+
+	if (!sysinfo.pcidev.list[i].acs)
+		return false;
+	uint16_t controls = VTD_ACS_ISOLATION & sysinfo.pcidev.list[i].acs_cap;
+	return (sysinfo.pcidev.list[i].acs_ctrl & controls) == controls;
+}
+
+/*
+ * Check whether ACS isolates from a PCI function up to its root bus.
+ */
+static bool vtd_acs_path_enabled(uint32_t i)
+{
+	for (; i != PCI_NO_PARENT; i = sysinfo.pcidev.list[i].parent) {
+		if (!vtd_acs_enabled(i))
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Find the first function of the isolation group of a PCI function, like
+ * Linux pci_device_group(). Going up from the function, the group takes in
+ * every bridge until the path to the root bus is isolated by ACS, then the
+ * other functions of the slot if they can reach each other.
+ */
+static uint32_t vtd_group(uint32_t i)
+{
+	for (uint32_t p = sysinfo.pcidev.list[i].parent;
+	     p != PCI_NO_PARENT && !vtd_acs_path_enabled(p);
+	     p = sysinfo.pcidev.list[p].parent)
+		i = p;
+
+	if (!sysinfo.pcidev.list[i].multifunction || vtd_acs_enabled(i))
+		return i;
+	for (uint32_t j = 0; j < sysinfo.pcidev.count; j++) {
+		if (sysinfo.pcidev.list[j].segment == sysinfo.pcidev.list[i].segment &&
+		    (sysinfo.pcidev.list[j].devid & ~7) == (sysinfo.pcidev.list[i].devid & ~7) &&
+		    !vtd_acs_enabled(j))
+			return j;
+	}
+	return i;
+}
+
+/*
+ * Enumerate the PCI functions behind the DRHUs and compute the groups of
+ * functions that can be isolated from each other by the IOMMU, the smallest
+ * units that can be given their own DMA domain.
+ */
+static bool vtd_scan_groups(void)
+{
+	for (uint32_t i = 0; i < sysinfo.drhu.count; i++) {
+		bool scanned = false;
+		for (uint32_t j = 0; j < i; j++)
+			scanned |= sysinfo.drhu.list[j].segment == sysinfo.drhu.list[i].segment;
+		if (!scanned && !pci_scan(sysinfo.drhu.list[i].segment))
+			return false;
+	}
+
+	for (uint32_t i = 0; i < sysinfo.pcidev.count; i++) {
+		sysinfo.pcidev.list[i].drhu = vtd_find_drhu(sysinfo.pcidev.list[i].segment,
+		                                            sysinfo.pcidev.list[i].devid);
+		sysinfo.pcidev.list[i].group = vtd_group(i);
+	}
+
+	for (uint32_t i = 0; i < sysinfo.drhu.count; i++) {
+		uint32_t groups = 0, functions = 0;
+		for (uint32_t j = 0; j < sysinfo.pcidev.count; j++) {
+			uint32_t group = sysinfo.pcidev.list[j].group;
+			if (sysinfo.pcidev.list[group].drhu != i)
+				continue;
+			functions++;
+			groups += group == j;
+		}
+		serial_printf("[*] DRHU #%d: %d functions in %d isolation groups\n", i + 1, functions, groups);
+	}
+	return true;
 }
 
 /*
@@ -37,10 +192,41 @@ bool vtd_scan(void)
 	if (sysinfo.drhu.count == 0)
 		return true;
 
-	/* Code shamelessly taken from seL4 intel-vtd.c */
+	/*
+	 * Read the capabilities of all the IOMMUs. Those of the IOMMUs above 4GiB
+	 * are out of reach, they are left at zero which is the most restrictive.
+	 */
+	for (int i = 0; i < sysinfo.drhu.count; i++) {
+		if (sysinfo.drhu.list[i].addr >> 32) {
+			sysinfo.drhu.list[i].cap_unknown = true;
+			serial_printf("[!] Warning: DRHU #%d at %X above 4GiB, capabilities unknown\n",
+			              i + 1, sysinfo.drhu.list[i].addr);
+			continue;
+		}
+		sysinfo.drhu.list[i].cap  = vtd_read64(i, VTD_CAP_REG);
+		sysinfo.drhu.list[i].ecap = vtd_read64(i, VTD_ECAP_REG);
+		serial_printf("[*] DRHU #%d capabilities %X extended %X\n",
+		              i + 1,
+		              sysinfo.drhu.list[i].cap,
+		              sysinfo.drhu.list[i].ecap);
+	}
+
+	/*
+	 * Only advertise the second-level superpage sizes supported by all the
+	 * IOMMUs, as the IO page tables are shared by seL4.
+	 */
+	sysinfo.vtd.superpages = VTD_SLLPS_2M | VTD_SLLPS_1G;
+	for (int i = 0; i < sysinfo.drhu.count; i++)
+		sysinfo.vtd.superpages &= VTD_CAP_SLLPS(sysinfo.drhu.list[i].cap);
+
+	/*
+	 * Code shamelessly taken from seL4 intel-vtd.c, the IOMMUs with unknown
+	 * capabilities are assumed to support the levels of the others.
+	 */
 	uint32_t aw_bitmask = 0xffffffff;
 	for (int i = 0; i < sysinfo.drhu.count; i++)
-		aw_bitmask &= vtd_read32(i, VTD_CAP_REG) >> VTD_SAGAW;
+		if (!sysinfo.drhu.list[i].cap_unknown)
+			aw_bitmask &= VTD_CAP_SAGAW(sysinfo.drhu.list[i].cap);
 
 	/* Populate the sysinfo structure. */
 	if (aw_bitmask & VTD_SAGAW_3_LEVEL)
@@ -58,5 +244,5 @@ bool vtd_scan(void)
 		return false;
 	}
 
-	return true;
+	return vtd_scan_groups();
 }
@@ -0,0 +1,319 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/*
+ * Host tool pulling the machine file from a machine waiting in the command
+ * loop of machinedump, see serve() in src/dump.c. Every section is checked
+ * against its CRC32C, and the parts that got corrupted on the serial line
+ * are requested again chunk by chunk. The serial line runs at 115200 baud,
+ * as set up by machinedump, unless another rate is given with -b for a port
+ * left at the rate of the firmware.
+ *
+ * Usage: machinedump-pull [-b <baud rate>] <serial device> [<output file>]
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#define MAX_SECTIONS    64
+#define CHUNK_SIZE      1024
+#define MAX_RETRIES     8
+#define TIMEOUT_MS      5000
+
+struct section {
+	uint32_t seq;
+	char     name[32];
+	uint32_t length;
+	uint32_t crc;
+	char    *data;
+};
+
+static int fd;
+
+/* Bytes received and not consumed yet, with the carriage returns removed. */
+static char rx[1 << 20];
+static size_t rx_len;
+
+/*
+ * Compute the CRC32C of a buffer, bit by bit.
+ */
+static uint32_t crc32c(uint32_t crc, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+
+	crc = ~crc;
+	while (len--) {
+		crc ^= *p++;
+		for (int i = 0; i < 8; i++)
+			crc = (crc >> 1) ^ (0x82f63b78 & -(crc & 1));
+	}
+	return ~crc;
+}
+
+/*
+ * Send a command line, dropping whatever was received so far.
+ */
+static void send_command(const char *fmt, ...)
+{
+	char line[128];
+	va_list ap;
+
+	va_start(ap, fmt);
+	vsnprintf(line, sizeof (line) - 1, fmt, ap);
+	va_end(ap);
+	strcat(line, "\n");
+
+	tcflush(fd, TCIFLUSH);
+	rx_len = 0;
+	if (write(fd, line, strlen(line)) < 0)
+		perror("write");
+}
+
+/*
+ * Receive until a line starting with the given end marker is complete.
+ * Returns the offset of that line in the receive buffer, or -1 on timeout.
+ */
+static long receive_until(const char *marker)
+{
+	size_t scanned = 0;
+
+	for (;;) {
+		/* Look for the marker at the start of a complete line. */
+		for (size_t i = scanned; i < rx_len; i++) {
+			if (rx[i] != '\n')
+				continue;
+			size_t start = i;
+			while (start > 0 && rx[start - 1] != '\n')
+				start--;
+			if (!strncmp(rx + start, marker, strlen(marker)))
+				return start;
+			scanned = i + 1;
+		}
+
+		struct pollfd pfd = { .fd = fd, .events = POLLIN };
+		if (poll(&pfd, 1, TIMEOUT_MS) <= 0 || rx_len == sizeof (rx))
+			return -1;
+
+		char buf[4096];
+		ssize_t n = read(fd, buf, sizeof (buf));
+		if (n <= 0)
+			return -1;
+		for (ssize_t i = 0; i < n && rx_len < sizeof (rx); i++)
+			if (buf[i] != '\r')
+				rx[rx_len++] = buf[i];
+	}
+}
+
+/*
+ * Find the body between a begin marker and the line at end, returns its
+ * length or -1.
+ */
+static long find_body(const char *marker, long end, char **body)
+{
+	char *begin = memmem(rx, end, marker, strlen(marker));
+	if (!begin)
+		return -1;
+	char *eol = memchr(begin, '\n', rx + end - begin);
+	if (!eol)
+		return -1;
+	*body = eol + 1;
+	return rx + end - *body;
+}
+
+/*
+ * Get the list of sections.
+ */
+static int get_list(struct section *sections)
+{
+	for (int retry = 0; retry < MAX_RETRIES; retry++) {
+		send_command("LIST");
+		long end = receive_until("-----END MACHINE SECTION LIST ");
+		char *body;
+		long len = end < 0 ? -1 : find_body("-----BEGIN MACHINE SECTION LIST-----", end, &body);
+		if (len < 0)
+			continue;
+
+		uint32_t count = 0, expected;
+		bool ok = sscanf(rx + end, "-----END MACHINE SECTION LIST %u-----", &expected) == 1;
+		for (char *line = body; ok && line < body + len; line = strchr(line, '\n') + 1) {
+			struct section *s = &sections[count];
+			if (count == MAX_SECTIONS ||
+			    sscanf(line, "@%u %31s %u %x", &s->seq, s->name, &s->length, &s->crc) != 4 ||
+			    s->seq != count)
+				ok = false;
+			else
+				count++;
+		}
+		if (ok && count == expected)
+			return count;
+	}
+	return -1;
+}
+
+/*
+ * Get a whole section, returns false if it didn't arrive intact.
+ */
+static bool get_section(struct section *s)
+{
+	char marker[64];
+
+	send_command("SECTION %u", s->seq);
+	snprintf(marker, sizeof (marker), "-----END MACHINE SECTION %u ", s->seq);
+	long end = receive_until(marker);
+	snprintf(marker, sizeof (marker), "-----BEGIN MACHINE SECTION %u ", s->seq);
+	char *body;
+	long len = end < 0 ? -1 : find_body(marker, end, &body);
+	if (len != s->length || crc32c(0, body, len) != s->crc)
+		return false;
+	memcpy(s->data, body, len);
+	return true;
+}
+
+/*
+ * Get a chunk of a section, returns false if it didn't arrive intact.
+ */
+static bool get_chunk(struct section *s, uint32_t offset, uint32_t length)
+{
+	char marker[64];
+	uint32_t sent, crc;
+
+	send_command("CHUNK %u %u %u", s->seq, offset, length);
+	snprintf(marker, sizeof (marker), "-----END MACHINE CHUNK %u %u ", s->seq, offset);
+	long end = receive_until(marker);
+	snprintf(marker, sizeof (marker), "-----BEGIN MACHINE CHUNK %u %u-----", s->seq, offset);
+	char *body;
+	long len = end < 0 ? -1 : find_body(marker, end, &body);
+	if (len < 1 || sscanf(rx + end, "-----END MACHINE CHUNK %*u %*u %u %x", &sent, &crc) != 2)
+		return false;
+
+	/* The chunk is followed by a newline of its own. */
+	len--;
+	if (len != length || sent != length || crc32c(0, body, len) != crc)
+		return false;
+	memcpy(s->data + offset, body, len);
+	return true;
+}
+
+/*
+ * Get a section, falling back to chunks when it gets corrupted.
+ */
+static bool pull_section(struct section *s)
+{
+	s->data = malloc(s->length + 1);
+
+	if (get_section(s))
+		return true;
+	fprintf(stderr, "section %u (%s) corrupted, pulling it in chunks\n", s->seq, s->name);
+
+	for (uint32_t offset = 0; offset < s->length; offset += CHUNK_SIZE) {
+		uint32_t length = s->length - offset < CHUNK_SIZE ? s->length - offset : CHUNK_SIZE;
+		int retry = 0;
+		while (!get_chunk(s, offset, length)) {
+			if (++retry == MAX_RETRIES) {
+				fprintf(stderr, "cannot get section %u at offset %u\n", s->seq, offset);
+				return false;
+			}
+			fprintf(stderr, "section %u chunk at offset %u corrupted, retrying\n",
+			        s->seq, offset);
+		}
+	}
+	return crc32c(0, s->data, s->length) == s->crc;
+}
+
+/*
+ * Get the termios speed of a baud rate, or B0 if it isn't supported.
+ */
+static speed_t baud_speed(unsigned long baud)
+{
+	static const struct {
+		unsigned long baud;
+		speed_t       speed;
+	} speeds[] = {
+		{ 9600, B9600 }, { 19200, B19200 }, { 38400, B38400 }, { 57600, B57600 },
+		{ 115200, B115200 }, { 230400, B230400 }, { 460800, B460800 },
+		{ 921600, B921600 },
+	};
+
+	for (size_t i = 0; i < sizeof (speeds) / sizeof (speeds[0]); i++)
+		if (speeds[i].baud == baud)
+			return speeds[i].speed;
+	return B0;
+}
+
+/*
+ * Open the serial device in raw mode.
+ */
+static bool open_serial(const char *path, speed_t speed)
+{
+	struct termios tio;
+
+	fd = open(path, O_RDWR | O_NOCTTY);
+	if (fd < 0 || tcgetattr(fd, &tio) < 0) {
+		perror(path);
+		return false;
+	}
+	cfmakeraw(&tio);
+	cfsetspeed(&tio, speed);
+	tio.c_cflag |= CLOCAL | CREAD;
+	return tcsetattr(fd, TCSANOW, &tio) == 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct section sections[MAX_SECTIONS];
+	speed_t speed = B115200;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "b:")) != -1)
+		if (opt != 'b' || (speed = baud_speed(strtoul(optarg, NULL, 10))) == B0)
+			break;
+	if (opt != -1 || argc - optind < 1 || argc - optind > 2) {
+		fprintf(stderr, "Usage: %s [-b <baud rate>] <serial device> [<output file>]\n", argv[0]);
+		return 1;
+	}
+	argc -= optind - 1;
+	argv += optind - 1;
+	if (!open_serial(argv[1], speed))
+		return 1;
+
+	int count = get_list(sections);
+	if (count < 0) {
+		fprintf(stderr, "no answer to the LIST command\n");
+		return 1;
+	}
+	for (int i = 0; i < count; i++)
+		if (!pull_section(&sections[i]))
+			return 1;
+
+	/* Merge the section objects into the machine file. */
+	FILE *out = argc == 3 ? fopen(argv[2], "w") : stdout;
+	if (!out) {
+		perror(argv[2]);
+		return 1;
+	}
+	fputs("{\n", out);
+	for (int i = 0; i < count; i++) {
+		/* Strip the braces around the object. */
+		fwrite(sections[i].data + 2, 1, sections[i].length - 5, out);
+		fputs(i + 1 == count ? "\n" : ",\n", out);
+	}
+	fputs("}\n", out);
+	if (out != stdout)
+		fclose(out);
+
+	fprintf(stderr, "%d sections pulled\n", count);
+	return 0;
+}
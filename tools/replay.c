@@ -0,0 +1,368 @@
+/*
+ * Copyright 2024, Neutrality.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/*
+ * Host tool replaying a raw dump captured with dump=raw. The blobs are
+ * checked, optionally saved to a directory, and mapped back at their original
+ * physical addresses so that the machinedump table parsers can run on them
+ * unchanged, and the machine file is printed from what they found. Hardware
+ * that isn't part of the dump reads as absent: port reads return all ones and
+ * other memory reads as 0xff. The sections describing the processor, its
+ * registers and the IOMMU units are left empty, and so the fingerprint
+ * differs from the one of the machine.
+ *
+ * Usage: machinedump-replay <capture> [<output directory>]
+ */
+
+#define _GNU_SOURCE
+
+#include <signal.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "acpi.h"
+#include "dump.h"
+#include "fingerprint.h"
+#include "memory.h"
+#include "multiboot2.h"
+#include "options.h"
+#include "prt.h"
+#include "rawdump.h"
+#include "smbios.h"
+#include "sysinfo.h"
+
+#define PAGE_SIZE       0x1000UL
+#define MAX_PAGES       0x10000
+
+/* Physical pages mapped so far, to tell them apart from our own memory. */
+static uint64_t pages[MAX_PAGES];
+static uint32_t num_pages;
+
+/* Globals normally defined by main.c. */
+struct sysinfo sysinfo;
+struct options options;
+
+/* Linker symbols of the firmware image, which isn't in the replayed memory. */
+__asm__(".globl __image_start, __image_end\n"
+        "__image_start:\n"
+        "__image_end:\n");
+
+/*
+ * Serial output goes to the standard output, with the same format
+ * specifiers as the firmware.
+ */
+void serial_printf(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	for (; *fmt; fmt++) {
+		if (*fmt != '%') {
+			putchar(*fmt);
+			continue;
+		}
+		switch (*++fmt) {
+		case 'c': putchar(va_arg(ap, int)); break;
+		case 's': fputs(va_arg(ap, char *), stdout); break;
+		case 'x': printf("0x%x", va_arg(ap, uint32_t)); break;
+		case 'X': printf("0x%llx", (unsigned long long) va_arg(ap, uint64_t)); break;
+		case 'd': printf("%u", va_arg(ap, uint32_t)); break;
+		case 'D': printf("%llu", (unsigned long long) va_arg(ap, uint64_t)); break;
+		case '%': putchar('%'); break;
+		default: putchar(*fmt);
+		}
+	}
+	va_end(ap);
+}
+
+void serial_init(void)
+{
+}
+
+/* Commands aren't served offline, see serve(). */
+uint8_t serial_getc(void)
+{
+	exit(0);
+}
+
+/*
+ * Port accesses, only the serial port is emulated.
+ */
+uint8_t in8(uint16_t port)
+{
+	return port == options.serial.base + 5 ? 0x60 : 0xff;
+}
+
+void out8(uint16_t port, uint8_t value)
+{
+	if (port == options.serial.base && value != '\r')
+		putchar(value);
+}
+
+uint16_t in16(uint16_t port) { return 0xffff; }
+uint32_t in32(uint16_t port) { return 0xffffffff; }
+void out16(uint16_t port, uint16_t value) { }
+void out32(uint16_t port, uint32_t value) { }
+uint64_t rdmsr(uint32_t msr) { return 0; }
+bool rdmsr_safe(uint32_t msr, uint64_t *value) { return false; }
+
+/*
+ * Check whether a physical page was mapped by a previous blob.
+ */
+static bool page_mapped(uint64_t page)
+{
+	for (uint32_t i = 0; i < num_pages; i++)
+		if (pages[i] == page)
+			return true;
+	return false;
+}
+
+/*
+ * Map a range of physical addresses at the same host addresses. The pages
+ * may already be mapped by a previous blob, but must not collide with the
+ * memory of the tool itself.
+ */
+static bool map_range(uint64_t addr, uint64_t size)
+{
+	uint64_t start = addr & ~(PAGE_SIZE - 1);
+
+	for (uint64_t page = start; page < addr + size; page += PAGE_SIZE) {
+		if (page_mapped(page))
+			continue;
+
+		void *ptr = mmap((void *) page, PAGE_SIZE, PROT_READ | PROT_WRITE,
+		                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+		if (ptr != (void *) page || num_pages == MAX_PAGES) {
+			if (ptr != MAP_FAILED)
+				munmap(ptr, PAGE_SIZE);
+			fprintf(stderr, "cannot map the physical address %#llx\n",
+			        (unsigned long long) page);
+			return false;
+		}
+		memset(ptr, 0xff, PAGE_SIZE);
+		pages[num_pages++] = page;
+	}
+	return true;
+}
+
+/*
+ * Reads of unmapped physical memory, such as device registers, see a page of
+ * all ones.
+ */
+static void fault_handler(int sig, siginfo_t *info, void *context)
+{
+	uintptr_t addr = (uintptr_t) info->si_addr;
+
+	if (addr >> 32 || !map_range(addr, 1))
+		_exit(1);
+}
+
+/*
+ * Decode base64 data in place, returns the decoded size.
+ */
+static size_t base64_decode(char *text, uint8_t *data)
+{
+	static const char symbols[] =
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	uint32_t bits = 0, nbits = 0;
+	size_t size = 0;
+
+	for (; *text; text++) {
+		const char *p = strchr(symbols, *text);
+		if (!p || !*p)
+			continue;
+		bits = (bits << 6) | (p - symbols);
+		nbits += 6;
+		if (nbits >= 8) {
+			nbits -= 8;
+			data[size++] = bits >> nbits;
+		}
+	}
+	return size;
+}
+
+/*
+ * Decode run-length encoded data, returns the decoded size.
+ */
+static size_t rle_decode(const uint8_t *in, size_t in_size, uint8_t *out, size_t out_size)
+{
+	size_t size = 0;
+
+	for (size_t i = 0; i < in_size;) {
+		uint8_t ctl = in[i++];
+		if (ctl < RAWDUMP_RLE_RUN) {
+			for (uint32_t j = 0; j <= ctl && i < in_size && size < out_size; j++)
+				out[size++] = in[i++];
+		} else if (i < in_size) {
+			uint32_t run = ctl - RAWDUMP_RLE_RUN + RAWDUMP_RLE_MIN_RUN;
+			for (uint32_t j = 0; j < run && size < out_size; j++)
+				out[size++] = in[i];
+			i++;
+		}
+	}
+	return size;
+}
+
+/*
+ * Check a record and map it at its physical address.
+ */
+static bool load_record(const char *kind, uint32_t addr, uint32_t size, bool rle,
+                        uint32_t crc, char *text, const char *outdir, uint32_t *mbi)
+{
+	uint8_t *encoded = malloc(strlen(text));
+	uint8_t *data = malloc(size);
+	size_t len = base64_decode(text, encoded);
+
+	if (rle) {
+		len = rle_decode(encoded, len, data, size);
+	} else if (len <= size) {
+		memcpy(data, encoded, len);
+	}
+	free(encoded);
+
+	if (len != size || crc32c(0, data, size) != crc) {
+		fprintf(stderr, "corrupted %s blob at %#x\n", kind, addr);
+		free(data);
+		return false;
+	}
+
+	if (outdir) {
+		char name[256];
+		const char *prefix = kind;
+		char signature[5] = {0};
+		if (!strcmp(kind, "acpi") && size >= 4) {
+			memcpy(signature, data, 4);
+			prefix = signature;
+		}
+		snprintf(name, sizeof (name), "%s/%s-%08x.bin", outdir, prefix, addr);
+		FILE *f = fopen(name, "wb");
+		if (!f || fwrite(data, 1, size, f) != size) {
+			perror(name);
+			free(data);
+			return false;
+		}
+		fclose(f);
+	}
+
+	if (!map_range(addr, size)) {
+		free(data);
+		return false;
+	}
+	memcpy((void *) (uintptr_t) addr, data, size);
+	free(data);
+
+	if (!strcmp(kind, "mbi"))
+		*mbi = addr;
+	return true;
+}
+
+/*
+ * Read the raw block of a capture and load its records.
+ */
+static bool load_capture(FILE *f, const char *outdir, uint32_t *mbi)
+{
+	char line[1024], kind[16], encoding[16];
+	char *text = NULL;
+	size_t text_len = 0;
+	bool in_block = false, in_record = false;
+	uint32_t addr = 0, size = 0, crc = 0;
+
+	while (fgets(line, sizeof (line), f)) {
+		line[strcspn(line, "\r\n")] = '\0';
+
+		if (!strcmp(line, RAWDUMP_BEGIN)) {
+			in_block = true;
+			continue;
+		}
+		if (!in_block)
+			continue;
+
+		/* A record ends at the next header or at the end of the block. */
+		bool end = !strcmp(line, RAWDUMP_END);
+		if ((end || line[0] == '@') && in_record) {
+			if (!load_record(kind, addr, size, !strcmp(encoding, "rle"), crc,
+			                 text ? text : "", outdir, mbi))
+				return false;
+			in_record = false;
+			text_len = 0;
+			if (text)
+				text[0] = '\0';
+		}
+		if (end)
+			return *mbi != 0;
+
+		if (line[0] == '@') {
+			if (sscanf(line, "@%15s %x %u %15s %x", kind, &addr, &size, encoding, &crc) != 5) {
+				fprintf(stderr, "malformed record header: %s\n", line);
+				return false;
+			}
+			in_record = true;
+			continue;
+		}
+
+		if (in_record) {
+			size_t len = strlen(line);
+			text = realloc(text, text_len + len + 1);
+			memcpy(text + text_len, line, len + 1);
+			text_len += len;
+		}
+	}
+
+	fprintf(stderr, "no complete raw block found\n");
+	return false;
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t mbi = 0;
+
+	if (argc < 2 || argc > 3) {
+		fprintf(stderr, "Usage: %s <capture> [<output directory>]\n", argv[0]);
+		return 1;
+	}
+
+	FILE *f = fopen(argv[1], "r");
+	if (!f) {
+		perror(argv[1]);
+		return 1;
+	}
+	bool loaded = load_capture(f, argc == 3 ? argv[2] : NULL, &mbi);
+	fclose(f);
+	if (!loaded)
+		return 1;
+
+	struct sigaction sa = { .sa_sigaction = fault_handler, .sa_flags = SA_SIGINFO };
+	sigaction(SIGSEGV, &sa, NULL);
+
+	/*
+	 * The firmware already split the captured command line in place, and its
+	 * options don't apply offline anyway.
+	 */
+	struct multiboot2_info_header *info = (void *) mbi;
+	for (uint32_t tag_addr = mbi + sizeof (*info); tag_addr < mbi + info->total_size; ) {
+		struct multiboot2_tag_header *tag = (void *) tag_addr;
+		if (tag->type == MULTIBOOT2_INFO_TAG_END)
+			break;
+		if (tag->type == MULTIBOOT2_INFO_TAG_COMMAND_LINE && tag->size > sizeof (*tag))
+			*(char *) (tag + 1) = '\0';
+		tag_addr = roundup64(tag_addr + tag->size);
+	}
+
+	/* Run the table parsers like the firmware does and print the machine file. */
+	options.serial.base = CONFIG_SERIAL_PORT;
+	if (!multiboot2_parse_info(mbi) || !acpi_parse_tables() || !memory_finalise() ||
+	    !prt_scan() || !smbios_scan())
+		return 1;
+	dump_machine_file();
+
+	return 0;
+}